@@ -0,0 +1,251 @@
+/*
+ * can_autobaud.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "can_autobaud.h"
+
+#define TAG             "AUTOBAUD"
+
+static const cfg_boad_rate_t autobaud_rates[] = {
+	CFG_125KBPS, CFG_250KBPS, CFG_500KBPS, CFG_1000KBPS
+};
+#define AUTOBAUD_N_RATES	(sizeof(autobaud_rates) / sizeof(autobaud_rates[0]))
+
+static uint8_t can_autobaud_is_tester(uint32_t id, uint8_t idt)
+{
+	if (idt == 0) {
+		return (id == 0x7DF || (id >= 0x7E0 && id <= 0x7E7));
+	}
+	//Functional or addressed to us, from any tester source address
+	return ((id & 0x1FFFFF00) == (OBD_FUNC_ID_EXT & 0x1FFFFF00) ||
+			(id & 0x1FFFFF00) == (OBD_PHYS_ID_EXT & 0x1FFFFF00));
+}
+
+int can_autobaud_run(can_autobaud_listen_t listen, void *arg,
+		const emulator_cfg_t *start, uint32_t tout_ms, can_autobaud_result_t *res)
+{
+	uint8_t idx = 0;
+	int64_t elapsed_us = 0;
+
+	memset(res, 0, sizeof(can_autobaud_result_t));
+	res->boadrate = start->boadrate;
+	res->id_type = start->id_type;
+	for (uint8_t i = 0; i < AUTOBAUD_N_RATES; i++) {
+		if (autobaud_rates[i] == start->boadrate) {
+			idx = i;
+		}
+	}
+
+	while (elapsed_us < (int64_t)tout_ms * 1000) {
+		can_autobaud_probe_t probe = { 0 };
+		cfg_boad_rate_t rate = res->rate_locked ? res->boadrate : autobaud_rates[idx];
+
+		elapsed_us += listen(rate, CAN_AUTOBAUD_DWELL_MS, &probe, arg);
+		res->attempts++;
+
+		if (!res->rate_locked) {
+			if (probe.frames == 0 || probe.bus_errors > probe.frames) {
+				idx = (idx + 1) % AUTOBAUD_N_RATES;
+				continue;
+			}
+			res->rate_locked = 1;
+			res->boadrate = rate;
+			res->rate_lock_us = elapsed_us;
+		}
+		//Both ID types are served, there is nothing to wait for
+		if (start->id_type == CFG_MIXED_ID) {
+			break;
+		}
+		//Keep listening at the locked rate until a tester shows up
+		if (probe.tester_id != 0) {
+			res->idt_locked = 1;
+			res->id_type = probe.tester_idt ? CFG_EXTENDED_ID : CFG_STANDARD_ID;
+			res->idt_lock_us = elapsed_us;
+			break;
+		}
+	}
+	return res->rate_locked ? 0 : -1;
+}
+
+typedef struct autobaud_twai_s {
+	const twai_general_config_t *g_config;
+	const twai_filter_config_t *f_config;
+} autobaud_twai_t;
+
+static int64_t can_autobaud_listen_twai(cfg_boad_rate_t rate, uint32_t dwell_ms,
+		can_autobaud_probe_t *probe, void *arg)
+{
+	autobaud_twai_t *twai = (autobaud_twai_t *)arg;
+	twai_general_config_t g_config = *twai->g_config;
+	twai_timing_config_t t_config;
+	twai_status_info_t status;
+	int64_t t0 = esp_timer_get_time();
+
+	switch (rate) {
+		case CFG_125KBPS:
+			t_config = (twai_timing_config_t)TWAI_TIMING_CONFIG_125KBITS();
+			break;
+		case CFG_250KBPS:
+			t_config = (twai_timing_config_t)TWAI_TIMING_CONFIG_250KBITS();
+			break;
+		case CFG_1000KBPS:
+			t_config = (twai_timing_config_t)TWAI_TIMING_CONFIG_1MBITS();
+			break;
+		default:
+			t_config = (twai_timing_config_t)TWAI_TIMING_CONFIG_500KBITS();
+	}
+	g_config.mode = TWAI_MODE_LISTEN_ONLY;
+	g_config.alerts_enabled = TWAI_ALERT_NONE;
+
+	if (twai_driver_install(&g_config, &t_config, twai->f_config) != ESP_OK) {
+		vTaskDelay(pdMS_TO_TICKS(dwell_ms));
+		return esp_timer_get_time() - t0;
+	}
+	twai_start();
+	while (esp_timer_get_time() - t0 < (int64_t)dwell_ms * 1000) {
+		twai_message_t msg;
+		if (twai_receive(&msg, 1) != ESP_OK) {
+			continue;
+		}
+		probe->frames++;
+		if (can_autobaud_is_tester(msg.identifier, msg.extd)) {
+			probe->tester_id = msg.identifier;
+			probe->tester_idt = msg.extd;
+			break;
+		}
+	}
+	if (twai_get_status_info(&status) == ESP_OK) {
+		probe->bus_errors = status.bus_error_count;
+	}
+	twai_stop();
+	twai_driver_uninstall();
+	return esp_timer_get_time() - t0;
+}
+
+int can_autobaud_detect(const twai_general_config_t *g_config,
+		const twai_filter_config_t *f_config, emulator_cfg_t *cfg, uint32_t tout_ms)
+{
+	autobaud_twai_t twai = {
+			.g_config = g_config,
+			.f_config = f_config
+	};
+	can_autobaud_result_t res;
+
+	ESP_LOGI(TAG, "Listening from %d kbps", cfg_boadrate_kbps(cfg->boadrate));
+	if (can_autobaud_run(can_autobaud_listen_twai, &twai, cfg, tout_ms, &res) < 0) {
+		ESP_LOGW(TAG, "No traffic in %d ms, keeping %d kbps", tout_ms,
+				cfg_boadrate_kbps(cfg->boadrate));
+		return -1;
+	}
+	cfg->boadrate = res.boadrate;
+	ESP_LOGI(TAG, "Locked to %d kbps in %lld ms (%d windows)",
+			cfg_boadrate_kbps(res.boadrate), res.rate_lock_us / 1000, res.attempts);
+	if (res.idt_locked) {
+		cfg->id_type = res.id_type;
+		ESP_LOGI(TAG, "Tester uses %s IDs, locked in %lld ms",
+				(res.id_type == CFG_EXTENDED_ID)?"29 bit":"11 bit",
+				res.idt_lock_us / 1000);
+	} else if (cfg->id_type != CFG_MIXED_ID) {
+		ESP_LOGW(TAG, "No tester request seen, keeping the ID type");
+	}
+	return 0;
+}
+
+/*
+ * Simulated bus on a virtual clock. At a wrong rate every frame on the
+ * bus shows up as a bus error, at the right rate as a valid frame. The
+ * tester sends a request every period_us.
+ */
+typedef struct autobaud_sim_s {
+	cfg_boad_rate_t rate;
+	cfg_can_idt_t idt;
+	uint32_t bg_fps;			//background frames per second
+	int64_t period_us;
+	int64_t phase_us;
+	int64_t now_us;
+} autobaud_sim_t;
+
+static int64_t can_autobaud_listen_sim(cfg_boad_rate_t rate, uint32_t dwell_ms,
+		can_autobaud_probe_t *probe, void *arg)
+{
+	autobaud_sim_t *sim = (autobaud_sim_t *)arg;
+	int64_t start = sim->now_us;
+	int64_t end = start + (int64_t)dwell_ms * 1000;
+	int64_t next_req = sim->phase_us;
+
+	if (start > sim->phase_us) {
+		next_req += ((start - sim->phase_us + sim->period_us - 1) / sim->period_us)
+														* sim->period_us;
+	}
+	if (rate != sim->rate) {
+		probe->bus_errors = (uint32_t)((end - start) * sim->bg_fps / 1000000)
+														+ ((next_req < end)?1:0);
+	} else {
+		if (next_req < end) {
+			end = next_req;
+			probe->tester_idt = sim->idt;
+			probe->tester_id = (sim->idt == CFG_EXTENDED_ID)?0x18DB33F1:0x7DF;
+		}
+		probe->frames = (uint32_t)((end - start) * sim->bg_fps / 1000000)
+														+ ((probe->tester_id != 0)?1:0);
+	}
+	sim->now_us = end;
+	return end - start;
+}
+
+void can_autobaud_sim(void)
+{
+	uint32_t seed = 0x2026;
+	uint32_t cases = 0, correct = 0;
+	int64_t sum_us = 0, max_us = 0;
+
+	printf("\nactual  start  bg fps  idt  locked  lock ms\n");
+	for (uint8_t a = 0; a < AUTOBAUD_N_RATES; a++) {
+		for (uint8_t s = 0; s < AUTOBAUD_N_RATES; s++) {
+			for (uint8_t idt = 0; idt < 2; idt++) {
+				emulator_cfg_t start = {
+						.boadrate = autobaud_rates[s],
+						.id_type = CFG_STANDARD_ID
+				};
+				seed = seed * 1103515245 + 12345;
+				autobaud_sim_t sim = {
+						.rate = autobaud_rates[a],
+						.idt = idt ? CFG_EXTENDED_ID : CFG_STANDARD_ID,
+						.bg_fps = (idt ? 0 : 200) + (seed >> 16) % 500,
+						.period_us = 100000,
+						.phase_us = (seed >> 8) % 100000,
+						.now_us = 0
+				};
+				can_autobaud_result_t res;
+				can_autobaud_run(can_autobaud_listen_sim, &sim, &start, 5000, &res);
+
+				uint8_t ok = res.rate_locked && res.idt_locked &&
+						res.boadrate == sim.rate && res.id_type == sim.idt;
+				int64_t lock_us = res.idt_locked ? res.idt_lock_us : res.rate_lock_us;
+				cases++;
+				correct += ok;
+				sum_us += lock_us;
+				if (lock_us > max_us) {
+					max_us = lock_us;
+				}
+				printf("%6d  %5d  %6d  %3s  %6s  %7lld\n",
+						cfg_boadrate_kbps(sim.rate), cfg_boadrate_kbps(start.boadrate),
+						sim.bg_fps, idt ? "EXT" : "STD", ok ? "yes" : "NO",
+						lock_us / 1000);
+			}
+		}
+	}
+	printf("%d/%d locked correctly, time to lock avg %lld ms max %lld ms\n",
+			correct, cases, sum_us / cases / 1000, max_us / 1000);
+}
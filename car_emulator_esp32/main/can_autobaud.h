@@ -0,0 +1,72 @@
+/*
+ * can_autobaud.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+
+#ifndef __CAN_AUTOBAUD_H_
+#define __CAN_AUTOBAUD_H_
+
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "driver/twai.h"
+
+#include "can-tp.h"
+#include "car_emulator.h"
+
+/*
+ * Bit rate and ID type detection. The controller listens at each
+ * candidate rate in listen-only mode, so it never sends an ACK or an
+ * error frame. A rate is locked when valid frames are received without
+ * more bus errors than frames. Unless both ID types are served
+ * (CFG_MIXED_ID), the ID type is taken from the first tester request
+ * seen (0x7DF/0x7E0-0x7E7 or 0x18DB33xx/0x18DA10xx).
+ */
+#define CAN_AUTOBAUD_DWELL_MS		100
+
+typedef struct can_autobaud_probe_s {
+	uint32_t frames;			//valid frames received
+	uint32_t bus_errors;
+	uint32_t tester_id;			//first tester request seen, 0 if none
+	uint8_t tester_idt;
+} can_autobaud_probe_t;
+
+/*
+ * Listens at one rate for at most dwell_ms and fills probe. May return
+ * early once a tester request was seen. Returns the time spent in us.
+ */
+typedef int64_t (*can_autobaud_listen_t)(cfg_boad_rate_t rate, uint32_t dwell_ms,
+		can_autobaud_probe_t *probe, void *arg);
+
+typedef struct can_autobaud_result_s {
+	cfg_boad_rate_t boadrate;
+	cfg_can_idt_t id_type;
+	uint8_t rate_locked;
+	uint8_t idt_locked;
+	int64_t rate_lock_us;		//time to lock the bit rate
+	int64_t idt_lock_us;		//time to lock the ID type
+	uint16_t attempts;			//listen windows used
+} can_autobaud_result_t;
+
+/*
+ * Runs the detection with the given listen function, starting at the
+ * rate of start. Returns 0 when the bit rate was locked within tout_ms.
+ */
+int can_autobaud_run(can_autobaud_listen_t listen, void *arg,
+		const emulator_cfg_t *start, uint32_t tout_ms, can_autobaud_result_t *res);
+
+/*
+ * Detection on the real bus. The driver must not be installed. cfg is
+ * updated with what was locked and is left unchanged otherwise.
+ */
+int can_autobaud_detect(const twai_general_config_t *g_config,
+		const twai_filter_config_t *f_config, emulator_cfg_t *cfg, uint32_t tout_ms);
+
+//Runs the detection against simulated buses for every rate mismatch
+void can_autobaud_sim(void);
+
+#endif /* __CAN_AUTOBAUD_H_ */
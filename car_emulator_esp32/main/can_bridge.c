@@ -0,0 +1,485 @@
+/*
+ * can_bridge.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+
+#include "can-tp.h"
+#include "cantp_esp32.h"
+#include "emu_tasks.h"
+#include "can_capture.h"
+#include "can_bridge.h"
+
+#define TAG             "BRIDGE"
+
+#ifdef CONFIG_CAR_EMU_BRIDGE
+
+#define SLCAN_LINE_MAX			32
+#define GVRET_BINARY			0xE7
+#define GVRET_CMD				0xF1
+#define GVRET_ARGS_MAX			20
+#define GVRET_BUILD				1		//reported firmware build
+
+typedef enum {
+	GVRET_BUILD_CAN_FRAME = 0x00,
+	GVRET_TIME_SYNC = 0x01,
+	GVRET_SETUP_CANBUS = 0x05,
+	GVRET_GET_CANBUS_PARAMS = 0x06,
+	GVRET_GET_DEVICE_INFO = 0x07,
+	GVRET_SET_SINGLEWIRE_MODE = 0x08,
+	GVRET_KEEPALIVE = 0x09,
+	GVRET_SET_SYSTYPE = 0x0A,
+	GVRET_ECHO_CAN_FRAME = 0x0B,
+	GVRET_GET_NUM_BUSES = 0x0C,
+	GVRET_GET_EXT_BUSES = 0x0D,
+	GVRET_SET_EXT_BUSES = 0x0E
+} gvret_cmd_t;
+
+typedef enum {
+	BRIDGE_SLCAN = 0,
+	BRIDGE_GVRET
+} bridge_proto_t;
+
+typedef struct bridge_parser_s {
+	bridge_proto_t proto;
+	uint8_t slcan_ts;
+	uint8_t slcan_open;
+	char line[SLCAN_LINE_MAX];
+	uint8_t line_len;
+	int16_t gv_cmd;			//-1 idle, -2 waiting for the command byte
+	uint8_t gv_args[GVRET_ARGS_MAX];
+	uint8_t gv_len;
+	uint8_t gv_need;
+} bridge_parser_t;
+
+static int client = -1;
+static SemaphoreHandle_t send_lock;
+static can_bridge_stats_t stats;
+static bridge_parser_t parser;
+static void (*bridge_net_init)(void);
+static uint32_t bridge_bitrate;
+
+//Capture sink and command replies, both must go out whole
+static int bridge_send(const char *buf, size_t len)
+{
+	int ret = 0;
+
+	xSemaphoreTake(send_lock, portMAX_DELAY);
+	while (len > 0) {
+		int n = (client < 0)?-1:send(client, buf, len, 0);
+		if (n <= 0) {
+			//A partial batch breaks the framing, drop the client
+			if (client >= 0) {
+				if (errno == EAGAIN || errno == EWOULDBLOCK) {
+					stats.send_timeouts++;
+				}
+				//The bridge task sees recv() fail and closes the socket
+				shutdown(client, SHUT_RDWR);
+				client = -1;
+			}
+			ret = -1;
+			break;
+		}
+		buf += n;
+		len -= n;
+	}
+	xSemaphoreGive(send_lock);
+	if (ret < 0) {
+		stats.send_errors++;
+	}
+	return ret;
+}
+
+static void bridge_stream(can_capture_fmt_t fmt)
+{
+	can_capture_stop();
+	can_capture_set_sink((fmt == CAN_CAPTURE_OFF)?NULL:bridge_send);
+	if (fmt != CAN_CAPTURE_OFF) {
+		can_capture_start(fmt);
+	}
+}
+
+static void bridge_inject(uint32_t id, uint8_t idt, uint8_t dlc, uint8_t *data)
+{
+	if (cantp_can_tx(id, idt, dlc, data, CAN_BRIDGE_TX_TOUT_US) == 0) {
+		stats.injected++;
+	} else {
+		stats.inject_errors++;
+	}
+}
+
+static int parse_hex(const char *s, uint8_t digits, uint32_t *v)
+{
+	*v = 0;
+	for (uint8_t i = 0; i < digits; i++) {
+		char c = s[i];
+		*v <<= 4;
+		if (c >= '0' && c <= '9') {
+			*v |= c - '0';
+		} else if (c >= 'A' && c <= 'F') {
+			*v |= c - 'A' + 10;
+		} else if (c >= 'a' && c <= 'f') {
+			*v |= c - 'a' + 10;
+		} else {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+//tIIILDD.. or TIIIIIIIILDD..
+static int slcan_frame(const char *line, uint8_t len)
+{
+	uint8_t idt = (line[0] == 'T');
+	uint8_t id_digits = idt ? 8 : 3;
+	uint8_t data[8];
+	uint32_t id, dlc, v;
+
+	if (len < 2 + id_digits ||
+		parse_hex(&line[1], id_digits, &id) < 0 ||
+		parse_hex(&line[1 + id_digits], 1, &dlc) < 0 ||
+		dlc > 8 || len < 2 + id_digits + 2 * dlc) {
+		return -1;
+	}
+	for (uint8_t i = 0; i < dlc; i++) {
+		if (parse_hex(&line[2 + id_digits + 2 * i], 2, &v) < 0) {
+			return -1;
+		}
+		data[i] = v;
+	}
+	bridge_inject(id, idt, dlc, data);
+	return 0;
+}
+
+static void slcan_line(const char *line, uint8_t len)
+{
+	const char *reply = "\r";
+
+	switch (line[0]) {
+		case 'O':
+		case 'L':
+			parser.slcan_open = 1;
+			bridge_stream(parser.slcan_ts ? CAN_CAPTURE_SLCAN_TS : CAN_CAPTURE_SLCAN);
+			break;
+		case 'C':
+			parser.slcan_open = 0;
+			bridge_stream(CAN_CAPTURE_OFF);
+			break;
+		case 'Z':
+			parser.slcan_ts = (line[1] == '1');
+			if (parser.slcan_open) {
+				bridge_stream(parser.slcan_ts ? CAN_CAPTURE_SLCAN_TS : CAN_CAPTURE_SLCAN);
+			}
+			break;
+		case 't':
+		case 'T':
+			if (slcan_frame(line, len) < 0) {
+				reply = "\a";
+			} else {
+				reply = (line[0] == 't')?"z\r":"Z\r";
+			}
+			break;
+		case 'V':
+			reply = "V1013\r";
+			break;
+		case 'v':
+			reply = "v0100\r";
+			break;
+		case 'N':
+			reply = "NCEMU\r";
+			break;
+		case 'F':
+			reply = "F00\r";
+			break;
+		case 'S':		//the bit rate is set on the console with bpr=
+		case 's':
+		case 'M':
+		case 'm':
+		case 'X':
+		case 'Q':
+			break;
+		default:
+			reply = "\a";
+			break;
+	}
+	if (reply[0] == '\a') {
+		stats.cmd_errors++;
+	}
+	bridge_send(reply, strlen(reply));
+}
+
+static void slcan_byte(char c)
+{
+	if (c == '\r') {
+		if (parser.line_len > 0) {
+			slcan_line(parser.line, parser.line_len);
+		}
+		parser.line_len = 0;
+	} else if (c != '\n') {
+		if (parser.line_len < SLCAN_LINE_MAX) {
+			parser.line[parser.line_len++] = c;
+		}
+	}
+}
+
+static void gvret_put32(uint8_t *p, uint32_t v)
+{
+	for (uint8_t i = 0; i < 4; i++) {
+		p[i] = v >> (8 * i);
+	}
+}
+
+//Bytes following the command byte, for frames the header decides the rest
+static int8_t gvret_args_len(uint8_t cmd)
+{
+	switch (cmd) {
+		case GVRET_BUILD_CAN_FRAME:
+		case GVRET_ECHO_CAN_FRAME:
+			return 6;
+		case GVRET_SETUP_CANBUS:
+			return 8;
+		case GVRET_SET_SINGLEWIRE_MODE:
+		case GVRET_SET_SYSTYPE:
+			return 1;
+		case GVRET_SET_EXT_BUSES:
+			return 12;
+		case GVRET_TIME_SYNC:
+		case GVRET_GET_CANBUS_PARAMS:
+		case GVRET_GET_DEVICE_INFO:
+		case GVRET_KEEPALIVE:
+		case GVRET_GET_NUM_BUSES:
+		case GVRET_GET_EXT_BUSES:
+			return 0;
+		default:
+			return -1;
+	}
+}
+
+static void gvret_exec(uint8_t cmd, const uint8_t *args)
+{
+	uint8_t reply[2 + 15] = { GVRET_CMD, cmd };
+	uint8_t len = 2;
+
+	switch (cmd) {
+		case GVRET_BUILD_CAN_FRAME:
+		case GVRET_ECHO_CAN_FRAME: {
+			uint32_t id = args[0] | (args[1] << 8) | (args[2] << 16) |
+					((uint32_t)args[3] << 24);
+			uint8_t dlc = args[5] & 0x0F;
+			if (cmd == GVRET_BUILD_CAN_FRAME) {
+				bridge_inject(id & 0x7FFFFFFF, (id >> 31), dlc, (uint8_t *)&args[6]);
+			} else {
+				can_capture_rec_t rec = {
+						.ts_us = esp_timer_get_time(),
+						.id = id & 0x7FFFFFFF,
+						.idt = (id >> 31),
+						.dlc = dlc
+				};
+				char out[24];
+				memcpy(rec.data, &args[6], dlc);
+				bridge_send(out, can_capture_format(CAN_CAPTURE_GVRET,
+						CAN_CAPTURE_RX, &rec, out));
+			}
+		}; return;
+		case GVRET_TIME_SYNC:
+			gvret_put32(&reply[2], (uint32_t)esp_timer_get_time());
+			len += 4;
+			break;
+		case GVRET_GET_CANBUS_PARAMS:
+			reply[2] = 1;		//CAN0 enabled, not listen-only
+			gvret_put32(&reply[3], bridge_bitrate);
+			reply[7] = 0;		//CAN1 disabled
+			gvret_put32(&reply[8], 0);
+			len += 10;
+			break;
+		case GVRET_GET_DEVICE_INFO:
+			reply[2] = GVRET_BUILD & 0xFF;
+			reply[3] = GVRET_BUILD >> 8;
+			reply[4] = 0x20;	//EEPROM version
+			reply[5] = 0;		//file output type
+			reply[6] = 0;		//auto start logging
+			reply[7] = 0;		//single wire mode
+			len += 6;
+			break;
+		case GVRET_KEEPALIVE:
+			reply[2] = 0xDE;
+			reply[3] = 0xAD;
+			len += 2;
+			break;
+		case GVRET_GET_NUM_BUSES:
+			reply[2] = 1;
+			len += 1;
+			break;
+		case GVRET_GET_EXT_BUSES:
+			memset(&reply[2], 0, 15);
+			len += 15;
+			break;
+		default:
+			//Settings of buses the emulator does not have
+			return;
+	}
+	bridge_send((const char *)reply, len);
+}
+
+static void gvret_byte(uint8_t c)
+{
+	if (parser.gv_cmd == -1) {
+		if (c == GVRET_CMD) {
+			parser.gv_cmd = -2;
+		}
+		return;
+	}
+	if (parser.gv_cmd == -2) {
+		int8_t need = gvret_args_len(c);
+		if (need < 0) {
+			stats.cmd_errors++;
+			parser.gv_cmd = -1;
+			return;
+		}
+		parser.gv_cmd = c;
+		parser.gv_len = 0;
+		parser.gv_need = need;
+	} else {
+		parser.gv_args[parser.gv_len++] = c;
+		if ((parser.gv_cmd == GVRET_BUILD_CAN_FRAME ||
+			 parser.gv_cmd == GVRET_ECHO_CAN_FRAME) && parser.gv_len == 6) {
+			uint8_t dlc = c & 0x0F;
+			if (dlc > 8) {
+				stats.cmd_errors++;
+				parser.gv_cmd = -1;
+				return;
+			}
+			//Data and the checksum byte, which GVRET tools do not fill in
+			parser.gv_need = 6 + dlc + 1;
+		}
+	}
+	if (parser.gv_len >= parser.gv_need) {
+		gvret_exec(parser.gv_cmd, parser.gv_args);
+		parser.gv_cmd = -1;
+	}
+}
+
+static void bridge_byte(uint8_t c)
+{
+	if (parser.proto == BRIDGE_SLCAN && c == GVRET_BINARY) {
+		parser.proto = BRIDGE_GVRET;
+		bridge_stream(CAN_CAPTURE_GVRET);
+		return;
+	}
+	if (parser.proto == BRIDGE_GVRET) {
+		gvret_byte(c);
+	} else {
+		slcan_byte(c);
+	}
+}
+
+static void can_bridge_task(void *arg)
+{
+	struct sockaddr_in addr = {
+			.sin_family = AF_INET,
+			.sin_port = htons(CONFIG_CAR_EMU_BRIDGE_PORT),
+			.sin_addr.s_addr = htonl(INADDR_ANY)
+	};
+	uint8_t buf[CAN_BRIDGE_RX_BUF_LEN];
+	int one = 1;
+
+	if (bridge_net_init != NULL) {
+		bridge_net_init();
+	}
+	int listen_sock = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+	if (listen_sock < 0) {
+		ESP_LOGE(TAG, "socket: errno %d", errno);
+		vTaskDelete(NULL);
+		return;
+	}
+	setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if (bind(listen_sock, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+		listen(listen_sock, 1) != 0) {
+		ESP_LOGE(TAG, "bind/listen on port %d: errno %d",
+				CONFIG_CAR_EMU_BRIDGE_PORT, errno);
+		close(listen_sock);
+		vTaskDelete(NULL);
+		return;
+	}
+	ESP_LOGI(TAG, "Listening on port %d", CONFIG_CAR_EMU_BRIDGE_PORT);
+
+	while (1) {
+		struct sockaddr_in peer;
+		socklen_t peer_len = sizeof(peer);
+		int sock = accept(listen_sock, (struct sockaddr *)&peer, &peer_len);
+		if (sock < 0) {
+			vTaskDelay(pdMS_TO_TICKS(100));
+			continue;
+		}
+		//Batches are already coalesced, Nagle would only delay them
+		setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+		//send() holds send_lock, it must not block for good on a full window
+		struct timeval tv = {
+				.tv_sec = CAN_BRIDGE_SEND_TOUT_MS / 1000,
+				.tv_usec = (CAN_BRIDGE_SEND_TOUT_MS % 1000) * 1000
+		};
+		setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+		ESP_LOGI(TAG, "Client %s connected", inet_ntoa(peer.sin_addr));
+		stats.clients++;
+
+		memset(&parser, 0, sizeof(parser));
+		parser.gv_cmd = -1;
+		xSemaphoreTake(send_lock, portMAX_DELAY);
+		client = sock;
+		xSemaphoreGive(send_lock);
+
+		int n;
+		while ((n = recv(sock, buf, sizeof(buf), 0)) > 0) {
+			for (int i = 0; i < n; i++) {
+				bridge_byte(buf[i]);
+			}
+		}
+
+		bridge_stream(CAN_CAPTURE_OFF);
+		xSemaphoreTake(send_lock, portMAX_DELAY);
+		client = -1;
+		xSemaphoreGive(send_lock);
+		close(sock);
+		ESP_LOGI(TAG, "Client disconnected");
+	}
+}
+
+int can_bridge_start(void (*net_init)(void), uint32_t bitrate)
+{
+	bridge_net_init = net_init;
+	bridge_bitrate = bitrate;
+	send_lock = xSemaphoreCreateMutex();
+	if (send_lock == NULL) {
+		return -1;
+	}
+	return (emu_task_create(can_bridge_task, "bridge", 4 * 1024, NULL, 2,
+							EMU_CORE_APP, NULL) == pdPASS)?0:-1;
+}
+
+void can_bridge_stats_get(can_bridge_stats_t *s)
+{
+	*s = stats;
+}
+
+void can_bridge_stats_print(void)
+{
+	printf("\nBridge: clients=%u connected=%s injected=%u inject_errors=%u "
+			"send_errors=%u send_timeouts=%u cmd_errors=%u\n",
+			stats.clients, (client >= 0)?"yes":"no", stats.injected,
+			stats.inject_errors, stats.send_errors, stats.send_timeouts,
+			stats.cmd_errors);
+}
+
+#endif /* CONFIG_CAR_EMU_BRIDGE */
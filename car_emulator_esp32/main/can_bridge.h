@@ -0,0 +1,49 @@
+/*
+ * can_bridge.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+
+#ifndef __CAN_BRIDGE_H_
+#define __CAN_BRIDGE_H_
+
+#include <stdint.h>
+
+/*
+ * TCP bridge between the bus and PC tools. One client at a time gets the
+ * RX and TX frames from the bus capture and may send frames to be
+ * transmitted. The protocol is chosen by the client: SavvyCAN and other
+ * GVRET tools switch to binary with 0xE7, anything else talks SLCAN and
+ * receives frames after "O\r".
+ *
+ * Frames are sent in the batches drained by the capture task, so the
+ * socket runs with TCP_NODELAY and Nagle never holds a batch back.
+ * A client that does not read is dropped once a send has waited
+ * CAN_BRIDGE_SEND_TOUT_MS, so it cannot stall the capture task.
+ */
+#define CAN_BRIDGE_RX_BUF_LEN		128
+#define CAN_BRIDGE_TX_TOUT_US		100000
+#define CAN_BRIDGE_SEND_TOUT_MS		200
+
+typedef struct can_bridge_stats_s {
+	uint32_t clients;
+	uint32_t injected;		//frames from the client sent on the bus
+	uint32_t inject_errors;
+	uint32_t send_errors;	//batches lost because the client was gone
+	uint32_t send_timeouts;	//clients dropped for not reading
+	uint32_t cmd_errors;	//unknown or malformed commands
+} can_bridge_stats_t;
+
+/*
+ * Starts the bridge task. net_init brings the network up and is called
+ * from the bridge task, so boot does not wait for WiFi. bitrate is
+ * reported to GVRET clients.
+ */
+int can_bridge_start(void (*net_init)(void), uint32_t bitrate);
+
+void can_bridge_stats_get(can_bridge_stats_t *stats);
+
+void can_bridge_stats_print(void);
+
+#endif /* __CAN_BRIDGE_H_ */
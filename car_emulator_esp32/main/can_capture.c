@@ -0,0 +1,413 @@
+/*
+ * can_capture.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "driver/uart.h"
+
+#include "spsc_ring.h"
+#include "emu_tasks.h"
+#include "can_capture.h"
+
+#define TAG             "CAPTURE"
+
+#ifdef CONFIG_CAR_EMU_CAPTURE
+
+#define CAN_CAPTURE_LINE_MAX		64
+#define CAN_CAPTURE_OUT_LEN			2048
+#define CAN_CAPTURE_DRAIN_MS		10
+//Shortest 11 bit frame (DLC 0) incl. interframe space: 47 bits
+#define CAN_CAPTURE_MAX_FPS_500K	(500000 / 47)
+#define CAN_CAPTURE_BENCH_STEP_MS	2000
+
+volatile uint8_t can_capture_active;
+
+static can_capture_rec_t rec_buf[2][EMU_CAPTURE_LEN];
+static spsc_ring_t rings[2];
+static can_capture_fmt_t capture_fmt;
+static can_capture_stats_t stats;
+static TaskHandle_t capture_task;
+static char out_buf[CAN_CAPTURE_OUT_LEN];
+static can_capture_sink_t capture_sink;
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+void can_capture_put(can_capture_dir_t dir, uint32_t id, uint8_t idt,
+		uint8_t dlc, const uint8_t *data)
+{
+	can_capture_rec_t *rec = spsc_ring_reserve(&rings[dir]);
+	if (rec == NULL) {
+		stats.overflows[dir]++;
+		return;
+	}
+	rec->ts_us = esp_timer_get_time();
+	rec->id = id;
+	rec->idt = idt;
+	rec->dlc = (dlc > 8)?8:dlc;
+	memcpy(rec->data, data, rec->dlc);
+	spsc_ring_commit(&rings[dir]);
+	stats.captured[dir]++;
+}
+
+static inline char *put_hex(char *p, uint32_t v, uint8_t digits)
+{
+	for (int8_t i = digits - 1; i >= 0; i--) {
+		p[i] = hex_digits[v & 0xF];
+		v >>= 4;
+	}
+	return p + digits;
+}
+
+static inline char *put_dec(char *p, uint32_t v, uint8_t digits)
+{
+	for (int8_t i = digits - 1; i >= 0; i--) {
+		p[i] = '0' + (v % 10);
+		v /= 10;
+	}
+	return p + digits;
+}
+
+uint16_t can_capture_format(can_capture_fmt_t fmt, can_capture_dir_t dir,
+		const can_capture_rec_t *rec, char *out)
+{
+	char *p = out;
+	uint32_t sec = (uint32_t)(rec->ts_us / 1000000);
+	uint32_t usec = (uint32_t)(rec->ts_us % 1000000);
+
+	if (fmt == CAN_CAPTURE_GVRET) {
+		//F1 00 <timestamp us> <id, bit 31 extended> <len | bus << 4> <data> 00
+		uint32_t ts = (uint32_t)rec->ts_us;
+		uint32_t id = rec->id | (rec->idt ? 0x80000000 : 0);
+		*p++ = 0xF1;
+		*p++ = 0x00;
+		for (uint8_t i = 0; i < 4; i++) {
+			*p++ = ts >> (8 * i);
+		}
+		for (uint8_t i = 0; i < 4; i++) {
+			*p++ = id >> (8 * i);
+		}
+		*p++ = rec->dlc;
+		memcpy(p, rec->data, rec->dlc);
+		p += rec->dlc;
+		*p++ = 0;
+		return p - out;
+	} else if (fmt == CAN_CAPTURE_SLCAN || fmt == CAN_CAPTURE_SLCAN_TS) {
+		//t7DF302010C[TTTT]\r
+		*p++ = rec->idt ? 'T' : 't';
+		p = put_hex(p, rec->id, rec->idt ? 8 : 3);
+		*p++ = '0' + rec->dlc;
+		for (uint8_t i = 0; i < rec->dlc; i++) {
+			p = put_hex(p, rec->data[i], 2);
+		}
+		if (fmt == CAN_CAPTURE_SLCAN_TS) {
+			p = put_hex(p, (uint32_t)((rec->ts_us / 1000) % 60000), 4);
+		}
+		*p++ = '\r';
+		return p - out;
+	} else if (fmt == CAN_CAPTURE_CANDUMP) {
+		//(0000012.345678) can0 7DF#02010C
+		*p++ = '(';
+		p = put_dec(p, sec, 10);
+		*p++ = '.';
+		p = put_dec(p, usec, 6);
+		memcpy(p, ") can0 ", 7);
+		p += 7;
+		p = put_hex(p, rec->id, rec->idt ? 8 : 3);
+		*p++ = '#';
+		for (uint8_t i = 0; i < rec->dlc; i++) {
+			p = put_hex(p, rec->data[i], 2);
+		}
+	} else {
+		//   12.345678 1  7DF             Rx   d 3 02 01 0C
+		p += sprintf(p, "%6u.%06u 1  ", sec, usec);
+		char *id = p;
+		p = put_hex(p, rec->id, rec->idt ? 8 : 3);
+		if (rec->idt) {
+			*p++ = 'x';
+		}
+		while (p - id < 16) {
+			*p++ = ' ';
+		}
+		memcpy(p, (dir == CAN_CAPTURE_RX)?"Rx   d ":"Tx   d ", 7);
+		p += 7;
+		*p++ = '0' + rec->dlc;
+		for (uint8_t i = 0; i < rec->dlc; i++) {
+			*p++ = ' ';
+			p = put_hex(p, rec->data[i], 2);
+		}
+	}
+	*p++ = '\n';
+	return p - out;
+}
+
+static void can_capture_write(const char *buf, size_t len)
+{
+	if (len == 0) {
+		return;
+	}
+	if (capture_sink != NULL) {
+		if (capture_sink(buf, len) == 0) {
+			stats.bytes_out += len;
+		}
+		return;
+	}
+#ifdef CONFIG_CAR_EMU_CAPTURE_DEDICATED_UART
+	uart_write_bytes(CONFIG_CAR_EMU_CAPTURE_UART_NUM, buf, len);
+#else
+	fwrite(buf, 1, len, stdout);
+	fflush(stdout);
+#endif
+	stats.bytes_out += len;
+}
+
+//Merges both rings in timestamp order, returns the number of records
+static uint32_t can_capture_drain(can_capture_fmt_t fmt, uint8_t output)
+{
+	uint32_t n[2] = { spsc_ring_count(&rings[0]), spsc_ring_count(&rings[1]) };
+	uint32_t idx[2] = { 0, 0 };
+	size_t len = 0;
+
+	if (n[0] + n[1] > stats.max_fill) {
+		stats.max_fill = n[0] + n[1];
+	}
+	while (idx[0] < n[0] || idx[1] < n[1]) {
+		can_capture_dir_t dir;
+		if (idx[1] >= n[1]) {
+			dir = CAN_CAPTURE_RX;
+		} else if (idx[0] >= n[0]) {
+			dir = CAN_CAPTURE_TX;
+		} else {
+			can_capture_rec_t *rx = spsc_ring_peek(&rings[0], idx[0]);
+			can_capture_rec_t *tx = spsc_ring_peek(&rings[1], idx[1]);
+			dir = (rx->ts_us <= tx->ts_us)?CAN_CAPTURE_RX:CAN_CAPTURE_TX;
+		}
+		len += can_capture_format(fmt, dir,
+				spsc_ring_peek(&rings[dir], idx[dir]), &out_buf[len]);
+		idx[dir]++;
+		if (len > CAN_CAPTURE_OUT_LEN - CAN_CAPTURE_LINE_MAX) {
+			if (output) {
+				can_capture_write(out_buf, len);
+			}
+			len = 0;
+		}
+	}
+	if (output) {
+		can_capture_write(out_buf, len);
+	}
+	spsc_ring_release(&rings[0], n[0]);
+	spsc_ring_release(&rings[1], n[1]);
+	if (n[0] + n[1] > 0) {
+		stats.batches++;
+	}
+	return n[0] + n[1];
+}
+
+static void can_capture_task(void *arg)
+{
+	while (1) {
+		ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(CAN_CAPTURE_DRAIN_MS));
+		if (capture_fmt != CAN_CAPTURE_OFF) {
+			can_capture_drain(capture_fmt, 1);
+		}
+	}
+}
+
+static void can_capture_rings_init(void)
+{
+	spsc_ring_init(&rings[CAN_CAPTURE_RX], rec_buf[CAN_CAPTURE_RX],
+					sizeof(can_capture_rec_t), EMU_CAPTURE_LEN);
+	spsc_ring_init(&rings[CAN_CAPTURE_TX], rec_buf[CAN_CAPTURE_TX],
+					sizeof(can_capture_rec_t), EMU_CAPTURE_LEN);
+}
+
+int can_capture_init(void)
+{
+	can_capture_rings_init();
+#ifdef CONFIG_CAR_EMU_CAPTURE_DEDICATED_UART
+	uart_config_t uart_config = {
+			.baud_rate = CONFIG_CAR_EMU_CAPTURE_UART_BAUD,
+			.data_bits = UART_DATA_8_BITS,
+			.parity = UART_PARITY_DISABLE,
+			.stop_bits = UART_STOP_BITS_1,
+			.flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+			.source_clk = UART_SCLK_APB,
+	};
+	if (uart_driver_install(CONFIG_CAR_EMU_CAPTURE_UART_NUM, 256,
+							4 * CAN_CAPTURE_OUT_LEN, 0, NULL, 0) != ESP_OK ||
+		uart_param_config(CONFIG_CAR_EMU_CAPTURE_UART_NUM, &uart_config) != ESP_OK ||
+		uart_set_pin(CONFIG_CAR_EMU_CAPTURE_UART_NUM,
+				CONFIG_CAR_EMU_CAPTURE_TX_GPIO, UART_PIN_NO_CHANGE,
+				UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE) != ESP_OK) {
+		return -1;
+	}
+#endif
+	return (emu_task_create(can_capture_task, "capture", 3 * 1024, NULL, 2,
+							EMU_CORE_APP, &capture_task) == pdPASS)?0:-1;
+}
+
+void can_capture_start(can_capture_fmt_t fmt)
+{
+	if (fmt == CAN_CAPTURE_OFF) {
+		can_capture_stop();
+		return;
+	}
+	capture_fmt = fmt;
+	if (fmt == CAN_CAPTURE_ASC) {
+		static const char asc_header[] = "date Thu Jan 1 00:00:00.000 am 1970\n"
+				"base hex  timestamps absolute\n"
+				"internal events logged\n"
+				"Begin Triggerblock\n";
+		can_capture_write(asc_header, sizeof(asc_header) - 1);
+	}
+	can_capture_active = 1;
+}
+
+void can_capture_stop(void)
+{
+	can_capture_fmt_t fmt = capture_fmt;
+
+	can_capture_active = 0;
+	//Let the capture task write what is left before switching the format
+	vTaskDelay(pdMS_TO_TICKS(2 * CAN_CAPTURE_DRAIN_MS));
+	capture_fmt = CAN_CAPTURE_OFF;
+	if (fmt == CAN_CAPTURE_ASC) {
+		static const char asc_footer[] = "End TriggerBlock\n";
+		can_capture_write(asc_footer, sizeof(asc_footer) - 1);
+	}
+}
+
+void can_capture_set_sink(can_capture_sink_t sink)
+{
+	capture_sink = sink;
+}
+
+void can_capture_stats_get(can_capture_stats_t *s)
+{
+	*s = stats;
+}
+
+void can_capture_stats_print(void)
+{
+	printf("\nCapture: rx=%u tx=%u overflow rx=%u tx=%u max_fill=%u/%d "
+			"batches=%u bytes=%u\n",
+			stats.captured[CAN_CAPTURE_RX], stats.captured[CAN_CAPTURE_TX],
+			stats.overflows[CAN_CAPTURE_RX], stats.overflows[CAN_CAPTURE_TX],
+			stats.max_fill, 2 * EMU_CAPTURE_LEN,
+			stats.batches, stats.bytes_out);
+}
+
+static const uint8_t bench_data[8] = { 0x02, 0x01, 0x0C, 0x00, 0x00, 0x00, 0x00, 0x00 };
+
+/*
+ * Offers fps frames per second for one step to the capture task, which
+ * drains and writes them as during a real capture. Frames come in one
+ * burst per tick, as the RX queue hands them over. Returns the frames
+ * lost.
+ */
+static uint32_t can_capture_bench_load(uint32_t fps)
+{
+	uint32_t lost = stats.overflows[CAN_CAPTURE_RX];
+	uint32_t acc = 0;
+
+	for (TickType_t t = 0; t < pdMS_TO_TICKS(CAN_CAPTURE_BENCH_STEP_MS); t++) {
+		acc += fps;
+		for (; acc >= configTICK_RATE_HZ; acc -= configTICK_RATE_HZ) {
+			can_capture_put(CAN_CAPTURE_RX, 0x7DF, 0, 8, bench_data);
+		}
+		vTaskDelay(1);
+	}
+	//What is still in the ring is not lost yet
+	vTaskDelay(pdMS_TO_TICKS(10 * CAN_CAPTURE_DRAIN_MS));
+	return stats.overflows[CAN_CAPTURE_RX] - lost;
+}
+
+//Finds the highest rate the output keeps up with
+static void can_capture_bench_output(void)
+{
+	static const uint32_t rates[] = { 500, 1000, 2000, 4000, 6000, 8000,
+									CAN_CAPTURE_MAX_FPS_500K };
+	uint32_t sustained = 0;
+
+#ifndef CONFIG_CAR_EMU_CAPTURE_DEDICATED_UART
+	if (capture_sink == NULL) {
+		printf("Output: needs CAR_EMU_CAPTURE_DEDICATED_UART or a bridge client, "
+				"the console would carry the capture\n");
+		return;
+	}
+#endif
+	printf("\ncandump output: offered    lost  bytes/s\n");
+	capture_fmt = CAN_CAPTURE_CANDUMP;
+	for (uint8_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++) {
+		uint32_t bytes = stats.bytes_out;
+		uint32_t lost = can_capture_bench_load(rates[i]);
+		printf("%23u %7u %8u\n", rates[i], lost,
+				(stats.bytes_out - bytes) * 1000 / CAN_CAPTURE_BENCH_STEP_MS);
+		if (lost > 0) {
+			break;
+		}
+		sustained = rates[i];
+	}
+	capture_fmt = CAN_CAPTURE_OFF;
+	printf("Sustained without loss: %u frames/s (%u%% of a fully loaded "
+			"500kbit/s bus)\n", sustained, sustained * 100 / CAN_CAPTURE_MAX_FPS_500K);
+}
+
+void can_capture_bench(void)
+{
+	const uint32_t frames = 20000;
+	can_capture_fmt_t fmts[2] = { CAN_CAPTURE_CANDUMP, CAN_CAPTURE_ASC };
+	can_capture_fmt_t running = capture_fmt;
+	uint32_t captured = stats.captured[CAN_CAPTURE_RX];
+	uint32_t overflows_before = stats.overflows[CAN_CAPTURE_RX];
+
+	if (capture_task == NULL) {
+		//Called from the console before the capture is initialized
+		can_capture_rings_init();
+	} else {
+		can_capture_stop();
+	}
+	//The bench is the only producer, the dispatcher stays out of the RX ring
+	for (uint8_t f = 0; f < 2; f++) {
+		uint32_t overflows = stats.overflows[CAN_CAPTURE_RX];
+
+		int64_t t0 = esp_timer_get_time();
+		for (uint32_t i = 0; i < frames; i++) {
+			can_capture_put(CAN_CAPTURE_RX, 0x7DF, 0, 8, bench_data);
+			if ((i & 63) == 63) {
+				can_capture_drain(fmts[f], 0);
+			}
+		}
+		can_capture_drain(fmts[f], 0);
+		int64_t t1 = esp_timer_get_time();
+
+		uint32_t fps = (uint32_t)(frames * 1000000LL / (t1 - t0));
+		char line[CAN_CAPTURE_LINE_MAX];
+		can_capture_rec_t rec = { .ts_us = t1, .id = 0x7DF, .idt = 0, .dlc = 8 };
+		uint16_t line_len = can_capture_format(fmts[f], CAN_CAPTURE_RX, &rec, line);
+		printf("%s, output discarded: %u frames/s (%u%% of a fully loaded 500kbit/s bus), "
+				"lost %u, output needs %u baud at 4500 frames/s\n",
+				(fmts[f] == CAN_CAPTURE_CANDUMP)?"candump":"asc", fps,
+				fps * 100 / CAN_CAPTURE_MAX_FPS_500K,
+				stats.overflows[CAN_CAPTURE_RX] - overflows, line_len * 10 * 4500);
+	}
+	if (capture_task != NULL) {
+		can_capture_bench_output();
+	}
+	//Bench frames do not count as bus traffic
+	stats.captured[CAN_CAPTURE_RX] = captured;
+	stats.overflows[CAN_CAPTURE_RX] = overflows_before;
+	if (running != CAN_CAPTURE_OFF) {
+		can_capture_start(running);
+	}
+}
+
+#endif //CONFIG_CAR_EMU_CAPTURE
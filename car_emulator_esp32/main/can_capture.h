@@ -0,0 +1,103 @@
+/*
+ * can_capture.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+
+#ifndef __CAN_CAPTURE_H_
+#define __CAN_CAPTURE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "sdkconfig.h"
+
+/*
+ * Bus capture. Every RX and TX frame is stamped with esp_timer_get_time()
+ * and stored into a preallocated ring by the path handling it, without
+ * locks or waiting. The capture task drains the rings in batches and
+ * writes them in candump or Vector ASC format. Nothing is lost as long
+ * as the output keeps up, which "capbench" measures; beyond that full
+ * rings are counted as overflows.
+ *
+ * RX frames are only stored by the dispatcher and TX frames only by the
+ * bus owner granted by tx_sched_acquire(), so each ring has a single
+ * producer.
+ */
+typedef enum {
+	CAN_CAPTURE_OFF = 0,
+	CAN_CAPTURE_CANDUMP,
+	CAN_CAPTURE_ASC,
+	CAN_CAPTURE_SLCAN,			//Lawicel ASCII, no timestamp
+	CAN_CAPTURE_SLCAN_TS,		//Lawicel ASCII with the 60 s millisecond timestamp
+	CAN_CAPTURE_GVRET			//GVRET binary, as read by SavvyCAN
+} can_capture_fmt_t;
+
+//Receives the formatted output in place of the console or capture UART
+typedef int (*can_capture_sink_t)(const char *buf, size_t len);
+
+typedef enum {
+	CAN_CAPTURE_RX = 0,
+	CAN_CAPTURE_TX
+} can_capture_dir_t;
+
+typedef struct can_capture_rec_s {
+	int64_t ts_us;
+	uint32_t id;
+	uint8_t idt;
+	uint8_t dlc;
+	uint8_t data[8];
+} can_capture_rec_t;
+
+typedef struct can_capture_stats_s {
+	uint32_t captured[2];		//per direction
+	uint32_t overflows[2];		//frames lost because a ring was full
+	uint32_t max_fill;			//highest ring occupancy seen by the drain
+	uint32_t batches;
+	uint32_t bytes_out;
+} can_capture_stats_t;
+
+extern volatile uint8_t can_capture_active;
+
+void can_capture_put(can_capture_dir_t dir, uint32_t id, uint8_t idt,
+		uint8_t dlc, const uint8_t *data);
+
+static inline void can_capture_frame(can_capture_dir_t dir, uint32_t id,
+		uint8_t idt, uint8_t dlc, const uint8_t *data)
+{
+#ifdef CONFIG_CAR_EMU_CAPTURE
+	if (can_capture_active) {
+		can_capture_put(dir, id, idt, dlc, data);
+	}
+#endif
+}
+
+int can_capture_init(void);
+
+void can_capture_start(can_capture_fmt_t fmt);
+
+void can_capture_stop(void);
+
+/*
+ * Routes the output to sink, NULL restores the default output. Set it
+ * while the capture is stopped.
+ */
+void can_capture_set_sink(can_capture_sink_t sink);
+
+void can_capture_stats_get(can_capture_stats_t *stats);
+
+void can_capture_stats_print(void);
+
+//Formats one record, returns the number of characters written
+uint16_t can_capture_format(can_capture_fmt_t fmt, can_capture_dir_t dir,
+		const can_capture_rec_t *rec, char *out);
+
+/*
+ * Measures ring + formatting throughput with the output discarded, then
+ * the frame rate the capture sustains through its real output (capture
+ * UART or bridge) without loss. A running capture is paused meanwhile.
+ */
+void can_capture_bench(void);
+
+#endif /* __CAN_CAPTURE_H_ */
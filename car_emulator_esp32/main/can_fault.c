@@ -0,0 +1,329 @@
+/*
+ * can_fault.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_rom_sys.h"
+
+#include "cantp_txq.h"
+#include "can_fault.h"
+
+#define TAG             "CAN_FAULT"
+
+#ifdef CONFIG_CAR_EMU_FAULT
+
+//ISO-TP N_PCI types, normal addressing
+#define CAN_FAULT_PCI_SF		0x0
+#define CAN_FAULT_PCI_FF		0x1
+#define CAN_FAULT_PCI_CF		0x2
+#define CAN_FAULT_PCI_FC		0x3
+
+#define CAN_FAULT_BENCH_FRAMES	20000
+
+typedef struct can_fault_s {
+	can_fault_cfg_t cfg;
+	uint32_t thr[CAN_FAULT_NUM];	//permille scaled to 1 << 16
+	uint32_t rng;
+	cantp_can_frame_t held;			//reordered frame waiting for the next one
+	uint8_t held_valid;
+	can_fault_stats_t stats;
+} can_fault_t;
+
+static const char *can_fault_names[CAN_FAULT_NUM] = {
+		"drop", "delay", "dup", "reorder", "sn", "dlc", "fc", "jitter"
+};
+
+volatile uint8_t can_fault_active;
+
+static can_fault_t fault = {
+		.cfg = {
+				.seed = 1,
+				.delay_us = 20000,
+				.jitter_us = 50000
+		},
+		.rng = 1
+};
+
+//xorshift32
+static inline uint32_t can_fault_rand(void)
+{
+	uint32_t x = fault.rng;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	fault.rng = x;
+	return x;
+}
+
+static inline uint8_t can_fault_draw(can_fault_type_t type)
+{
+	//Faults which are off do not consume random numbers
+	if (fault.thr[type] == 0 || (can_fault_rand() >> 16) >= fault.thr[type]) {
+		return 0;
+	}
+	fault.stats.injected[type]++;
+	return 1;
+}
+
+static void can_fault_sleep(uint32_t us)
+{
+	uint32_t ticks = us / (portTICK_PERIOD_MS * 1000);
+	if (ticks > 0) {
+		vTaskDelay(ticks);
+		us -= ticks * portTICK_PERIOD_MS * 1000;
+	}
+	if (us > 0) {
+		esp_rom_delay_us(us);
+	}
+}
+
+int can_fault_tx(const cantp_can_frame_t *frame, uint8_t wait, long tout_us,
+		can_fault_tx_t tx)
+{
+	if (fault.cfg.id != 0 && frame->id != fault.cfg.id) {
+		return tx(frame, wait, tout_us);
+	}
+
+	cantp_can_frame_t f = *frame;
+	uint8_t pci = (f.dlc > 0)?(f.data_u8[0] >> 4):0xF;
+	fault.stats.frames++;
+
+	//Dropped frames look sent to CAN-TP, as on a bus without a receiver
+	if (pci == CAN_FAULT_PCI_FC && can_fault_draw(CAN_FAULT_FC)) {
+		return CAN_FAULT_TX_CONSUMED;
+	}
+	if (can_fault_draw(CAN_FAULT_DROP)) {
+		return CAN_FAULT_TX_CONSUMED;
+	}
+	if (pci == CAN_FAULT_PCI_CF && can_fault_draw(CAN_FAULT_SN)) {
+		f.data_u8[0] = 0x20 | ((f.data_u8[0] + 1 + can_fault_rand() % 15) & 0x0F);
+	}
+	if (can_fault_draw(CAN_FAULT_DLC)) {
+		uint8_t dlc = can_fault_rand() % 8;
+		if (dlc >= f.dlc) {
+			dlc++;
+		}
+		for (uint8_t i = f.dlc; i < dlc; i++) {
+			f.data_u8[i] = 0xAA;
+		}
+		f.dlc = dlc;
+	}
+	if ((pci == CAN_FAULT_PCI_SF || pci == CAN_FAULT_PCI_FF) &&
+			can_fault_draw(CAN_FAULT_JITTER)) {
+		can_fault_sleep(can_fault_rand() % (fault.cfg.jitter_us + 1));
+	}
+	if (can_fault_draw(CAN_FAULT_DELAY)) {
+		can_fault_sleep(fault.cfg.delay_us);
+	}
+	if (!fault.held_valid && can_fault_draw(CAN_FAULT_REORDER)) {
+		fault.held = f;
+		fault.held_valid = 1;
+		return CAN_FAULT_TX_CONSUMED;
+	}
+
+	int res = tx(&f, wait, tout_us);
+	if (fault.held_valid) {
+		fault.held_valid = 0;
+		tx(&fault.held, wait, tout_us);
+	}
+	if (can_fault_draw(CAN_FAULT_DUP)) {
+		tx(&f, wait, tout_us);
+	}
+	return res;
+}
+
+static void can_fault_apply(const can_fault_cfg_t *cfg)
+{
+	fault.cfg = *cfg;
+	for (uint8_t i = 0; i < CAN_FAULT_NUM; i++) {
+		uint16_t p = (cfg->permille[i] > 1000)?1000:cfg->permille[i];
+		fault.thr[i] = (uint32_t)p * 65536 / 1000;
+	}
+}
+
+void can_fault_cfg_get(can_fault_cfg_t *cfg)
+{
+	*cfg = fault.cfg;
+}
+
+//The state belongs to the bus owner, so changes wait for the bus
+void can_fault_cfg_set(const can_fault_cfg_t *cfg)
+{
+	tx_sched_acquire(0, 0, esp_timer_get_time());
+	can_fault_apply(cfg);
+	tx_sched_release();
+}
+
+void can_fault_start(void)
+{
+	tx_sched_acquire(0, 0, esp_timer_get_time());
+	fault.rng = (fault.cfg.seed != 0)?fault.cfg.seed:1;
+	fault.held_valid = 0;
+	memset(&fault.stats, 0, sizeof(fault.stats));
+	can_fault_active = 1;
+	tx_sched_release();
+}
+
+//A frame held for reordering is lost
+void can_fault_stop(void)
+{
+	tx_sched_acquire(0, 0, esp_timer_get_time());
+	can_fault_active = 0;
+	fault.held_valid = 0;
+	tx_sched_release();
+}
+
+void can_fault_stats_get(can_fault_stats_t *stats)
+{
+	*stats = fault.stats;
+}
+
+void can_fault_print(void)
+{
+	can_fault_stats_t st = fault.stats;
+
+	printf("\nFault injection %s, seed %u, ID ", can_fault_active?"on":"off",
+			fault.cfg.seed);
+	if (fault.cfg.id == 0) {
+		printf("any\n");
+	} else {
+		printf("0x%X\n", fault.cfg.id);
+	}
+	printf("delay_us %u, jitter_us %u, frames %u\n", fault.cfg.delay_us,
+			fault.cfg.jitter_us, st.frames);
+	for (uint8_t i = 0; i < CAN_FAULT_NUM; i++) {
+		printf("  %-8s %4u permille  injected %u\n", can_fault_names[i],
+				fault.cfg.permille[i], st.injected[i]);
+	}
+}
+
+void can_fault_cmd(const char *args)
+{
+	can_fault_cfg_t cfg;
+
+	if (args[0] == '\0') {
+		can_fault_print();
+		return;
+	}
+	if (strcmp(args, "=on") == 0) {
+		can_fault_start();
+		printf("\nFault injection on, seed %u\n", fault.cfg.seed);
+		return;
+	}
+	if (strcmp(args, "=off") == 0) {
+		can_fault_stop();
+		printf("\nFault injection off\n");
+		return;
+	}
+
+	const char *sep = strchr(args, ':');
+	if (args[0] != '=' || sep == NULL) {
+		printf("\nUse fault, fault=on, fault=off or fault=NAME:VALUE\n");
+		return;
+	}
+	const char *name = &args[1];
+	size_t name_len = sep - name;
+	uint8_t is_id = (name_len == 2 && strncmp(name, "id", 2) == 0);
+	uint32_t value = strtoul(sep + 1, NULL, is_id?16:10);
+
+	can_fault_cfg_get(&cfg);
+	if (is_id) {
+		cfg.id = value;
+	} else if (name_len == 4 && strncmp(name, "seed", 4) == 0) {
+		cfg.seed = value;
+	} else if (name_len == 8 && strncmp(name, "delay_us", 8) == 0) {
+		cfg.delay_us = value;
+	} else if (name_len == 9 && strncmp(name, "jitter_us", 9) == 0) {
+		cfg.jitter_us = value;
+	} else {
+		uint8_t i;
+		for (i = 0; i < CAN_FAULT_NUM; i++) {
+			if (strlen(can_fault_names[i]) == name_len &&
+					strncmp(name, can_fault_names[i], name_len) == 0) {
+				break;
+			}
+		}
+		if (i == CAN_FAULT_NUM) {
+			printf("\nUnknown fault, use seed, id, delay_us, jitter_us");
+			for (i = 0; i < CAN_FAULT_NUM; i++) {
+				printf(", %s", can_fault_names[i]);
+			}
+			printf("\n");
+			return;
+		}
+		cfg.permille[i] = (value > 1000)?1000:value;
+	}
+	can_fault_cfg_set(&cfg);
+	can_fault_print();
+}
+
+static uint32_t bench_sent;
+
+static int can_fault_bench_tx(const cantp_can_frame_t *frame, uint8_t wait, long tout_us)
+{
+	bench_sent += frame->dlc;
+	return 0;
+}
+
+void can_fault_bench(void)
+{
+	//Request, First Frame, Consecutive Frame and Flow Control in turn
+	static const cantp_can_frame_t frames[4] = {
+			{ .id = 0x7E8, .dlc = 8, .data_u8 = { 0x04, 0x41, 0x0C, 0x1A, 0xF8 } },
+			{ .id = 0x7E8, .dlc = 8, .data_u8 = { 0x10, 0x14, 0x49, 0x02, 0x01, 'W' } },
+			{ .id = 0x7E8, .dlc = 8, .data_u8 = { 0x21, 'V', 'W', 'Z', 'Z', 'Z' } },
+			{ .id = 0x7E8, .dlc = 3, .data_u8 = { 0x30, 0x00, 0x00 } }
+	};
+	can_fault_cfg_t armed = {
+			.seed = 1
+	};
+	uint32_t ns[2];
+
+	for (uint8_t i = 0; i < CAN_FAULT_NUM; i++) {
+		armed.permille[i] = 100;
+	}
+
+	//Live frames wait while the stage state is borrowed
+	tx_sched_acquire(0, 0, esp_timer_get_time());
+	can_fault_t saved = fault;
+	uint8_t active = can_fault_active;
+
+	for (uint8_t run = 0; run < 2; run++) {
+		can_fault_active = run;
+		can_fault_apply(&armed);
+		fault.rng = armed.seed;
+		fault.held_valid = 0;
+
+		int64_t t0 = esp_timer_get_time();
+		for (uint32_t i = 0; i < CAN_FAULT_BENCH_FRAMES; i++) {
+			can_fault_frame(&frames[i & 3], 0, 0, can_fault_bench_tx);
+		}
+		int64_t t1 = esp_timer_get_time();
+		ns[run] = (uint32_t)((t1 - t0) * 1000 / CAN_FAULT_BENCH_FRAMES);
+	}
+
+	fault = saved;
+	can_fault_active = active;
+	tx_sched_release();
+
+	for (uint8_t run = 0; run < 2; run++) {
+		//ns per frame times frames per second, in 0.01% of one core
+		uint32_t load_500k = (uint32_t)((uint64_t)ns[run] * CAN_FAULT_MAX_FPS_500K / 100000);
+		printf("%s: %u ns/frame, %u.%02u%% CPU at full 500kbit/s load, "
+				"%u.%02u%% at 1Mbit/s\n", run?"armed (100 permille each)":"disabled",
+				ns[run], load_500k / 100, load_500k % 100,
+				load_500k * 2 / 100, load_500k * 2 % 100);
+	}
+}
+
+#endif //CONFIG_CAR_EMU_FAULT
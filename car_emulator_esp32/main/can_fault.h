@@ -0,0 +1,97 @@
+/*
+ * can_fault.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+
+#ifndef __CAN_FAULT_H_
+#define __CAN_FAULT_H_
+
+#include <stdint.h>
+
+#include "can-tp.h"
+
+/*
+ * Fault injection between the CAN-TP glue and the CAN driver, to certify
+ * testers against a misbehaving ECU. Every transmitted frame (optionally
+ * only one ID) draws from a seeded xorshift32 generator against the
+ * probability of each fault, so the same seed and the same traffic give
+ * the same faults. "fault=on" restarts the sequence from the seed.
+ *
+ * The generator, the reorder slot and the counters are only touched by
+ * the bus owner (tx_sched), so no lock is needed. With
+ * CONFIG_CAR_EMU_FAULT unset the stage compiles away, otherwise a
+ * disabled stage costs one load and branch per frame.
+ */
+typedef enum {
+	CAN_FAULT_DROP = 0,		//frame silently not sent
+	CAN_FAULT_DELAY,		//sent delay_us late
+	CAN_FAULT_DUP,			//sent twice
+	CAN_FAULT_REORDER,		//held back and sent after the next frame
+	CAN_FAULT_SN,			//Consecutive Frame with a wrong sequence number
+	CAN_FAULT_DLC,			//sent with a wrong DLC
+	CAN_FAULT_FC,			//Flow Control withheld
+	CAN_FAULT_JITTER,		//Single/First Frame delayed by 0..jitter_us
+	CAN_FAULT_NUM
+} can_fault_type_t;
+
+//Shortest 11 bit frame (DLC 0) incl. interframe space: 47 bits
+#define CAN_FAULT_MAX_FPS_500K		(500000 / 47)
+
+typedef struct can_fault_cfg_s {
+	uint32_t seed;
+	uint32_t id;			//0 applies the faults to every ID
+	uint16_t permille[CAN_FAULT_NUM];
+	uint32_t delay_us;
+	uint32_t jitter_us;
+} can_fault_cfg_t;
+
+typedef struct can_fault_stats_s {
+	uint32_t frames;		//frames which drew faults
+	uint32_t injected[CAN_FAULT_NUM];
+} can_fault_stats_t;
+
+//Puts one frame on the bus, cantp_can_drv_tx() outside the benchmark
+typedef int (*can_fault_tx_t)(const cantp_can_frame_t *frame, uint8_t wait, long tout_us);
+
+extern volatile uint8_t can_fault_active;
+
+//Returned for a frame the stage dropped or held back, no TX done will follow
+#define CAN_FAULT_TX_CONSUMED		1
+
+//Returns what tx() returned, or CAN_FAULT_TX_CONSUMED when it was not called
+int can_fault_tx(const cantp_can_frame_t *frame, uint8_t wait, long tout_us,
+		can_fault_tx_t tx);
+
+static inline int can_fault_frame(const cantp_can_frame_t *frame, uint8_t wait,
+		long tout_us, can_fault_tx_t tx)
+{
+#ifdef CONFIG_CAR_EMU_FAULT
+	if (can_fault_active) {
+		return can_fault_tx(frame, wait, tout_us, tx);
+	}
+#endif
+	return tx(frame, wait, tout_us);
+}
+
+void can_fault_cfg_get(can_fault_cfg_t *cfg);
+
+void can_fault_cfg_set(const can_fault_cfg_t *cfg);
+
+//Reseeds the generator and clears the counters
+void can_fault_start(void);
+
+void can_fault_stop(void);
+
+void can_fault_stats_get(can_fault_stats_t *stats);
+
+void can_fault_print(void);
+
+//Console entry, args is "" (status), "=on", "=off" or "=NAME:VALUE"
+void can_fault_cmd(const char *args);
+
+//Cost per frame disabled and with every fault armed, at full bus load
+void can_fault_bench(void);
+
+#endif /* __CAN_FAULT_H_ */
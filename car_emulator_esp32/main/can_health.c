@@ -0,0 +1,341 @@
+/*
+ * can_health.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+
+#include "emu_tasks.h"
+#include "can_health.h"
+
+#define TAG             "CAN_HEALTH"
+
+#define CAN_HEALTH_CHECK_MS		10
+
+static can_health_t health;
+static SemaphoreHandle_t tx_done;
+//TX sequence numbers: frames queued by the bus owners, and done of those
+static volatile uint32_t tx_queued;
+static volatile uint32_t tx_seen;
+//Last frame queued when a TX failed
+static volatile uint32_t tx_failed;
+
+static const char *can_health_state_str[] = {
+	"OK", "WARN", "PASSIVE", "RECOVERING"
+};
+
+void can_health_handle(can_health_t *h, uint32_t alerts)
+{
+	if (alerts & TWAI_ALERT_TX_FAILED) {
+		h->stats.tx_failed++;
+	}
+	if (alerts & TWAI_ALERT_BUS_ERROR) {
+		h->stats.bus_errors++;
+	}
+	if (alerts & TWAI_ALERT_ARB_LOST) {
+		h->stats.arb_lost++;
+	}
+	if (alerts & TWAI_ALERT_RX_QUEUE_FULL) {
+		h->stats.rx_queue_full++;
+	}
+	if (alerts & TWAI_ALERT_RX_FIFO_OVERRUN) {
+		h->stats.rx_overrun++;
+	}
+
+	if (h->state != CAN_HEALTH_RECOVERING) {
+		if (alerts & TWAI_ALERT_ABOVE_ERR_WARN) {
+			h->stats.err_warn++;
+			if (h->state == CAN_HEALTH_OK) {
+				h->state = CAN_HEALTH_WARN;
+			}
+		}
+		if (alerts & TWAI_ALERT_ERR_PASS) {
+			h->stats.err_passive++;
+			h->state = CAN_HEALTH_PASSIVE;
+		}
+		if ((alerts & TWAI_ALERT_ERR_ACTIVE) && h->state == CAN_HEALTH_PASSIVE) {
+			h->state = CAN_HEALTH_WARN;
+		}
+		if (alerts & TWAI_ALERT_BELOW_ERR_WARN) {
+			h->state = CAN_HEALTH_OK;
+		}
+	}
+
+	if (alerts & TWAI_ALERT_BUS_OFF) {
+		h->stats.bus_off++;
+		h->state = CAN_HEALTH_RECOVERING;
+		h->bus_off_us = h->ops->now();
+		if (h->ops->recover() < 0) {
+			//The bound check resets the controller
+			h->bus_off_us -= (int64_t)h->recovery_ms * 1000;
+		}
+	}
+	if ((alerts & TWAI_ALERT_BUS_RECOVERED) && h->state == CAN_HEALTH_RECOVERING) {
+		if (h->ops->start() < 0) {
+			h->bus_off_us -= (int64_t)h->recovery_ms * 1000;
+			return;
+		}
+		h->stats.recoveries++;
+		h->stats.last_recovery_us = h->ops->now() - h->bus_off_us;
+		if (h->stats.last_recovery_us > h->stats.max_recovery_us) {
+			h->stats.max_recovery_us = h->stats.last_recovery_us;
+		}
+		h->state = CAN_HEALTH_OK;
+	}
+}
+
+void can_health_check(can_health_t *h)
+{
+	if (h->state != CAN_HEALTH_RECOVERING) {
+		return;
+	}
+	int64_t now = h->ops->now();
+	if (now - h->bus_off_us < (int64_t)h->recovery_ms * 1000) {
+		return;
+	}
+	h->stats.resets++;
+	h->ops->reset();
+	//Only reached when reset() does not restart the chip
+	h->stats.last_recovery_us = now - h->bus_off_us;
+	if (h->stats.last_recovery_us > h->stats.max_recovery_us) {
+		h->stats.max_recovery_us = h->stats.last_recovery_us;
+	}
+	h->state = CAN_HEALTH_OK;
+}
+
+static int can_health_twai_recover(void)
+{
+	return (twai_initiate_recovery() == ESP_OK)?0:-1;
+}
+
+static int can_health_twai_start(void)
+{
+	return (twai_start() == ESP_OK)?0:-1;
+}
+
+static void can_health_twai_reset(void)
+{
+	ESP_LOGE(TAG, "Bus-off recovery did not finish in %d ms, restarting",
+			CONFIG_CAR_EMU_HEALTH_RECOVERY_MS);
+	esp_restart();
+}
+
+static const can_health_ops_t can_health_twai_ops = {
+	.recover = can_health_twai_recover,
+	.start = can_health_twai_start,
+	.reset = can_health_twai_reset,
+	.now = esp_timer_get_time
+};
+
+/*
+ * Every frame queued up to tx_queued is done once the driver has none
+ * left to send. Also run without alerts, for a TX done which came before
+ * its frame was numbered.
+ */
+static void can_health_tx_check(uint32_t alerts)
+{
+	twai_status_info_t status;
+	uint32_t queued = tx_queued;
+
+	if (queued == tx_seen || twai_get_status_info(&status) != ESP_OK) {
+		return;
+	}
+	if (alerts & (TWAI_ALERT_TX_FAILED | TWAI_ALERT_BUS_OFF)) {
+		tx_failed = queued;
+	}
+	if (status.msgs_to_tx == 0) {
+		tx_seen = queued;
+		xSemaphoreGive(tx_done);
+	}
+}
+
+static void can_health_task(void *arg)
+{
+	while (1) {
+		uint32_t alerts = 0;
+		if (twai_read_alerts(&alerts, pdMS_TO_TICKS(CAN_HEALTH_CHECK_MS)) != ESP_OK) {
+			alerts = 0;
+		}
+		can_health_tx_check(alerts);
+		if (alerts != 0) {
+			can_health_handle(&health, alerts);
+			if (alerts & TWAI_ALERT_BUS_OFF) {
+				emu_logf("CAN bus-off, recovering\n");
+			}
+			if (alerts & TWAI_ALERT_BUS_RECOVERED) {
+				emu_logf("CAN recovered from bus-off in %lld us\n",
+						health.stats.last_recovery_us);
+			}
+		}
+		can_health_check(&health);
+	}
+}
+
+int can_health_start(void)
+{
+	health.ops = &can_health_twai_ops;
+	health.recovery_ms = CONFIG_CAR_EMU_HEALTH_RECOVERY_MS;
+	tx_done = xSemaphoreCreateBinary();
+	if (tx_done == NULL) {
+		return -1;
+	}
+	if (twai_reconfigure_alerts(CAN_HEALTH_ALERTS, NULL) != ESP_OK) {
+		return -1;
+	}
+	return (emu_task_create(can_health_task, "can_health", 3 * 1024, NULL, 5,
+							EMU_CORE_CAN, NULL) == pdPASS)?0:-1;
+}
+
+uint32_t can_health_tx_sent(void)
+{
+	return ++tx_queued;
+}
+
+int can_health_tx_wait(uint32_t seq, uint32_t tout_us)
+{
+	//Rounded up, plus the part of the current tick which is already gone
+	TickType_t ticks = (tout_us == 0)?portMAX_DELAY:
+			(tout_us + portTICK_PERIOD_MS * 1000 - 1) / (portTICK_PERIOD_MS * 1000) + 1;
+	TimeOut_t tout;
+
+	vTaskSetTimeOutState(&tout);
+	//The semaphore may still hold the give of an earlier frame
+	while ((int32_t)(tx_seen - seq) < 0) {
+		if (xTaskCheckForTimeOut(&tout, &ticks) != pdFALSE ||
+			xSemaphoreTake(tx_done, ticks) != pdTRUE) {
+			return -1;
+		}
+	}
+	return ((int32_t)(tx_failed - seq) >= 0)?-1:0;
+}
+
+void can_health_stats_get(can_health_stats_t *stats)
+{
+	*stats = health.stats;
+}
+
+static void can_health_print(const can_health_t *h)
+{
+	const can_health_stats_t *s = &h->stats;
+	printf("state=%s tx_failed=%u bus_errors=%u arb_lost=%u warn=%u passive=%u\n"
+			"bus_off=%u recoveries=%u resets=%u recovery last=%lld max=%lld us\n"
+			"rx_queue_full=%u rx_overrun=%u\n",
+			can_health_state_str[h->state], s->tx_failed, s->bus_errors, s->arb_lost,
+			s->err_warn, s->err_passive, s->bus_off, s->recoveries, s->resets,
+			s->last_recovery_us, s->max_recovery_us, s->rx_queue_full, s->rx_overrun);
+}
+
+void can_health_stats_print(void)
+{
+	twai_status_info_t status;
+
+	printf("\nCAN health: ");
+	can_health_print(&health);
+	if (twai_get_status_info(&status) == ESP_OK) {
+		printf("TEC=%u REC=%u rx_missed=%u\n", status.tx_error_counter,
+				status.rx_error_counter, status.rx_missed_count);
+	}
+}
+
+/*
+ * Simulated controller on a virtual clock. recover() schedules the
+ * BUS_RECOVERED alert after the scenario's recovery delay, a negative
+ * delay models a bus that never releases (e.g. stuck dominant).
+ */
+static int64_t sim_now_us;
+static int64_t sim_recovered_at_us;
+static int64_t sim_recovery_delay_us;
+
+static int can_health_sim_recover(void)
+{
+	if (sim_recovery_delay_us >= 0) {
+		sim_recovered_at_us = sim_now_us + sim_recovery_delay_us;
+	}
+	return 0;
+}
+
+static int can_health_sim_start(void)
+{
+	return 0;
+}
+
+static void can_health_sim_reset(void)
+{
+	sim_recovered_at_us = -1;
+}
+
+static int64_t can_health_sim_now(void)
+{
+	return sim_now_us;
+}
+
+static const can_health_ops_t can_health_sim_ops = {
+	.recover = can_health_sim_recover,
+	.start = can_health_sim_start,
+	.reset = can_health_sim_reset,
+	.now = can_health_sim_now
+};
+
+typedef struct can_health_scenario_s {
+	const char *name;
+	int64_t recovery_delay_us;
+	uint32_t events[6];			//one set of alerts per ms, 0 terminated
+} can_health_scenario_t;
+
+static const can_health_scenario_t scenarios[] = {
+	//128 x 11 recessive bits at 500 kbit/s
+	{ "bus-off on an idle bus", 2816,
+		{ TWAI_ALERT_ABOVE_ERR_WARN, TWAI_ALERT_ERR_PASS, TWAI_ALERT_BUS_OFF } },
+	{ "bus-off on a busy bus", 45000,
+		{ TWAI_ALERT_BUS_ERROR, TWAI_ALERT_ERR_PASS, TWAI_ALERT_BUS_OFF } },
+	{ "bus-off, bus stuck dominant", -1,
+		{ TWAI_ALERT_BUS_ERROR, TWAI_ALERT_BUS_OFF } },
+	{ "error passive and back", -1,
+		{ TWAI_ALERT_ABOVE_ERR_WARN, TWAI_ALERT_ERR_PASS, TWAI_ALERT_BUS_ERROR,
+		  TWAI_ALERT_ERR_ACTIVE, TWAI_ALERT_BELOW_ERR_WARN } },
+	{ "RX queue full burst", -1,
+		{ TWAI_ALERT_RX_QUEUE_FULL, TWAI_ALERT_RX_QUEUE_FULL,
+		  TWAI_ALERT_RX_QUEUE_FULL | TWAI_ALERT_RX_FIFO_OVERRUN } },
+	{ "TX failure and lost arbitration", -1,
+		{ TWAI_ALERT_ARB_LOST, TWAI_ALERT_ARB_LOST, TWAI_ALERT_TX_FAILED } },
+};
+
+void can_health_sim(void)
+{
+	for (uint8_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+		const can_health_scenario_t *sc = &scenarios[i];
+		can_health_t h = {
+				.ops = &can_health_sim_ops,
+				.recovery_ms = CONFIG_CAR_EMU_HEALTH_RECOVERY_MS
+		};
+		sim_now_us = 0;
+		sim_recovered_at_us = -1;
+		sim_recovery_delay_us = sc->recovery_delay_us;
+
+		for (uint32_t ms = 0; ms < 2 * CONFIG_CAR_EMU_HEALTH_RECOVERY_MS; ms++) {
+			sim_now_us = (int64_t)ms * 1000;
+			if (ms < 6 && sc->events[ms] != 0) {
+				can_health_handle(&h, sc->events[ms]);
+			}
+			if (sim_recovered_at_us >= 0 && sim_now_us >= sim_recovered_at_us) {
+				sim_recovered_at_us = -1;
+				can_health_handle(&h, TWAI_ALERT_BUS_RECOVERED);
+			}
+			if (ms % CAN_HEALTH_CHECK_MS == 0) {
+				can_health_check(&h);
+			}
+		}
+		printf("\n%s:\n", sc->name);
+		can_health_print(&h);
+	}
+}
@@ -0,0 +1,91 @@
+/*
+ * can_health.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+
+#ifndef __CAN_HEALTH_H_
+#define __CAN_HEALTH_H_
+
+#include <stdint.h>
+
+#include "driver/twai.h"
+
+/*
+ * CAN controller health monitor. Its task is the only reader of the TWAI
+ * alerts: TX completion is passed on to the transmitting task, errors are
+ * counted and bus-off is recovered automatically. If the controller does
+ * not come back within CONFIG_CAR_EMU_HEALTH_RECOVERY_MS the chip is
+ * restarted, which brings it back with the configuration saved in NVS.
+ */
+#define CAN_HEALTH_ALERTS	(TWAI_ALERT_TX_SUCCESS | TWAI_ALERT_TX_FAILED | \
+							TWAI_ALERT_BUS_ERROR | TWAI_ALERT_ARB_LOST | \
+							TWAI_ALERT_ABOVE_ERR_WARN | TWAI_ALERT_BELOW_ERR_WARN | \
+							TWAI_ALERT_ERR_PASS | TWAI_ALERT_ERR_ACTIVE | \
+							TWAI_ALERT_BUS_OFF | TWAI_ALERT_BUS_RECOVERED | \
+							TWAI_ALERT_RX_QUEUE_FULL | TWAI_ALERT_RX_FIFO_OVERRUN)
+
+typedef enum {
+	CAN_HEALTH_OK = 0,
+	CAN_HEALTH_WARN,			//an error counter is above 96
+	CAN_HEALTH_PASSIVE,			//an error counter is above 127
+	CAN_HEALTH_RECOVERING		//bus-off, waiting for 128 x 11 recessive bits
+} can_health_state_t;
+
+typedef struct can_health_stats_s {
+	uint32_t tx_failed;
+	uint32_t bus_errors;
+	uint32_t arb_lost;
+	uint32_t err_warn;
+	uint32_t err_passive;
+	uint32_t bus_off;
+	uint32_t recoveries;
+	uint32_t resets;			//recovery took too long
+	uint32_t rx_queue_full;
+	uint32_t rx_overrun;
+	int64_t last_recovery_us;	//bus-off to running again
+	int64_t max_recovery_us;
+} can_health_stats_t;
+
+//Controller actions, replaced by the simulation
+typedef struct can_health_ops_s {
+	int (*recover)(void);		//start bus-off recovery
+	int (*start)(void);			//restart the controller after recovery
+	void (*reset)(void);		//recovery did not finish in time
+	int64_t (*now)(void);
+} can_health_ops_t;
+
+typedef struct can_health_s {
+	const can_health_ops_t *ops;
+	can_health_state_t state;
+	int64_t bus_off_us;
+	uint32_t recovery_ms;
+	can_health_stats_t stats;
+} can_health_t;
+
+//Processes one set of alerts
+void can_health_handle(can_health_t *h, uint32_t alerts);
+
+//Enforces the recovery bound, called periodically
+void can_health_check(can_health_t *h);
+
+int can_health_start(void);
+
+/*
+ * TX completion for the frames sent by the bus owner. can_health_tx_sent()
+ * numbers a frame once twai_transmit() queued it, can_health_tx_wait()
+ * waits for the frame with that number. Returns 0 on TX success, -1 on
+ * failure, bus-off or timeout.
+ */
+uint32_t can_health_tx_sent(void);
+int can_health_tx_wait(uint32_t seq, uint32_t tout_us);
+
+void can_health_stats_get(can_health_stats_t *stats);
+
+void can_health_stats_print(void);
+
+//Runs the fault scenarios against a simulated controller
+void can_health_sim(void);
+
+#endif /* __CAN_HEALTH_H_ */
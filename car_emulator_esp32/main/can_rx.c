@@ -0,0 +1,332 @@
+/*
+ * can_rx.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "driver/twai.h"
+
+#include "cantp_esp32.h"
+#include "car_emulator.h"
+#include "emu_tasks.h"
+#include "spsc_ring.h"
+#include "can_stats.h"
+#include "can_rx.h"
+
+#define TAG             "CAN_RX"
+
+#ifdef CONFIG_CAR_EMU_RX_RING
+static can_rx_entry_t rx_buf[EMU_CAN_RX_RING_LEN];
+static spsc_ring_t rx_ring;
+static can_rx_stats_t stats;
+static TaskHandle_t consumer;
+
+static void can_rx_pump_task(void *arg)
+{
+	cantp_can_frame_t frame;
+
+	while (1) {
+		if (cantp_can_drv_rx(&frame, 0) < 0) {
+			continue;
+		}
+		can_rx_entry_t *e = spsc_ring_reserve(&rx_ring);
+		if (e == NULL) {
+			//Counted in rx_ring.drops
+			continue;
+		}
+		e->frame = frame;
+		e->rx_us = esp_timer_get_time();
+		spsc_ring_commit(&rx_ring);
+		stats.frames++;
+		uint32_t n = spsc_ring_count(&rx_ring);
+		if (n > stats.peak) {
+			stats.peak = n;
+		}
+		TaskHandle_t c = __atomic_load_n(&consumer, __ATOMIC_ACQUIRE);
+		if (c != NULL) {
+			xTaskNotifyGive(c);
+		}
+	}
+}
+
+int can_rx_start(void)
+{
+	spsc_ring_init(&rx_ring, rx_buf, sizeof(can_rx_entry_t), EMU_CAN_RX_RING_LEN);
+	return (emu_task_create(can_rx_pump_task, "can_rx", 2 * 1024, NULL,
+			CAN_RX_PUMP_PRIO, EMU_CORE_CAN, NULL) == pdPASS)?0:-1;
+}
+
+uint32_t can_rx_wait(uint32_t max, TickType_t ticks)
+{
+	__atomic_store_n(&consumer, xTaskGetCurrentTaskHandle(), __ATOMIC_RELEASE);
+	uint32_t n = spsc_ring_count(&rx_ring);
+	if (n == 0) {
+		//Notifications of frames already taken only cause an empty batch
+		ulTaskNotifyTake(pdTRUE, ticks);
+		n = spsc_ring_count(&rx_ring);
+	}
+	if (n == 0) {
+		return 0;
+	}
+	if (n > max) {
+		n = max;
+	}
+	uint32_t wait_us = (uint32_t)(esp_timer_get_time() - can_rx_peek(0)->rx_us);
+	if (wait_us > stats.max_wait_us) {
+		stats.max_wait_us = wait_us;
+	}
+	stats.batches++;
+	if (n > stats.max_batch) {
+		stats.max_batch = n;
+	}
+	return n;
+}
+
+can_rx_entry_t *can_rx_peek(uint32_t idx)
+{
+	return (can_rx_entry_t *)spsc_ring_peek(&rx_ring, idx);
+}
+
+void can_rx_release(uint32_t n)
+{
+	spsc_ring_release(&rx_ring, n);
+}
+
+void can_rx_stats_get(can_rx_stats_t *st)
+{
+	*st = stats;
+	st->drops = rx_ring.drops;
+}
+
+void can_rx_print(void)
+{
+	can_rx_stats_t st;
+
+	can_rx_stats_get(&st);
+	printf("\nRX ring: frames=%u drops=%u peak=%u/%u batches=%u (avg %u, max %u) "
+			"max wait=%uus\n", st.frames, st.drops, st.peak, EMU_CAN_RX_RING_LEN,
+			st.batches, (st.batches > 0) ? st.frames / st.batches : 0, st.max_batch,
+			st.max_wait_us);
+#if ESP32_IDF_CAN_HAL
+	twai_status_info_t status;
+	if (twai_get_status_info(&status) == ESP_OK) {
+		printf("Driver queue: %u/%u pending, rx_missed=%u, ISR in %s\n",
+				status.msgs_to_rx, EMU_CAN_RX_DRV_QUEUE_LEN, status.rx_missed_count,
+#ifdef CONFIG_TWAI_ISR_IN_IRAM
+				"IRAM");
+#else
+				"flash");
+#endif
+	}
+#endif
+}
+
+/*
+ * Virtual clock model of both receive paths. The controller buffers
+ * CAN_RX_SIM_HW_FIFO frames (64 byte FIFO, 11 bit IDs with 8 bytes); the
+ * ISR moves them to the driver queue unless the flash cache is off and
+ * it is not in IRAM. Dispatching costs CAN_RX_SIM_WAKE_US per wakeup
+ * plus CAN_RX_SIM_FRAME_US per frame; the pump preempts the dispatcher
+ * for CAN_RX_SIM_PUMP_US per frame. The ring is the real spsc_ring_t.
+ */
+#define CAN_RX_SIM_HW_FIFO		5
+#define CAN_RX_SIM_WAKE_US		25
+#define CAN_RX_SIM_FRAME_US		100
+#define CAN_RX_SIM_PUMP_US		8
+#define CAN_RX_SIM_QUEUE_MAX	256
+
+typedef struct can_rx_sim_path_s {
+	const char *name;
+	uint8_t isr_in_iram;
+	uint32_t drv_queue;
+	uint32_t ring;				//0: the dispatcher reads the driver queue
+	uint32_t batch;
+} can_rx_sim_path_t;
+
+typedef struct can_rx_sim_case_s {
+	const char *name;
+	uint32_t bitrate;
+	uint32_t frames;			//back-to-back, 11 bit IDs, 8 bytes
+	int64_t block_at_us;
+	int64_t block_us;
+	uint8_t flash;				//cache off: only IRAM code runs, no task
+} can_rx_sim_case_t;
+
+typedef struct can_rx_sim_res_s {
+	uint32_t delivered;
+	uint32_t hw_overrun;
+	uint32_t drv_missed;
+	uint32_t ring_drops;
+	uint32_t peak;
+	int64_t max_wait_us;		//on the bus to dispatched
+} can_rx_sim_res_t;
+
+//Arrival times of the frames waiting in the FIFO or the driver queue
+typedef struct can_rx_sim_q_s {
+	int64_t t[CAN_RX_SIM_QUEUE_MAX];
+	uint32_t cap;
+	uint32_t head;
+	uint32_t n;
+} can_rx_sim_q_t;
+
+static int can_rx_sim_q_push(can_rx_sim_q_t *q, int64_t t)
+{
+	if (q->n == q->cap) {
+		return -1;
+	}
+	q->t[(q->head + q->n) % CAN_RX_SIM_QUEUE_MAX] = t;
+	q->n++;
+	return 0;
+}
+
+static int64_t can_rx_sim_q_pop(can_rx_sim_q_t *q)
+{
+	int64_t t = q->t[q->head];
+	q->head = (q->head + 1) % CAN_RX_SIM_QUEUE_MAX;
+	q->n--;
+	return t;
+}
+
+static void can_rx_sim_run(const can_rx_sim_case_t *c, const can_rx_sim_path_t *p,
+		can_rx_sim_q_t *q, can_rx_entry_t *ring_buf, can_rx_sim_res_t *res)
+{
+	can_rx_sim_q_t *hw = &q[0];
+	can_rx_sim_q_t *drv = &q[1];
+	spsc_ring_t ring;
+	uint32_t frame_us = can_stats_frame_bits(0, 8) * 1000000 / c->bitrate;
+	int64_t busy_until = 0;
+	uint32_t next = 0;
+
+	memset(res, 0, sizeof(can_rx_sim_res_t));
+	memset(q, 0, 2 * sizeof(can_rx_sim_q_t));
+	hw->cap = CAN_RX_SIM_HW_FIFO;
+	drv->cap = (p->drv_queue < CAN_RX_SIM_QUEUE_MAX) ? p->drv_queue : CAN_RX_SIM_QUEUE_MAX;
+	if (p->ring > 0) {
+		spsc_ring_init(&ring, ring_buf, sizeof(can_rx_entry_t), p->ring);
+	}
+	for (int64_t t = 0; ; t++) {
+		if (next < c->frames && t >= (int64_t)next * frame_us) {
+			if (can_rx_sim_q_push(hw, t) < 0) {
+				res->hw_overrun++;
+			}
+			next++;
+		}
+		uint8_t stalled = c->flash && t >= c->block_at_us &&
+							t < c->block_at_us + c->block_us;
+		if (!c->flash && t == c->block_at_us && busy_until < t + c->block_us) {
+			//Dispatcher waiting for its response to go out
+			busy_until = t + c->block_us;
+		}
+		if (!stalled || p->isr_in_iram) {
+			while (hw->n > 0) {
+				int64_t at = can_rx_sim_q_pop(hw);
+				if (can_rx_sim_q_push(drv, at) < 0) {
+					res->drv_missed++;
+				}
+			}
+			if (p->ring == 0 && drv->n > res->peak) {
+				res->peak = drv->n;
+			}
+		}
+		if (stalled) {
+			if (busy_until > t) {
+				busy_until++;
+			}
+		} else {
+			while (p->ring > 0 && drv->n > 0) {
+				int64_t at = can_rx_sim_q_pop(drv);
+				can_rx_entry_t *e = spsc_ring_reserve(&ring);
+				if (e != NULL) {
+					e->rx_us = at;
+					spsc_ring_commit(&ring);
+				}
+				busy_until = ((busy_until > t) ? busy_until : t) + CAN_RX_SIM_PUMP_US;
+				if (spsc_ring_count(&ring) > res->peak) {
+					res->peak = spsc_ring_count(&ring);
+				}
+			}
+			if (t >= busy_until) {
+				uint32_t n = 0;
+				if (p->ring > 0) {
+					n = spsc_ring_count(&ring);
+					n = (n > p->batch) ? p->batch : n;
+					for (uint32_t i = 0; i < n; i++) {
+						can_rx_entry_t *e = spsc_ring_peek(&ring, i);
+						if (t - e->rx_us > res->max_wait_us) {
+							res->max_wait_us = t - e->rx_us;
+						}
+					}
+					spsc_ring_release(&ring, n);
+				} else if (drv->n > 0) {
+					int64_t at = can_rx_sim_q_pop(drv);
+					if (t - at > res->max_wait_us) {
+						res->max_wait_us = t - at;
+					}
+					n = 1;
+				}
+				if (n > 0) {
+					res->delivered += n;
+					busy_until = t + CAN_RX_SIM_WAKE_US + n * CAN_RX_SIM_FRAME_US;
+				}
+			}
+		}
+		if (next == c->frames && hw->n == 0 && drv->n == 0 &&
+			(p->ring == 0 || spsc_ring_count(&ring) == 0)) {
+			break;
+		}
+	}
+	if (p->ring > 0) {
+		res->ring_drops = ring.drops;
+	}
+}
+
+void can_rx_sim(void)
+{
+	static const can_rx_sim_case_t cases[] = {
+			{ "500k 300 frames, 5 ms TX wait", 500000, 300, 2000, 5000, 0 },
+			{ "500k 300 frames, 30 ms erase", 500000, 300, 2000, 30000, 1 },
+			{ "1M 2000 frames, 5 ms TX wait", 1000000, 2000, 10000, 5000, 0 },
+			{ "1M 2000 frames, no stall", 1000000, 2000, 0, 0, 0 }
+	};
+	const can_rx_sim_path_t paths[] = {
+			{ "queue", 0, 5, 0, 1 },
+			{ "ring", 1, EMU_CAN_RX_DRV_QUEUE_LEN, EMU_CAN_RX_RING_LEN, CAN_RX_BATCH }
+	};
+	can_rx_sim_q_t *q = malloc(2 * sizeof(can_rx_sim_q_t));
+	can_rx_entry_t *ring_buf = malloc(EMU_CAN_RX_RING_LEN * sizeof(can_rx_entry_t));
+
+	if (q == NULL || ring_buf == NULL) {
+		printf("\nNo memory for the simulation\n");
+		free(q);
+		free(ring_buf);
+		return;
+	}
+	printf("\nqueue: driver queue of 5, ISR in flash, one frame per wakeup\n"
+			"ring:  driver queue of %u, ISR in IRAM, ring of %u, batches of %u\n"
+			"%-30s %-5s %5s %6s %8s %9s %5s %9s\n", EMU_CAN_RX_DRV_QUEUE_LEN,
+			EMU_CAN_RX_RING_LEN, CAN_RX_BATCH, "case", "path", "lost", "hw_ovr",
+			"drv_miss", "ring_drop", "peak", "max wait");
+	for (uint8_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		for (uint8_t j = 0; j < sizeof(paths) / sizeof(paths[0]); j++) {
+			can_rx_sim_res_t res;
+			can_rx_sim_run(&cases[i], &paths[j], q, ring_buf, &res);
+			printf("%-30s %-5s %5u %6u %8u %9u %5u %7lldus\n", cases[i].name,
+					paths[j].name, cases[i].frames - res.delivered, res.hw_overrun,
+					res.drv_missed, res.ring_drops, res.peak, res.max_wait_us);
+		}
+	}
+	free(q);
+	free(ring_buf);
+}
+
+#endif //CONFIG_CAR_EMU_RX_RING
@@ -0,0 +1,66 @@
+/*
+ * can_rx.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+
+#ifndef __CAN_RX_H_
+#define __CAN_RX_H_
+
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "can-tp.h"
+#include "emu_profile.h"
+
+/*
+ * Receive path in two stages. The TWAI interrupt runs from IRAM
+ * (CONFIG_TWAI_ISR_IN_IRAM), so it keeps moving frames from the hardware
+ * FIFO into a deep driver queue (EMU_CAN_RX_DRV_QUEUE_LEN) while the
+ * flash cache is disabled by NVS or UDS download writes. The pump
+ * task, the highest priority task on the CAN core, moves them on into
+ * a lock-free SPSC ring with a receive timestamp, so a dispatcher busy
+ * sending a response does not back the driver queue up. The dispatcher
+ * takes whatever is pending as one batch.
+ */
+#define CAN_RX_PUMP_PRIO		6
+#define CAN_RX_BATCH			16
+
+typedef struct can_rx_entry_s {
+	cantp_can_frame_t frame;
+	int64_t rx_us;			//taken from the driver queue
+} can_rx_entry_t;
+
+typedef struct can_rx_stats_s {
+	uint32_t frames;		//put into the ring
+	uint32_t drops;			//ring full
+	uint32_t peak;			//highest ring occupancy
+	uint32_t batches;
+	uint32_t max_batch;
+	uint32_t max_wait_us;	//taken from the driver queue to dispatched
+} can_rx_stats_t;
+
+//Creates the ring and starts the pump, once the driver is running
+int can_rx_start(void);
+
+/*
+ * Dispatcher side: waits up to ticks for frames and returns how many,
+ * at most max, can be read with can_rx_peek() before can_rx_release().
+ */
+uint32_t can_rx_wait(uint32_t max, TickType_t ticks);
+can_rx_entry_t *can_rx_peek(uint32_t idx);
+void can_rx_release(uint32_t n);
+
+void can_rx_stats_get(can_rx_stats_t *st);
+void can_rx_print(void);
+
+/*
+ * Burst scenarios (back-to-back frames, blocked dispatcher, flash
+ * erase) on a virtual clock, comparing the old single-frame path
+ * (5 frame driver queue, ISR in flash) with this one.
+ */
+void can_rx_sim(void);
+
+#endif /* __CAN_RX_H_ */
@@ -0,0 +1,271 @@
+/*
+ * can_stats.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "can_stats.h"
+
+#define TAG             "STATS"
+
+#ifdef CONFIG_CAR_EMU_BUS_STATS
+
+typedef struct can_stats_slot_s {
+	volatile uint32_t seq;		//odd while the dispatcher updates the entry
+	can_stats_id_t s;
+} can_stats_slot_t;
+
+typedef struct can_stats_s {
+	can_stats_slot_t table[CAN_STATS_TABLE_SIZE];
+	uint8_t count;
+	volatile uint8_t reset_req;
+	uint32_t bitrate;
+	//Written by the dispatcher
+	volatile uint32_t rx_frames;
+	volatile uint32_t untracked;
+	volatile uint32_t rx_bits;
+	volatile int64_t since_us;
+	volatile int64_t win_start_us;
+	volatile uint32_t win_bits;
+	volatile uint16_t load_permille;
+	volatile uint16_t peak_permille;
+	//Written by the bus owner, counted from the bases set on reset
+	volatile uint32_t tx_frames;
+	volatile uint32_t tx_bits;
+	volatile uint32_t tx_frames_base;
+	volatile uint32_t tx_bits_base;
+} can_stats_t;
+
+volatile uint8_t can_stats_active;
+
+static can_stats_t stats;
+static can_stats_id_t print_ids[CAN_STATS_MAX_IDS];
+
+static inline uint32_t can_stats_hash(uint32_t id, uint8_t idt)
+{
+	uint32_t key = id | ((uint32_t)idt << 31);
+	return (key * 0x9E3779B1) >> (32 - CAN_STATS_TABLE_BITS);
+}
+
+static inline void can_stats_write_begin(can_stats_slot_t *slot)
+{
+	__atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static inline void can_stats_write_end(can_stats_slot_t *slot)
+{
+	__atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELEASE);
+}
+
+static inline uint32_t can_stats_bits(void)
+{
+	return stats.rx_bits + (stats.tx_bits - stats.tx_bits_base);
+}
+
+static uint16_t can_stats_load(uint32_t bits, int64_t elapsed_us)
+{
+	if (elapsed_us <= 0 || stats.bitrate == 0) {
+		return 0;
+	}
+	uint64_t load = (uint64_t)bits * 1000000000ULL / ((uint64_t)stats.bitrate * elapsed_us);
+	return (load > 1000) ? 1000 : load;
+}
+
+//Runs on the dispatcher only
+static void can_stats_clear(int64_t now)
+{
+	for (uint16_t i = 0; i < CAN_STATS_TABLE_SIZE; i++) {
+		can_stats_slot_t *slot = &stats.table[i];
+		if (slot->s.used) {
+			can_stats_write_begin(slot);
+			memset(&slot->s, 0, sizeof(can_stats_id_t));
+			can_stats_write_end(slot);
+		}
+	}
+	stats.count = 0;
+	stats.rx_frames = 0;
+	stats.untracked = 0;
+	stats.rx_bits = 0;
+	stats.tx_frames_base = stats.tx_frames;
+	stats.tx_bits_base = stats.tx_bits;
+	stats.load_permille = 0;
+	stats.peak_permille = 0;
+	stats.win_bits = 0;
+	stats.win_start_us = now;
+	stats.since_us = now;
+}
+
+void can_stats_rx_put(uint32_t id, uint8_t idt, uint8_t dlc)
+{
+	int64_t now = esp_timer_get_time();
+	if (stats.reset_req) {
+		can_stats_clear(now);
+		stats.reset_req = 0;
+	}
+	uint8_t len = (dlc > 8) ? 8 : dlc;
+	stats.rx_frames++;
+	stats.rx_bits += can_stats_frame_bits(idt, len);
+
+	uint32_t i = can_stats_hash(id, idt);
+	can_stats_slot_t *slot = NULL;
+	while (stats.table[i].s.used) {
+		if (stats.table[i].s.id == id && stats.table[i].s.idt == idt) {
+			slot = &stats.table[i];
+			break;
+		}
+		i = (i + 1) & (CAN_STATS_TABLE_SIZE - 1);
+	}
+	if (slot == NULL && stats.count < CAN_STATS_MAX_IDS) {
+		slot = &stats.table[i];
+		can_stats_write_begin(slot);
+		slot->s.id = id;
+		slot->s.idt = idt;
+		slot->s.min_gap_us = UINT32_MAX;
+		slot->s.used = 1;
+		can_stats_write_end(slot);
+		stats.count++;
+	}
+	if (slot == NULL) {
+		stats.untracked++;
+	} else {
+		can_stats_write_begin(slot);
+		if (slot->s.frames > 0) {
+			uint32_t gap = now - slot->s.last_us;
+			if (gap < slot->s.min_gap_us) {
+				slot->s.min_gap_us = gap;
+			}
+			if (gap > slot->s.max_gap_us) {
+				slot->s.max_gap_us = gap;
+			}
+		}
+		slot->s.last_us = now;
+		slot->s.frames++;
+		slot->s.bytes += len;
+		can_stats_write_end(slot);
+	}
+
+	int64_t elapsed = now - stats.win_start_us;
+	if (elapsed >= CAN_STATS_WINDOW_US) {
+		uint32_t bits = can_stats_bits();
+		uint16_t load = can_stats_load(bits - stats.win_bits, elapsed);
+		stats.load_permille = load;
+		if (load > stats.peak_permille) {
+			stats.peak_permille = load;
+		}
+		stats.win_bits = bits;
+		stats.win_start_us = now;
+	}
+}
+
+void can_stats_tx_put(uint8_t idt, uint8_t dlc)
+{
+	stats.tx_frames++;
+	stats.tx_bits += can_stats_frame_bits(idt, dlc);
+}
+
+void can_stats_start(uint32_t bitrate)
+{
+	int64_t now = esp_timer_get_time();
+	stats.bitrate = bitrate;
+	can_stats_clear(now);
+	can_stats_active = 1;
+	ESP_LOGI(TAG, "Counting traffic at %u bit/s", bitrate);
+}
+
+void can_stats_reset(void)
+{
+	stats.reset_req = 1;
+}
+
+uint16_t can_stats_snapshot(can_stats_id_t *ids, uint16_t max, can_stats_bus_t *bus)
+{
+	uint16_t n = 0;
+	for (uint16_t i = 0; i < CAN_STATS_TABLE_SIZE && n < max; i++) {
+		can_stats_slot_t *slot = &stats.table[i];
+		uint32_t seq;
+		do {
+			seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+			memcpy(&ids[n], (const void *)&slot->s, sizeof(can_stats_id_t));
+			__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		} while ((seq & 1) || seq != __atomic_load_n(&slot->seq, __ATOMIC_RELAXED));
+		if (ids[n].used) {
+			n++;
+		}
+	}
+	if (bus != NULL) {
+		int64_t now = esp_timer_get_time();
+		bus->bitrate = stats.bitrate;
+		bus->rx_frames = stats.rx_frames;
+		bus->tx_frames = stats.tx_frames - stats.tx_frames_base;
+		bus->untracked = stats.untracked;
+		bus->bits = can_stats_bits();
+		bus->load_permille = stats.load_permille;
+		bus->peak_permille = stats.peak_permille;
+		bus->since_us = stats.since_us;
+		//No RX closing the window, e.g. an idle bus
+		int64_t elapsed = now - stats.win_start_us;
+		if (elapsed >= 2 * CAN_STATS_WINDOW_US) {
+			bus->load_permille = can_stats_load(bus->bits - stats.win_bits, elapsed);
+		}
+	}
+	return n;
+}
+
+void can_stats_print(void)
+{
+	can_stats_bus_t bus;
+	uint16_t n = can_stats_snapshot(print_ids, CAN_STATS_MAX_IDS, &bus);
+	int64_t elapsed = esp_timer_get_time() - bus.since_us;
+
+	//Busiest IDs first
+	for (uint16_t i = 1; i < n; i++) {
+		can_stats_id_t e = print_ids[i];
+		int16_t j = i - 1;
+		while (j >= 0 && print_ids[j].frames < e.frames) {
+			print_ids[j + 1] = print_ids[j];
+			j--;
+		}
+		print_ids[j + 1] = e;
+	}
+
+	printf("\nBus load %u.%u%% (peak %u.%u%%) at %u kbit/s over %lld s\n",
+			bus.load_permille / 10, bus.load_permille % 10,
+			bus.peak_permille / 10, bus.peak_permille % 10,
+			bus.bitrate / 1000, elapsed / 1000000);
+	printf("RX %u frames, TX %u frames, %u IDs, untracked %u\n",
+			bus.rx_frames, bus.tx_frames, n, bus.untracked);
+	printf("  ID         frames      bytes  fps    min/max gap ms\n");
+	for (uint16_t i = 0; i < n; i++) {
+		can_stats_id_t *e = &print_ids[i];
+		uint32_t fps = (elapsed > 0) ? (uint64_t)e->frames * 1000000 / elapsed : 0;
+		printf("  %0*X %*s%10u %10u %4u ", e->idt ? 8 : 3, e->id,
+				e->idt ? 0 : 5, "", e->frames, e->bytes, fps);
+		if (e->frames > 1) {
+			printf("  %u.%03u/%u.%03u\n", e->min_gap_us / 1000, e->min_gap_us % 1000,
+					e->max_gap_us / 1000, e->max_gap_us % 1000);
+		} else {
+			printf("  -\n");
+		}
+	}
+}
+
+void can_stats_cmd(const char *args)
+{
+	if (strcmp(args, "=reset") == 0) {
+		can_stats_reset();
+		printf("\nTraffic statistics cleared\n");
+	} else if (args[0] == 0) {
+		can_stats_print();
+	} else {
+		printf("\nWrong command\n");
+	}
+}
+
+#endif
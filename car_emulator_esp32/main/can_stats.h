@@ -0,0 +1,105 @@
+/*
+ * can_stats.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+
+#ifndef __CAN_STATS_H_
+#define __CAN_STATS_H_
+
+#include <stdint.h>
+
+#include "sdkconfig.h"
+
+/*
+ * Per-ID traffic statistics and bus load. Every received frame is
+ * counted by the dispatcher into a fixed open-addressing table (frames,
+ * bytes, min/max inter-arrival), in O(1) and without locks or
+ * allocation. Transmitted frames only count towards the bus load.
+ *
+ * Each table entry carries a sequence number, so the console or a host
+ * build reads a consistent copy of it while the dispatcher keeps going.
+ */
+#define CAN_STATS_TABLE_BITS	7
+#define CAN_STATS_TABLE_SIZE	(1 << CAN_STATS_TABLE_BITS)
+#define CAN_STATS_MAX_IDS		(CAN_STATS_TABLE_SIZE / 2)
+#define CAN_STATS_WINDOW_US		1000000
+
+typedef struct can_stats_id_s {
+	uint32_t id;
+	uint8_t idt;
+	uint8_t used;
+	uint32_t frames;
+	uint32_t bytes;
+	uint32_t min_gap_us;
+	uint32_t max_gap_us;
+	int64_t last_us;
+} can_stats_id_t;
+
+typedef struct can_stats_bus_s {
+	uint32_t bitrate;
+	uint32_t rx_frames;
+	uint32_t tx_frames;
+	uint32_t untracked;			//RX frames of IDs that did not fit the table
+	uint32_t bits;				//RX and TX, wraps
+	uint16_t load_permille;		//last complete window
+	uint16_t peak_permille;
+	int64_t since_us;			//start or last reset
+} can_stats_bus_t;
+
+extern volatile uint8_t can_stats_active;
+
+void can_stats_rx_put(uint32_t id, uint8_t idt, uint8_t dlc);
+
+void can_stats_tx_put(uint8_t idt, uint8_t dlc);
+
+//Called by the dispatcher for every received frame
+static inline void can_stats_rx(uint32_t id, uint8_t idt, uint8_t dlc)
+{
+#ifdef CONFIG_CAR_EMU_BUS_STATS
+	if (can_stats_active) {
+		can_stats_rx_put(id, idt, dlc);
+	}
+#endif
+}
+
+//Called by the bus owner for every transmitted frame
+static inline void can_stats_tx(uint8_t idt, uint8_t dlc)
+{
+#ifdef CONFIG_CAR_EMU_BUS_STATS
+	if (can_stats_active) {
+		can_stats_tx_put(idt, dlc);
+	}
+#endif
+}
+
+/*
+ * Bits on the wire for one data frame incl. interframe space, with the
+ * worst case stuff bits, so the bus load is an upper bound.
+ */
+static inline uint32_t can_stats_frame_bits(uint8_t idt, uint8_t dlc)
+{
+	uint32_t data = 8 * ((dlc > 8) ? 8 : dlc);
+	uint32_t stuffed = (idt ? 54 : 34) + data;
+	return stuffed + (stuffed - 1) / 4 + 13;
+}
+
+//Starts counting for the bus bitrate
+void can_stats_start(uint32_t bitrate);
+
+//Clears the counters, done by the dispatcher on its next frame
+void can_stats_reset(void);
+
+/*
+ * Copies up to max used entries into ids and the bus counters into bus.
+ * Returns the number of entries copied.
+ */
+uint16_t can_stats_snapshot(can_stats_id_t *ids, uint16_t max, can_stats_bus_t *bus);
+
+void can_stats_print(void);
+
+//Console entry, args is "" or "=reset"
+void can_stats_cmd(const char *args);
+
+#endif /* __CAN_STATS_H_ */
@@ -19,12 +19,54 @@
 #include "hal/twai_ll.h"
 
 #include "can_drv_esp32.h"
+#include "cantp_esp32.h"
 #include "can-tp.h"
 #include "obd.h"
 #include "car_emulator.h"
+#include "timer_wheel.h"
+#include "cantp_session.h"
+#include "cantp_txq.h"
+#include "can_capture.h"
+#include "can_health.h"
+#include "emu_mem.h"
+#include "can_fault.h"
+#include "can_stats.h"
+#include "emu_trace.h"
 
 #define TAG             "CANTP_ESP32"
 
+
+#ifdef CONFIG_CANTP_TIMER_WHEEL
+static timer_wheel_t cantp_tw;
+static esp_timer_handle_t cantp_tw_tick_timer;
+//The tick only runs while timers are pending, an idle bus costs no wakeups
+static portMUX_TYPE cantp_tw_tick_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint8_t cantp_tw_ticking;
+
+static void cantp_tw_tick_cb(void *arg)
+{
+	timer_wheel_tick(&cantp_tw);
+	//A timer started meanwhile saw cantp_tw_ticking set and needs the tick
+	portENTER_CRITICAL(&cantp_tw_tick_lock);
+	if (timer_wheel_pending(&cantp_tw) == 0) {
+		esp_timer_stop(cantp_tw_tick_timer);
+		cantp_tw_ticking = 0;
+	}
+	portEXIT_CRITICAL(&cantp_tw_tick_lock);
+}
+
+//After the timer is in the wheel, so a stopping tick sees it pending
+static void cantp_tw_tick_arm(void)
+{
+	portENTER_CRITICAL(&cantp_tw_tick_lock);
+	if (!cantp_tw_ticking) {
+		esp_timer_start_periodic(cantp_tw_tick_timer, CONFIG_CANTP_TIMER_WHEEL_TICK_US);
+		cantp_tw_ticking = 1;
+	}
+	portEXIT_CRITICAL(&cantp_tw_tick_lock);
+}
+#endif
+
 static const char *cantp_frame_t_enum_str[] = {
 		FOREACH_CANTP_N_PCI_TYPE(GENERATE_STRING)
 };
@@ -98,17 +140,86 @@ void cantp_received_cb(cantp_rxtx_status_t *ctx,
 	cantp_logi("\033[0;36mCAN-SL Receiver Received "
 			"from ID=0x%06x IDT=%d :\033[0m ", id, idt);
 	ectx->data = malloc(len);
+	if (ectx->data != NULL) {
+		emu_mem_rx_alloc(len);
+	}
 	for (uint16_t i = 0; i < len; i++) {
 		cantp_logi("0x%02x ", data[i]);
 		ectx->data[i] = data[i];
 	}
 	cantp_logi("\n"); fflush(0);
+	emu_trace(EMU_TRACE_OBD_BEGIN, id, len);
 	can_check_rx_frame(ectx);
+	emu_trace(EMU_TRACE_OBD_END, id, 0);
+}
+
+/*
+ * Task which sent with cantp_can_tx_nb() and keeps the bus until its
+ * cantp_sndr_wait_tx_done(), or until its lease runs out at N_As. Only
+ * the bus owner writes it.
+ */
+static TaskHandle_t tx_nb_owner;
+static uint32_t tx_nb_lease;
+//Its frame never reached the driver, so there is no TX done to wait for
+static uint8_t tx_nb_consumed;
+#if ESP32_IDF_CAN_HAL
+//TX sequence number of the last frame the bus owner queued
+static uint32_t tx_seq;
+#endif
+
+static inline void cantp_tx_end(void)
+{
+	tx_sched_release();
+}
+
+//Gives the bus back if the calling task still holds it from a send
+static inline void cantp_tx_nb_end(void)
+{
+	if (tx_nb_owner != NULL && tx_nb_owner == xTaskGetCurrentTaskHandle()) {
+		tx_nb_owner = NULL;
+		//Does nothing if a waiter already took the bus at the deadline
+		tx_sched_lease_end(tx_nb_lease);
+	}
+}
+
+static inline void cantp_tx_begin(uint32_t id, uint8_t idt, int64_t deadline_us)
+{
+	cantp_session_t *ses = cantp_session_current();
+	if (ses != NULL) {
+		cantp_session_touch(ses);
+	}
+	//Sent again without waiting for the previous frame
+	cantp_tx_nb_end();
+	tx_sched_acquire(id, idt, deadline_us);
+}
+
+int cantp_timer_wheel_start(void)
+{
+#ifdef CONFIG_CANTP_TIMER_WHEEL
+	timer_wheel_init(&cantp_tw, CONFIG_CANTP_TIMER_WHEEL_TICK_US);
+
+	const esp_timer_create_args_t tick_timer_args = {
+			.callback = &cantp_tw_tick_cb,
+			.arg = NULL,
+			.name = "cantp_tw"
+	};
+	//Started by the first cantp_timer_start()
+	return (esp_timer_create(&tick_timer_args, &cantp_tw_tick_timer) == ESP_OK)?0:-1;
+#else
+	return 0;
+#endif
 }
 
 int cantp_timer_start(void *timer, char *name, long tout_us)
 {
 	cantp_logd("Starting timer (%p) %s %ldμs\n", timer, name, tout_us);
+	emu_trace_timer(EMU_TRACE_TIMER_START, timer, name, tout_us);
+#ifdef CONFIG_CANTP_TIMER_WHEEL
+	//Restarting a running timer just moves it in the wheel
+	tw_timer_start(&cantp_tw, (tw_timer_t *)timer, tout_us);
+	cantp_tw_tick_arm();
+	return 0;
+#else
 	esp_err_t res = esp_timer_start_once((esp_timer_handle_t)timer, tout_us);
     switch (res) {
     	case ESP_ERR_INVALID_ARG:
@@ -121,6 +232,7 @@ int cantp_timer_start(void *timer, char *name, long tout_us)
     		break;
     }
 	return (res == ESP_OK)?0:-1;
+#endif
 }
 
 void cantp_timer_stop(void *timer)
@@ -128,11 +240,26 @@ void cantp_timer_stop(void *timer)
 //	esp_timer_handle_t t;
 //	t = (esp_timer_handle_t)timer;
 	cantp_logv("Timer (%p) ", timer); fflush(0);
+	emu_trace_timer(EMU_TRACE_TIMER_STOP, timer, NULL, 0);
+#ifdef CONFIG_CANTP_TIMER_WHEEL
+	tw_timer_stop(&cantp_tw, (tw_timer_t *)timer);
+#else
 	esp_timer_stop((esp_timer_handle_t)timer);
+#endif
 	cantp_logv("Stopped\n");
 }
 
 int cantp_can_rx(cantp_can_frame_t *rx_frame, uint32_t tout_us)
+{
+	//Session tasks are fed by the dispatcher, not by the driver
+	cantp_session_t *ses = cantp_session_current();
+	if (ses != NULL) {
+		return cantp_session_rx(ses, rx_frame, tout_us);
+	}
+	return cantp_can_drv_rx(rx_frame, tout_us);
+}
+
+int cantp_can_drv_rx(cantp_can_frame_t *rx_frame, uint32_t tout_us)
 {
 	TickType_t ticks_to_wait;
 	if (tout_us == 0) {
@@ -143,7 +270,9 @@ int cantp_can_rx(cantp_can_frame_t *rx_frame, uint32_t tout_us)
 #if ESP32_IDF_CAN_HAL
 	twai_message_t rx_msg;
 
-	twai_receive(&rx_msg, ticks_to_wait);
+	if (twai_receive(&rx_msg, ticks_to_wait) != ESP_OK) {
+		return -1;
+	}
 
 	rx_frame->dlc = rx_msg.data_length_code;
 	rx_frame->rtr = rx_msg.extd;
@@ -155,6 +284,10 @@ int cantp_can_rx(cantp_can_frame_t *rx_frame, uint32_t tout_us)
 		cantp_logv("0x%02x ", rx_frame->data_u8[i]);
 	}
 	cantp_logv("\n");
+	can_capture_frame(CAN_CAPTURE_RX, rx_frame->id, rx_frame->rtr,
+						rx_frame->dlc, rx_frame->data_u8);
+	can_stats_rx(rx_frame->id, rx_frame->rtr, rx_frame->dlc);
+	emu_trace_frame(EMU_TRACE_RX, rx_frame->id, rx_frame->data_u8[0]);
 	return 0;
 
 #else
@@ -170,6 +303,10 @@ int cantp_can_rx(cantp_can_frame_t *rx_frame, uint32_t tout_us)
 		cantp_logv("0x%02x ", rx_frame->data_u8[i]);
 	}
 	cantp_logv("\n");
+	can_capture_frame(CAN_CAPTURE_RX, rx_frame->id, rx_frame->rtr,
+						rx_frame->dlc, rx_frame->data_u8);
+	can_stats_rx(rx_frame->id, rx_frame->rtr, rx_frame->dlc);
+	emu_trace_frame(EMU_TRACE_RX, rx_frame->id, rx_frame->data_u8[0]);
 	return 0;
 
 #endif
@@ -178,121 +315,127 @@ int cantp_can_rx(cantp_can_frame_t *rx_frame, uint32_t tout_us)
 int cantp_can_tx_nb(uint32_t id, uint8_t idt, uint8_t dlc, uint8_t *data)
 {
 	cantp_logv("\t\tTWAI Sending NB from ID=0x%06x IDt=%d DLC=%d :", id, idt, dlc);
-#if ESP32_IDF_CAN_HAL
-	twai_message_t tx_msg = {
-			.identifier = id,
-			.data_length_code = dlc,
-			.extd = idt,
-			.ss = 1,
-			.self = 0,
-			.rtr = 0
+	cantp_can_frame_t frame = {
+			.id = id,
+			.dlc = dlc,
+			.rtr = idt
 	};
-
 	for (uint8_t i=0; i < dlc; i++) {
 		cantp_logv("0x%02x ", data[i]);
-		tx_msg.data[i] = data[i];
+		frame.data_u8[i] = data[i];
 	}
 	cantp_logv("\n"); fflush(0);
-	return (twai_transmit(&tx_msg, 1) == ESP_OK)?0:-1;
-#else
-	can_frame_esp32_t tx_frame = { 0 };
-	tx_frame.id = id;
-	tx_frame.idt = idt;
-	tx_frame.rtr = 0;
-	tx_frame.dlc = dlc;
-	for (uint8_t i=0; i < dlc; i++) {
-		cantp_logv("0x%02x ", data[i]);
-		tx_frame.data_u8[i] = data[i];
+	int64_t deadline_us = esp_timer_get_time() + CANTP_TXQ_N_AS_US;
+	cantp_tx_begin(id, idt, deadline_us);
+	int res = can_fault_frame(&frame, 0, 0, cantp_can_drv_tx);
+	if (res < 0) {
+		cantp_tx_end();
+		return res;
 	}
-	cantp_logv("\n"); fflush(0);
-	return (can_drv_esp32_tx(&tx_frame) == ESP_OK)?0:-1;
-#endif
+	//No other frame may be sent, and complete, before our TX done is seen
+	tx_nb_lease = tx_sched_lease(deadline_us);
+	tx_nb_owner = xTaskGetCurrentTaskHandle();
+	tx_nb_consumed = (res == CAN_FAULT_TX_CONSUMED);
+	return 0;
 }
 
 int cantp_sndr_wait_tx_done(cantp_rxtx_status_t *ctx, uint32_t tout_us)
 {
-#if ESP32_IDF_CAN_HAL
-	uint32_t alerts;
-	twai_reconfigure_alerts(TWAI_ALERT_TX_SUCCESS, NULL);
-
-	if (twai_read_alerts(&alerts, (tout_us/1000)/portTICK_PERIOD_MS) != ESP_OK) {
-		return -1;
-	}
-	printf("--%d--", alerts);fflush(0);
-	if (alerts & TWAI_ALERT_TX_SUCCESS) {
+	if (tx_nb_consumed && tx_nb_owner == xTaskGetCurrentTaskHandle()) {
+		cantp_tx_nb_end();
 		return 0;
 	}
-	return -1;
+#if ESP32_IDF_CAN_HAL
+	//Signalled by the health monitor, which owns the TWAI alerts
+	int res = can_health_tx_wait(tx_seq, tout_us);
 #else
-	esp_err_t res = can_drv_esp32_wait_tx_end((tout_us/1000)/portTICK_RATE_MS);
-	return (res == ESP_OK)?0:-1;
+	int res = (can_drv_esp32_wait_tx_end((tout_us/1000)/portTICK_RATE_MS) == ESP_OK)?0:-1;
 #endif
+	cantp_tx_nb_end();
+	return res;
 }
 
 int cantp_can_tx(uint32_t id, uint8_t idt, uint8_t dlc, uint8_t *data, long tout_us)
+{
+	return cantp_can_tx_deadline(id, idt, dlc, data, tout_us,
+			esp_timer_get_time() + ((tout_us > 0)?tout_us:CANTP_TXQ_N_AS_US));
+}
+
+int cantp_can_tx_deadline(uint32_t id, uint8_t idt, uint8_t dlc, uint8_t *data,
+		long tout_us, int64_t deadline_us)
 {
 	cantp_logv("\t\tTWAI Sending from ID=0x%06x IDt=%d DLC=%d :", id, idt, dlc);
-#if ESP32_IDF_CAN_HAL
-	twai_message_t tx_msg = {
-			.identifier = id,
-			.data_length_code = dlc,
-			.extd = idt,
-			.ss = 1,
-			.self = 0,
-			.rtr = 0
+	cantp_can_frame_t frame = {
+			.id = id,
+			.dlc = dlc,
+			.rtr = idt
 	};
-
 	for (uint8_t i=0; i < dlc; i++) {
 		cantp_logv("0x%02x ", data[i]);
-		tx_msg.data[i] = data[i];
+		frame.data_u8[i] = data[i];
 	}
 	cantp_logv("\n"); fflush(0);
-	esp_err_t res = twai_transmit(&tx_msg, 1);
-	if (res != ESP_OK) {
-		return -1;
-	}
+	//Owning the bus also keeps other frames from signalling our TX done
+	cantp_tx_begin(id, idt, deadline_us);
+	int res = can_fault_frame(&frame, 1, tout_us, cantp_can_drv_tx);
+	cantp_tx_end();
+	return (res < 0)?res:0;
+}
 
-	uint32_t alerts;
-	twai_reconfigure_alerts(TWAI_ALERT_TX_SUCCESS, NULL);
+int cantp_can_drv_tx(const cantp_can_frame_t *frame, uint8_t wait, long tout_us)
+{
+#if ESP32_IDF_CAN_HAL
+	twai_message_t tx_msg = {
+			.identifier = frame->id,
+			.data_length_code = frame->dlc,
+			.extd = frame->rtr,
+			.ss = 1,
+			.self = 0,
+			.rtr = 0
+	};
+	memcpy(tx_msg.data, frame->data_u8, frame->dlc);
 
-	if (twai_read_alerts(&alerts, (tout_us/1000)/portTICK_PERIOD_MS) != ESP_OK) {
+	if (twai_transmit(&tx_msg, 1) != ESP_OK) {
 		return -1;
 	}
-	printf("-----%d-----", alerts);fflush(0);
-	if (alerts & TWAI_ALERT_TX_SUCCESS) {
-		return 0;
-	}
-	return -1;
+	tx_seq = can_health_tx_sent();
+	int done = wait ? can_health_tx_wait(tx_seq, tout_us) : 0;
 #else
-	can_frame_esp32_t tx_frame;
-	tx_frame.id = id;
-	tx_frame.idt = idt;
+	can_frame_esp32_t tx_frame = { 0 };
+	tx_frame.id = frame->id;
+	tx_frame.idt = frame->rtr;
 	tx_frame.rtr = 0;
-	tx_frame.dlc = dlc;
+	tx_frame.dlc = frame->dlc;
+	memcpy(tx_frame.data_u8, frame->data_u8, frame->dlc);
 
-	for (uint8_t i=0; i < dlc; i++) {
-		cantp_logv("0x%02x ", data[i]);
-		tx_frame.data_u8[i] = data[i];
+	if (can_drv_esp32_tx(&tx_frame) != ESP_OK) {
+		return -1;
+	}
+	int done = 0;
+	if (wait) {
+		done = (can_drv_esp32_wait_tx_end((tout_us/1000)/portTICK_RATE_MS) == ESP_OK)?0:-1;
 	}
-	cantp_logv("\n"); fflush(0);
-
-	can_drv_esp32_tx(&tx_frame);
-
-	esp_err_t res = can_drv_esp32_wait_tx_end((tout_us/1000)/portTICK_RATE_MS);
-	return (res == ESP_OK)?0:-1;
-
 #endif
+	if (done == 0) {
+		can_capture_frame(CAN_CAPTURE_TX, frame->id, frame->rtr,
+							frame->dlc, (uint8_t *)frame->data_u8);
+		can_stats_tx(frame->rtr, frame->dlc);
+		emu_trace_frame(EMU_TRACE_TX, frame->id, frame->data_u8[0]);
+	}
+	return done;
 }
 
 int cantp_sndr_state_sem_take(cantp_rxtx_status_t *ctx, uint32_t tout_us)
 {
-	if (tout_us == 0) {
-		//Wait forever
-		return (xSemaphoreTake((SemaphoreHandle_t)ctx->sndr.state_sem,
-												portMAX_DELAY) == pdTRUE)?0:-1;
+	TickType_t ticks = portMAX_DELAY;	//Wait forever
+	if (tout_us != 0) {
+		ticks = (tout_us/1000)/portTICK_RATE_MS;
 	}
-	return (xSemaphoreTake((SemaphoreHandle_t)ctx->sndr.state_sem,
-								(tout_us/1000)/portTICK_RATE_MS) == pdTRUE)?0:-1;
+	emu_trace(EMU_TRACE_SNDR_WAIT_BEGIN, 0, 0);
+	int res = (xSemaphoreTake((SemaphoreHandle_t)ctx->sndr.state_sem,
+												ticks) == pdTRUE)?0:-1;
+	emu_trace(EMU_TRACE_SNDR_WAIT_END, (res < 0), 0);
+	return res;
 }
 
 void cantp_sndr_state_sem_give(cantp_rxtx_status_t *ctx)
@@ -9,15 +9,40 @@
 #define __CANTP_ESP32_H_
 
 #include "can-tp.h"
+#include "emu_trace.h"
 
 static inline void cantp_rcvr_t_cb(void *args)
 {
+	emu_trace_timer(EMU_TRACE_TIMEOUT, args, "rcvr timeout", 0);
 	cantp_rcvr_timer_cb((cantp_rxtx_status_t *)args);
 }
 
 static inline void cantp_sndr_t_cb(void *args)
 {
+	emu_trace_timer(EMU_TRACE_TIMEOUT, args, "sndr timeout", 0);
 	cantp_sndr_timer_cb((cantp_rxtx_status_t *)args);
 }
 
+/*
+ * With CONFIG_CANTP_TIMER_WHEEL the timer pointers handed to the CAN-TP
+ * layer are tw_timer_t and every session is serviced by one tick timer.
+ */
+int cantp_timer_wheel_start(void);
+
+//Reads one frame straight from the CAN driver
+int cantp_can_drv_rx(cantp_can_frame_t *rx_frame, uint32_t tout_us);
+
+/*
+ * cantp_can_tx() with an explicit deadline for the TX scheduler, which
+ * otherwise uses now + tout_us.
+ */
+int cantp_can_tx_deadline(uint32_t id, uint8_t idt, uint8_t dlc, uint8_t *data,
+		long tout_us, int64_t deadline_us);
+
+/*
+ * Puts one frame on the bus and captures it. With wait it blocks until
+ * the frame is sent or tout_us expires. The caller owns the bus.
+ */
+int cantp_can_drv_tx(const cantp_can_frame_t *frame, uint8_t wait, long tout_us);
+
 #endif /* __CANTP_ESP32_H_ */
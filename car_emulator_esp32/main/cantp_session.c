@@ -0,0 +1,372 @@
+/*
+ * cantp_session.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "cantp_esp32.h"
+#include "can-tp.h"
+#include "car_emulator.h"
+#include "emu_tasks.h"
+#include "timer_wheel.h"
+#include "cantp_session.h"
+#include "cantp_txq.h"
+#include "obd_id_table.h"
+#include "j1939.h"
+#include "uds_download.h"
+#include "emu_trace.h"
+#include "can_rx.h"
+
+#define TAG             "CANTP_SES"
+
+#define CANTP_N_PCI_SF		0x0
+#define CANTP_N_PCI_FF		0x1
+
+static cantp_session_t *sessions;
+static uint8_t n_sessions;
+static cantp_session_stats_t stats;
+
+//Written by the dispatcher, read by the console
+#define SES_STAT_INC(f)		__atomic_fetch_add(&stats.f, 1, __ATOMIC_RELAXED)
+#define SES_STAT_GET(f)		__atomic_load_n(&stats.f, __ATOMIC_RELAXED)
+
+/*
+ * Frames of one exchange arrive on different IDs (functional request,
+ * physical flow control), so the key is normalized to the physical
+ * request/response pair of the addressed ECU. The ID table only tells
+ * whether the ID is served and which ECU it addresses; 29-bit testers
+ * are told apart by the source address in their CAN ID. 11-bit IDs do
+ * not carry the tester, all 11-bit testers share one key.
+ */
+static int cantp_session_key_get(uint32_t id, uint8_t idt, cantp_session_key_t *key)
+{
+	const obd_id_entry_t *entry = obd_id_lookup(id, idt);
+	if (entry == NULL) {
+		return -1;
+	}
+	if (idt == 0) {
+		key->src_id = entry->phys_id;
+		key->tgt_id = entry->resp_id;
+	} else {
+		uint32_t ta = (entry->phys_id >> 8) & 0xFF;
+		uint32_t sa = id & OBD_ID_EXT_SA_MASK;
+		key->src_id = 0x18DA0000 | (ta << 8) | sa;
+		key->tgt_id = 0x18DA0000 | (sa << 8) | ta;
+	}
+	key->idt = idt;
+	return 0;
+}
+
+static inline int cantp_session_key_eq(cantp_session_key_t *a, cantp_session_key_t *b)
+{
+	return (a->src_id == b->src_id) && (a->tgt_id == b->tgt_id) &&
+			(a->idt == b->idt);
+}
+
+static inline int cantp_session_is_idle(cantp_session_t *ses, TickType_t now)
+{
+	return ((now - ses->last_used) >= pdMS_TO_TICKS(CANTP_SESSION_IDLE_MS)) &&
+			(uxQueueMessagesWaiting(ses->rx_queue) == 0);
+}
+
+static cantp_session_t *cantp_session_find(cantp_session_key_t *key)
+{
+	for (uint8_t i = 0; i < n_sessions; i++) {
+		if (sessions[i].in_use && cantp_session_key_eq(&sessions[i].key, key)) {
+			return &sessions[i];
+		}
+	}
+	return NULL;
+}
+
+//Takes a free session or evicts the least recently used idle one
+static cantp_session_t *cantp_session_alloc(cantp_session_key_t *key)
+{
+	TickType_t now = xTaskGetTickCount();
+	cantp_session_t *lru = NULL;
+
+	for (uint8_t i = 0; i < n_sessions; i++) {
+		cantp_session_t *ses = &sessions[i];
+		if (!ses->in_use) {
+			SES_STAT_INC(created);
+			lru = ses;
+			break;
+		}
+		if (cantp_session_is_idle(ses, now) &&
+			(lru == NULL || (now - ses->last_used) > (now - lru->last_used))) {
+			lru = ses;
+		}
+	}
+	if (lru == NULL) {
+		SES_STAT_INC(rejected);
+		return NULL;
+	}
+	if (lru->in_use) {
+		SES_STAT_INC(evicted);
+		ESP_LOGI(TAG, "Evicting session 0x%06x->0x%06x", lru->key.src_id,
+															lru->key.tgt_id);
+	}
+	lru->key = *key;
+	lru->in_use = 1;
+	cantp_session_touch(lru);
+	return lru;
+}
+
+int cantp_session_dispatch(cantp_can_frame_t *frame, int64_t rx_us)
+{
+	cantp_session_key_t key;
+	if (cantp_session_key_get(frame->id, frame->rtr, &key) < 0) {
+		SES_STAT_INC(unknown_id);
+		return -1;
+	}
+
+	uint8_t n_pci = frame->data_u8[0] >> 4;
+	int starts_request = (n_pci == CANTP_N_PCI_SF) || (n_pci == CANTP_N_PCI_FF);
+
+	cantp_session_t *ses = cantp_session_find(&key);
+	if (ses == NULL) {
+		if (!starts_request) {
+			SES_STAT_INC(orphans);
+			return -1;
+		}
+		ses = cantp_session_alloc(&key);
+		if (ses == NULL) {
+			return -1;
+		}
+	} else if (starts_request) {
+		SES_STAT_INC(reused);
+	}
+
+	cantp_session_touch(ses);
+	if (starts_request) {
+		ses->ectx.rx_us = rx_us;
+	}
+	if (xQueueSend(ses->rx_queue, frame, 0) != pdTRUE) {
+		SES_STAT_INC(rx_dropped);
+		return -1;
+	}
+	return 0;
+}
+
+static void cantp_session_rx_frame(cantp_can_frame_t *frame, int64_t rx_us)
+{
+#ifdef CONFIG_CAR_EMU_FAST_PATH
+	if (car_emu_fast_request(frame, rx_us) == 0) {
+		emu_trace_span(EMU_TRACE_OBD_FAST, rx_us, frame->id);
+		return;
+	}
+#endif
+#ifdef CONFIG_CAR_EMU_UDS_DOWNLOAD
+	if (uds_dl_rx(frame) == 0) {
+		return;
+	}
+#endif
+#ifdef CONFIG_CAR_EMU_J1939
+	if (j1939_rx(frame) == 0) {
+		return;
+	}
+#endif
+	cantp_session_dispatch(frame, rx_us);
+}
+
+void cantp_session_dispatch_task(void *arg)
+{
+#ifdef CONFIG_CAR_EMU_RX_RING
+	while (1) {
+		//Everything pending is dispatched before the slots are given back
+		uint32_t n = can_rx_wait(CAN_RX_BATCH, portMAX_DELAY);
+		for (uint32_t i = 0; i < n; i++) {
+			can_rx_entry_t *e = can_rx_peek(i);
+			cantp_session_rx_frame(&e->frame, e->rx_us);
+		}
+		can_rx_release(n);
+	}
+#else
+	cantp_can_frame_t frame;
+	while (1) {
+		if (cantp_can_drv_rx(&frame, 0) < 0) {
+			continue;
+		}
+		cantp_session_rx_frame(&frame, esp_timer_get_time());
+	}
+#endif
+}
+
+cantp_session_t *cantp_session_current(void)
+{
+	TaskHandle_t self = xTaskGetCurrentTaskHandle();
+	for (uint8_t i = 0; i < n_sessions; i++) {
+		if (sessions[i].rx_task == self || sessions[i].sndr_task == self) {
+			return &sessions[i];
+		}
+	}
+	return NULL;
+}
+
+cantp_session_t *cantp_session_from_ctx(cantp_rxtx_status_t *ctx)
+{
+	for (uint8_t i = 0; i < n_sessions; i++) {
+		if (&sessions[i].ctx == ctx) {
+			return &sessions[i];
+		}
+	}
+	return NULL;
+}
+
+int cantp_session_rx(cantp_session_t *ses, cantp_can_frame_t *frame, uint32_t tout_us)
+{
+	TickType_t ticks_to_wait;
+	if (tout_us == 0) {
+		ticks_to_wait = portMAX_DELAY;
+	} else {
+		ticks_to_wait = (tout_us/1000)/portTICK_PERIOD_MS;
+	}
+	return (xQueueReceive(ses->rx_queue, frame, ticks_to_wait) == pdTRUE)?0:-1;
+}
+
+/*
+ * 11-bit testers share one key per ECU, 29-bit testers get a key each,
+ * so only those need more than one session per ECU. Every session
+ * costs three task stacks, sessions no key can reach are not created.
+ */
+static uint8_t cantp_session_reachable(const emulator_cfg_t *cfg)
+{
+	uint8_t n = 0;
+
+	if (cfg->id_type == CFG_STANDARD_ID || cfg->id_type == CFG_MIXED_ID) {
+		n += 1;
+	}
+	if (cfg->id_type == CFG_EXTENDED_ID || cfg->id_type == CFG_MIXED_ID) {
+		n += EMU_CANTP_SESSIONS;
+	}
+	return (n < EMU_CANTP_SESSIONS)?n:EMU_CANTP_SESSIONS;
+}
+
+int cantp_session_table_init(emulator_cfg_t *cfg, cantp_params_t *params)
+{
+	n_sessions = cantp_session_reachable(cfg);
+	sessions = calloc(n_sessions, sizeof(cantp_session_t));
+	if (sessions == NULL) {
+		ESP_LOGE(TAG, "Out of memory");
+		n_sessions = 0;
+		return -1;
+	}
+	for (uint8_t i = 0; i < n_sessions; i++) {
+		cantp_session_t *ses = &sessions[i];
+		char name[configMAX_TASK_NAME_LEN];
+
+		memset(ses, 0, sizeof(cantp_session_t));
+		ses->params = *params;
+		ses->rx_queue = xQueueCreate(CANTP_SESSION_RX_QUEUE_LEN,
+												sizeof(cantp_can_frame_t));
+		ses->ctx.sndr.state_sem = (void *)xSemaphoreCreateBinary();
+		ses->ectx.sem = xSemaphoreCreateBinary();
+		ses->tx_queue = xQueueCreate(EMU_CANTP_TXQ_LEN,
+												sizeof(cantp_txq_msg_t *));
+		ses->tx_done = xSemaphoreCreateBinary();
+		if (ses->rx_queue == NULL || ses->ctx.sndr.state_sem == NULL ||
+			ses->ectx.sem == NULL || ses->tx_queue == NULL ||
+			ses->tx_done == NULL) {
+			ESP_LOGE(TAG, "Session %d: out of memory", i);
+			return -1;
+		}
+		ses->ectx.cfg = cfg;
+		ses->ectx.cantp_ctx = &ses->ctx;
+		ses->ctx.cb_ctx = (void *)&ses->ectx;
+
+#ifdef CONFIG_CANTP_TIMER_WHEEL
+		tw_timer_init(&ses->sndr_timer, cantp_sndr_t_cb, (void *)&ses->ctx, "sndr");
+		cantp_set_sndr_timer_ptr(&ses->sndr_timer, &ses->ctx);
+#else
+		const esp_timer_create_args_t sndr_timer_args = {
+				.callback = &cantp_sndr_t_cb,
+				.arg = (void *)&ses->ctx,
+				.name = "one-shot"
+		};
+		if (esp_timer_create(&sndr_timer_args, &ses->sndr_timer) != ESP_OK) {
+			return -1;
+		}
+		cantp_set_sndr_timer_ptr(ses->sndr_timer, &ses->ctx);
+#endif
+		snprintf(name, sizeof(name), "Session%d", i);
+		cantp_rcvr_params_init(&ses->ctx, &ses->params, name);
+
+		//Equal priorities: the TX lock hands out frames round robin
+		snprintf(name, sizeof(name), "can_task%d", i);
+		if (emu_task_create(cantp_sndr_task, name, 2 * 1024, &ses->ctx, 1,
+									EMU_CORE_CAN, &ses->sndr_task) != pdPASS) {
+			return -1;
+		}
+		snprintf(name, sizeof(name), "cantp_tx%d", i);
+		if (emu_task_create(cantp_txq_mf_task, name, 2 * 1024, ses, 1,
+									EMU_CORE_CAN, &ses->tx_task) != pdPASS) {
+			return -1;
+		}
+		snprintf(name, sizeof(name), "cantp_rx%d", i);
+		if (emu_task_create(cantp_rx_task, name, 3 * 1024, &ses->ctx, 2,
+									EMU_CORE_CAN, &ses->rx_task) != pdPASS) {
+			return -1;
+		}
+	}
+	ESP_LOGI(TAG, "%d CAN-TP sessions ready", n_sessions);
+	return 0;
+}
+
+void cantp_session_stats_get(cantp_session_stats_t *s)
+{
+	s->created = SES_STAT_GET(created);
+	s->reused = SES_STAT_GET(reused);
+	s->evicted = SES_STAT_GET(evicted);
+	s->rejected = SES_STAT_GET(rejected);
+	s->orphans = SES_STAT_GET(orphans);
+	s->unknown_id = SES_STAT_GET(unknown_id);
+	s->rx_dropped = SES_STAT_GET(rx_dropped);
+}
+
+uint8_t cantp_session_count(void)
+{
+	return n_sessions;
+}
+
+uint8_t cantp_session_in_use(void)
+{
+	uint8_t n = 0;
+	for (uint8_t i = 0; i < n_sessions; i++) {
+		n += sessions[i].in_use;
+	}
+	return n;
+}
+
+void cantp_session_stats_print(void)
+{
+	TickType_t now = xTaskGetTickCount();
+	cantp_session_stats_t st;
+
+	cantp_session_stats_get(&st);
+	printf("\nCAN-TP sessions: created=%u reused=%u evicted=%u rejected=%u "
+			"orphans=%u unknown_id=%u rx_dropped=%u\n",
+			st.created, st.reused, st.evicted, st.rejected,
+			st.orphans, st.unknown_id, st.rx_dropped);
+	for (uint8_t i = 0; i < n_sessions; i++) {
+		cantp_session_t *ses = &sessions[i];
+		if (!ses->in_use) {
+			printf("  [%d] free\n", i);
+			continue;
+		}
+		printf("  [%d] 0x%08x->0x%08x IDT=%d idle %ums\n", i,
+				ses->key.src_id, ses->key.tgt_id, ses->key.idt,
+				(now - ses->last_used) * portTICK_PERIOD_MS);
+	}
+}
@@ -0,0 +1,102 @@
+/*
+ * cantp_session.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+
+#ifndef __CANTP_SESSION_H_
+#define __CANTP_SESSION_H_
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+#include "esp_timer.h"
+
+#include "can-tp.h"
+#include "car_emulator.h"
+#include "timer_wheel.h"
+
+#define CANTP_SESSION_RX_QUEUE_LEN		8
+//A session without traffic for this long may be evicted (> N_Bs/N_Cr)
+#define CANTP_SESSION_IDLE_MS			2000
+
+typedef struct cantp_session_key_s {
+	uint32_t src_id;		//physical request ID of the tester
+	uint32_t tgt_id;		//response ID of the addressed ECU
+	uint8_t idt;
+} cantp_session_key_t;
+
+typedef struct cantp_session_s {
+	cantp_session_key_t key;
+	uint8_t in_use;
+	TickType_t last_used;
+	cantp_rxtx_status_t ctx;
+	cantp_params_t params;
+	emulator_ctx_t ectx;
+	QueueHandle_t rx_queue;
+#ifdef CONFIG_CANTP_TIMER_WHEEL
+	tw_timer_t sndr_timer;
+#else
+	esp_timer_handle_t sndr_timer;
+#endif
+	TaskHandle_t rx_task;
+	TaskHandle_t sndr_task;
+	//Multi-frame messages queued by cantp_send_async()
+	QueueHandle_t tx_queue;
+	SemaphoreHandle_t tx_done;
+	int tx_result;
+	TaskHandle_t tx_task;
+} cantp_session_t;
+
+typedef struct cantp_session_stats_s {
+	uint32_t created;		//free slot taken
+	uint32_t reused;		//new request on an existing session
+	uint32_t evicted;		//idle session handed to another tester
+	uint32_t rejected;		//no free or idle session left
+	uint32_t orphans;		//CF/FC without a session
+	uint32_t unknown_id;	//not a diagnostic request ID
+	uint32_t rx_dropped;	//session RX queue full
+} cantp_session_stats_t;
+
+/*
+ * Preallocates independent CAN-TP sender/receiver pairs, each with its
+ * own tasks, timer and emulator context: as many as keys of the ID type
+ * in cfg can reach, at most EMU_CANTP_SESSIONS.
+ */
+int cantp_session_table_init(emulator_cfg_t *cfg, cantp_params_t *params);
+
+/*
+ * Single reader of the CAN driver: demultiplexes every frame by
+ * (source ID, target ID, ID type) into the queue of its session.
+ */
+void cantp_session_dispatch_task(void *arg);
+
+//rx_us: reception time, the start of a request's latency
+int cantp_session_dispatch(cantp_can_frame_t *frame, int64_t rx_us);
+
+//Session owning the calling task (receiver or sender), NULL for others
+cantp_session_t *cantp_session_current(void);
+
+cantp_session_t *cantp_session_from_ctx(cantp_rxtx_status_t *ctx);
+
+int cantp_session_rx(cantp_session_t *ses, cantp_can_frame_t *frame, uint32_t tout_us);
+
+static inline void cantp_session_touch(cantp_session_t *ses)
+{
+	ses->last_used = xTaskGetTickCount();
+}
+
+void cantp_session_stats_get(cantp_session_stats_t *stats);
+
+//Sessions bound to a tester/ECU address pair
+uint8_t cantp_session_in_use(void);
+
+//Sessions created by cantp_session_table_init()
+uint8_t cantp_session_count(void);
+
+void cantp_session_stats_print(void);
+
+#endif /* __CANTP_SESSION_H_ */
@@ -0,0 +1,379 @@
+/*
+ * cantp_txq.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "cantp_esp32.h"
+#include "can-tp.h"
+#include "car_emulator.h"
+#include "cantp_session.h"
+#include "cantp_txq.h"
+#include "emu_tasks.h"
+#include "emu_trace.h"
+
+#define TAG             "CANTP_TXQ"
+
+#define CANTP_SF_MAX_LEN	7
+
+typedef enum {
+	TX_WAITER_FREE = 0,
+	TX_WAITER_WAITING,
+	TX_WAITER_GRANTED
+} tx_waiter_state_t;
+
+typedef struct tx_sched_waiter_s {
+	tx_waiter_state_t state;
+	uint32_t arb;			//arbitration key, lower wins
+	int64_t deadline_us;
+	SemaphoreHandle_t grant;
+} tx_sched_waiter_t;
+
+static tx_sched_waiter_t waiters[TX_SCHED_MAX_WAITERS];
+static SemaphoreHandle_t sched_lock;
+static uint8_t bus_busy;
+//Lease of the current owner, 0 when it holds the bus until it releases it
+static uint32_t lease;
+static uint32_t lease_last;
+static int64_t lease_deadline_us;
+
+static cantp_txq_msg_t msg_pool[EMU_CANTP_TXQ_LEN];
+static QueueHandle_t msg_free;
+//Pending single frames, the SF task always sends the most urgent one
+static cantp_txq_msg_t *sf_pending[EMU_CANTP_TXQ_LEN];
+static SemaphoreHandle_t sf_lock;
+static SemaphoreHandle_t sf_count;
+
+static cantp_txq_stats_t stats;
+
+//Written by the SF, MF and sender tasks, read by the console
+#define TXQ_STAT_INC(f)		__atomic_fetch_add(&stats.f, 1, __ATOMIC_RELAXED)
+#define TXQ_STAT_GET(f)		__atomic_load_n(&stats.f, __ATOMIC_RELAXED)
+
+/*
+ * 11 bit IDs are compared on the same scale as the 29 bit ones (base ID
+ * in the upper bits), a standard frame wins against an extended one with
+ * the same base ID.
+ */
+static inline uint32_t tx_sched_arb(uint32_t id, uint8_t idt)
+{
+	uint32_t arb = idt ? (id & 0x1FFFFFFF) : ((id & 0x7FF) << 18);
+	return (arb << 1) | (idt ? 1 : 0);
+}
+
+static inline int tx_sched_before(uint32_t arb_a, int64_t dl_a,
+									uint32_t arb_b, int64_t dl_b)
+{
+	if (arb_a != arb_b) {
+		return arb_a < arb_b;
+	}
+	return dl_a < dl_b;
+}
+
+//Hands the bus to the most urgent waiter, called with sched_lock held
+static void tx_sched_pass(void)
+{
+	tx_sched_waiter_t *best = NULL;
+
+	lease = 0;
+	for (uint8_t i = 0; i < TX_SCHED_MAX_WAITERS; i++) {
+		tx_sched_waiter_t *w = &waiters[i];
+		if (w->state != TX_WAITER_WAITING) {
+			continue;
+		}
+		if (best == NULL ||
+			tx_sched_before(w->arb, w->deadline_us, best->arb, best->deadline_us)) {
+			best = w;
+		}
+	}
+	if (best != NULL) {
+		//The bus stays busy, ownership moves to the waiter
+		best->state = TX_WAITER_GRANTED;
+		xSemaphoreGive(best->grant);
+	} else {
+		bus_busy = 0;
+	}
+}
+
+//Takes the bus from an owner whose lease ran out
+static void tx_sched_lease_check(void)
+{
+	xSemaphoreTake(sched_lock, portMAX_DELAY);
+	if (lease != 0 && esp_timer_get_time() >= lease_deadline_us) {
+		TXQ_STAT_INC(lease_expired);
+		tx_sched_pass();
+	}
+	xSemaphoreGive(sched_lock);
+}
+
+void tx_sched_acquire(uint32_t id, uint8_t idt, int64_t deadline_us)
+{
+	tx_sched_waiter_t *w = NULL;
+
+	while (w == NULL) {
+		xSemaphoreTake(sched_lock, portMAX_DELAY);
+		if (!bus_busy) {
+			bus_busy = 1;
+			xSemaphoreGive(sched_lock);
+			return;
+		}
+		for (uint8_t i = 0; i < TX_SCHED_MAX_WAITERS; i++) {
+			if (waiters[i].state == TX_WAITER_FREE) {
+				w = &waiters[i];
+				w->state = TX_WAITER_WAITING;
+				w->arb = tx_sched_arb(id, idt);
+				w->deadline_us = deadline_us;
+				break;
+			}
+		}
+		xSemaphoreGive(sched_lock);
+		if (w == NULL) {
+			vTaskDelay(1);
+		}
+	}
+	//Wakes up now and then to end a lease which ran out
+	while (xSemaphoreTake(w->grant, pdMS_TO_TICKS(TX_SCHED_LEASE_POLL_MS)) != pdTRUE) {
+		tx_sched_lease_check();
+	}
+
+	xSemaphoreTake(sched_lock, portMAX_DELAY);
+	w->state = TX_WAITER_FREE;
+	xSemaphoreGive(sched_lock);
+}
+
+void tx_sched_release(void)
+{
+	xSemaphoreTake(sched_lock, portMAX_DELAY);
+	tx_sched_pass();
+	xSemaphoreGive(sched_lock);
+}
+
+uint32_t tx_sched_lease(int64_t deadline_us)
+{
+	uint32_t id;
+
+	xSemaphoreTake(sched_lock, portMAX_DELAY);
+	if (++lease_last == 0) {
+		lease_last = 1;
+	}
+	id = lease = lease_last;
+	lease_deadline_us = deadline_us;
+	xSemaphoreGive(sched_lock);
+	return id;
+}
+
+void tx_sched_lease_end(uint32_t id)
+{
+	xSemaphoreTake(sched_lock, portMAX_DELAY);
+	if (lease != 0 && lease == id) {
+		tx_sched_pass();
+	}
+	xSemaphoreGive(sched_lock);
+}
+
+static void cantp_txq_complete(cantp_txq_msg_t *msg, int result)
+{
+	int64_t now = esp_timer_get_time();
+	uint32_t latency = (uint32_t)(now - msg->queued_us);
+
+	if (result < 0) {
+		TXQ_STAT_INC(failed);
+	}
+	if (now > msg->deadline_us) {
+		TXQ_STAT_INC(late);
+	}
+	uint32_t max = TXQ_STAT_GET(max_latency_us);
+	while (latency > max && !__atomic_compare_exchange_n(&stats.max_latency_us,
+			&max, latency, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+	}
+	if (msg->cb != NULL) {
+		msg->cb(result, msg->cb_arg);
+	}
+	xQueueSend(msg_free, &msg, 0);
+}
+
+static void cantp_txq_sf_task(void *arg)
+{
+	while (1) {
+		xSemaphoreTake(sf_count, portMAX_DELAY);
+
+		cantp_txq_msg_t *msg = NULL;
+		uint8_t best = 0;
+		xSemaphoreTake(sf_lock, portMAX_DELAY);
+		for (uint8_t i = 0; i < EMU_CANTP_TXQ_LEN; i++) {
+			cantp_txq_msg_t *m = sf_pending[i];
+			if (m == NULL) {
+				continue;
+			}
+			if (msg == NULL || tx_sched_before(tx_sched_arb(m->id, m->idt),
+						m->deadline_us, tx_sched_arb(msg->id, msg->idt),
+						msg->deadline_us)) {
+				msg = m;
+				best = i;
+			}
+		}
+		sf_pending[best] = NULL;
+		xSemaphoreGive(sf_lock);
+		if (msg == NULL) {
+			continue;
+		}
+
+		uint8_t frame[8] = { 0 };
+		frame[0] = msg->len;		//N_PCI: single frame, length
+		memcpy(&frame[1], msg->data, msg->len);
+		int result = cantp_can_tx_deadline(msg->id, msg->idt, 8, frame,
+									CANTP_TXQ_N_AS_US, msg->deadline_us);
+		TXQ_STAT_INC(sent_sf);
+		cantp_txq_complete(msg, result);
+	}
+}
+
+void cantp_txq_mf_task(void *arg)
+{
+	cantp_session_t *ses = (cantp_session_t *)arg;
+	cantp_txq_msg_t *msg;
+
+	while (1) {
+		xQueueReceive(ses->tx_queue, &msg, portMAX_DELAY);
+
+		//Drop a result left over from a transfer that timed out
+		xSemaphoreTake(ses->tx_done, 0);
+		int result = -1;
+		emu_trace(EMU_TRACE_TX_BEGIN, msg->id, msg->len);
+		if (cantp_send(msg->ctx, msg->id, msg->idt, msg->data, msg->len) >= 0 &&
+			xSemaphoreTake(ses->tx_done,
+						pdMS_TO_TICKS(CANTP_TXQ_MF_TOUT_MS)) == pdTRUE) {
+			result = (ses->tx_result == CANTP_RESULT_N_OK)?0:-1;
+		}
+		emu_trace(EMU_TRACE_TX_END, msg->id, result);
+		TXQ_STAT_INC(sent_mf);
+		cantp_txq_complete(msg, result);
+	}
+}
+
+void cantp_txq_sndr_result(int result)
+{
+	cantp_session_t *ses = cantp_session_current();
+	if (ses == NULL) {
+		//Not called from a sender task, the MF task runs into its timeout
+		return;
+	}
+	ses->tx_result = result;
+	xSemaphoreGive(ses->tx_done);
+}
+
+int cantp_send_async(cantp_rxtx_status_t *ctx, uint32_t id, uint8_t idt,
+		const uint8_t *data, uint16_t len, uint32_t deadline_us,
+		cantp_send_done_cb_t cb, void *cb_arg)
+{
+	cantp_txq_msg_t *msg;
+	cantp_session_t *ses = NULL;
+
+	if (len > CANTP_TXQ_MSG_MAX) {
+		return -1;
+	}
+	if (len > CANTP_SF_MAX_LEN) {
+		ses = cantp_session_from_ctx(ctx);
+		if (ses == NULL) {
+			return -1;
+		}
+	}
+	if (xQueueReceive(msg_free, &msg, 0) != pdTRUE) {
+		TXQ_STAT_INC(pool_empty);
+		return -1;
+	}
+	msg->ctx = ctx;
+	msg->id = id;
+	msg->idt = idt;
+	msg->len = len;
+	msg->queued_us = esp_timer_get_time();
+	msg->deadline_us = msg->queued_us + deadline_us;
+	msg->cb = cb;
+	msg->cb_arg = cb_arg;
+	memcpy(msg->data, data, len);
+
+	if (ses != NULL) {
+		//The pool is no larger than a session TX queue, this cannot block
+		xQueueSend(ses->tx_queue, &msg, portMAX_DELAY);
+		return 0;
+	}
+
+	xSemaphoreTake(sf_lock, portMAX_DELAY);
+	for (uint8_t i = 0; i < EMU_CANTP_TXQ_LEN; i++) {
+		if (sf_pending[i] == NULL) {
+			sf_pending[i] = msg;
+			break;
+		}
+	}
+	xSemaphoreGive(sf_lock);
+	xSemaphoreGive(sf_count);
+	return 0;
+}
+
+int cantp_txq_init(void)
+{
+	sched_lock = xSemaphoreCreateMutex();
+	sf_lock = xSemaphoreCreateMutex();
+	sf_count = xSemaphoreCreateCounting(EMU_CANTP_TXQ_LEN, 0);
+	msg_free = xQueueCreate(EMU_CANTP_TXQ_LEN, sizeof(cantp_txq_msg_t *));
+	if (sched_lock == NULL || sf_lock == NULL || sf_count == NULL ||
+		msg_free == NULL) {
+		return -1;
+	}
+	for (uint8_t i = 0; i < TX_SCHED_MAX_WAITERS; i++) {
+		waiters[i].state = TX_WAITER_FREE;
+		waiters[i].grant = xSemaphoreCreateBinary();
+		if (waiters[i].grant == NULL) {
+			return -1;
+		}
+	}
+	for (uint8_t i = 0; i < EMU_CANTP_TXQ_LEN; i++) {
+		cantp_txq_msg_t *msg = &msg_pool[i];
+		xQueueSend(msg_free, &msg, 0);
+	}
+	//Above the session tasks, a queued response never waits for a transfer
+	if (emu_task_create(cantp_txq_sf_task, "cantp_sf", 2 * 1024, NULL, 3,
+											EMU_CORE_CAN, NULL) != pdPASS) {
+		return -1;
+	}
+	return 0;
+}
+
+void cantp_txq_stats_get(cantp_txq_stats_t *s)
+{
+	s->sent_sf = TXQ_STAT_GET(sent_sf);
+	s->sent_mf = TXQ_STAT_GET(sent_mf);
+	s->failed = TXQ_STAT_GET(failed);
+	s->pool_empty = TXQ_STAT_GET(pool_empty);
+	s->late = TXQ_STAT_GET(late);
+	s->lease_expired = TXQ_STAT_GET(lease_expired);
+	s->max_latency_us = TXQ_STAT_GET(max_latency_us);
+}
+
+uint32_t cantp_txq_pool_free(void)
+{
+	return (msg_free == NULL)?0:uxQueueMessagesWaiting(msg_free);
+}
+
+void cantp_txq_stats_print(void)
+{
+	cantp_txq_stats_t s;
+
+	cantp_txq_stats_get(&s);
+	printf("\nCAN-TP TX queue: SF=%u MF=%u failed=%u late=%u pool_empty=%u "
+			"lease_expired=%u max_latency=%uus free=%u/%d\n",
+			s.sent_sf, s.sent_mf, s.failed, s.late,
+			s.pool_empty, s.lease_expired, s.max_latency_us,
+			(unsigned)uxQueueMessagesWaiting(msg_free), EMU_CANTP_TXQ_LEN);
+}
@@ -0,0 +1,92 @@
+/*
+ * cantp_txq.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+
+#ifndef __CANTP_TXQ_H_
+#define __CANTP_TXQ_H_
+
+#include <stdint.h>
+
+#include "can-tp.h"
+
+#define CANTP_TXQ_MSG_MAX			64
+//OBD P2 response time, default deadline of a response
+#define CANTP_TXQ_P2_US				50000
+//Default deadline of frames queued by CAN-TP (N_As/N_Ar)
+#define CANTP_TXQ_N_AS_US			1000000
+#define CANTP_TXQ_MF_TOUT_MS		5000
+#define TX_SCHED_MAX_WAITERS		16
+//How often waiters look for a lease which ran out
+#define TX_SCHED_LEASE_POLL_MS		10
+
+typedef void (*cantp_send_done_cb_t)(int result, void *arg);
+
+typedef struct cantp_txq_msg_s {
+	cantp_rxtx_status_t *ctx;
+	uint32_t id;
+	uint8_t idt;
+	uint16_t len;
+	int64_t queued_us;
+	int64_t deadline_us;
+	cantp_send_done_cb_t cb;
+	void *cb_arg;
+	uint8_t data[CANTP_TXQ_MSG_MAX];
+} cantp_txq_msg_t;
+
+typedef struct cantp_txq_stats_s {
+	uint32_t sent_sf;
+	uint32_t sent_mf;
+	uint32_t failed;
+	uint32_t pool_empty;		//cantp_send_async() rejected, no free message
+	uint32_t late;				//sent after their deadline
+	uint32_t lease_expired;		//bus taken back from a lease at its deadline
+	uint32_t max_latency_us;	//queued to sent
+} cantp_txq_stats_t;
+
+int cantp_txq_init(void);
+
+/*
+ * Queues a CAN-TP message and returns at once. Single frames are sent by
+ * the TX scheduler directly, longer messages by the CAN-TP sender of the
+ * session owning ctx. cb (may be NULL) is called with 0 or -1 when the
+ * message is done. data is copied.
+ */
+int cantp_send_async(cantp_rxtx_status_t *ctx, uint32_t id, uint8_t idt,
+		const uint8_t *data, uint16_t len, uint32_t deadline_us,
+		cantp_send_done_cb_t cb, void *cb_arg);
+
+//Task function feeding multi-frame messages of one session to cantp_send()
+void cantp_txq_mf_task(void *arg);
+
+//Forwards the CAN-TP sender result to the waiting multi-frame task
+void cantp_txq_sndr_result(int result);
+
+/*
+ * Bus grant shared by everything that transmits. When the bus is busy
+ * the waiters are served by CAN arbitration priority (lowest ID, 11 bit
+ * before 29 bit) and then by earliest deadline.
+ */
+void tx_sched_acquire(uint32_t id, uint8_t idt, int64_t deadline_us);
+
+void tx_sched_release(void);
+
+/*
+ * Bounds the grant of the current owner: at deadline_us a waiter takes
+ * the bus back, unless tx_sched_lease_end() with the returned lease gave
+ * it back before. Ending a lease which already ran out does nothing.
+ */
+uint32_t tx_sched_lease(int64_t deadline_us);
+
+void tx_sched_lease_end(uint32_t id);
+
+void cantp_txq_stats_get(cantp_txq_stats_t *stats);
+
+//Messages left in the pool of EMU_CANTP_TXQ_LEN
+uint32_t cantp_txq_pool_free(void);
+
+void cantp_txq_stats_print(void);
+
+#endif /* __CANTP_TXQ_H_ */
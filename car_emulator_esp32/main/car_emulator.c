@@ -9,30 +9,250 @@
 #include <stdlib.h>
 
 #include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "freertos/semphr.h"
 
+#include "esp_timer.h"
+
 #include "cantp_esp32.h"
 #include "can-tp.h"
 #include "obd.h"
 #include "car_emulator.h"
+#include "emu_tasks.h"
+#include "cantp_txq.h"
+#include "emu_config.h"
+#include "emu_mem.h"
+#include "obd_id_table.h"
+#include "vehicle_profile.h"
+
+#define VEHICLE_SIM_PERIOD_MS		100
+#define VEHICLE_SIM_CYCLE_STEPS		600		//one drive cycle per minute
+//Attempts to read a consistent snapshot before keeping the previous one
+#define VEHICLE_STATE_READ_TRIES	4
+
+vehicle_state_t vehicle_state = {
+	.speed = 100,
+	.rpm = 2500,
+	.throttle = 30
+};
+//Replaced by the benchmark to keep responses off the bus
+static car_emu_send_t car_emu_send = cantp_send_async;
+//Request frame received to response transmitted, per path
+static car_emu_latency_t latency[2];
+
+/*
+ * Latest snapshot of the simulation, published through a sequence
+ * counter (odd while being written): a newer snapshot replaces an
+ * unread one, so a request always sees the newest state however long
+ * nobody asked.
+ */
+static vehicle_state_t vehicle_state_pub;
+static uint32_t vehicle_state_seq;
+static uint32_t vehicle_state_seen;
+//The responder and the cyclic sender both consume snapshots
+static portMUX_TYPE vehicle_state_mux = portMUX_INITIALIZER_UNLOCKED;
+
+void vehicle_state_init(void)
+{
+	vehicle_state_seq = 0;
+	vehicle_state_seen = 0;
+}
+
+//Single writer, the simulation task
+static void vehicle_state_publish(const vehicle_state_t *vs)
+{
+	__atomic_store_n(&vehicle_state_seq, vehicle_state_seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	vehicle_state_pub = *vs;
+	__atomic_store_n(&vehicle_state_seq, vehicle_state_seq + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Called on the CAN core: takes the newest snapshot from the simulation.
+ * The reader never waits for the writer; when the simulation task was
+ * interrupted in the middle of a write (single core builds) the previous
+ * state is kept until the next request.
+ */
+void vehicle_state_sync(void)
+{
+	vehicle_state_t vs;
+	uint32_t seq;
+
+	for (uint8_t i = 0; i < VEHICLE_STATE_READ_TRIES; i++) {
+		seq = __atomic_load_n(&vehicle_state_seq, __ATOMIC_ACQUIRE);
+		if (seq == vehicle_state_seen) {
+			//Nothing new, keeps a state set from the console
+			return;
+		}
+		vs = vehicle_state_pub;
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if ((seq & 1) == 0 && seq == __atomic_load_n(&vehicle_state_seq, __ATOMIC_RELAXED)) {
+			//Several tasks sync, an older copy must not replace a newer one
+			portENTER_CRITICAL(&vehicle_state_mux);
+			if ((int32_t)(seq - vehicle_state_seen) > 0) {
+				vehicle_state_seen = seq;
+				vehicle_state = vs;
+			}
+			portEXIT_CRITICAL(&vehicle_state_mux);
+			return;
+		}
+	}
+}
+
+//Consistent copy of the state as last seen by the CAN core
+void vehicle_state_get(vehicle_state_t *vs)
+{
+	portENTER_CRITICAL(&vehicle_state_mux);
+	*vs = vehicle_state;
+	portEXIT_CRITICAL(&vehicle_state_mux);
+}
+
+//Only while the simulation is not publishing snapshots
+void vehicle_state_set(const vehicle_state_t *vs)
+{
+	portENTER_CRITICAL(&vehicle_state_mux);
+	vehicle_state = *vs;
+	portEXIT_CRITICAL(&vehicle_state_mux);
+}
+
+/*
+ * Simple drive cycle: accelerate, cruise, coast down to a stop and idle.
+ * Runs on the application core and only publishes snapshots.
+ */
+void vehicle_sim_task(void *arg)
+{
+	vehicle_state_t s;
+	uint32_t step = 0;
+
+	//Continue from the state restored at boot
+	vehicle_state_get(&s);
+
+	while (1) {
+		uint32_t phase = step % VEHICLE_SIM_CYCLE_STEPS;
+		if (phase < 200) {
+			s.throttle = 40;
+			s.speed += 0.6f;
+		} else if (phase < 400) {
+			s.throttle = 15;
+		} else {
+			s.throttle = 0;
+			s.speed = (s.speed > 0.6f)?(s.speed - 0.6f):0;
+		}
+		s.rpm = 800 + s.speed * 25;
+
+		vehicle_state_publish(&s);
+		step++;
+		if (step % (EMU_CONFIG_VEHICLE_SAVE_MS / VEHICLE_SIM_PERIOD_MS) == 0) {
+			emu_config_save_vehicle(&s);
+		}
+		vTaskDelay(VEHICLE_SIM_PERIOD_MS / portTICK_PERIOD_MS);
+	}
+}
+
+uint16_t cfg_boadrate_kbps(cfg_boad_rate_t boadrate)
+{
+	switch (boadrate) {
+		case CFG_125KBPS:
+			return 125;
+		case CFG_250KBPS:
+			return 250;
+		case CFG_1000KBPS:
+			return 1000;
+		default:
+			return 500;
+	}
+}
+
+int cfg_boadrate_from_kbps(uint16_t kbps, cfg_boad_rate_t *boadrate)
+{
+	switch (kbps) {
+		case 125:
+			*boadrate = CFG_125KBPS;
+			break;
+		case 250:
+			*boadrate = CFG_250KBPS;
+			break;
+		case 500:
+			*boadrate = CFG_500KBPS;
+			break;
+		case 1000:
+			*boadrate = CFG_1000KBPS;
+			break;
+		default:
+			return -1;
+	}
+	return 0;
+}
+
+car_emu_send_t car_emu_sender_set(car_emu_send_t send)
+{
+	car_emu_send_t prev = car_emu_send;
+	car_emu_send = send;
+	return prev;
+}
 
-#define OBD2_VIN_LEN 17
-unsigned int vehicle_speed = 100;
-float vehicle_rpm = 2500;
-float vehicle_throttle = 30;
-char vehicle_vin[OBD2_VIN_LEN] = "ESP32OBD2EMULATOR";
-static uint8_t resp_vin[20];
+/*
+ * rx_us: low 32 bits of the reception time, the difference wraps correctly.
+ * Called from the TX tasks of every session and from the dispatcher.
+ */
+static void car_emu_latency_add(car_emu_path_t path, uint32_t rx_us)
+{
+	car_emu_latency_t *lat = &latency[path];
+	uint32_t us = (uint32_t)esp_timer_get_time() - rx_us;
+	uint32_t max = __atomic_load_n(&lat->max_us, __ATOMIC_RELAXED);
+
+	__atomic_fetch_add(&lat->count, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&lat->sum_us, us, __ATOMIC_RELAXED);
+	while (us > max && !__atomic_compare_exchange_n(&lat->max_us, &max, us, 1,
+							__ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+	}
+}
+
+static inline const vehicle_profile_t *car_emu_profile(const emulator_ctx_t *ectx)
+{
+	return (ectx->profile != NULL)?ectx->profile:vehicle_profile;
+}
+
+static inline const vehicle_state_t *car_emu_state(const emulator_ctx_t *ectx)
+{
+	return (ectx->state != NULL)?ectx->state:&vehicle_state;
+}
+
+/*
+ * The reception time travels with the response as the callback argument.
+ * By the time the response is on the bus the session may already hold
+ * the next request, whose time is in ectx->rx_us.
+ */
+static inline void *car_emu_done_arg(const emulator_ctx_t *ectx)
+{
+	return (void *)(uintptr_t)(uint32_t)ectx->rx_us;
+}
+
+//Called by the TX queue once a response is on the bus
+static void car_emu_response_done(int result, void *arg)
+{
+	uint32_t rx_us = (uint32_t)(uintptr_t)arg;
+
+	if (result == 0) {
+		emu_boot_mark_response();
+		if (rx_us != 0) {
+			car_emu_latency_add(CAR_EMU_PATH_FULL, rx_us);
+		}
+	}
+}
 
 void createOBDResponse(	obd2_frame_t *response,
 						uint8_t service,
 						uint8_t pid,
+						uint32_t req_id,
 						cfg_can_idt_t idt)
 {
-	if (idt == CFG_STANDARD_ID) {
-		response->id = 0x7E8;
+	if (EMU_CFG_IDT(idt) == CFG_STANDARD_ID) {
+		response->id = OBD_RESP_ID_STD;
 		response->idt = 0;
 	} else {
-		response->id = 0x18DAF110;
+		//Back to the source address of the tester that asked
+		response->id = OBD_RESP_ID_EXT_TO(req_id);
 		response->idt = 1;
 	}
 	response->len = 2;
@@ -40,133 +260,226 @@ void createOBDResponse(	obd2_frame_t *response,
 	response->obd2_pid = pid; // PID
 }
 
+//Fills in the Service 01 data, returns NULL for PIDs the profile does not support
+static const char *obd1_fill(uint8_t pid, obd2_frame_t *resp,
+		const vehicle_profile_t *p, const vehicle_state_t *vs)
+{
+	if (!vehicle_profile_pid01(p, pid)) {
+		return NULL;
+	}
+	if ((pid & 0x1F) == 0) { // Supported PIDs
+		resp->len += 4; // Number of data bytes
+		memcpy(resp->obd2_d, &p->pids01[pid / 8], 4);
+		return "Supported PIDS";
+	}
+	switch (pid) {
+		case 0x0C: // RPM
+			resp->len += 2; // Number of data bytes
+			obdRevConvert_0C(vs->rpm, &resp->obd2_d[0],
+										&resp->obd2_d[1], 0, 0);
+			return "RPM";
+		case 0x0D: // Speed
+			resp->len += 1; // Number of data bytes
+			obdRevConvert_0D(vs->speed, &resp->obd2_d[0], 0, 0, 0);
+			return "Speed";
+		case 0x11: // Throttle position
+			resp->len += 1; // Number of data bytes
+			obdRevConvert_11(vs->throttle, &resp->obd2_d[0], 0, 0, 0);
+			return "Throttle position";
+		default:
+			return NULL;
+	}
+}
+
+//Service 09 PID 00, the only Service 09 answer fitting a single frame
+static void obd9_fill_supported(obd2_frame_t *resp, const vehicle_profile_t *p)
+{
+	resp->len += 4;
+	memcpy(resp->obd2_d, p->pids09, 4);
+}
+
 void respondToOBD1(uint8_t pid, emulator_ctx_t *ectx)
 {
-	printf("Responding to Service 1: PID 0x%02x ", pid);
+	emu_logf("Responding to Service 1: PID 0x%02x ", pid);
 
 	obd2_frame_t resp;
-	createOBDResponse(&resp, 1, pid, ectx->cfg->id_type);
+	createOBDResponse(&resp, 1, pid, ectx->id, ectx->idt);
+
+	const char *name = obd1_fill(pid, &resp, car_emu_profile(ectx), car_emu_state(ectx));
+	if (name == NULL) {
+		emu_logf(": PID is not supported!\n");
+		return;
+	}
+	emu_logf(": %s\n", name);
+	car_emu_send(ectx->cantp_ctx, resp.id, resp.idt, resp.obd_data, resp.len,
+							CANTP_TXQ_P2_US, car_emu_response_done, car_emu_done_arg(ectx));
+}
+
+void respondToOBD9(uint8_t pid, emulator_ctx_t *ectx)
+{
+	const vehicle_profile_t *p = car_emu_profile(ectx);
+
+	emu_logf("Responding to Service 9: PID 0x%02x ", pid);
+
+	if (!vehicle_profile_pid09(p, pid)) {
+		emu_logf(": PID is not supported!\n");
+		return;
+	}
+
+	obd2_frame_t response;
+	createOBDResponse(&response, 9, pid, ectx->id, ectx->idt);
+
+	//Service, PID, number of data items and the longest item
+	uint8_t data[3 + OBD2_VIN_LEN];
+	uint16_t len = 3;
+	data[0] = response.obd2_service;
+	data[1] = pid;
+	data[2] = 1;
 
 	switch (pid) {
 		case 0x00: // Supported PIDs
-			printf(": Supported PIDS 01-%x\n", pid+0x1F);
-			resp.len += 4; // Number of data bytes
-			resp.obd2_d[0] = 0x00; // can_data[3] Data byte 0
-			resp.obd2_d[1] = 0x18; // can_data[4] Data byte 1
-			resp.obd2_d[2] = 0x80; // can_data[5] Data byte 2
-			resp.obd2_d[3] = 0x00; // can_data[6] Data byte 3
+			emu_logf(": Supported PIDS 01-%x\n", pid+0x1F);
+			obd9_fill_supported(&response, p);
+			car_emu_send(ectx->cantp_ctx, response.id, response.idt,
+									response.obd_data, response.len,
+									CANTP_TXQ_P2_US, car_emu_response_done, car_emu_done_arg(ectx));
+			return;
+		case 0x02: // Vehicle Identification Number (VIN)
+			emu_logf(": VIN %.*s\n", OBD2_VIN_LEN, p->vin);
+			memcpy(&data[3], p->vin, OBD2_VIN_LEN);
+			len += OBD2_VIN_LEN;
 			break;
-		case 0x0C: // RPM
-			printf(": RPM\n");
-			resp.len += 2; // Number of data bytes
-			obdRevConvert_0C(vehicle_rpm, &resp.obd2_d[0],
-										&resp.obd2_d[1], 0, 0);
+		case 0x04: // Calibration ID
+			emu_logf(": CAL ID %.*s\n", VP_CAL_ID_LEN, p->cal_id);
+			memcpy(&data[3], p->cal_id, VP_CAL_ID_LEN);
+			len += VP_CAL_ID_LEN;
 			break;
-		case 0x0D: // Speed
-			printf(": Speed\n");
-			resp.len += 1; // Number of data bytes
-			obdRevConvert_0D(vehicle_speed, &resp.obd2_d[0], 0, 0, 0);
+		default:
+			emu_logf(": PID is not emulated!\n");
+			return;
+	}
+	car_emu_send(ectx->cantp_ctx, response.id, response.idt, data, len,
+							CANTP_TXQ_P2_US, car_emu_response_done, car_emu_done_arg(ectx));
+}
+
+//Service 03, the stored DTCs of the profile
+void respondToOBD3(emulator_ctx_t *ectx)
+{
+	const vehicle_profile_t *p = car_emu_profile(ectx);
+	uint8_t n = (p->n_dtc <= VP_MAX_DTCS) ? p->n_dtc : VP_MAX_DTCS;
+	uint8_t data[2 + 2 * VP_MAX_DTCS];
+	obd2_frame_t response;
+
+	emu_logf("Responding to Service 3: %u DTCs\n", n);
+	createOBDResponse(&response, 3, 0, ectx->id, ectx->idt);
+	data[0] = response.obd2_service;
+	data[1] = n;
+	for (uint8_t i = 0; i < n; i++) {
+		data[2 + 2 * i] = p->dtc[i] >> 8;
+		data[3 + 2 * i] = p->dtc[i] & 0xFF;
+	}
+	car_emu_send(ectx->cantp_ctx, response.id, response.idt, data, 2 + 2 * n,
+							CANTP_TXQ_P2_US, car_emu_response_done, car_emu_done_arg(ectx));
+}
+
+//Handler of the functional and physical OBD request IDs
+static void car_emu_obd_request(const obd_id_entry_t *entry,
+		emulator_ctx_t *ectx, const uint8_t *data, uint16_t len)
+{
+	emu_logf("OBD QUERY (%s)!\n",
+			(entry->kind == OBD_ID_FUNCTIONAL)?"functional":"physical");
+	switch (data[0]) {
+		case 1:
+			respondToOBD1(data[1], ectx);
 			break;
-		case 0x11: // Throttle position
-			printf(": Throttle position\n");
-			resp.len += 1; // Number of data bytes
-			obdRevConvert_11(vehicle_throttle, &resp.obd2_d[0], 0, 0, 0);
+		case 3:
+			respondToOBD3(ectx);
 			break;
-		case 0x20:
-		case 0x40:
-		case 0x60:
-		case 0x80:
-		case 0xA0:
-		case 0xC0:
-		case 0xE0:
-			printf(": Supported PIDS 01-%x\n", pid+0x1F);
-			resp.len += 4; // Number of data bytes
-			resp.obd2_d[0] = 0x00; // can_data[3] Data byte 0
-			resp.obd2_d[1] = 0x00; // can_data[4] Data byte 1
-			resp.obd2_d[2] = 0x00; // can_data[5] Data byte 2
-			resp.obd2_d[3] = 0x00; // can_data[6] Data byte 3
+		case 9:
+			respondToOBD9(data[1], ectx);
 			break;
 		default:
-			printf(": PID is not supported!\n");
-			return;
+			emu_logf("Unsupported Service %d !\n", data[0]);
 	}
-	cantp_send(ectx->cantp_ctx, resp.id, resp.idt, resp.obd_data, resp.len);
 }
 
-void respondToOBD9(uint8_t pid, emulator_ctx_t *ectx)
+int car_emu_id_table_build(const emulator_cfg_t *cfg)
 {
-	printf("Responding to Service 9: PID 0x%02x ", pid);
+	int res = 0;
 
-	obd2_frame_t response;
-	createOBDResponse(&response, 9, pid, ectx->cfg->id_type);
+	obd_id_table_clear();
+	if (EMU_CFG_ID_TYPE(cfg) != CFG_EXTENDED_ID) {
+		res |= obd_id_table_add(OBD_FUNC_ID_STD, 0, OBD_ID_FUNCTIONAL,
+				OBD_PHYS_ID_STD, OBD_RESP_ID_STD, car_emu_obd_request);
+		res |= obd_id_table_add(OBD_PHYS_ID_STD, 0, OBD_ID_PHYSICAL,
+				OBD_PHYS_ID_STD, OBD_RESP_ID_STD, car_emu_obd_request);
+	}
+	if (EMU_CFG_ID_TYPE(cfg) != CFG_STANDARD_ID) {
+		res |= obd_id_table_add(OBD_FUNC_ID_EXT, 1, OBD_ID_FUNCTIONAL,
+				OBD_PHYS_ID_EXT, OBD_RESP_ID_EXT, car_emu_obd_request);
+		res |= obd_id_table_add(OBD_PHYS_ID_EXT, 1, OBD_ID_PHYSICAL,
+				OBD_PHYS_ID_EXT, OBD_RESP_ID_EXT, car_emu_obd_request);
+	}
+	return res;
+}
 
-	switch (pid) {
-		case 0x00: {// Supported PIDs
-			printf(": Supported PIDS 01-%x\n", pid+0x1F);
-			response.len += 4;
-			response.obd2_d[0] = 0x40;
-			response.obd2_d[1] = 0x00; // Data byte 2
-			response.obd2_d[2] = 0x00; // Data byte 3
-			response.obd2_d[3] = 0x00; // Data byte 4
-			cantp_send(ectx->cantp_ctx, response.id, response.idt,
-													response.obd_data, response.len);
-		}; break;
-		case 0x02: // Vehicle Identification Number (VIN)
-			printf(": VIN\n");
-//			uint8_t *resp_vin = malloc(20);
-			obd2_frame_t *res_vin_p;
-			res_vin_p = (obd2_frame_t *)resp_vin;
+int car_emu_fast_request(const cantp_can_frame_t *frame, int64_t rx_us)
+{
+	const uint8_t *d = frame->data_u8;
+	uint8_t len = d[0] & 0x0F;
+	const obd_id_entry_t *entry;
+	obd2_frame_t resp;
 
-			createOBDResponse(res_vin_p, 9, pid, ectx->cfg->id_type);
+	/*
+	 * Only Single Frames with one PID, on an ID served by the OBD handler,
+	 * and only where the answer is the one can_check_rx_frame() gives.
+	 * Everything else goes to the CAN-TP path.
+	 */
+	if ((d[0] >> 4) != 0 || len != 2 || len + 1 > frame->dlc) {
+		return -1;
+	}
+	entry = obd_id_lookup(frame->id, frame->rtr);
+	if (entry == NULL || entry->handler != car_emu_obd_request) {
+		return -1;
+	}
+	createOBDResponse(&resp, d[1], d[2], frame->id, frame->rtr);
+	vehicle_state_sync();
+	if (d[1] == 1) {
+		if (obd1_fill(d[2], &resp, vehicle_profile, &vehicle_state) == NULL) {
+			return -1;
+		}
+	} else if (d[1] == 9 && d[2] == 0x00 && vehicle_profile_pid09(vehicle_profile, 0x00)) {
+		obd9_fill_supported(&resp, vehicle_profile);
+	} else {
+		return -1;
+	}
 
-			res_vin_p->obd2_d[0] = 1;
+	uint8_t tx[8] = { 0 };
+	tx[0] = resp.len;		//N_PCI: single frame, length
+	memcpy(&tx[1], resp.obd_data, resp.len);
+	if (cantp_can_tx_deadline(resp.id, resp.idt, 8, tx, CANTP_TXQ_N_AS_US,
+								rx_us + CANTP_TXQ_P2_US) == 0) {
+		emu_boot_mark_response();
+		car_emu_latency_add(CAR_EMU_PATH_FAST, (uint32_t)rx_us);
+	}
+	return 0;
+}
 
-			printf("Copy VIN: ");
-			for (uint8_t i = 0; i < OBD2_VIN_LEN; i++) {
-				res_vin_p->obd2_d[i+1] = vehicle_vin[i];
-				printf("%c(0x%02x) ", vehicle_vin[i], vehicle_vin[i]);
-			}
-			printf("\n"); fflush(0);
-
-			res_vin_p->len += OBD2_VIN_LEN + 1;
-			cantp_send(ectx->cantp_ctx, res_vin_p->id, res_vin_p->idt,
-													res_vin_p->obd_data, res_vin_p->len);
-//			// Initiate multi-frame message packet
-//			response.can_data[0] = 0x10; // FF (First Frame, ISO_15765-2)
-//			response.can_data[1] = 0x14; // Length (20 bytes)
-//			response.can_data[2] = 0x49; // Service (+ 0x40)
-//			response.obd2_d[0] = 0x02; // PID
-//			response.obd2_d[1] = 0x01; // Data byte 1
-//			response.obd2_d[2] = vehicle_vin[0]; // Data byte 2
-//			response.obd2_d[3] = vehicle_vin[1]; // Data byte 3
-//			response.obd2_d[4] = vehicle_vin[2]; // Data byte 4
-//
-//			esp32_twai_send_response(&response);
-
-//			// Clear flow control queue
-//			// memset(can_flow_queue, 0, 40);
-//
-//			// Fill flow control queue
-//			// Part 1
-//			can_flow_queue[0][0] = 0x21; // CF (Consecutive Frame, ISO_15765-2), sequence number
-//			can_flow_queue[0][1] = vehicle_vin[3]; // Data byte 1
-//			can_flow_queue[0][2] = vehicle_vin[4]; // Data byte 2
-//			can_flow_queue[0][3] = vehicle_vin[5]; // Data byte 3
-//			can_flow_queue[0][4] = vehicle_vin[6]; // Data byte 4
-//			can_flow_queue[0][5] = vehicle_vin[7]; // Data byte 5
-//			can_flow_queue[0][6] = vehicle_vin[8]; // Data byte 6
-//			can_flow_queue[0][7] = vehicle_vin[9]; // Data byte 7
-//			// Part 2
-//			can_flow_queue[1][0] = 0x22; // CF
-//			can_flow_queue[1][1] = vehicle_vin[10]; // Data byte 1
-//			can_flow_queue[1][2] = vehicle_vin[11]; // Data byte 2
-//			can_flow_queue[1][3] = vehicle_vin[12]; // Data byte 3
-//			can_flow_queue[1][4] = vehicle_vin[13]; // Data byte 4
-//			can_flow_queue[1][5] = vehicle_vin[14]; // Data byte 5
-//			can_flow_queue[1][6] = vehicle_vin[15]; // Data byte 6
-//			can_flow_queue[1][7] = vehicle_vin[16]; // Data byte 7
+void car_emu_latency_get(car_emu_path_t path, car_emu_latency_t *lat)
+{
+	*lat = latency[path];
+}
 
-			break;
+void car_emu_latency_print(void)
+{
+	static const char *path_names[] = { "CAN-TP", "fast" };
+
+	printf("\nRequest to response latency:\n");
+	for (uint8_t p = 0; p < 2; p++) {
+		car_emu_latency_t *lat = &latency[p];
+		printf("%-7s count=%u avg=%uus max=%uus\n", path_names[p], lat->count,
+				(lat->count > 0)?(uint32_t)(lat->sum_us / lat->count):0,
+				lat->max_us);
 	}
 }
 
@@ -177,68 +490,21 @@ void can_check_rx_frame(emulator_ctx_t *ectx)
 	obd_rx_frame.id = ectx->id;
 	obd_rx_frame.idt = ectx->idt;
 	if (ectx->len > 7) {
-		printf("RX Len %d can not be larger than 7\n", ectx->len);
+		emu_logf("RX Len %d can not be larger than 7\n", ectx->len);
 	}
 	for (uint8_t i=0; i < ectx->len; i++) {
 		obd_rx_frame.obd_data[i] = ectx->data[i];
 	}
 
 	free(ectx->data);
+	emu_mem_rx_free(ectx->len);
 
-	uint32_t tester_id;
-	switch (ectx->cfg->id_type) {
-	case CFG_STANDARD_ID:
-		tester_id = 0x7df;
-		break;
-	case CFG_EXTENDED_ID:
-		tester_id = 0x18DB33F1;
-		break;
-	default:
-		printf("ERROR: Tester ID Type is not correct: %d", ectx->cfg->id_type);
-		tester_id = 0x7df;
-		break;
-	}
-
-	printf("====================================OBD2======================================\n");
-	// Check if frame is OBD query
-	if (obd_rx_frame.idt == ectx->cfg->id_type) {
-		// Compare the bits ID
-		if (obd_rx_frame.id == tester_id) {
-			printf("OBD QUERY !\n");
-			switch (obd_rx_frame.obd2_service) {
-				case 1:
-					respondToOBD1(obd_rx_frame.obd2_pid, ectx);
-					break;
-				case 9:
-					respondToOBD9(obd_rx_frame.obd2_pid, ectx);
-					break;
-				default:
-					printf("Unsupported Service %d !\n", obd_rx_frame.obd2_service);
-			}
-		} //else
-//		if (obd_rx_frame.id == 0x7e0) { // Check if frame is addressed to the ECU (us)
-//			printf("ECU MSG !\n");
-//
-//			if (obd_rx_frame.len == 0x30) { // Flow control frame (continue)
-//				obd2_can_frame_t response = createOBDResponse(0, 0);
-//
-//				for (int i = 0; i < 5; i++) {
-//					if (can_flow_queue[i][0] == 0) {
-//						continue;
-//					}
-//
-//					for (int j = 0; j < 8; j++) {
-//						response.can_data[j] = can_flow_queue[i][j];
-//					}
-//					esp32_twai_send_response(&response);
-//				}
-//
-//				memset(can_flow_queue, 0, 40);
-//			}
-//		}
-	} else {
-		//29bit ID
+	vehicle_state_sync();
 
+	emu_logf("====================================OBD2======================================\n");
+	const obd_id_entry_t *entry = obd_id_lookup(obd_rx_frame.id, obd_rx_frame.idt);
+	if (entry != NULL) {
+		entry->handler(entry, ectx, obd_rx_frame.obd_data, ectx->len);
 	}
-	printf("====================================OBD2 END==================================\n");
+	emu_logf("====================================OBD2 END==================================\n");
 }
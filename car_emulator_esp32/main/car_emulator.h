@@ -8,16 +8,36 @@
 #ifndef __CAR_EMULATOR_H_
 #define __CAR_EMULATOR_H_
 
+#include "sdkconfig.h"
+
+#include "obd.h"
+#include "cantp_txq.h"
+
 #define ESP32_IDF_CAN_HAL	1
 
+#define OBD2_VIN_LEN 17
+
+//Addresses of the emulated ECU, the first engine ECU in ISO 15765-4
+#define OBD_FUNC_ID_STD			0x7DF
+#define OBD_PHYS_ID_STD			0x7E0
+#define OBD_RESP_ID_STD			0x7E8
+#define OBD_FUNC_ID_EXT			0x18DB33F1
+#define OBD_PHYS_ID_EXT			0x18DA10F1
+#define OBD_RESP_ID_EXT			0x18DAF110
+//29-bit response to the tester with the source address of req_id
+#define OBD_RESP_ID_EXT_TO(req_id)	((OBD_RESP_ID_EXT & 0x1FFF00FF) | (((req_id) & 0xFF) << 8))
+
 typedef enum {
 	CFG_250KBPS = 0,
-	CFG_500KBPS
+	CFG_500KBPS,
+	CFG_125KBPS,
+	CFG_1000KBPS
 } cfg_boad_rate_t;
 
 typedef enum {
 	CFG_STANDARD_ID = 0,
-	CFG_EXTENDED_ID
+	CFG_EXTENDED_ID,
+	CFG_MIXED_ID		//11 and 29 bit testers on the same bus
 } cfg_can_idt_t;
 
 typedef struct emulator_cfg_s {
@@ -25,16 +45,111 @@ typedef struct emulator_cfg_s {
 	cfg_can_idt_t id_type;
 } emulator_cfg_t;
 
+/*
+ * Bit rate and ID type of a configuration. With CONFIG_CAR_EMU_FIXED_CONFIG
+ * they are constants and the branches on them are resolved at compile time.
+ */
+#ifdef CONFIG_CAR_EMU_FIXED_CONFIG
+#if defined(CONFIG_CAR_EMU_FIXED_125KBPS)
+#define EMU_FIXED_BOADRATE		CFG_125KBPS
+#elif defined(CONFIG_CAR_EMU_FIXED_250KBPS)
+#define EMU_FIXED_BOADRATE		CFG_250KBPS
+#elif defined(CONFIG_CAR_EMU_FIXED_1000KBPS)
+#define EMU_FIXED_BOADRATE		CFG_1000KBPS
+#else
+#define EMU_FIXED_BOADRATE		CFG_500KBPS
+#endif
+
+#if defined(CONFIG_CAR_EMU_FIXED_EXT)
+#define EMU_FIXED_ID_TYPE		CFG_EXTENDED_ID
+#elif defined(CONFIG_CAR_EMU_FIXED_ALL)
+#define EMU_FIXED_ID_TYPE		CFG_MIXED_ID
+#else
+#define EMU_FIXED_ID_TYPE		CFG_STANDARD_ID
+#endif
+
+#define EMU_CFG_BOADRATE(cfg)	EMU_FIXED_BOADRATE
+#define EMU_CFG_ID_TYPE(cfg)	EMU_FIXED_ID_TYPE
+//ID type of a served frame: only the fixed type is in the ID table
+#define EMU_CFG_IDT(idt)		((EMU_FIXED_ID_TYPE == CFG_MIXED_ID) ? (idt) : \
+									(EMU_FIXED_ID_TYPE == CFG_EXTENDED_ID))
+#else
+#define EMU_CFG_BOADRATE(cfg)	((cfg)->boadrate)
+#define EMU_CFG_ID_TYPE(cfg)	((cfg)->id_type)
+#define EMU_CFG_IDT(idt)		(idt)
+#endif
+
+typedef struct vehicle_state_s {
+	float speed;		//km/h
+	float rpm;
+	float throttle;		//%
+} vehicle_state_t;
+
+struct vehicle_profile_s;
+
 typedef struct emulator_ctx_c {
 	emulator_cfg_t *cfg;
 	cantp_rxtx_status_t *cantp_ctx;
+	//The car answering, NULL for the selected profile and vehicle_state
+	const struct vehicle_profile_s *profile;
+	const vehicle_state_t *state;
 	SemaphoreHandle_t sem;
 	uint32_t id;
 	uint8_t idt;
 	uint16_t len;
 	uint8_t *data;
+	int64_t rx_us;		//first frame of the request received
 } emulator_ctx_t;
 
+typedef enum {
+	CAR_EMU_PATH_FULL = 0,	//CAN-TP receiver, can_check_rx_frame() and TX queue
+	CAR_EMU_PATH_FAST		//answered by the dispatcher
+} car_emu_path_t;
+
+typedef struct car_emu_latency_s {
+	uint32_t count;
+	uint32_t max_us;
+	uint64_t sum_us;
+} car_emu_latency_t;
+
+extern vehicle_state_t vehicle_state;
+
+typedef int (*car_emu_send_t)(cantp_rxtx_status_t *ctx, uint32_t id, uint8_t idt,
+		const uint8_t *data, uint16_t len, uint32_t deadline_us,
+		cantp_send_done_cb_t cb, void *cb_arg);
+
 void can_check_rx_frame(emulator_ctx_t *ectx);
 
+//Fills the ID table with the addresses cfg->id_type asks to serve
+int car_emu_id_table_build(const emulator_cfg_t *cfg);
+void createOBDResponse(obd2_frame_t *response, uint8_t service, uint8_t pid,
+		uint32_t req_id, cfg_can_idt_t idt);
+void respondToOBD1(uint8_t pid, emulator_ctx_t *ectx);
+void respondToOBD9(uint8_t pid, emulator_ctx_t *ectx);
+void respondToOBD3(emulator_ctx_t *ectx);
+
+/*
+ * Answers a Single Frame OBD request with a Single Frame response right
+ * away, for the dispatcher task. Returns -1 when the request has to go
+ * through CAN-TP: multi-frame responses, more than one PID, unsupported
+ * PIDs, other IDs.
+ */
+int car_emu_fast_request(const cantp_can_frame_t *frame, int64_t rx_us);
+
+void car_emu_latency_get(car_emu_path_t path, car_emu_latency_t *lat);
+void car_emu_latency_print(void);
+
+//Sets the function the responses are sent with, returns the previous one
+car_emu_send_t car_emu_sender_set(car_emu_send_t send);
+
+uint16_t cfg_boadrate_kbps(cfg_boad_rate_t boadrate);
+//Returns -1 when kbps is not a supported rate
+int cfg_boadrate_from_kbps(uint16_t kbps, cfg_boad_rate_t *boadrate);
+
+void vehicle_state_init(void);
+void vehicle_state_sync(void);
+void vehicle_state_get(vehicle_state_t *vs);
+void vehicle_state_set(const vehicle_state_t *vs);
+void vehicle_sim_task(void *arg);
+
 #endif /* __CAR_EMULATOR_H_ */
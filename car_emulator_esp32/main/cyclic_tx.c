@@ -0,0 +1,226 @@
+/*
+ * cyclic_tx.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "cantp_esp32.h"
+#include "can-tp.h"
+#include "car_emulator.h"
+#include "emu_tasks.h"
+#include "dbc_tables.h"
+#include "cyclic_tx.h"
+
+#define TAG             "CYCLIC_TX"
+
+#ifdef CONFIG_CAR_EMU_CYCLIC_TX
+
+#define CYCLIC_TX_REPORT_US		(30 * 1000000LL)
+
+typedef struct cyclic_tx_slot_s {
+	int64_t due_us;
+	uint8_t counter;
+} cyclic_tx_slot_t;
+
+static cyclic_tx_slot_t *slots;
+static cyclic_tx_stats_t *stats;
+static esp_timer_handle_t tick_timer;
+static TaskHandle_t cyclic_task;
+
+static void dbc_pack(uint8_t *data, const dbc_signal_t *sig, uint32_t raw)
+{
+	uint8_t bit = sig->start_bit;
+
+	if (!sig->big_endian) {
+		//Intel: start bit is the LSB, bits go up
+		for (uint8_t i = 0; i < sig->length; i++, bit++) {
+			if (raw & (1UL << i)) {
+				data[bit >> 3] |= 1 << (bit & 7);
+			}
+		}
+		return;
+	}
+	//Motorola: start bit is the MSB, continues at bit 7 of the next byte
+	for (int8_t i = sig->length - 1; i >= 0; i--) {
+		if (raw & (1UL << i)) {
+			data[bit >> 3] |= 1 << (bit & 7);
+		}
+		bit = ((bit & 7) == 0)?(bit + 15):(bit - 1);
+	}
+}
+
+static float cyclic_tx_value(const dbc_signal_t *sig, const vehicle_state_t *vs)
+{
+	switch (sig->source) {
+	case DBC_SRC_SPEED:
+		return vs->speed;
+	case DBC_SRC_RPM:
+		return vs->rpm;
+	case DBC_SRC_THROTTLE:
+		return vs->throttle;
+	case DBC_SRC_RUNNING:
+		return (vs->rpm > 0)?1:0;
+	default:
+		return sig->init;
+	}
+}
+
+uint8_t cyclic_tx_encode(const dbc_message_t *msg, uint8_t counter, uint8_t *data)
+{
+	vehicle_state_t vs;
+
+	//One consistent snapshot for all signals of the frame
+	vehicle_state_get(&vs);
+	memset(data, 0, 8);
+	for (uint8_t s = 0; s < msg->n_signals; s++) {
+		const dbc_signal_t *sig = &dbc_signals[msg->first_signal + s];
+		int32_t raw_max = (sig->length >= 32)?INT32_MAX:
+				(int32_t)((1UL << (sig->length - sig->is_signed)) - 1);
+		int32_t raw_min = sig->is_signed ? (-raw_max - 1) : 0;
+		int32_t raw;
+
+		if (sig->source == DBC_SRC_COUNTER) {
+			raw = counter & raw_max;
+		} else {
+			float v = cyclic_tx_value(sig, &vs);
+			if (sig->max > sig->min) {
+				v = (v < sig->min)?sig->min:((v > sig->max)?sig->max:v);
+			}
+			float r = (v - sig->offset) / sig->factor;
+			raw = (int32_t)((r >= 0)?(r + 0.5f):(r - 0.5f));
+			raw = (raw < raw_min)?raw_min:((raw > raw_max)?raw_max:raw);
+		}
+		uint32_t bits = (uint32_t)raw;
+		if (sig->length < 32) {
+			bits &= (1UL << sig->length) - 1;
+		}
+		dbc_pack(data, sig, bits);
+	}
+	return msg->dlc;
+}
+
+static void cyclic_tx_tick_cb(void *arg)
+{
+	xTaskNotifyGive(cyclic_task);
+}
+
+static void cyclic_tx_task(void *arg)
+{
+	int64_t next_report = esp_timer_get_time() + CYCLIC_TX_REPORT_US;
+	uint8_t data[8];
+
+	while (1) {
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+		vehicle_state_sync();
+
+		for (uint16_t i = 0; i < dbc_n_messages; i++) {
+			const dbc_message_t *msg = &dbc_messages[i];
+			cyclic_tx_slot_t *slot = &slots[i];
+			cyclic_tx_stats_t *st = &stats[i];
+			int64_t period = msg->cycle_ms * 1000LL;
+			int64_t now = esp_timer_get_time();
+
+			if (now < slot->due_us) {
+				continue;
+			}
+			if (now - slot->due_us >= period) {
+				int64_t skipped = (now - slot->due_us) / period;
+				st->missed += skipped;
+				slot->due_us += skipped * period;
+			}
+
+			int32_t jitter = (int32_t)(now - slot->due_us);
+			if (st->sent == 0 || jitter < st->jitter_min_us) {
+				st->jitter_min_us = jitter;
+			}
+			if (jitter > st->jitter_max_us) {
+				st->jitter_max_us = jitter;
+			}
+			st->jitter_sum_us += jitter;
+
+			uint8_t dlc = cyclic_tx_encode(msg, slot->counter++, data);
+			if (cantp_can_tx_deadline(msg->id, msg->idt, dlc, data, period,
+										slot->due_us + period) < 0) {
+				st->tx_errors++;
+			}
+			st->sent++;
+			slot->due_us += period;
+		}
+
+		if (esp_timer_get_time() >= next_report) {
+			next_report += CYCLIC_TX_REPORT_US;
+			cyclic_tx_stats_print();
+		}
+	}
+}
+
+int cyclic_tx_start(void)
+{
+	if (dbc_n_messages == 0) {
+		return 0;
+	}
+	slots = calloc(dbc_n_messages, sizeof(cyclic_tx_slot_t));
+	stats = calloc(dbc_n_messages, sizeof(cyclic_tx_stats_t));
+	if (slots == NULL || stats == NULL) {
+		return -1;
+	}
+
+	//Stagger the first transmissions by one tick so they do not collide
+	int64_t now = esp_timer_get_time();
+	for (uint16_t i = 0; i < dbc_n_messages; i++) {
+		slots[i].due_us = now + (i + 1) * CONFIG_CAR_EMU_CYCLIC_TICK_US;
+	}
+
+	if (emu_task_create(cyclic_tx_task, "cyclic_tx", 3 * 1024, NULL, 4,
+										EMU_CORE_CAN, &cyclic_task) != pdPASS) {
+		return -1;
+	}
+	const esp_timer_create_args_t tick_timer_args = {
+			.callback = &cyclic_tx_tick_cb,
+			.arg = NULL,
+			.name = "cyclic_tx"
+	};
+	if (esp_timer_create(&tick_timer_args, &tick_timer) != ESP_OK) {
+		return -1;
+	}
+	ESP_LOGI(TAG, "%d cyclic messages", dbc_n_messages);
+	return (esp_timer_start_periodic(tick_timer,
+					CONFIG_CAR_EMU_CYCLIC_TICK_US) == ESP_OK)?0:-1;
+}
+
+void cyclic_tx_stop(void)
+{
+	if (tick_timer != NULL) {
+		esp_timer_stop(tick_timer);
+	}
+}
+
+void cyclic_tx_stats_print(void)
+{
+	if (stats == NULL) {
+		return;
+	}
+	emu_logf("\nCyclic TX:     ID  cycle      sent  missed  errors  jitter min/avg/max (us)\n");
+	for (uint16_t i = 0; i < dbc_n_messages; i++) {
+		const dbc_message_t *msg = &dbc_messages[i];
+		cyclic_tx_stats_t *st = &stats[i];
+		emu_logf("       %8x %4ums %9u %7u %7u   %d/%d/%d\n",
+				msg->id, msg->cycle_ms, st->sent, st->missed, st->tx_errors,
+				st->jitter_min_us,
+				(st->sent > 0)?(int32_t)(st->jitter_sum_us / st->sent):0,
+				st->jitter_max_us);
+	}
+}
+
+#endif //CONFIG_CAR_EMU_CYCLIC_TX
@@ -0,0 +1,37 @@
+/*
+ * cyclic_tx.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+
+#ifndef __CYCLIC_TX_H_
+#define __CYCLIC_TX_H_
+
+#include <stdint.h>
+
+#include "dbc_tables.h"
+
+typedef struct cyclic_tx_stats_s {
+	uint32_t sent;
+	uint32_t missed;		//slots skipped because the message was too late
+	uint32_t tx_errors;
+	int32_t jitter_min_us;	//actual - scheduled send time
+	int32_t jitter_max_us;
+	int64_t jitter_sum_us;
+} cyclic_tx_stats_t;
+
+/*
+ * Sends every message of the DBC tables at its cycle time with signal
+ * values taken from the vehicle state.
+ */
+int cyclic_tx_start(void);
+
+void cyclic_tx_stop(void);
+
+//Encodes one message from the current vehicle state, returns the DLC
+uint8_t cyclic_tx_encode(const dbc_message_t *msg, uint8_t counter, uint8_t *data);
+
+void cyclic_tx_stats_print(void);
+
+#endif /* __CYCLIC_TX_H_ */
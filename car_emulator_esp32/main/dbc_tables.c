@@ -0,0 +1,33 @@
+/*
+ * dbc_tables.c
+ *
+ * Generated by tools/dbc2c.py from dbc/vehicle.dbc, do not edit.
+ */
+#include <stdint.h>
+
+#include "dbc_tables.h"
+
+const dbc_signal_t dbc_signals[] = {
+	{  0, 16, 0, 0, DBC_SRC_RPM, 0.25f, 0.0f, 0.0f, 16383.75f, 0.0f },	//ENGINE_STATUS.EngineSpeed
+	{ 16,  8, 0, 0, DBC_SRC_THROTTLE, 0.392157f, 0.0f, 0.0f, 100.0f, 0.0f },	//ENGINE_STATUS.ThrottlePosition
+	{ 24,  1, 0, 0, DBC_SRC_RUNNING, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f },	//ENGINE_STATUS.EngineRunning
+	{ 28,  4, 0, 0, DBC_SRC_COUNTER, 1.0f, 0.0f, 0.0f, 15.0f, 0.0f },	//ENGINE_STATUS.EngineStatusCounter
+	{  0, 16, 0, 0, DBC_SRC_SPEED, 0.01f, 0.0f, 0.0f, 655.35f, 0.0f },	//WHEEL_SPEEDS.WheelSpeedFL
+	{ 16, 16, 0, 0, DBC_SRC_SPEED, 0.01f, 0.0f, 0.0f, 655.35f, 0.0f },	//WHEEL_SPEEDS.WheelSpeedFR
+	{ 32, 16, 0, 0, DBC_SRC_SPEED, 0.01f, 0.0f, 0.0f, 655.35f, 0.0f },	//WHEEL_SPEEDS.WheelSpeedRL
+	{ 48, 16, 0, 0, DBC_SRC_SPEED, 0.01f, 0.0f, 0.0f, 655.35f, 0.0f },	//WHEEL_SPEEDS.WheelSpeedRR
+	{  7, 16, 1, 0, DBC_SRC_SPEED, 0.01f, 0.0f, 0.0f, 655.35f, 0.0f },	//VEHICLE_SPEED.VehicleSpeed
+	{ 19,  4, 1, 0, DBC_SRC_CONST, 1.0f, 0.0f, 0.0f, 8.0f, 4.0f },	//VEHICLE_SPEED.GearPosition
+	{  0,  8, 0, 0, DBC_SRC_CONST, 1.0f, -40.0f, -40.0f, 215.0f, 90.0f },	//ENGINE_TEMPERATURES.CoolantTemperature
+	{  8,  8, 0, 0, DBC_SRC_CONST, 1.0f, -40.0f, -40.0f, 215.0f, 95.0f },	//ENGINE_TEMPERATURES.OilTemperature
+	{ 16,  8, 0, 1, DBC_SRC_CONST, 0.5f, 0.0f, -64.0f, 63.5f, 20.0f },	//ENGINE_TEMPERATURES.AmbientTemperature
+};
+
+const dbc_message_t dbc_messages[] = {
+	{ 0x000000c9, 0, 8,    10,   0,  4 },	//ENGINE_STATUS
+	{ 0x000001f5, 0, 8,    20,   4,  4 },	//WHEEL_SPEEDS
+	{ 0x000003e9, 0, 8,   100,   8,  2 },	//VEHICLE_SPEED
+	{ 0x000004c1, 0, 8,  1000,  10,  3 },	//ENGINE_TEMPERATURES
+};
+
+const uint16_t dbc_n_messages = 4;
@@ -0,0 +1,50 @@
+/*
+ * dbc_tables.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+
+#ifndef __DBC_TABLES_H_
+#define __DBC_TABLES_H_
+
+#include <stdint.h>
+
+//Vehicle state a signal is taken from (DBC attribute "EmuSource")
+typedef enum {
+	DBC_SRC_CONST = 0,		//GenSigStartValue
+	DBC_SRC_SPEED,
+	DBC_SRC_RPM,
+	DBC_SRC_THROTTLE,
+	DBC_SRC_RUNNING,		//1 while the engine turns
+	DBC_SRC_COUNTER			//rolling counter of the message
+} dbc_source_t;
+
+typedef struct dbc_signal_s {
+	uint8_t start_bit;		//DBC numbering, MSB for big endian signals
+	uint8_t length;
+	uint8_t big_endian;
+	uint8_t is_signed;
+	uint8_t source;			//dbc_source_t
+	float factor;
+	float offset;
+	float min;
+	float max;
+	float init;				//physical value for DBC_SRC_CONST
+} dbc_signal_t;
+
+typedef struct dbc_message_s {
+	uint32_t id;
+	uint8_t idt;
+	uint8_t dlc;
+	uint16_t cycle_ms;
+	uint16_t first_signal;	//index into dbc_signals
+	uint8_t n_signals;
+} dbc_message_t;
+
+//Generated from dbc/vehicle.dbc by tools/dbc2c.py into dbc_tables.c
+extern const dbc_signal_t dbc_signals[];
+extern const dbc_message_t dbc_messages[];
+extern const uint16_t dbc_n_messages;
+
+#endif /* __DBC_TABLES_H_ */
@@ -0,0 +1,220 @@
+/*
+ * emu_bench.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+
+#include "obd.h"
+#include "car_emulator.h"
+#include "emu_tasks.h"
+#include "emu_mem.h"
+#include "obd_id_table.h"
+#include "emu_bench.h"
+
+typedef uint32_t (*emu_bench_fn_t)(uint32_t iters, uint32_t arg);
+
+typedef struct emu_bench_case_s {
+	const char *name;
+	emu_bench_fn_t fn;
+	uint32_t arg;
+	uint32_t iters;		//sized for a few milliseconds per repetition
+} emu_bench_case_t;
+
+static uint32_t bench_enc_0C(uint32_t iters, uint32_t arg);
+static uint32_t bench_enc_0D(uint32_t iters, uint32_t arg);
+static uint32_t bench_enc_11(uint32_t iters, uint32_t arg);
+static uint32_t bench_enc_05(uint32_t iters, uint32_t arg);
+static uint32_t bench_create_resp(uint32_t iters, uint32_t arg);
+static uint32_t bench_obd1(uint32_t iters, uint32_t arg);
+static uint32_t bench_obd9(uint32_t iters, uint32_t arg);
+static uint32_t bench_rx_parse(uint32_t iters, uint32_t arg);
+
+static const emu_bench_case_t bench_cases[] = {
+	{ "enc_0C_rpm",		bench_enc_0C,		0,		10000 },
+	{ "enc_0D_speed",	bench_enc_0D,		0,		10000 },
+	{ "enc_11_throttle",bench_enc_11,		0,		10000 },
+	{ "enc_05_coolant",	bench_enc_05,		0,		10000 },
+	{ "create_resp",	bench_create_resp,	0,		10000 },
+	{ "obd1_0C",		bench_obd1,			0x0C,	2000 },
+	{ "obd1_00",		bench_obd1,			0x00,	2000 },
+	{ "obd9_02_vin",	bench_obd9,			0x02,	2000 },
+	{ "rx_parse",		bench_rx_parse,		0,		1000 }
+};
+#define EMU_BENCH_CASES		(sizeof(bench_cases) / sizeof(bench_cases[0]))
+
+static volatile uint32_t bench_sink;
+static uint32_t bench_sent;
+static emulator_cfg_t bench_cfg = {
+	.boadrate = CFG_500KBPS,
+	.id_type = CFG_STANDARD_ID
+};
+static emulator_ctx_t bench_ctx = {
+	.cfg = &bench_cfg
+};
+
+//Takes the place of cantp_send_async() so no response reaches the bus
+static int bench_send(cantp_rxtx_status_t *ctx, uint32_t id, uint8_t idt,
+		const uint8_t *data, uint16_t len, uint32_t deadline_us,
+		cantp_send_done_cb_t cb, void *cb_arg)
+{
+	bench_sink += data[len - 1];
+	bench_sent++;
+	return 0;
+}
+
+static uint32_t bench_enc_0C(uint32_t iters, uint32_t arg)
+{
+	uint8_t a, b;
+	for (uint32_t i = 0; i < iters; i++) {
+		obdRevConvert_0C((float)(i & 0x1FFF), &a, &b, 0, 0);
+		bench_sink += a + b;
+	}
+	return 0;
+}
+
+static uint32_t bench_enc_0D(uint32_t iters, uint32_t arg)
+{
+	uint8_t a;
+	for (uint32_t i = 0; i < iters; i++) {
+		obdRevConvert_0D((float)(i & 0xFF), &a, 0, 0, 0);
+		bench_sink += a;
+	}
+	return 0;
+}
+
+static uint32_t bench_enc_11(uint32_t iters, uint32_t arg)
+{
+	uint8_t a;
+	for (uint32_t i = 0; i < iters; i++) {
+		obdRevConvert_11((float)(i % 101), &a, 0, 0, 0);
+		bench_sink += a;
+	}
+	return 0;
+}
+
+static uint32_t bench_enc_05(uint32_t iters, uint32_t arg)
+{
+	uint8_t a;
+	for (uint32_t i = 0; i < iters; i++) {
+		obdRevConvert_05((float)(i & 0x7F) - 40, &a, 0, 0, 0);
+		bench_sink += a;
+	}
+	return 0;
+}
+
+static uint32_t bench_create_resp(uint32_t iters, uint32_t arg)
+{
+	obd2_frame_t resp;
+	for (uint32_t i = 0; i < iters; i++) {
+		createOBDResponse(&resp, 1, i & 0xFF, (i & 1) ? OBD_FUNC_ID_EXT : OBD_FUNC_ID_STD, i & 1);
+		bench_sink += resp.id;
+	}
+	return 0;
+}
+
+static uint32_t bench_obd1(uint32_t iters, uint32_t arg)
+{
+	bench_sent = 0;
+	for (uint32_t i = 0; i < iters; i++) {
+		respondToOBD1(arg, &bench_ctx);
+	}
+	return (bench_sent < iters)?(iters - bench_sent):0;
+}
+
+static uint32_t bench_obd9(uint32_t iters, uint32_t arg)
+{
+	bench_sent = 0;
+	for (uint32_t i = 0; i < iters; i++) {
+		respondToOBD9(arg, &bench_ctx);
+	}
+	return (bench_sent < iters)?(iters - bench_sent):0;
+}
+
+//Same path as cantp_esp32.c: a heap copy of the request, freed by the parser
+static uint32_t bench_rx_parse(uint32_t iters, uint32_t arg)
+{
+	//The CAN-TP payload: service and PID, no PCI byte
+	static const uint8_t req[] = { 0x01, 0x0C };
+	uint32_t errors = 0;
+
+	//To whichever functional address the ID table serves
+	bench_ctx.idt = (obd_id_lookup(OBD_FUNC_ID_STD, 0) == NULL);
+	bench_ctx.id = bench_ctx.idt ? OBD_FUNC_ID_EXT : OBD_FUNC_ID_STD;
+	bench_sent = 0;
+	for (uint32_t i = 0; i < iters; i++) {
+		bench_ctx.data = malloc(sizeof(req));
+		if (bench_ctx.data == NULL) {
+			errors++;
+			continue;
+		}
+		emu_mem_rx_alloc(sizeof(req));
+		memcpy(bench_ctx.data, req, sizeof(req));
+		bench_ctx.len = sizeof(req);
+		can_check_rx_frame(&bench_ctx);
+	}
+	return errors + ((bench_sent < iters)?(iters - bench_sent):0);
+}
+
+static void bench_sort(uint32_t *v, uint8_t n)
+{
+	for (uint8_t i = 1; i < n; i++) {
+		uint32_t x = v[i];
+		int8_t j = i - 1;
+		for (; j >= 0 && v[j] > x; j--) {
+			v[j + 1] = v[j];
+		}
+		v[j + 1] = x;
+	}
+}
+
+int emu_bench_run(void)
+{
+	uint32_t failed = 0;
+
+	//Responses of the running emulator are dropped until the bench is done
+	car_emu_send_t send = car_emu_sender_set(bench_send);
+	emu_log_mute(1);
+
+	printf("\ncase                ns/op      min  spread\n");
+	for (uint32_t c = 0; c < EMU_BENCH_CASES; c++) {
+		const emu_bench_case_t *bc = &bench_cases[c];
+		uint32_t ns[EMU_BENCH_REPS];
+		uint32_t errors = bc->fn(bc->iters, bc->arg);	//warm-up
+
+		for (uint8_t r = 0; r < EMU_BENCH_REPS; r++) {
+			int64_t t0 = esp_timer_get_time();
+			errors += bc->fn(bc->iters, bc->arg);
+			int64_t t1 = esp_timer_get_time();
+			ns[r] = (uint32_t)((t1 - t0) * 1000 / bc->iters);
+			//Lets the idle task feed the task watchdog
+			vTaskDelay(1);
+		}
+		bench_sort(ns, EMU_BENCH_REPS);
+		uint32_t median = ns[EMU_BENCH_REPS / 2];
+
+		printf("%-16s %8u %8u %6u%%%s\n", bc->name, median, ns[0],
+				(median > 0)?(ns[EMU_BENCH_REPS - 1] - ns[0]) * 100 / median:0,
+				(errors != 0)?"  WRONG RESULT":"");
+		if (errors != 0) {
+			failed++;
+		}
+	}
+
+	emu_log_mute(0);
+	car_emu_sender_set(send);
+
+	if (failed != 0) {
+		printf("Bench FAILED: %u case(s) wrong\n", failed);
+		return -1;
+	}
+	printf("Bench passed\n");
+	return 0;
+}
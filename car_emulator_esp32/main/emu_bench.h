@@ -0,0 +1,25 @@
+/*
+ * emu_bench.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+
+#ifndef __EMU_BENCH_H_
+#define __EMU_BENCH_H_
+
+#include <stdint.h>
+
+/*
+ * Microbenchmarks of the request/response hot paths on the target: the
+ * OBD encoders, response dispatch and RX frame parsing. Every case is
+ * warmed up once and then timed EMU_BENCH_REPS times. The CAN-TP cases
+ * and the baseline with its regression threshold are in
+ * tools/cantp_sim ("cantp_sim bench").
+ */
+#define EMU_BENCH_REPS			7
+
+//Runs all cases, returns -1 when one produced wrong results
+int emu_bench_run(void);
+
+#endif /* __EMU_BENCH_H_ */
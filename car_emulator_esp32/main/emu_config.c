@@ -0,0 +1,131 @@
+/*
+ * emu_config.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+
+#include "emu_tasks.h"
+#include "emu_config.h"
+
+#define TAG             "EMU_CONFIG"
+
+static emu_boot_times_t boot_times;
+
+int emu_config_load_blob(const char *key, void *blob, size_t len)
+{
+	nvs_handle_t nvs;
+	size_t stored_len = len;
+
+	if (nvs_open(EMU_CONFIG_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+		return -1;
+	}
+	esp_err_t err = nvs_get_blob(nvs, key, blob, &stored_len);
+	nvs_close(nvs);
+	if (err != ESP_OK || stored_len != len) {
+		return -1;
+	}
+	return 0;
+}
+
+int emu_config_save_blob(const char *key, const void *blob, size_t len)
+{
+	nvs_handle_t nvs;
+
+	if (nvs_open(EMU_CONFIG_NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) {
+		return -1;
+	}
+	esp_err_t err = nvs_set_blob(nvs, key, blob, len);
+	if (err == ESP_OK) {
+		err = nvs_commit(nvs);
+	}
+	nvs_close(nvs);
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "Saving %s failed: %s", key, esp_err_to_name(err));
+		return -1;
+	}
+	return 0;
+}
+
+int emu_config_load(emulator_cfg_t *cfg)
+{
+	emulator_cfg_t stored;
+
+	if (emu_config_load_blob("cfg", &stored, sizeof(stored)) < 0) {
+		return -1;
+	}
+	if (stored.boadrate > CFG_1000KBPS || stored.id_type > CFG_MIXED_ID) {
+		return -1;
+	}
+	*cfg = stored;
+	return 0;
+}
+
+int emu_config_save(const emulator_cfg_t *cfg)
+{
+	return emu_config_save_blob("cfg", cfg, sizeof(emulator_cfg_t));
+}
+
+int emu_config_load_vehicle(vehicle_state_t *vs)
+{
+	return emu_config_load_blob("vstate", vs, sizeof(vehicle_state_t));
+}
+
+int emu_config_save_vehicle(const vehicle_state_t *vs)
+{
+	return emu_config_save_blob("vstate", vs, sizeof(vehicle_state_t));
+}
+
+void emu_boot_mark_go(int64_t wait_start_us)
+{
+	boot_times.go_wait_us = esp_timer_get_time() - wait_start_us;
+}
+
+void emu_boot_mark_ready(void)
+{
+	boot_times.bus_ready_us = esp_timer_get_time();
+	ESP_LOGI(TAG, "Bus ready %lld ms after start", boot_times.bus_ready_us / 1000);
+}
+
+void emu_boot_mark_response(void)
+{
+	if (boot_times.first_response_us != 0) {
+		return;
+	}
+	boot_times.first_response_us = esp_timer_get_time();
+	emu_logf("First response %lld ms after start\n",
+						boot_times.first_response_us / 1000);
+}
+
+void emu_boot_times_get(emu_boot_times_t *times)
+{
+	*times = boot_times;
+}
+
+void emu_boot_report(void)
+{
+	printf("\nBoot: bus ready %lld.%03lld ms", boot_times.bus_ready_us / 1000,
+							boot_times.bus_ready_us % 1000);
+	if (boot_times.first_response_us != 0) {
+		printf(", first response %lld.%03lld ms\n",
+							boot_times.first_response_us / 1000,
+							boot_times.first_response_us % 1000);
+	} else {
+		printf(", no response sent yet\n");
+	}
+	if (boot_times.go_wait_us != 0) {
+		printf("Waited %lld.%03lld ms for \"go\", bus ready %lld.%03lld ms without it\n",
+							boot_times.go_wait_us / 1000, boot_times.go_wait_us % 1000,
+							(boot_times.bus_ready_us - boot_times.go_wait_us) / 1000,
+							(boot_times.bus_ready_us - boot_times.go_wait_us) % 1000);
+	}
+}
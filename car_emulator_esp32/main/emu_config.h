@@ -0,0 +1,62 @@
+/*
+ * emu_config.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+
+#ifndef __EMU_CONFIG_H_
+#define __EMU_CONFIG_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "can-tp.h"
+#include "car_emulator.h"
+
+/*
+ * Emulator configuration and vehicle state kept in NVS, so a unit that
+ * is power cycled with the ignition comes back serving with the last
+ * settings. Blobs whose size does not match the current structures are
+ * ignored and the defaults are used instead.
+ */
+#define EMU_CONFIG_NVS_NAMESPACE	"car_emu"
+//The simulation saves the vehicle state at most this often
+#define EMU_CONFIG_VEHICLE_SAVE_MS	60000
+
+typedef struct emu_boot_times_s {
+	int64_t bus_ready_us;		//CAN driver started, dispatcher about to run
+	int64_t first_response_us;	//first OBD response transmitted on the bus
+	int64_t go_wait_us;			//spent at the "CMD>" prompt, without CAR_EMU_AUTOSTART
+} emu_boot_times_t;
+
+//Returns 0 when a stored configuration was loaded, -1 when cfg is unchanged
+int emu_config_load(emulator_cfg_t *cfg);
+int emu_config_save(const emulator_cfg_t *cfg);
+
+/*
+ * Raw blobs for other modules in the same namespace. Loading fails when
+ * the stored size differs from len.
+ */
+int emu_config_load_blob(const char *key, void *blob, size_t len);
+int emu_config_save_blob(const char *key, const void *blob, size_t len);
+
+int emu_config_load_vehicle(vehicle_state_t *vs);
+int emu_config_save_vehicle(const vehicle_state_t *vs);
+
+/*
+ * Boot timing. Times are esp_timer_get_time() values, so they start when
+ * the application starts and do not include the second stage bootloader.
+ * The wait for "go" of the interactive boot is kept apart, so the boot
+ * work of both builds can be compared.
+ */
+void emu_boot_mark_go(int64_t wait_start_us);
+void emu_boot_mark_ready(void);
+void emu_boot_mark_response(void);
+void emu_boot_times_get(emu_boot_times_t *times);
+void emu_boot_report(void);
+
+#endif /* __EMU_CONFIG_H_ */
@@ -0,0 +1,169 @@
+/*
+ * emu_mem.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+
+#include "can-tp.h"
+#include "emu_tasks.h"
+#include "cantp_session.h"
+#include "cantp_txq.h"
+#include "can_capture.h"
+#include "emu_mem.h"
+
+#define TAG             "EMU_MEM"
+
+static emu_mem_stats_t stats;
+static portMUX_TYPE mem_mux = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t telemetry_timer;
+
+//Tasks created by ESP-IDF itself
+static const struct {
+	const char *name;
+	uint32_t stack_size;
+} system_tasks[] = {
+	{ "main", CONFIG_ESP_MAIN_TASK_STACK_SIZE },
+	{ "esp_timer", CONFIG_ESP_TIMER_TASK_STACK_SIZE },
+};
+
+void emu_mem_mark_boot(void)
+{
+	stats.heap_boot = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+}
+
+void emu_mem_mark_ready(void)
+{
+	stats.heap_ready = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+}
+
+void emu_mem_rx_alloc(uint32_t len)
+{
+	portENTER_CRITICAL(&mem_mux);
+	stats.rx_bytes += len;
+	if (stats.rx_bytes > stats.rx_bytes_peak) {
+		stats.rx_bytes_peak = stats.rx_bytes;
+	}
+	portEXIT_CRITICAL(&mem_mux);
+}
+
+void emu_mem_rx_free(uint32_t len)
+{
+	portENTER_CRITICAL(&mem_mux);
+	stats.rx_bytes -= len;
+	portEXIT_CRITICAL(&mem_mux);
+}
+
+void emu_mem_ff_alloc(uint32_t len)
+{
+	portENTER_CRITICAL(&mem_mux);
+	stats.ff_bytes += len;
+	portEXIT_CRITICAL(&mem_mux);
+}
+
+void emu_mem_stats_get(emu_mem_stats_t *s)
+{
+	stats.heap_free = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+	stats.heap_min = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+	stats.heap_largest = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+	portENTER_CRITICAL(&mem_mux);
+	*s = stats;
+	portEXIT_CRITICAL(&mem_mux);
+}
+
+void emu_mem_report(void)
+{
+	emu_mem_stats_t s;
+	const emu_task_info_t *tasks;
+	uint8_t n = emu_task_list(&tasks);
+
+	emu_mem_stats_get(&s);
+#ifdef CONFIG_CAR_EMU_LOW_RAM
+	printf("\nMemory (low RAM profile)\n");
+#else
+	printf("\nMemory (default profile)\n");
+#endif
+	printf("heap: free=%u min=%u largest_block=%u used_by_init=%u\n",
+			s.heap_free, s.heap_min, s.heap_largest, s.heap_boot - s.heap_ready);
+	printf("CAN-TP RX buffers: now=%u peak=%u, multi-frame total=%u\n",
+			s.rx_bytes, s.rx_bytes_peak, s.ff_bytes);
+	printf("%-16s %6s %9s\n", "task", "stack", "min free");
+	for (uint8_t i = 0; i < n; i++) {
+		printf("%-16s %6u %9u\n", pcTaskGetName(tasks[i].handle),
+				tasks[i].stack_size,
+				(unsigned)uxTaskGetStackHighWaterMark(tasks[i].handle));
+	}
+	for (uint8_t i = 0; i < sizeof(system_tasks) / sizeof(system_tasks[0]); i++) {
+		TaskHandle_t handle = xTaskGetHandle(system_tasks[i].name);
+		if (handle != NULL) {
+			printf("%-16s %6u %9u\n", system_tasks[i].name,
+					system_tasks[i].stack_size,
+					(unsigned)uxTaskGetStackHighWaterMark(handle));
+		}
+	}
+	printf("pools: txq free=%u/%d sessions=%u/%d",
+			cantp_txq_pool_free(), EMU_CANTP_TXQ_LEN,
+			cantp_session_in_use(), cantp_session_count());
+#ifdef CONFIG_CAR_EMU_CAPTURE
+	can_capture_stats_t cs;
+	can_capture_stats_get(&cs);
+	printf(" capture max_fill=%u/%d", cs.max_fill, 2 * EMU_CAPTURE_LEN);
+#endif
+#ifdef CONFIG_CAR_EMU_DUAL_CORE
+	printf(" log drops=%u", emu_log_drops());
+#endif
+	printf("\n");
+}
+
+static void emu_mem_telemetry_cb(void *arg)
+{
+	emu_mem_stats_t s;
+	const emu_task_info_t *tasks;
+	uint8_t n = emu_task_list(&tasks);
+	uint32_t min_free = UINT32_MAX;
+	const char *min_name = "-";
+
+	emu_mem_stats_get(&s);
+	for (uint8_t i = 0; i < n; i++) {
+		uint32_t free = uxTaskGetStackHighWaterMark(tasks[i].handle);
+		if (free < min_free) {
+			min_free = free;
+			min_name = pcTaskGetName(tasks[i].handle);
+		}
+	}
+	emu_logf("mem: heap free=%u min=%u largest=%u rx_peak=%u stack %s=%u "
+			"txq=%u/%d\n", s.heap_free, s.heap_min, s.heap_largest,
+			s.rx_bytes_peak, min_name, min_free,
+			cantp_txq_pool_free(), EMU_CANTP_TXQ_LEN);
+}
+
+int emu_mem_telemetry_start(uint32_t period_s)
+{
+#ifndef CONFIG_CAR_EMU_LOG
+	//Reported through emu_logf() only
+	period_s = 0;
+#endif
+	if (period_s == 0) {
+		return 0;
+	}
+	const esp_timer_create_args_t args = {
+			.callback = &emu_mem_telemetry_cb,
+			.arg = NULL,
+			.name = "mem_telemetry"
+	};
+	if (esp_timer_create(&args, &telemetry_timer) != ESP_OK) {
+		return -1;
+	}
+	return (esp_timer_start_periodic(telemetry_timer,
+					(uint64_t)period_s * 1000000) == ESP_OK)?0:-1;
+}
@@ -0,0 +1,45 @@
+/*
+ * emu_mem.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+
+#ifndef __EMU_MEM_H_
+#define __EMU_MEM_H_
+
+#include <stdint.h>
+
+/*
+ * Memory budget instrumentation: stack high-water marks of every task
+ * created by emu_task_create() plus the esp_timer and main tasks, heap
+ * low-water mark and largest free block, pool occupancy and the heap
+ * held by received CAN-TP messages.
+ */
+typedef struct emu_mem_stats_s {
+	uint32_t heap_free;
+	uint32_t heap_min;			//lowest free heap since boot
+	uint32_t heap_largest;		//largest free block
+	uint32_t heap_boot;			//free heap when app_main started
+	uint32_t heap_ready;		//free heap once the emulator was serving
+	uint32_t rx_bytes;			//held by received messages being processed
+	uint32_t rx_bytes_peak;
+	uint32_t ff_bytes;			//allocated for multi-frame reception in total
+} emu_mem_stats_t;
+
+void emu_mem_mark_boot(void);
+void emu_mem_mark_ready(void);
+
+void emu_mem_rx_alloc(uint32_t len);
+void emu_mem_rx_free(uint32_t len);
+void emu_mem_ff_alloc(uint32_t len);
+
+void emu_mem_stats_get(emu_mem_stats_t *stats);
+
+//Full report on the console
+void emu_mem_report(void);
+
+//One line of telemetry every period_s seconds, 0 disables it
+int emu_mem_telemetry_start(uint32_t period_s);
+
+#endif /* __EMU_MEM_H_ */
@@ -0,0 +1,36 @@
+/*
+ * emu_profile.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+
+#ifndef __EMU_PROFILE_H_
+#define __EMU_PROFILE_H_
+
+#include "sdkconfig.h"
+
+/*
+ * Pool and ring sizes. CONFIG_CAR_EMU_LOW_RAM replaces the individual
+ * Kconfig sizes with a fixed minimal set for modules with little free
+ * RAM: one CAN-TP session, a short TX pool and short rings.
+ */
+#ifdef CONFIG_CAR_EMU_LOW_RAM
+#define EMU_CANTP_SESSIONS		1
+#define EMU_CANTP_TXQ_LEN		4
+#define EMU_LOG_RING_LEN		8
+#define EMU_CAPTURE_LEN			128
+#define EMU_TRACE_LEN			128
+#define EMU_CAN_RX_RING_LEN		32
+#define EMU_CAN_RX_DRV_QUEUE_LEN	32
+#else
+#define EMU_CANTP_SESSIONS		CONFIG_CANTP_MAX_SESSIONS
+#define EMU_CANTP_TXQ_LEN		CONFIG_CANTP_TXQ_LEN
+#define EMU_LOG_RING_LEN		CONFIG_CAR_EMU_LOG_RING_LEN
+#define EMU_CAPTURE_LEN			CONFIG_CAR_EMU_CAPTURE_LEN
+#define EMU_TRACE_LEN			CONFIG_CAR_EMU_TRACE_LEN
+#define EMU_CAN_RX_RING_LEN		CONFIG_CAR_EMU_RX_RING_LEN
+#define EMU_CAN_RX_DRV_QUEUE_LEN	CONFIG_CAR_EMU_RX_DRV_QUEUE_LEN
+#endif
+
+#endif /* __EMU_PROFILE_H_ */
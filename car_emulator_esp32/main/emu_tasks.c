@@ -0,0 +1,146 @@
+/*
+ * emu_tasks.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "spsc_ring.h"
+#include "emu_tasks.h"
+
+#ifdef CONFIG_CAR_EMU_DUAL_CORE
+#define EMU_CAN_CORE		CONFIG_CAR_EMU_CAN_CORE
+#define EMU_APP_CORE		(1 - CONFIG_CAR_EMU_CAN_CORE)
+#endif
+
+//Lines logged on the CAN core are printed by the log task
+#if defined(CONFIG_CAR_EMU_DUAL_CORE) && defined(CONFIG_CAR_EMU_LOG)
+#define EMU_LOG_RING
+
+typedef struct emu_log_line_s {
+	char str[EMU_LOG_LINE_LEN];
+} emu_log_line_t;
+
+static emu_log_line_t log_buf[EMU_LOG_RING_LEN];
+static spsc_ring_t log_ring;
+//Every task on the CAN core may log, the lock only serializes them
+static portMUX_TYPE log_mux = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t log_task_handle;
+#endif
+
+static emu_task_info_t tasks[EMU_MAX_TASKS];
+static uint8_t n_tasks;
+#ifdef CONFIG_CAR_EMU_LOG
+static volatile uint8_t log_muted;
+#endif
+
+BaseType_t emu_task_create(TaskFunction_t fn, const char *name,
+		uint32_t stack_size, void *arg, UBaseType_t prio,
+		emu_core_t core, TaskHandle_t *handle)
+{
+	TaskHandle_t task = NULL;
+	BaseType_t res;
+	//The caller's handle is written by FreeRTOS before the new task can run
+	if (handle == NULL) {
+		handle = &task;
+	}
+#ifdef CONFIG_CAR_EMU_DUAL_CORE
+	res = xTaskCreatePinnedToCore(fn, name, stack_size, arg, prio, handle,
+						(core == EMU_CORE_CAN)?EMU_CAN_CORE:EMU_APP_CORE);
+#else
+	res = xTaskCreate(fn, name, stack_size, arg, prio, handle);
+#endif
+	if (res == pdPASS && n_tasks < EMU_MAX_TASKS) {
+		tasks[n_tasks].handle = *handle;
+		tasks[n_tasks].stack_size = stack_size;
+		n_tasks++;
+	}
+	return res;
+}
+
+uint8_t emu_task_list(const emu_task_info_t **list)
+{
+	*list = tasks;
+	return n_tasks;
+}
+
+void emu_log_mute(uint8_t mute)
+{
+#ifdef CONFIG_CAR_EMU_LOG
+	log_muted = mute;
+#endif
+}
+
+#ifdef CONFIG_CAR_EMU_LOG
+void emu_logf(const char *fmt, ...)
+{
+	va_list args;
+
+	if (log_muted) {
+		return;
+	}
+	va_start(args, fmt);
+#ifdef EMU_LOG_RING
+	emu_log_line_t line;
+	vsnprintf(line.str, sizeof(line.str), fmt, args);
+
+	portENTER_CRITICAL(&log_mux);
+	spsc_ring_push(&log_ring, &line);
+	portEXIT_CRITICAL(&log_mux);
+	if (log_task_handle != NULL) {
+		xTaskNotifyGive(log_task_handle);
+	}
+#else
+	vprintf(fmt, args);
+#endif
+	va_end(args);
+}
+#endif
+
+uint32_t emu_log_drops(void)
+{
+#ifdef EMU_LOG_RING
+	return log_ring.drops;
+#else
+	return 0;
+#endif
+}
+
+#ifdef EMU_LOG_RING
+static void emu_log_task(void *arg)
+{
+	uint32_t reported_drops = 0;
+	while (1) {
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+		uint32_t n = spsc_ring_count(&log_ring);
+		for (uint32_t i = 0; i < n; i++) {
+			emu_log_line_t *line = spsc_ring_peek(&log_ring, i);
+			fputs(line->str, stdout);
+		}
+		spsc_ring_release(&log_ring, n);
+		if (log_ring.drops != reported_drops) {
+			printf("\033[0;31mLOG: %u lines dropped\033[0m\n",
+									log_ring.drops - reported_drops);
+			reported_drops = log_ring.drops;
+		}
+		fflush(stdout);
+	}
+}
+#endif
+
+void emu_log_start(void)
+{
+#ifdef EMU_LOG_RING
+	spsc_ring_init(&log_ring, log_buf, sizeof(emu_log_line_t),
+										EMU_LOG_RING_LEN);
+	emu_task_create(emu_log_task, "log_task", 3 * 1024, NULL, 1,
+											EMU_CORE_APP, &log_task_handle);
+#endif
+}
@@ -0,0 +1,61 @@
+/*
+ * emu_tasks.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+
+#ifndef __EMU_TASKS_H_
+#define __EMU_TASKS_H_
+
+#include <stdio.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "emu_profile.h"
+
+#define EMU_LOG_LINE_LEN	96
+#define EMU_MAX_TASKS		32
+
+typedef enum {
+	EMU_CORE_CAN = 0,	//CAN RX, CAN-TP and the OBD responder
+	EMU_CORE_APP		//vehicle simulation, logging and console
+} emu_core_t;
+
+/*
+ * Creates a task on the core assigned to its role. With
+ * CONFIG_CAR_EMU_DUAL_CORE unset all tasks are created without affinity.
+ */
+BaseType_t emu_task_create(TaskFunction_t fn, const char *name,
+		uint32_t stack_size, void *arg, UBaseType_t prio,
+		emu_core_t core, TaskHandle_t *handle);
+
+typedef struct emu_task_info_s {
+	TaskHandle_t handle;
+	uint32_t stack_size;
+} emu_task_info_t;
+
+//Tasks created by emu_task_create(), for the memory report
+uint8_t emu_task_list(const emu_task_info_t **tasks);
+
+/*
+ * printf() replacement for the CAN core. In dual-core mode the line is
+ * formatted into the log ring and printed by the log task on the
+ * application core, so the UART never stalls the responder.
+ */
+#ifdef CONFIG_CAR_EMU_LOG
+void emu_logf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+#else
+//Still type-checked, but the calls and format strings drop out
+#define emu_logf(...)		do { if (0) printf(__VA_ARGS__); } while (0)
+#endif
+
+void emu_log_start(void);
+
+//Drops emu_logf() output, for benchmarks of the paths that log
+void emu_log_mute(uint8_t mute);
+
+uint32_t emu_log_drops(void);
+
+#endif /* __EMU_TASKS_H_ */
@@ -0,0 +1,251 @@
+/*
+ * emu_trace.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "emu_tasks.h"
+#include "emu_trace.h"
+
+#define TAG             "TRACE"
+
+#ifdef CONFIG_CAR_EMU_TRACE
+
+#define EMU_TRACE_MASK			(EMU_TRACE_LEN - 1)
+#define EMU_TRACE_BENCH_N		256
+#define EMU_TRACE_OPEN_MAX		16
+
+//Async spans open while exporting, keyed by kind and timer or CAN ID
+typedef struct emu_trace_open_s {
+	uint32_t id;
+	uint8_t kind;
+	const char *name;
+} emu_trace_open_t;
+
+enum {
+	EMU_TRACE_OPEN_TIMER = 1,
+	EMU_TRACE_OPEN_ISOTP
+};
+
+volatile uint8_t emu_trace_active;
+
+static emu_trace_rec_t ring[EMU_TRACE_LEN];
+static uint32_t head;
+static uint32_t cost_ns;
+static emu_trace_open_t open_spans[EMU_TRACE_OPEN_MAX];
+static uint8_t first_event;
+
+static const char *pci_names[] = { "SF", "FF", "CF", "FC" };
+
+void emu_trace_put(emu_trace_ev_t ev, uint32_t ts_us, uint32_t arg,
+		uint32_t arg2, const char *name, uint8_t pci)
+{
+	uint32_t idx = __atomic_fetch_add(&head, 1, __ATOMIC_RELAXED);
+	emu_trace_rec_t *rec = &ring[idx & EMU_TRACE_MASK];
+
+	rec->seq = 0;
+	rec->ts_us = ts_us;
+	rec->arg = arg;
+	rec->arg2 = arg2;
+	rec->name = name;
+	rec->task = xTaskGetCurrentTaskHandle();
+	rec->ev = ev;
+	rec->pci = pci;
+	__atomic_store_n(&rec->seq, idx + 1, __ATOMIC_RELEASE);
+}
+
+void emu_trace_clear(void)
+{
+	uint8_t active = emu_trace_active;
+	emu_trace_active = 0;
+	vTaskDelay(1);
+	memset(ring, 0, sizeof(ring));
+	__atomic_store_n(&head, 0, __ATOMIC_RELEASE);
+	emu_trace_active = active;
+}
+
+void emu_trace_start(void)
+{
+	int64_t t0 = esp_timer_get_time();
+	for (uint32_t i = 0; i < EMU_TRACE_BENCH_N; i++) {
+		emu_trace_put(EMU_TRACE_RX, (uint32_t)esp_timer_get_time(), i, 0, NULL, 0);
+	}
+	cost_ns = (uint32_t)((esp_timer_get_time() - t0) * 1000 / EMU_TRACE_BENCH_N);
+	emu_trace_clear();
+	emu_trace_active = 1;
+	ESP_LOGI(TAG, "Recording %d events, %u ns per event", EMU_TRACE_LEN, cost_ns);
+}
+
+static emu_trace_open_t *emu_trace_open_find(uint8_t kind, uint32_t id)
+{
+	for (uint8_t i = 0; i < EMU_TRACE_OPEN_MAX; i++) {
+		if (open_spans[i].kind == kind && open_spans[i].id == id) {
+			return &open_spans[i];
+		}
+	}
+	return NULL;
+}
+
+static void emu_trace_json_begin(const char *name, const char *cat, char ph,
+		uint32_t ts, TaskHandle_t task)
+{
+	printf("%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%u,"
+			"\"pid\":1,\"tid\":%u", first_event ? "" : ",\n", name, cat, ph,
+			ts, (uint32_t)(uintptr_t)task);
+	first_event = 0;
+}
+
+static void emu_trace_async(uint8_t kind, uint32_t id, const char *name,
+		char ph, uint32_t ts, TaskHandle_t task)
+{
+	emu_trace_open_t *o = emu_trace_open_find(kind, id);
+	if (ph == 'b') {
+		if (o != NULL) {
+			//Restarted without a stop
+			emu_trace_async(kind, id, o->name, 'e', ts, task);
+		}
+		o = emu_trace_open_find(0, 0);
+		if (o == NULL) {
+			return;
+		}
+		o->kind = kind;
+		o->id = id;
+		o->name = name;
+	} else {
+		if (o == NULL) {
+			return;
+		}
+		name = o->name;
+		o->kind = 0;
+		o->id = 0;
+	}
+	emu_trace_json_begin(name, (kind == EMU_TRACE_OPEN_TIMER) ? "timer" : "isotp",
+			ph, ts, task);
+	printf(",\"id\":\"0x%X\"}", id);
+}
+
+static void emu_trace_rec_json(const emu_trace_rec_t *rec, uint32_t ts)
+{
+	switch (rec->ev) {
+	case EMU_TRACE_RX:
+	case EMU_TRACE_TX:
+		emu_trace_json_begin((rec->ev == EMU_TRACE_RX) ? "RX" : "TX", "frame",
+				'i', ts, rec->task);
+		printf(",\"s\":\"t\",\"args\":{\"id\":\"0x%X\",\"pci\":\"%s\"}}", rec->arg,
+				(rec->pci >> 4) < 4 ? pci_names[rec->pci >> 4] : "-");
+		if (rec->ev == EMU_TRACE_RX && (rec->pci >> 4) == 1) {
+			emu_trace_async(EMU_TRACE_OPEN_ISOTP, rec->arg, "ISO-TP RX", 'b',
+					ts, rec->task);
+		}
+		break;
+	case EMU_TRACE_TIMER_START:
+		emu_trace_async(EMU_TRACE_OPEN_TIMER, rec->arg2,
+				(rec->name != NULL) ? rec->name : "timer", 'b', ts, rec->task);
+		break;
+	case EMU_TRACE_TIMER_STOP:
+		emu_trace_async(EMU_TRACE_OPEN_TIMER, rec->arg2, NULL, 'e', ts, rec->task);
+		break;
+	case EMU_TRACE_TIMEOUT:
+		emu_trace_json_begin(rec->name, "timer", 'i', ts, rec->task);
+		printf(",\"s\":\"t\"}");
+		break;
+	case EMU_TRACE_SNDR_WAIT_BEGIN:
+		emu_trace_json_begin("sndr wait", "cantp", 'B', ts, rec->task);
+		printf("}");
+		break;
+	case EMU_TRACE_SNDR_WAIT_END:
+		emu_trace_json_begin("sndr wait", "cantp", 'E', ts, rec->task);
+		printf(",\"args\":{\"timeout\":%u}}", rec->arg);
+		break;
+	case EMU_TRACE_TX_BEGIN:
+		emu_trace_json_begin("ISO-TP TX", "isotp", 'B', ts, rec->task);
+		printf(",\"args\":{\"id\":\"0x%X\",\"len\":%u}}", rec->arg, rec->arg2);
+		break;
+	case EMU_TRACE_TX_END:
+		emu_trace_json_begin("ISO-TP TX", "isotp", 'E', ts, rec->task);
+		printf(",\"args\":{\"result\":%d}}", (int32_t)rec->arg2);
+		break;
+	case EMU_TRACE_OBD_BEGIN:
+		if (rec->arg2 > 7) {
+			emu_trace_async(EMU_TRACE_OPEN_ISOTP, rec->arg, NULL, 'e', ts, rec->task);
+		}
+		emu_trace_json_begin("OBD", "obd", 'B', ts, rec->task);
+		printf(",\"args\":{\"id\":\"0x%X\",\"len\":%u}}", rec->arg, rec->arg2);
+		break;
+	case EMU_TRACE_OBD_END:
+		emu_trace_json_begin("OBD", "obd", 'E', ts, rec->task);
+		printf("}");
+		break;
+	case EMU_TRACE_OBD_FAST:
+		emu_trace_json_begin("OBD fast", "obd", 'X', ts, rec->task);
+		printf(",\"dur\":%u,\"args\":{\"id\":\"0x%X\"}}", rec->arg2, rec->arg);
+		break;
+	}
+}
+
+void emu_trace_export(void)
+{
+	uint8_t active = emu_trace_active;
+	emu_trace_active = 0;
+	//Keeps log lines of the running emulator out of the JSON
+	emu_log_mute(1);
+	//Lets a record being written finish
+	vTaskDelay(1);
+
+	uint32_t end = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+	uint32_t start = (end > EMU_TRACE_LEN) ? end - EMU_TRACE_LEN : 0;
+	uint32_t ts0 = ring[start & EMU_TRACE_MASK].ts_us;
+
+	printf("\nTrace: %u events (%u lost), %u ns per event\n", end - start,
+			start, cost_ns);
+	printf("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	first_event = 1;
+	memset(open_spans, 0, sizeof(open_spans));
+
+	const emu_task_info_t *tasks;
+	uint8_t n = emu_task_list(&tasks);
+	for (uint8_t i = 0; i < n; i++) {
+		emu_trace_json_begin("thread_name", "", 'M', 0, tasks[i].handle);
+		printf(",\"args\":{\"name\":\"%s\"}}", pcTaskGetName(tasks[i].handle));
+	}
+	for (uint32_t i = start; i != end; i++) {
+		const emu_trace_rec_t *rec = &ring[i & EMU_TRACE_MASK];
+		if (rec->seq != i + 1) {
+			continue;
+		}
+		//Relative to the oldest record, which also handles the 32 bit wrap
+		emu_trace_rec_json(rec, rec->ts_us - ts0);
+	}
+	printf("\n]}\n");
+	emu_log_mute(0);
+	emu_trace_active = active;
+}
+
+void emu_trace_cmd(const char *args)
+{
+	if (args[0] == 0) {
+		emu_trace_export();
+	} else if (strcmp(args, "=on") == 0) {
+		emu_trace_active = 1;
+		printf("\nTrace recording on\n");
+	} else if (strcmp(args, "=off") == 0) {
+		emu_trace_active = 0;
+		printf("\nTrace recording off\n");
+	} else if (strcmp(args, "=clear") == 0) {
+		emu_trace_clear();
+		printf("\nTrace cleared\n");
+	} else {
+		printf("\nWrong command\n");
+	}
+}
+
+#endif
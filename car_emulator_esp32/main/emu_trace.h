@@ -0,0 +1,114 @@
+/*
+ * emu_trace.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+
+#ifndef __EMU_TRACE_H_
+#define __EMU_TRACE_H_
+
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+
+#include "sdkconfig.h"
+
+/*
+ * CAN-TP timeline recorder. Frame RX/TX, CAN-TP timer start/stop and
+ * expiry, the sender waiting for a state change, multi-frame sends and
+ * OBD dispatch are stored as fixed size records into a flight recorder
+ * ring, from any task, with one atomic add and no locks. "trace" prints
+ * the ring as Chrome trace / Perfetto JSON (ui.perfetto.dev or
+ * chrome://tracing).
+ *
+ * The receiver state is derived when exporting: a First Frame opens an
+ * "ISO-TP RX" span which the OBD dispatch of the reassembled request
+ * closes.
+ */
+typedef enum {
+	EMU_TRACE_RX = 0,			//arg CAN ID, pci first data byte
+	EMU_TRACE_TX,
+	EMU_TRACE_TIMER_START,		//arg timeout, arg2 timer
+	EMU_TRACE_TIMER_STOP,		//arg2 timer
+	EMU_TRACE_TIMEOUT,			//name "sndr" or "rcvr"
+	EMU_TRACE_SNDR_WAIT_BEGIN,	//sender waiting for FC or TX done
+	EMU_TRACE_SNDR_WAIT_END,	//arg 0 signalled, 1 timed out
+	EMU_TRACE_TX_BEGIN,			//multi-frame send, arg CAN ID, arg2 length
+	EMU_TRACE_TX_END,			//arg2 result
+	EMU_TRACE_OBD_BEGIN,		//arg CAN ID, arg2 request length
+	EMU_TRACE_OBD_END,
+	EMU_TRACE_OBD_FAST,			//fast path answer, arg CAN ID, arg2 duration
+	EMU_TRACE_NUM
+} emu_trace_ev_t;
+
+typedef struct emu_trace_rec_s {
+	volatile uint32_t seq;		//record index + 1 once written
+	uint32_t ts_us;
+	uint32_t arg;
+	uint32_t arg2;
+	const char *name;
+	TaskHandle_t task;
+	uint8_t ev;
+	uint8_t pci;
+} emu_trace_rec_t;
+
+extern volatile uint8_t emu_trace_active;
+
+void emu_trace_put(emu_trace_ev_t ev, uint32_t ts_us, uint32_t arg,
+		uint32_t arg2, const char *name, uint8_t pci);
+
+static inline void emu_trace(emu_trace_ev_t ev, uint32_t arg, uint32_t arg2)
+{
+#ifdef CONFIG_CAR_EMU_TRACE
+	if (emu_trace_active) {
+		emu_trace_put(ev, (uint32_t)esp_timer_get_time(), arg, arg2, NULL, 0);
+	}
+#endif
+}
+
+static inline void emu_trace_frame(emu_trace_ev_t ev, uint32_t id, uint8_t pci)
+{
+#ifdef CONFIG_CAR_EMU_TRACE
+	if (emu_trace_active) {
+		emu_trace_put(ev, (uint32_t)esp_timer_get_time(), id, 0, NULL, pci);
+	}
+#endif
+}
+
+static inline void emu_trace_timer(emu_trace_ev_t ev, const void *timer,
+		const char *name, uint32_t tout_us)
+{
+#ifdef CONFIG_CAR_EMU_TRACE
+	if (emu_trace_active) {
+		emu_trace_put(ev, (uint32_t)esp_timer_get_time(), tout_us,
+				(uint32_t)(uintptr_t)timer, name, 0);
+	}
+#endif
+}
+
+//A span that already ended, recorded at its start
+static inline void emu_trace_span(emu_trace_ev_t ev, int64_t start_us, uint32_t arg)
+{
+#ifdef CONFIG_CAR_EMU_TRACE
+	if (emu_trace_active) {
+		emu_trace_put(ev, (uint32_t)start_us, arg,
+				(uint32_t)(esp_timer_get_time() - start_us), NULL, 0);
+	}
+#endif
+}
+
+//Measures the recording cost and starts recording
+void emu_trace_start(void);
+
+void emu_trace_clear(void);
+
+//Prints the ring as Chrome trace JSON, recording pauses meanwhile
+void emu_trace_export(void);
+
+//Console entry, args is "" (export), "=on", "=off" or "=clear"
+void emu_trace_cmd(const char *args);
+
+#endif /* __EMU_TRACE_H_ */
@@ -0,0 +1,162 @@
+/*
+ * isotp_codec.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+#include <string.h>
+
+#include "isotp_codec.h"
+
+#define ISOTP_PCI_SF		0x00
+#define ISOTP_PCI_FF		0x10
+#define ISOTP_PCI_CF		0x20
+#define ISOTP_PCI_FC		0x30
+
+#define ISOTP_FC_CTS		0
+#define ISOTP_FC_WAIT		1
+#define ISOTP_FC_OVFLW		2
+
+uint32_t isotp_stmin_us(uint8_t stmin)
+{
+	if (stmin <= 0x7F) {
+		return stmin * 1000;
+	}
+	if (stmin >= 0xF1 && stmin <= 0xF9) {
+		return (stmin - 0xF0) * 100;
+	}
+	//Reserved values are treated as the longest separation time
+	return 127000;
+}
+
+int isotp_tx_start(isotp_tx_t *tx, const uint8_t *data, uint16_t len, uint8_t *frame)
+{
+	if (len == 0 || len > ISOTP_MAX_LEN) {
+		return -1;
+	}
+	tx->data = data;
+	tx->len = len;
+	memset(frame, ISOTP_PAD, 8);
+	if (len <= 7) {
+		frame[0] = ISOTP_PCI_SF | len;
+		memcpy(&frame[1], data, len);
+		tx->off = len;
+		tx->state = ISOTP_IDLE;
+		return 0;
+	}
+	frame[0] = ISOTP_PCI_FF | (len >> 8);
+	frame[1] = len & 0xFF;
+	memcpy(&frame[2], data, 6);
+	tx->off = 6;
+	tx->sn = 1;
+	tx->state = ISOTP_WAIT_FC;
+	return 0;
+}
+
+int isotp_tx_fc(isotp_tx_t *tx, const uint8_t *frame)
+{
+	if (tx->state != ISOTP_WAIT_FC || (frame[0] & 0xF0) != ISOTP_PCI_FC) {
+		return -1;
+	}
+	switch (frame[0] & 0x0F) {
+		case ISOTP_FC_CTS:
+			tx->bs = frame[1];
+			tx->bs_left = frame[1];
+			tx->stmin_us = isotp_stmin_us(frame[2]);
+			tx->state = ISOTP_SEND_CF;
+			return 0;
+		case ISOTP_FC_WAIT:
+			return 1;
+		default:
+			tx->state = ISOTP_IDLE;
+			return -1;
+	}
+}
+
+isotp_state_t isotp_tx_cf(isotp_tx_t *tx, uint8_t *frame)
+{
+	uint16_t n = tx->len - tx->off;
+
+	if (n > 7) {
+		n = 7;
+	}
+	memset(frame, ISOTP_PAD, 8);
+	frame[0] = ISOTP_PCI_CF | tx->sn;
+	memcpy(&frame[1], &tx->data[tx->off], n);
+	tx->off += n;
+	tx->sn = (tx->sn + 1) & 0x0F;
+
+	if (tx->off >= tx->len) {
+		tx->state = ISOTP_IDLE;
+	} else if (tx->bs != 0 && --tx->bs_left == 0) {
+		tx->state = ISOTP_WAIT_FC;
+	}
+	return tx->state;
+}
+
+void isotp_rx_init(isotp_rx_t *rx, uint8_t *buf, uint16_t size)
+{
+	memset(rx, 0, sizeof(isotp_rx_t));
+	rx->data = buf;
+	rx->size = size;
+}
+
+isotp_rx_result_t isotp_rx_frame(isotp_rx_t *rx, const uint8_t *frame,
+		uint8_t dlc, uint8_t *fc)
+{
+	uint16_t len;
+
+	switch (frame[0] & 0xF0) {
+		case ISOTP_PCI_SF:
+			len = frame[0] & 0x0F;
+			if (len == 0 || len > 7 || len + 1 > dlc || len > rx->size) {
+				return ISOTP_RX_ERROR;
+			}
+			memcpy(rx->data, &frame[1], len);
+			rx->len = len;
+			rx->state = ISOTP_IDLE;
+			return ISOTP_RX_DONE;
+		case ISOTP_PCI_FF:
+			len = ((frame[0] & 0x0F) << 8) | frame[1];
+			if (dlc < 8 || len < 8) {
+				return ISOTP_RX_ERROR;
+			}
+			memset(fc, ISOTP_PAD, 8);
+			if (len > rx->size) {
+				fc[0] = ISOTP_PCI_FC | ISOTP_FC_OVFLW;
+				rx->state = ISOTP_IDLE;
+				return ISOTP_RX_SEND_FC;
+			}
+			memcpy(rx->data, &frame[2], 6);
+			rx->len = len;
+			rx->off = 6;
+			rx->sn = 1;
+			rx->state = ISOTP_RX_CF;
+			fc[0] = ISOTP_PCI_FC | ISOTP_FC_CTS;
+			fc[1] = 0;		//block size: all at once
+			fc[2] = 0;		//STmin
+			return ISOTP_RX_SEND_FC;
+		case ISOTP_PCI_CF:
+			if (rx->state != ISOTP_RX_CF) {
+				return ISOTP_RX_IGNORED;
+			}
+			if ((frame[0] & 0x0F) != rx->sn) {
+				rx->state = ISOTP_IDLE;
+				return ISOTP_RX_ERROR;
+			}
+			len = rx->len - rx->off;
+			if (len > 7) {
+				len = 7;
+			}
+			memcpy(&rx->data[rx->off], &frame[1], len);
+			rx->off += len;
+			rx->sn = (rx->sn + 1) & 0x0F;
+			if (rx->off >= rx->len) {
+				rx->state = ISOTP_IDLE;
+				return ISOTP_RX_DONE;
+			}
+			return ISOTP_RX_MORE;
+		default:
+			return ISOTP_RX_IGNORED;
+	}
+}
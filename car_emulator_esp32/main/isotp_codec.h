@@ -0,0 +1,80 @@
+/*
+ * isotp_codec.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+
+#ifndef __ISOTP_CODEC_H_
+#define __ISOTP_CODEC_H_
+
+#include <stdint.h>
+
+/*
+ * ISO 15765-2 segmentation and reassembly without timers, tasks or I/O.
+ * The caller moves the 8 byte frames and runs the N_Bs/N_Cr timeouts, so
+ * the same code works on the bus and on a virtual clock.
+ */
+#define ISOTP_MAX_LEN		4095	//largest length a First Frame can carry
+#define ISOTP_PAD			0x00
+
+typedef enum {
+	ISOTP_IDLE = 0,
+	ISOTP_WAIT_FC,		//sender: First Frame or block sent
+	ISOTP_SEND_CF,		//sender: Consecutive Frames may be sent
+	ISOTP_RX_CF			//receiver: waiting for Consecutive Frames
+} isotp_state_t;
+
+typedef enum {
+	ISOTP_RX_ERROR = -1,
+	ISOTP_RX_IGNORED = 0,	//not a frame for the current state
+	ISOTP_RX_MORE,			//Consecutive Frame stored
+	ISOTP_RX_SEND_FC,		//First Frame stored, send the Flow Control in fc
+	ISOTP_RX_DONE			//message complete in data/len
+} isotp_rx_result_t;
+
+typedef struct isotp_tx_s {
+	const uint8_t *data;		//owned by the caller until the message is done
+	uint16_t len;
+	uint16_t off;
+	uint8_t sn;
+	uint8_t bs;
+	uint8_t bs_left;
+	uint32_t stmin_us;
+	isotp_state_t state;
+} isotp_tx_t;
+
+typedef struct isotp_rx_s {
+	uint8_t *data;
+	uint16_t size;
+	uint16_t len;
+	uint16_t off;
+	uint8_t sn;
+	isotp_state_t state;
+} isotp_rx_t;
+
+/*
+ * Starts a message and writes its Single or First Frame into frame. data
+ * is not copied. Returns -1 when len does not fit.
+ */
+int isotp_tx_start(isotp_tx_t *tx, const uint8_t *data, uint16_t len, uint8_t *frame);
+
+//Applies a Flow Control: 0 continue, 1 wait, -1 overflow or unexpected
+int isotp_tx_fc(isotp_tx_t *tx, const uint8_t *frame);
+
+/*
+ * Writes the next Consecutive Frame and returns the new state: ISOTP_IDLE
+ * when the message is complete, ISOTP_WAIT_FC at the end of a block.
+ */
+isotp_state_t isotp_tx_cf(isotp_tx_t *tx, uint8_t *frame);
+
+//Messages longer than size are refused with a Flow Control overflow
+void isotp_rx_init(isotp_rx_t *rx, uint8_t *buf, uint16_t size);
+
+//Feeds one received frame, fc is written on ISOTP_RX_SEND_FC
+isotp_rx_result_t isotp_rx_frame(isotp_rx_t *rx, const uint8_t *frame,
+		uint8_t dlc, uint8_t *fc);
+
+uint32_t isotp_stmin_us(uint8_t stmin);
+
+#endif /* __ISOTP_CODEC_H_ */
@@ -0,0 +1,671 @@
+/*
+ * j1939.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "cantp_esp32.h"
+#include "can-tp.h"
+#include "car_emulator.h"
+#include "vehicle_profile.h"
+#include "emu_tasks.h"
+#include "j1939.h"
+
+#define TAG             "J1939"
+
+#ifdef CONFIG_CAR_EMU_J1939
+
+#define J1939_TP_CM_RTS			16
+#define J1939_TP_CM_CTS			17
+#define J1939_TP_CM_EOMA		19
+#define J1939_TP_CM_BAM			32
+#define J1939_TP_CM_ABORT		255
+
+#define J1939_ABORT_BUSY		1
+#define J1939_ABORT_TIMEOUT		3
+#define J1939_ABORT_BAD_CTS		4
+
+#define J1939_ACK_NACK			1
+#define J1939_ACK_BUSY			3
+
+#define J1939_PRIO_CONTROL		3
+#define J1939_PRIO_DEFAULT		6
+#define J1939_PRIO_TP			7
+
+#define J1939_TX_TOUT_US		100000
+
+/*
+ * NAME: engine #1, on-highway, not arbitrary address capable. The
+ * identity number tells several emulators apart.
+ */
+#define J1939_NAME_IDENTITY		0x1939
+#define J1939_NAME_FUNCTION		0		//engine
+#define J1939_NAME_IND_GROUP	1		//on-highway
+#define J1939_NAME				((uint64_t)J1939_NAME_IDENTITY | \
+								((uint64_t)J1939_NAME_FUNCTION << 40) | \
+								((uint64_t)J1939_NAME_IND_GROUP << 60))
+
+typedef enum {
+	J1939_ADDR_CLAIMING = 0,
+	J1939_ADDR_CLAIMED,
+	J1939_ADDR_LOST			//lost the address, only "cannot claim" is sent
+} j1939_addr_state_t;
+
+typedef enum {
+	J1939_TP_FREE = 0,
+	J1939_TP_BAM_WAIT,		//one BAM at a time per originator
+	J1939_TP_BAM,
+	J1939_TP_CMDT_CTS,		//waiting for CTS
+	J1939_TP_CMDT_DT,		//sending the packets granted by the CTS
+	J1939_TP_CMDT_EOMA		//waiting for End of Message Acknowledge
+} j1939_tp_state_t;
+
+typedef struct j1939_tp_s {
+	j1939_tp_state_t state;
+	uint8_t da;
+	uint32_t pgn;
+	uint16_t len;
+	uint8_t packets;
+	uint8_t next;			//sequence number of the next packet
+	uint8_t last;			//last sequence number granted by the CTS
+	int64_t due_us;
+	uint8_t data[J1939_TP_BUF_LEN];
+} j1939_tp_t;
+
+//Fills the PGN data from the vehicle state, returns the length
+typedef uint16_t (*j1939_fill_t)(uint8_t *data);
+
+typedef struct j1939_pgn_s {
+	uint32_t pgn;
+	uint8_t prio;
+	uint16_t cycle_ms;		//0 when only sent on request
+	j1939_fill_t fill;
+} j1939_pgn_t;
+
+static uint16_t j1939_fill_eec1(uint8_t *data);
+static uint16_t j1939_fill_ccvs(uint8_t *data);
+static uint16_t j1939_fill_et1(uint8_t *data);
+static uint16_t j1939_fill_dm1(uint8_t *data);
+static uint16_t j1939_fill_vi(uint8_t *data);
+
+static const j1939_pgn_t j1939_pgns[] = {
+	{ J1939_PGN_EEC1,	J1939_PRIO_CONTROL,	10,		j1939_fill_eec1 },
+	{ J1939_PGN_CCVS,	J1939_PRIO_DEFAULT,	100,	j1939_fill_ccvs },
+	{ J1939_PGN_ET1,	J1939_PRIO_DEFAULT,	1000,	j1939_fill_et1 },
+	{ J1939_PGN_DM1,	J1939_PRIO_DEFAULT,	1000,	j1939_fill_dm1 },
+	{ J1939_PGN_VI,		J1939_PRIO_DEFAULT,	0,		j1939_fill_vi }
+};
+#define J1939_N_PGNS		(sizeof(j1939_pgns) / sizeof(j1939_pgns[0]))
+
+//Active DTCs reported in DM1: SPN, FMI
+static const uint32_t j1939_dtcs[][2] = {
+	{ 100, 1 },		//engine oil pressure, low
+	{ 110, 0 }		//engine coolant temperature, high
+};
+#define J1939_N_DTCS		(sizeof(j1939_dtcs) / sizeof(j1939_dtcs[0]))
+
+static uint8_t j1939_addr;
+static j1939_addr_state_t addr_state;
+static int64_t claim_due_us;
+static int64_t cyclic_due_us[J1939_N_PGNS];
+static j1939_tp_t tp[J1939_TP_SESSIONS];
+static j1939_stats_t stats;
+static QueueHandle_t rx_queue;
+static TaskHandle_t j1939_task;
+static esp_timer_handle_t j1939_timer;
+
+static uint16_t j1939_fill_eec1(uint8_t *data)
+{
+	uint16_t rpm = (uint16_t)(vehicle_state.rpm * 8);	//0.125 rpm/bit
+	uint8_t torque = (uint8_t)(125 + vehicle_state.throttle);	//%, offset -125
+
+	data[0] = 0xF0;			//torque mode: low idle governor/no request
+	data[1] = torque;		//driver's demand torque
+	data[2] = torque;		//actual torque
+	data[3] = rpm & 0xFF;
+	data[4] = rpm >> 8;
+	data[5] = j1939_addr;	//controlling device
+	data[6] = 0xFF;
+	data[7] = 0xFF;
+	return 8;
+}
+
+static uint16_t j1939_fill_ccvs(uint8_t *data)
+{
+	uint16_t speed = (uint16_t)(vehicle_state.speed * 256);	//1/256 km/h per bit
+
+	memset(data, 0xFF, 8);
+	data[1] = speed & 0xFF;
+	data[2] = speed >> 8;
+	return 8;
+}
+
+static uint16_t j1939_fill_et1(uint8_t *data)
+{
+	uint16_t oil = (uint16_t)((95 + 273) * 32);	//0.03125 C/bit, offset -273
+
+	memset(data, 0xFF, 8);
+	data[0] = 90 + 40;		//coolant, 1 C/bit, offset -40
+	data[1] = 40 + 40;		//fuel
+	data[2] = oil & 0xFF;
+	data[3] = oil >> 8;
+	return 8;
+}
+
+static uint16_t j1939_fill_dm1(uint8_t *data)
+{
+	data[0] = 0x40 | 0x04;	//MIL (bits 8-7) and amber warning lamp (bits 4-3) on
+	data[1] = 0xFF;
+	for (uint8_t i = 0; i < J1939_N_DTCS; i++) {
+		uint32_t spn = j1939_dtcs[i][0];
+		uint8_t *dtc = &data[2 + i * 4];
+		dtc[0] = spn & 0xFF;
+		dtc[1] = (spn >> 8) & 0xFF;
+		dtc[2] = ((spn >> 11) & 0xE0) | (j1939_dtcs[i][1] & 0x1F);
+		dtc[3] = 1;			//occurrence count, SPN conversion method 0
+	}
+	return 2 + J1939_N_DTCS * 4;
+}
+
+static uint16_t j1939_fill_vi(uint8_t *data)
+{
+	memcpy(data, vehicle_profile->vin, OBD2_VIN_LEN);
+	data[OBD2_VIN_LEN] = '*';
+	return OBD2_VIN_LEN + 1;
+}
+
+static const j1939_pgn_t *j1939_pgn_find(uint32_t pgn)
+{
+	for (uint8_t i = 0; i < J1939_N_PGNS; i++) {
+		if (j1939_pgns[i].pgn == pgn) {
+			return &j1939_pgns[i];
+		}
+	}
+	return NULL;
+}
+
+static void j1939_send(uint8_t prio, uint32_t pgn, uint8_t da, uint8_t sa,
+		const uint8_t *data, int64_t deadline_us)
+{
+	if (cantp_can_tx_deadline(j1939_id(prio, pgn, da, sa), 1, 8, (uint8_t *)data,
+								J1939_TX_TOUT_US, deadline_us) < 0) {
+		stats.tx_errors++;
+	}
+}
+
+static inline void j1939_pgn_put(uint8_t *data, uint32_t pgn)
+{
+	data[0] = pgn & 0xFF;
+	data[1] = (pgn >> 8) & 0xFF;
+	data[2] = (pgn >> 16) & 0xFF;
+}
+
+static void j1939_send_claim(void)
+{
+	uint8_t data[8];
+	uint64_t name = J1939_NAME;
+
+	for (uint8_t i = 0; i < 8; i++) {
+		data[i] = (name >> (i * 8)) & 0xFF;
+	}
+	j1939_send(J1939_PRIO_DEFAULT, J1939_PGN_ADDR_CLAIM, J1939_ADDR_GLOBAL,
+			(addr_state == J1939_ADDR_LOST)?J1939_ADDR_NULL:j1939_addr, data,
+			esp_timer_get_time() + J1939_TX_TOUT_US);
+}
+
+static void j1939_send_ack(uint8_t control, uint8_t requester, uint32_t pgn)
+{
+	uint8_t data[8] = { control, 0xFF, 0xFF, 0xFF, requester };
+
+	j1939_pgn_put(&data[5], pgn);
+	j1939_send(J1939_PRIO_DEFAULT, J1939_PGN_ACK, J1939_ADDR_GLOBAL, j1939_addr,
+			data, esp_timer_get_time() + J1939_TX_TOUT_US);
+}
+
+static void j1939_tp_cm(j1939_tp_t *s, uint8_t control, uint8_t b1)
+{
+	uint8_t data[8] = { control, s->len & 0xFF, s->len >> 8, s->packets, 0xFF };
+
+	if (control == J1939_TP_CM_ABORT) {
+		data[1] = b1;
+		data[2] = 0xFF;
+		data[3] = 0xFF;
+	}
+	j1939_pgn_put(&data[5], s->pgn);
+	j1939_send(J1939_PRIO_TP, J1939_PGN_TP_CM, s->da, j1939_addr, data,
+			esp_timer_get_time() + J1939_TX_TOUT_US);
+}
+
+static void j1939_tp_dt(j1939_tp_t *s)
+{
+	uint8_t data[8];
+	uint16_t off = (s->next - 1) * 7;
+
+	memset(data, 0xFF, sizeof(data));
+	data[0] = s->next;
+	memcpy(&data[1], &s->data[off], (s->len - off < 7)?(s->len - off):7);
+	j1939_send(J1939_PRIO_TP, J1939_PGN_TP_DT, s->da, j1939_addr, data,
+			s->due_us + J1939_CMDT_GAP_US);
+	s->next++;
+}
+
+static void j1939_tp_abort(j1939_tp_t *s, uint8_t reason)
+{
+	j1939_tp_cm(s, J1939_TP_CM_ABORT, reason);
+	stats.aborts++;
+	s->state = J1939_TP_FREE;
+}
+
+static j1939_tp_t *j1939_tp_find(uint8_t da, uint32_t pgn)
+{
+	for (uint8_t i = 0; i < J1939_TP_SESSIONS; i++) {
+		if (tp[i].state != J1939_TP_FREE && tp[i].da == da &&
+				(pgn == 0 || tp[i].pgn == pgn)) {
+			return &tp[i];
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Starts a transport session for a PGN longer than 8 bytes, BAM when da
+ * is global, CMDT otherwise. J1939-21 allows one CMDT per destination.
+ */
+static int j1939_tp_start(uint32_t pgn, uint8_t da, const uint8_t *data,
+		uint16_t len, int64_t now)
+{
+	j1939_tp_t *s = j1939_tp_find(da, (da == J1939_ADDR_GLOBAL)?pgn:0);
+
+	if (s != NULL) {
+		//A broadcast which is still queued goes out with the newest data
+		if (s->state != J1939_TP_BAM_WAIT) {
+			return -1;
+		}
+		memcpy(s->data, data, len);
+		return 0;
+	}
+	for (uint8_t i = 0; i < J1939_TP_SESSIONS && s == NULL; i++) {
+		if (tp[i].state == J1939_TP_FREE) {
+			s = &tp[i];
+		}
+	}
+	if (s == NULL) {
+		return -1;
+	}
+
+	s->da = da;
+	s->pgn = pgn;
+	s->len = len;
+	memcpy(s->data, data, len);
+	s->packets = (len + 6) / 7;
+	s->next = 1;
+	s->last = s->packets;
+	if (da == J1939_ADDR_GLOBAL) {
+		s->state = J1939_TP_BAM_WAIT;
+		s->due_us = now;
+		stats.bam++;
+	} else {
+		s->state = J1939_TP_CMDT_CTS;
+		s->due_us = now + J1939_T3_US;
+		j1939_tp_cm(s, J1939_TP_CM_RTS, 0);
+		stats.cmdt++;
+	}
+	return 0;
+}
+
+//Sends the PGN as one frame or starts its transport session
+static int j1939_pgn_send(const j1939_pgn_t *p, uint8_t da, int64_t deadline_us,
+		int64_t now)
+{
+	uint8_t data[J1939_TP_BUF_LEN];
+
+	memset(data, 0xFF, 8);
+	uint16_t len = p->fill(data);
+	if (len > 8) {
+		return j1939_tp_start(p->pgn, da, data, len, now);
+	}
+	j1939_send(p->prio, p->pgn, da, j1939_addr, data, deadline_us);
+	return 0;
+}
+
+static void j1939_request(uint8_t sa, uint8_t da, const uint8_t *data, uint8_t dlc)
+{
+	if (dlc < 3) {
+		return;
+	}
+	uint32_t pgn = data[0] | (data[1] << 8) | ((uint32_t)data[2] << 16);
+	uint8_t specific = (da != J1939_ADDR_GLOBAL);
+	int64_t now = esp_timer_get_time();
+
+	stats.requests++;
+	if (pgn == J1939_PGN_ADDR_CLAIM) {
+		j1939_send_claim();
+		return;
+	}
+	//Nothing else is sent before the address is claimed
+	if (addr_state != J1939_ADDR_CLAIMED) {
+		return;
+	}
+
+	const j1939_pgn_t *p = j1939_pgn_find(pgn);
+	if (p == NULL) {
+		//Global requests for unknown PGNs are not answered
+		if (specific) {
+			stats.nacks++;
+			j1939_send_ack(J1939_ACK_NACK, sa, pgn);
+		}
+		return;
+	}
+	//Single frame PGNs are PDU2, so j1939_id() makes them broadcasts
+	vehicle_state_sync();
+	if (j1939_pgn_send(p, specific?sa:J1939_ADDR_GLOBAL,
+						now + J1939_TX_TOUT_US, now) < 0 && specific) {
+		stats.nacks++;
+		j1939_send_ack(J1939_ACK_BUSY, sa, pgn);
+	}
+}
+
+static void j1939_tp_cm_rx(uint8_t sa, const uint8_t *data, uint8_t dlc)
+{
+	if (dlc < 8) {
+		return;
+	}
+	uint32_t pgn = data[5] | (data[6] << 8) | ((uint32_t)data[7] << 16);
+	j1939_tp_t *s = j1939_tp_find(sa, pgn);
+	int64_t now = esp_timer_get_time();
+
+	switch (data[0]) {
+	case J1939_TP_CM_CTS:
+		if (s == NULL) {
+			return;
+		}
+		if (s->state != J1939_TP_CMDT_CTS || data[2] == 0 || data[2] > s->packets) {
+			j1939_tp_abort(s, J1939_ABORT_BAD_CTS);
+			return;
+		}
+		if (data[1] == 0) {
+			//Hold: the receiver keeps the connection open
+			s->due_us = now + J1939_T4_US;
+			return;
+		}
+		s->next = data[2];
+		s->last = ((uint16_t)data[2] + data[1] - 1 > s->packets)?s->packets:
+				(data[2] + data[1] - 1);
+		s->state = J1939_TP_CMDT_DT;
+		s->due_us = now;
+		break;
+	case J1939_TP_CM_EOMA:
+		if (s != NULL && s->state == J1939_TP_CMDT_EOMA) {
+			stats.cmdt_done++;
+			s->state = J1939_TP_FREE;
+		}
+		break;
+	case J1939_TP_CM_ABORT:
+		if (s != NULL) {
+			stats.aborts++;
+			s->state = J1939_TP_FREE;
+		}
+		break;
+	case J1939_TP_CM_RTS: {
+			//This ECU takes no multi-packet data
+			j1939_tp_t rts = { .da = sa, .pgn = pgn };
+			j1939_tp_abort(&rts, J1939_ABORT_BUSY);
+		} break;
+	default:
+		break;
+	}
+}
+
+static void j1939_claim_rx(uint8_t sa, const uint8_t *data, uint8_t dlc)
+{
+	if (dlc < 8 || sa != j1939_addr || addr_state == J1939_ADDR_LOST) {
+		return;
+	}
+	uint64_t name = 0;
+	for (uint8_t i = 0; i < 8; i++) {
+		name |= (uint64_t)data[i] << (i * 8);
+	}
+	stats.claim_conflicts++;
+	//The lower NAME keeps the address
+	if (name < J1939_NAME) {
+		ESP_LOGW(TAG, "Address 0x%02X lost to another ECU", j1939_addr);
+		addr_state = J1939_ADDR_LOST;
+		for (uint8_t i = 0; i < J1939_TP_SESSIONS; i++) {
+			tp[i].state = J1939_TP_FREE;
+		}
+	}
+	j1939_send_claim();
+}
+
+static void j1939_handle(const cantp_can_frame_t *frame)
+{
+	uint8_t pf = (frame->id >> 16) & 0xFF;
+	uint8_t da = (frame->id >> 8) & 0xFF;
+	uint8_t sa = frame->id & 0xFF;
+
+	stats.rx++;
+	switch (pf << 8) {
+	case J1939_PGN_REQUEST:
+		j1939_request(sa, da, frame->data_u8, frame->dlc);
+		break;
+	case J1939_PGN_TP_CM:
+		if (da == j1939_addr) {
+			j1939_tp_cm_rx(sa, frame->data_u8, frame->dlc);
+		}
+		break;
+	case J1939_PGN_ADDR_CLAIM:
+		j1939_claim_rx(sa, frame->data_u8, frame->dlc);
+		break;
+	default:
+		break;
+	}
+}
+
+static void j1939_tp_run(j1939_tp_t *s, int64_t now)
+{
+	switch (s->state) {
+	case J1939_TP_BAM_WAIT:
+		for (uint8_t i = 0; i < J1939_TP_SESSIONS; i++) {
+			if (tp[i].state == J1939_TP_BAM) {
+				s->due_us = tp[i].due_us + J1939_BAM_GAP_US;
+				return;
+			}
+		}
+		j1939_tp_cm(s, J1939_TP_CM_BAM, 0);
+		s->state = J1939_TP_BAM;
+		s->due_us = now + J1939_BAM_GAP_US;
+		break;
+	case J1939_TP_BAM:
+		j1939_tp_dt(s);
+		if (s->next > s->packets) {
+			s->state = J1939_TP_FREE;
+		} else {
+			//Paced from the schedule, so late packets do not add up
+			s->due_us += J1939_BAM_GAP_US;
+		}
+		break;
+	case J1939_TP_CMDT_DT:
+		j1939_tp_dt(s);
+		if (s->next > s->last) {
+			s->state = (s->next > s->packets)?J1939_TP_CMDT_EOMA:J1939_TP_CMDT_CTS;
+			s->due_us = now + J1939_T3_US;
+		} else {
+			s->due_us = now + J1939_CMDT_GAP_US;
+		}
+		break;
+	case J1939_TP_CMDT_CTS:
+	case J1939_TP_CMDT_EOMA:
+		ESP_LOGW(TAG, "Transport of PGN 0x%05X to 0x%02X timed out", s->pgn, s->da);
+		j1939_tp_abort(s, J1939_ABORT_TIMEOUT);
+		break;
+	default:
+		break;
+	}
+}
+
+//Runs everything due and returns the earliest next deadline
+static int64_t j1939_run(int64_t now)
+{
+	int64_t next = INT64_MAX;
+
+	if (addr_state == J1939_ADDR_CLAIMING) {
+		if (now < claim_due_us) {
+			return claim_due_us;
+		}
+		addr_state = J1939_ADDR_CLAIMED;
+		ESP_LOGI(TAG, "Address 0x%02X claimed", j1939_addr);
+		for (uint8_t i = 0; i < J1939_N_PGNS; i++) {
+			cyclic_due_us[i] = now + i * 1000;
+		}
+	}
+	if (addr_state == J1939_ADDR_LOST) {
+		return next;
+	}
+
+	vehicle_state_sync();
+	for (uint8_t i = 0; i < J1939_N_PGNS; i++) {
+		const j1939_pgn_t *p = &j1939_pgns[i];
+		if (p->cycle_ms == 0) {
+			continue;
+		}
+		int64_t period = p->cycle_ms * 1000LL;
+		if (now >= cyclic_due_us[i]) {
+			if (now - cyclic_due_us[i] >= period) {
+				cyclic_due_us[i] += (now - cyclic_due_us[i]) / period * period;
+			}
+			j1939_pgn_send(p, J1939_ADDR_GLOBAL, cyclic_due_us[i] + period, now);
+			stats.broadcasts++;
+			cyclic_due_us[i] += period;
+		}
+		if (cyclic_due_us[i] < next) {
+			next = cyclic_due_us[i];
+		}
+	}
+
+	for (uint8_t i = 0; i < J1939_TP_SESSIONS; i++) {
+		j1939_tp_t *s = &tp[i];
+		if (s->state != J1939_TP_FREE && now >= s->due_us) {
+			j1939_tp_run(s, esp_timer_get_time());
+		}
+		if (s->state != J1939_TP_FREE && s->due_us < next) {
+			next = s->due_us;
+		}
+	}
+	return next;
+}
+
+static void j1939_timer_cb(void *arg)
+{
+	xTaskNotifyGive(j1939_task);
+}
+
+static void j1939_task_fn(void *arg)
+{
+	cantp_can_frame_t frame;
+
+	addr_state = J1939_ADDR_CLAIMING;
+	claim_due_us = esp_timer_get_time() + J1939_CLAIM_WAIT_US;
+	j1939_send_claim();
+
+	while (1) {
+		while (xQueueReceive(rx_queue, &frame, 0) == pdTRUE) {
+			j1939_handle(&frame);
+		}
+		int64_t now = esp_timer_get_time();
+		int64_t next = j1939_run(now);
+
+		esp_timer_stop(j1939_timer);
+		if (next != INT64_MAX) {
+			now = esp_timer_get_time();
+			esp_timer_start_once(j1939_timer, (next > now)?(next - now):1);
+		}
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+	}
+}
+
+int j1939_rx(const cantp_can_frame_t *frame)
+{
+	if (!frame->rtr || rx_queue == NULL) {
+		return -1;
+	}
+	uint8_t pf = (frame->id >> 16) & 0xFF;
+	uint8_t da = (frame->id >> 8) & 0xFF;
+
+	if (pf != (J1939_PGN_REQUEST >> 8) && pf != (J1939_PGN_TP_CM >> 8) &&
+			pf != (J1939_PGN_ADDR_CLAIM >> 8)) {
+		return -1;
+	}
+	if (da != j1939_addr && da != J1939_ADDR_GLOBAL) {
+		return -1;
+	}
+	if (xQueueSend(rx_queue, frame, 0) != pdTRUE) {
+		stats.rx_dropped++;
+		return 0;
+	}
+	xTaskNotifyGive(j1939_task);
+	return 0;
+}
+
+int j1939_start(uint8_t addr)
+{
+	j1939_addr = addr;
+	rx_queue = xQueueCreate(J1939_RX_QUEUE_LEN, sizeof(cantp_can_frame_t));
+	if (rx_queue == NULL) {
+		return -1;
+	}
+	const esp_timer_create_args_t timer_args = {
+			.callback = &j1939_timer_cb,
+			.arg = NULL,
+			.name = "j1939"
+	};
+	if (esp_timer_create(&timer_args, &j1939_timer) != ESP_OK) {
+		return -1;
+	}
+	if (emu_task_create(j1939_task_fn, "j1939", 3 * 1024, NULL, 4,
+										EMU_CORE_CAN, &j1939_task) != pdPASS) {
+		return -1;
+	}
+	ESP_LOGI(TAG, "Claiming address 0x%02X", addr);
+	return 0;
+}
+
+void j1939_stats_get(j1939_stats_t *st)
+{
+	*st = stats;
+}
+
+void j1939_print(void)
+{
+	static const char *addr_state_str[] = { "claiming", "claimed", "lost" };
+	static const char *tp_state_str[] = {
+			"free", "BAM queued", "BAM", "CMDT wait CTS", "CMDT data", "CMDT wait EoMA"
+	};
+	j1939_stats_t st = stats;
+
+	printf("\nJ1939 address 0x%02X %s\n", j1939_addr, addr_state_str[addr_state]);
+	printf("rx %u (dropped %u), requests %u, NACKs %u, broadcasts %u\n",
+			st.rx, st.rx_dropped, st.requests, st.nacks, st.broadcasts);
+	printf("BAM %u, CMDT %u (acknowledged %u), aborts %u, TX errors %u, "
+			"address conflicts %u\n", st.bam, st.cmdt, st.cmdt_done, st.aborts,
+			st.tx_errors, st.claim_conflicts);
+	for (uint8_t i = 0; i < J1939_TP_SESSIONS; i++) {
+		j1939_tp_t *s = &tp[i];
+		if (s->state != J1939_TP_FREE) {
+			printf("  PGN 0x%05X to 0x%02X: %s, packet %u/%u\n", s->pgn, s->da,
+					tp_state_str[s->state], s->next, s->packets);
+		}
+	}
+}
+
+#endif //CONFIG_CAR_EMU_J1939
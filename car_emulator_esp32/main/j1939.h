@@ -0,0 +1,87 @@
+/*
+ * j1939.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+
+#ifndef __J1939_H_
+#define __J1939_H_
+
+#include <stdint.h>
+
+#include "can-tp.h"
+
+/*
+ * SAE J1939 engine ECU on the extended IDs, next to the ISO 15765-4
+ * responder. It claims its address, broadcasts EEC1, CCVS, ET1 and DM1,
+ * answers PGN requests and sends PGNs longer than 8 bytes with the
+ * transport protocol: BAM to the global address, paced 50 ms, or CMDT
+ * (RTS/CTS) to the requester.
+ *
+ * Everything runs in one task driven by an esp_timer armed for the
+ * earliest deadline, so transport sessions are stepped one packet at a
+ * time and never hold back single frame traffic or other sessions.
+ */
+#define J1939_ADDR_NULL			0xFE
+#define J1939_ADDR_GLOBAL		0xFF
+
+#define J1939_PGN_ACK			0xE800
+#define J1939_PGN_REQUEST		0xEA00
+#define J1939_PGN_TP_DT			0xEB00
+#define J1939_PGN_TP_CM			0xEC00
+#define J1939_PGN_ADDR_CLAIM	0xEE00
+#define J1939_PGN_EEC1			0xF004
+#define J1939_PGN_VI			0xFEEC
+#define J1939_PGN_ET1			0xFEEE
+#define J1939_PGN_CCVS			0xFEF1
+#define J1939_PGN_DM1			0xFECA
+
+#define J1939_TP_SESSIONS		4
+#define J1939_TP_BUF_LEN		64		//longest multi-packet PGN served
+#define J1939_RX_QUEUE_LEN		16
+
+//J1939-21 transport timing
+#define J1939_BAM_GAP_US		50000
+#define J1939_CMDT_GAP_US		2000
+#define J1939_T3_US				1250000	//originator waiting for CTS or EoMA
+#define J1939_T4_US				1050000	//after a CTS holding the connection open
+#define J1939_CLAIM_WAIT_US		250000
+
+typedef struct j1939_stats_s {
+	uint32_t rx;
+	uint32_t rx_dropped;	//RX queue full
+	uint32_t requests;
+	uint32_t nacks;			//requests for PGNs not served, or no free session
+	uint32_t broadcasts;
+	uint32_t bam;
+	uint32_t cmdt;
+	uint32_t cmdt_done;		//acknowledged with EoMA
+	uint32_t aborts;		//sent on timeout or received
+	uint32_t tx_errors;
+	uint32_t claim_conflicts;
+} j1939_stats_t;
+
+static inline uint32_t j1939_id(uint8_t prio, uint32_t pgn, uint8_t da, uint8_t sa)
+{
+	uint32_t id = ((uint32_t)(prio & 7) << 26) | ((pgn & 0x3FFFF) << 8) | sa;
+	//PDU1: the low byte of the PGN is the destination address
+	if (((pgn >> 8) & 0xFF) < 240) {
+		id = (id & ~0xFF00UL) | ((uint32_t)da << 8);
+	}
+	return id;
+}
+
+int j1939_start(uint8_t addr);
+
+/*
+ * Called by the dispatcher for every extended frame. Returns 0 when the
+ * frame is J1939 traffic for this ECU and was queued, -1 otherwise.
+ */
+int j1939_rx(const cantp_can_frame_t *frame);
+
+void j1939_stats_get(j1939_stats_t *stats);
+
+void j1939_print(void);
+
+#endif /* __J1939_H_ */
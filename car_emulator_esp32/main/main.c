@@ -7,6 +7,7 @@
    CONDITIONS OF ANY KIND, either express or implied.
 */
 #include <string.h>
+#include <stdlib.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
@@ -32,10 +33,42 @@
 #include "can-tp.h"
 #include "obd.h"
 #include "car_emulator.h"
+#include "emu_tasks.h"
+#include "timer_wheel.h"
+#include "cantp_session.h"
+#include "cantp_txq.h"
+#include "cyclic_tx.h"
+#include "can_capture.h"
+#include "emu_config.h"
+#include "can_autobaud.h"
+#include "can_health.h"
+#include "emu_mem.h"
+#include "emu_bench.h"
+#include "can_bridge.h"
+#include "obd_id_table.h"
+#include "can_fault.h"
+#include "can_stats.h"
+#include "emu_trace.h"
+#include "j1939.h"
+#include "uds_download.h"
+#include "vehicle_profile.h"
+#include "can_rx.h"
 
 #define TX_GPIO_NUM             21
 #define RX_GPIO_NUM             22
 
+#ifdef CONFIG_CAR_EMU_RX_RING
+//Deep enough to ride out a flash write, filled by the IRAM interrupt
+#define CAN_RX_QUEUE_LEN        EMU_CAN_RX_DRV_QUEUE_LEN
+#else
+#define CAN_RX_QUEUE_LEN        5
+#endif
+#ifdef CONFIG_TWAI_ISR_IN_IRAM
+#define CAN_INTR_FLAGS          (ESP_INTR_FLAG_LEVEL1 | ESP_INTR_FLAG_IRAM)
+#else
+#define CAN_INTR_FLAGS          ESP_INTR_FLAG_LEVEL1
+#endif
+
 #define CAN_TAG             "CAN"
 
 /* The examples use WiFi configuration that you can set via project configuration menu
@@ -64,8 +97,6 @@ static const char *TAG = "wifi station";
 
 static int s_retry_num = 0;
 
-static cantp_rxtx_status_t cantp_ctx;
-
 #if 1//STDIN
 #include "esp_vfs_dev.h"
 #include "driver/uart.h"
@@ -210,6 +241,7 @@ void cantp_sndr_result_cb(int result)
 		printf("\033[0;31m");
 	}
 	printf("%s\033[0m\n", cantp_result_enum_str[result]);
+	cantp_txq_sndr_result(result);
 
 //	msync(rcvr_end_sem, sizeof(size_t), MS_SYNC);
 //	sem_post(rcvr_end_sem);
@@ -224,6 +256,8 @@ int cantp_rcvr_rx_ff_cb(uint32_t id, uint8_t idt, uint8_t **data, uint16_t len)
 	if (*data == NULL) {
 		printf("\033[0;36mCAN-SL Receiver: ERROR allocating memory\033[0m\n");
 		fflush(0);
+	} else {
+		emu_mem_ff_alloc(len);
 	}
 
 	//Here maybe should be checked if the ID of the Sender is correct
@@ -241,16 +275,207 @@ int cantp_rcvr_rx_ff_cb(uint32_t id, uint8_t idt, uint8_t **data, uint16_t len)
 void print_help()
 {
 	printf("\n\tCommands:\n"
+#ifndef CONFIG_CAR_EMU_AUTOSTART
 						"go        start simulator\n"
+#endif
+#ifndef CONFIG_CAR_EMU_FIXED_CONFIG
+						"bpr=125   sets the baudrate to 125kbps\n"
 						"bpr=250   sets the baudrate to 250kbps\n"
 						"bpr=500   sets the baudrate to 500kbps\n"
+						"bpr=1000  sets the baudrate to 1000kbps\n"
 						"idt=STD   sets the ID type to Standard (11bit)\n"
 						"idt=EXT   sets the ID type to Extended (29bit)\n"
+						"idt=ALL   serves Standard and Extended IDs together\n"
+#endif
+						"ids       served IDs\n"
+						"save      saves the vehicle state\n"
+						"profile   vehicle profiles (profile=N or profile=NAME selects)\n"
+						"boot      boot to first response timing\n"
+						"health    CAN error counters and bus-off recoveries\n"
+						"mem       stacks, heap and pool usage\n"
+						"latency   request to response latency per path\n"
+						"hsim      CAN fault scenarios on a simulated controller\n"
+						"bench     hot path benchmarks\n"
+						"twbench   CAN-TP timer wheel benchmark\n"
+						"absim     bit rate detection against simulated buses\n"
+#ifdef CONFIG_CAR_EMU_RX_RING
+						"rx        RX ring and driver queue counters\n"
+						"rxsim     RX bursts and flash stalls, old queue against the ring\n"
+#endif
+#ifdef CONFIG_CAR_EMU_BUS_STATS
+						"bus       per-ID frame counts, intervals and bus load\n"
+						"bus=reset clears the traffic statistics\n"
+#endif
+#ifdef CONFIG_CAR_EMU_TRACE
+						"trace     CAN-TP timeline as Chrome trace / Perfetto JSON\n"
+						"trace=clear  empties the trace (trace=off, trace=on)\n"
+#endif
+#ifdef CONFIG_CAR_EMU_CAPTURE
+						"capbench  bus capture throughput benchmark\n"
+#endif
+#ifdef CONFIG_CAR_EMU_BRIDGE
+						"bridge    TCP bridge clients and injected frames\n"
+#endif
+#ifdef CONFIG_CAR_EMU_UDS_DOWNLOAD
+						"dl        UDS download progress and throughput\n"
+						"dl=crc    downloads are only checksummed (dl=part to flash)\n"
+#endif
+#ifdef CONFIG_CAR_EMU_J1939
+						"j1939     J1939 address, requests and transport sessions\n"
+#endif
+#ifdef CONFIG_CAR_EMU_FAULT
+						"fault     fault injection settings and counters\n"
+						"fault=on  starts injecting from the seed (fault=off stops)\n"
+						"fault=drop:50  sets a fault in permille, also delay, dup,\n"
+						"          reorder, sn, dlc, fc, jitter, seed, id (hex),\n"
+						"          delay_us and jitter_us\n"
+						"faultbench  fault injection cost at full bus load\n"
+#endif
 						"help      this menu\n");
 }
 
+static emulator_cfg_t ecfg;
+static uint8_t emu_running;
+
+/*
+ * Executes one console command. Settings are saved at once; a new
+ * baudrate needs the driver to be reinstalled, which is done by
+ * restarting once the emulator is running. Returns 1 on "go".
+ */
+static int console_cmd(char *line)
+{
+	if (strstr("go", line) != NULL) {
+		printf("\nSTART\n");
+		return 1;
+	} else if (strstr("help", line) != NULL) {
+		print_help();
+#ifndef CONFIG_CAR_EMU_FIXED_CONFIG
+	} else if (strncmp(line, "bpr=", 4) == 0) {
+		cfg_boad_rate_t boadrate;
+		if (cfg_boadrate_from_kbps(atoi(&line[4]), &boadrate) < 0) {
+			printf("\nUnsupported baudrate\n");
+			return 0;
+		}
+		printf("\nBaudrate set to %dkbps\n", cfg_boadrate_kbps(boadrate));
+		if (boadrate != ecfg.boadrate) {
+			ecfg.boadrate = boadrate;
+			emu_config_save(&ecfg);
+			if (emu_running) {
+				printf("Restarting to apply the baudrate\n"); fflush(stdout);
+				esp_restart();
+			}
+		}
+	} else if (strncmp(line, "idt=", 4) == 0) {
+		cfg_can_idt_t id_type;
+		if (strcmp(&line[4], "STD") == 0) {
+			id_type = CFG_STANDARD_ID;
+		} else if (strcmp(&line[4], "EXT") == 0) {
+			id_type = CFG_EXTENDED_ID;
+		} else if (strcmp(&line[4], "ALL") == 0) {
+			id_type = CFG_MIXED_ID;
+		} else {
+			printf("\nUnsupported ID type\n");
+			return 0;
+		}
+		printf("\nID type is %s\n", (id_type == CFG_MIXED_ID)?"Standard and Extended":
+				(id_type == CFG_EXTENDED_ID)?"Extended":"Standard");
+		if (id_type != ecfg.id_type) {
+			ecfg.id_type = id_type;
+			emu_config_save(&ecfg);
+			//The ID table is read without locks, it is only built at boot
+			if (emu_running) {
+				printf("Restarting to apply the ID type\n"); fflush(stdout);
+				esp_restart();
+			}
+		}
+#endif
+	} else if (strstr("ids", line) != NULL) {
+		obd_id_table_print();
+	} else if (strstr("save", line) != NULL) {
+		vehicle_state_t vs;
+		vehicle_state_get(&vs);
+		printf("\nVehicle state %s\n",
+				(emu_config_save_vehicle(&vs) < 0)?"not saved":"saved");
+	} else if (strncmp(line, "profile", 7) == 0) {
+		vehicle_profile_cmd(&line[7]);
+	} else if (strstr("boot", line) != NULL) {
+		emu_boot_report();
+	} else if (strstr("health", line) != NULL) {
+		can_health_stats_print();
+	} else if (strstr("mem", line) != NULL) {
+		emu_mem_report();
+	} else if (strstr("latency", line) != NULL) {
+		car_emu_latency_print();
+	} else if (strstr("hsim", line) != NULL) {
+		can_health_sim();
+	} else if (strcmp(line, "bench") == 0) {
+		emu_bench_run();
+	} else if (strstr("twbench", line) != NULL) {
+		timer_wheel_bench();
+	} else if (strstr("absim", line) != NULL) {
+		can_autobaud_sim();
+#ifdef CONFIG_CAR_EMU_RX_RING
+	} else if (strcmp(line, "rxsim") == 0) {
+		can_rx_sim();
+	} else if (strcmp(line, "rx") == 0) {
+		can_rx_print();
+#endif
+#ifdef CONFIG_CAR_EMU_BUS_STATS
+	} else if (strncmp(line, "bus", 3) == 0) {
+		can_stats_cmd(&line[3]);
+#endif
+#ifdef CONFIG_CAR_EMU_TRACE
+	} else if (strncmp(line, "trace", 5) == 0) {
+		emu_trace_cmd(&line[5]);
+#endif
+#ifdef CONFIG_CAR_EMU_CAPTURE
+	} else if (strstr("capbench", line) != NULL) {
+		can_capture_bench();
+#endif
+#ifdef CONFIG_CAR_EMU_BRIDGE
+	} else if (strstr("bridge", line) != NULL) {
+		can_bridge_stats_print();
+#endif
+#ifdef CONFIG_CAR_EMU_UDS_DOWNLOAD
+	} else if (strncmp(line, "dl", 2) == 0) {
+		uds_dl_cmd(&line[2]);
+#endif
+#ifdef CONFIG_CAR_EMU_J1939
+	} else if (strstr("j1939", line) != NULL) {
+		j1939_print();
+#endif
+#ifdef CONFIG_CAR_EMU_FAULT
+	} else if (strcmp(line, "faultbench") == 0) {
+		can_fault_bench();
+	} else if (strncmp(line, "fault", 5) == 0) {
+		can_fault_cmd(&line[5]);
+#endif
+	} else {
+		printf("\nWrong command\n");
+	}
+	return 0;
+}
+
+//Keeps the console available for live changes while the emulator runs
+static void console_task(void *arg)
+{
+#ifdef CONFIG_CAR_EMU_AUTOSTART
+	print_help();
+#endif
+	while (1) {
+		char line[30];
+		printf("\n\nCMD> "); fflush(stdout);
+		if (stdin_getstr(line, 30) <= 0) {
+			continue;
+		}
+		console_cmd(line);
+	}
+}
+
 void app_main(void)
 {
+	emu_mem_mark_boot();
+
     //Initialize NVS
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
@@ -272,10 +497,10 @@ void app_main(void)
 										.clkout_io = TWAI_IO_UNUSED,
 										.bus_off_io = TWAI_IO_UNUSED,
 										.tx_queue_len = 0,//5,
-										.rx_queue_len = 5,
-										.alerts_enabled = TWAI_ALERT_TX_SUCCESS,//TWAI_ALERT_NONE,
+										.rx_queue_len = CAN_RX_QUEUE_LEN,
+										.alerts_enabled = CAN_HEALTH_ALERTS,
 										.clkout_divider = 0,
-										.intr_flags = ESP_INTR_FLAG_LEVEL1
+										.intr_flags = CAN_INTR_FLAGS
 									};
 
 //	static twai_timing_config_t t_config = {
@@ -288,14 +513,25 @@ void app_main(void)
 //										.triple_sampling = false
 //									};
 
-	emulator_cfg_t ecfg;
+#ifdef CONFIG_CAR_EMU_FIXED_CONFIG
+	ecfg.boadrate = EMU_FIXED_BOADRATE;
+	ecfg.id_type = EMU_FIXED_ID_TYPE;
+#else
 	ecfg.boadrate = CFG_500KBPS;
-	ecfg.id_type = CFG_STANDARD_ID;
+	ecfg.id_type = CFG_MIXED_ID;
+	if (emu_config_load(&ecfg) < 0) {
+		ESP_LOGI(TAG, "No stored configuration, using defaults");
+	}
+#endif
+	emu_config_load_vehicle(&vehicle_state);
+	vehicle_profile_init();
 
 	twai_timing_config_t *t_config_p;
 
 	static twai_timing_config_t t_config_500kb = TWAI_TIMING_CONFIG_500KBITS();
+	static twai_timing_config_t t_config_125kb = TWAI_TIMING_CONFIG_125KBITS();
 	static twai_timing_config_t t_config_250kb = TWAI_TIMING_CONFIG_250KBITS();
+	static twai_timing_config_t t_config_1000kb = TWAI_TIMING_CONFIG_1MBITS();
 
 	static twai_filter_config_t f_config = {
 										.acceptance_code = 0,
@@ -303,48 +539,50 @@ void app_main(void)
 										.single_filter = false
 									};
 
-	static emulator_ctx_t ectx;
-	ectx.cfg = &ecfg;
-
     stdin_init();
 
+#ifndef CONFIG_CAR_EMU_AUTOSTART
     print_help();
 
+    int64_t go_wait_start = esp_timer_get_time();
     while (1) {
 		char line[30];
 		printf("\n\nCMD> "); fflush(stdout);
 		if (stdin_getstr(line, 30) <= 0) {
 			continue;
 		}
-		if (strstr("go", line) != NULL) {
-			printf("\nSTART\n");
+		if (console_cmd(line) == 1) {
 			break;
-		} else if (strstr("help", line) != NULL) {
-			print_help();
-		} else if (strstr("bpr=250", line) != NULL) {
-			printf("\nBaudrate set to 250kbps\n");
-			ecfg.boadrate = CFG_250KBPS;
-		} else if (strstr("bpr=500", line) != NULL) {
-			printf("\nBaudrate set to 500kbps\n");
-			ecfg.boadrate = CFG_500KBPS;
-		} else if (strstr("idt=STD", line) != NULL) {
-			printf("\nID type is Standard\n");
-			ecfg.id_type = CFG_STANDARD_ID;
-		} else if (strstr("idt=EXT", line) != NULL) {
-			printf("\nID type is Extended\n");
-			ecfg.id_type = CFG_EXTENDED_ID;
-		} else {
-			printf("\nWrong command\n");
 		}
 	}
+    emu_boot_mark_go(go_wait_start);
+#endif
 
-    switch (ecfg.boadrate) {
+#if ESP32_IDF_CAN_HAL && defined(CONFIG_CAR_EMU_AUTOBAUD)
+    //Only until a configuration is stored, also one set on the console
+    {
+		emulator_cfg_t stored;
+		if (emu_config_load(&stored) < 0 &&
+			can_autobaud_detect(&g_config, &f_config, &ecfg,
+							CONFIG_CAR_EMU_AUTOBAUD_TIMEOUT_MS) == 0) {
+			emu_config_save(&ecfg);
+		}
+    }
+#endif
+
+    switch (EMU_CFG_BOADRATE(&ecfg)) {
+    	case CFG_125KBPS:
+    		t_config_p = &t_config_125kb;
+    		break;
     	case CFG_250KBPS:
     		t_config_p = &t_config_250kb;
     		break;
     	case CFG_500KBPS:
     		t_config_p = &t_config_500kb;
     		break;
+    	case CFG_1000KBPS:
+    		t_config_p = &t_config_1000kb;
+    		break;
     	default:
     		t_config_p = &t_config_500kb;
     }
@@ -365,41 +603,101 @@ void app_main(void)
 #endif
 //	can_drv_esp32_regs_print();
 	ESP_LOGI(CAN_TAG, "Driver started");
+#if ESP32_IDF_CAN_HAL
+	if (can_health_start() < 0) {
+		ESP_LOGE(CAN_TAG, "Failed to start the health monitor");
+		return;
+	}
+#endif
 
 	cantp_params_t sndr_params;
 	sndr_params.st_min_us = 127000;
 	sndr_params.block_size = 0;
 	sndr_params.wft_tim_us = 0;
 
-    const esp_timer_create_args_t sndr_timer_args = {
-            .callback = &cantp_sndr_t_cb,
-            .arg = (void*) &cantp_ctx,
-            .name = "one-shot"
-    };
-    esp_timer_handle_t sndr_timer;
-    ESP_ERROR_CHECK(esp_timer_create(&sndr_timer_args, &sndr_timer));
-    ESP_LOGI(TAG, "Created timer (%p)\n", sndr_timer);
-    cantp_set_sndr_timer_ptr(sndr_timer, &cantp_ctx);
-
-
-    ectx.sem = xSemaphoreCreateBinary();
-    cantp_ctx.cb_ctx = (void *)&ectx;
-    ectx.cantp_ctx = &cantp_ctx;
+#ifdef CONFIG_CANTP_TIMER_WHEEL
+    ESP_ERROR_CHECK(cantp_timer_wheel_start());
+#endif
+    if (cantp_txq_init() < 0) {
+		ESP_LOGE(TAG, "Failed to create the CAN-TP TX queue");
+		return;
+    }
 
-	if (cantp_rcvr_params_init(&cantp_ctx, &sndr_params, "Sender") < 0) {
-//		return EXIT_FAILURE;
+	vehicle_state_init();
+	emu_log_start();
+#ifdef CONFIG_CAR_EMU_TRACE
+	emu_trace_start();
+#endif
+#ifdef CONFIG_CAR_EMU_BUS_STATS
+	can_stats_start(cfg_boadrate_kbps(EMU_CFG_BOADRATE(&ecfg)) * 1000);
+#endif
+#ifdef CONFIG_CAR_EMU_CAPTURE
+	if (can_capture_init() < 0) {
+		ESP_LOGE(TAG, "Failed to start the bus capture");
+	} else {
+#if defined(CONFIG_CAR_EMU_BRIDGE)
+		//The capture goes to the bridge client once one connects
+		if (can_bridge_start(wifi_init_sta, cfg_boadrate_kbps(EMU_CFG_BOADRATE(&ecfg)) * 1000) < 0) {
+			ESP_LOGE(TAG, "Failed to start the TCP bridge");
+		}
+#elif defined(CONFIG_CAR_EMU_CAPTURE_ASC)
+		can_capture_start(CAN_CAPTURE_ASC);
+#else
+		can_capture_start(CAN_CAPTURE_CANDUMP);
+#endif
 	}
+#endif
+#ifdef CONFIG_CAR_EMU_VEHICLE_SIM
+	emu_task_create(vehicle_sim_task, "sim_task", 2 * 1024, NULL, 1,
+														EMU_CORE_APP, NULL);
+#endif
 
-//	uint8_t data[8] = { 0 };
-//	for (uint8_t i=0; i < 3; i++) {
-//		cantp_can_tx(0xaaa, 0, 8, data, 0);
-//		vTaskDelay(2000/portTICK_PERIOD_MS);
-//	}
+	if (car_emu_id_table_build(&ecfg) < 0) {
+		ESP_LOGE(TAG, "Failed to build the ID table");
+		return;
+	}
+	//Every tester/ECU address pair gets its own CAN-TP sender and receiver
+	if (cantp_session_table_init(&ecfg, &sndr_params) < 0) {
+		ESP_LOGE(TAG, "Failed to create the CAN-TP sessions");
+		return;
+	}
 
-	SemaphoreHandle_t sndr_state_sem = xSemaphoreCreateBinary();
-	cantp_ctx.sndr.state_sem = (void *)sndr_state_sem;
+#ifdef CONFIG_CAR_EMU_RX_RING
+	if (can_rx_start() < 0) {
+		ESP_LOGE(TAG, "Failed to start the RX pump");
+		return;
+	}
+#endif
+#ifdef CONFIG_CAR_EMU_UDS_DOWNLOAD
+	if (uds_dl_init(UDS_DL_SINK_PARTITION) < 0) {
+		ESP_LOGE(TAG, "Failed to start the UDS download sink");
+	}
+#endif
+#ifdef CONFIG_CAR_EMU_J1939
+	if (EMU_CFG_ID_TYPE(&ecfg) != CFG_STANDARD_ID && j1939_start(CONFIG_CAR_EMU_J1939_ADDR) < 0) {
+		ESP_LOGE(TAG, "Failed to start J1939");
+	}
+#endif
+#ifdef CONFIG_CAR_EMU_CYCLIC_TX
+	if (cyclic_tx_start() < 0) {
+		ESP_LOGE(TAG, "Failed to start the cyclic messages");
+	}
+#endif
 
-	xTaskCreate(cantp_sndr_task, "can_task", 2 * 1024, &cantp_ctx, 1, NULL);
+	emu_running = 1;
+	emu_task_create(console_task, "console", 3 * 1024, NULL, 1,
+														EMU_CORE_APP, NULL);
+	emu_boot_mark_ready();
+	emu_mem_mark_ready();
+	if (emu_mem_telemetry_start(CONFIG_CAR_EMU_MEM_REPORT_S) < 0) {
+		ESP_LOGE(TAG, "Failed to start the memory telemetry");
+	}
 
-	cantp_rx_task((void *)&cantp_ctx);
-}
+#ifdef CONFIG_CAR_EMU_DUAL_CORE
+	//app_main is pinned to core 0, so the dispatcher gets its own pinned task
+	emu_task_create(cantp_session_dispatch_task, "cantp_disp", 3 * 1024, NULL, 3,
+														EMU_CORE_CAN, NULL);
+#else
+	cantp_session_dispatch_task(NULL);
+#endif
+}
\ No newline at end of file
@@ -17,15 +17,16 @@ along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 /** \file
-  \brief Functions to convert from values back to OBDII output
+  \brief Functions to convert from values back to OBDII output, and the
+   obdConvert_ ones from OBDII output to values used by tools/obddec
 */
 
 // http://en.wikipedia.org/wiki/Table_of_OBD-II_Codes
 
 #include <stdio.h>
+#include <stdint.h>
 #include <string.h>
 #include "obd.h"
-#include "can-tp.h"
 
 int obdRevConvert_04    (float val, uint8_t  *A, uint8_t  *B, uint8_t  *C, uint8_t  *D) {
 	*A = (unsigned int)(255.0f*val/100.0f);
@@ -277,3 +278,188 @@ int obdRevConvert_52    (float val, uint8_t  *A, uint8_t  *B, uint8_t  *C, uint8
 	*A = (unsigned int)(255.0f*val/100.0f);
 	return 1;
 }
+
+
+float obdConvert_04    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D) {
+	return A*100.0f/255.0f;
+}
+
+
+float obdConvert_05    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D) {
+	return A-40.0f;
+}
+
+
+float obdConvert_06_09 (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D) {
+	return (A-128.0f)*100.0f/128.0f;
+}
+
+
+float obdConvert_0A    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D) {
+	return A*3.0f;
+}
+
+
+float obdConvert_0B    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D) {
+	return A;
+}
+
+
+float obdConvert_0C    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D) {
+	return ((A*256.0f)+B)/4.0f;
+}
+
+
+float obdConvert_0D    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D) {
+	return A;
+}
+
+
+float obdConvert_0E    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D) {
+	return A/2.0f-64.0f;
+}
+
+
+float obdConvert_0F    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D) {
+	return A-40.0f;
+}
+
+
+float obdConvert_10    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D) {
+	return ((A*256.0f)+B)/100.0f;
+}
+
+
+float obdConvert_11    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D) {
+	return A*100.0f/255.0f;
+}
+
+
+float obdConvert_14_1B (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D) {
+	return A*0.005f;
+}
+
+
+float obdConvert_1F    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D) {
+	return (A*256.0f)+B;
+}
+
+
+float obdConvert_21    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D) {
+	return (A*256.0f)+B;
+}
+
+
+float obdConvert_22    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D) {
+	return ((A*256.0f)+B)*0.079f;
+}
+
+
+float obdConvert_23    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D) {
+	return ((A*256.0f)+B)*10.0f;
+}
+
+
+float obdConvert_24_2B (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D) {
+	return ((A*256.0f)+B)*0.0000305f;
+}
+
+
+float obdConvert_2C    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D) {
+	return A*100.0f/255.0f;
+}
+
+
+float obdConvert_2D    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D) {
+	return A*0.78125f-100.0f;
+}
+
+
+float obdConvert_2E    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D) {
+	return A*100.0f/255.0f;
+}
+
+
+float obdConvert_2F    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D) {
+	return A*100.0f/255.0f;
+}
+
+
+float obdConvert_30    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D) {
+	return A;
+}
+
+
+float obdConvert_31    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D) {
+	return (A*256.0f)+B;
+}
+
+
+float obdConvert_32    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D) {
+	return ((A*256.0f)+B)/4.0f-8192.0f;
+}
+
+
+float obdConvert_33    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D) {
+	return A;
+}
+
+
+float obdConvert_34_3B (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D) {
+	return ((A*256.0f)+B)*0.0000305f;
+}
+
+
+float obdConvert_3C_3F (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D) {
+	return ((A*256.0f)+B)/10.0f-40.0f;
+}
+
+
+float obdConvert_42    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D) {
+	return ((A*256.0f)+B)/1000.0f;
+}
+
+
+float obdConvert_43    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D) {
+	return ((A*256.0f)+B)*100.0f/255.0f;
+}
+
+
+float obdConvert_44    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D) {
+	return ((A*256.0f)+B)*0.0000305f;
+}
+
+
+float obdConvert_45    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D) {
+	return A*100.0f/255.0f;
+}
+
+
+float obdConvert_46    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D) {
+	return A-40.0f;
+}
+
+
+float obdConvert_47_4B (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D) {
+	return A*100.0f/255.0f;
+}
+
+
+float obdConvert_4C    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D) {
+	return A*100.0f/255.0f;
+}
+
+
+float obdConvert_4D    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D) {
+	return (A*256.0f)+B;
+}
+
+
+float obdConvert_4E    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D) {
+	return (A*256.0f)+B;
+}
+
+
+float obdConvert_52    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D) {
+	return A*100.0f/255.0f;
+}
@@ -57,6 +57,44 @@ typedef float (*OBDConvFunc)(uint8_t  A, uint8_t  B,
 typedef int (*OBDConvRevFunc)(float val, uint8_t  *A, uint8_t  *B,
 	uint8_t  *C, uint8_t  *D);
 
+float obdConvert_04    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D);
+float obdConvert_05    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D);
+float obdConvert_06_09 (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D);
+float obdConvert_0A    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D);
+float obdConvert_0B    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D);
+float obdConvert_0C    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D);
+float obdConvert_0D    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D);
+float obdConvert_0E    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D);
+float obdConvert_0F    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D);
+float obdConvert_10    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D);
+float obdConvert_11    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D);
+float obdConvert_14_1B (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D);
+float obdConvert_1F    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D);
+float obdConvert_21    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D);
+float obdConvert_22    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D);
+float obdConvert_23    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D);
+float obdConvert_24_2B (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D);
+float obdConvert_2C    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D);
+float obdConvert_2D    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D);
+float obdConvert_2E    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D);
+float obdConvert_2F    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D);
+float obdConvert_30    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D);
+float obdConvert_31    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D);
+float obdConvert_32    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D);
+float obdConvert_33    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D);
+float obdConvert_34_3B (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D);
+float obdConvert_3C_3F (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D);
+float obdConvert_42    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D);
+float obdConvert_43    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D);
+float obdConvert_44    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D);
+float obdConvert_45    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D);
+float obdConvert_46    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D);
+float obdConvert_47_4B (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D);
+float obdConvert_4C    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D);
+float obdConvert_4D    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D);
+float obdConvert_4E    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D);
+float obdConvert_52    (uint8_t  A, uint8_t  B, uint8_t  C, uint8_t  D);
+
 int obdRevConvert_04    (float val, uint8_t  *A, uint8_t  *B, uint8_t  *C, uint8_t  *D);
 int obdRevConvert_05    (float val, uint8_t  *A, uint8_t  *B, uint8_t  *C, uint8_t  *D);
 int obdRevConvert_06_09 (float val, uint8_t  *A, uint8_t  *B, uint8_t  *C, uint8_t  *D);
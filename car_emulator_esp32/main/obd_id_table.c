@@ -0,0 +1,86 @@
+/*
+ * obd_id_table.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "obd_id_table.h"
+
+static obd_id_entry_t id_table[OBD_ID_TABLE_SIZE];
+static uint8_t id_count;
+
+//Fibonacci hashing, the 11 and 29 bit spaces do not collide by the idt bit
+static inline uint32_t obd_id_hash(uint32_t id, uint8_t idt)
+{
+	uint32_t key = obd_id_normalize(id, idt) | ((uint32_t)idt << 31);
+	return (key * 0x9E3779B1) >> (32 - OBD_ID_TABLE_BITS);
+}
+
+void obd_id_table_clear(void)
+{
+	memset(id_table, 0, sizeof(id_table));
+	id_count = 0;
+}
+
+int obd_id_table_add(uint32_t id, uint8_t idt, obd_id_kind_t kind,
+		uint32_t phys_id, uint32_t resp_id, obd_id_handler_t handler)
+{
+	//At most half full, so a miss ends after a short probe
+	if (id_count >= OBD_ID_TABLE_SIZE / 2 || obd_id_lookup(id, idt) != NULL) {
+		return -1;
+	}
+	uint32_t i = obd_id_hash(id, idt);
+	while (id_table[i].used) {
+		i = (i + 1) & (OBD_ID_TABLE_SIZE - 1);
+	}
+	obd_id_entry_t *e = &id_table[i];
+	e->id = obd_id_normalize(id, idt);
+	e->idt = idt;
+	e->kind = kind;
+	e->phys_id = phys_id;
+	e->resp_id = resp_id;
+	e->handler = handler;
+	e->used = 1;
+	id_count++;
+	return 0;
+}
+
+const obd_id_entry_t *obd_id_lookup(uint32_t id, uint8_t idt)
+{
+	uint32_t i = obd_id_hash(id, idt);
+	id = obd_id_normalize(id, idt);
+	while (id_table[i].used) {
+		if (id_table[i].id == id && id_table[i].idt == idt) {
+			return &id_table[i];
+		}
+		i = (i + 1) & (OBD_ID_TABLE_SIZE - 1);
+	}
+	return NULL;
+}
+
+void obd_id_table_print(void)
+{
+	printf("\nServed IDs (%u/%d):\n", id_count, OBD_ID_TABLE_SIZE);
+	for (uint8_t i = 0; i < OBD_ID_TABLE_SIZE; i++) {
+		obd_id_entry_t *e = &id_table[i];
+		if (!e->used) {
+			continue;
+		}
+		if (e->idt) {
+			//Any tester source address
+			printf("  %06Xxx %s -> %04Xxx%02X  slot %u\n", e->id >> 8,
+					(e->kind == OBD_ID_FUNCTIONAL)?"functional":"physical  ",
+					e->resp_id >> 16, e->resp_id & 0xFF, i);
+			continue;
+		}
+		printf("  %03X %s -> %03X  slot %u\n", e->id,
+				(e->kind == OBD_ID_FUNCTIONAL)?"functional":"physical  ",
+				e->resp_id, i);
+	}
+}
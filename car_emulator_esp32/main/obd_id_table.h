@@ -0,0 +1,81 @@
+/*
+ * obd_id_table.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+
+#ifndef __OBD_ID_TABLE_H_
+#define __OBD_ID_TABLE_H_
+
+#include <stdint.h>
+
+#include "car_emulator.h"
+
+/*
+ * Every CAN ID the emulator answers, with its handler and the addresses
+ * of the exchange, in an open addressing hash table. The table is
+ * filled once at configuration time and only read afterwards, so the
+ * dispatcher, the session tasks and the fast path look IDs up without
+ * locks and in the same time however many addresses are served.
+ */
+#define OBD_ID_TABLE_BITS		5
+#define OBD_ID_TABLE_SIZE		(1 << OBD_ID_TABLE_BITS)
+//Tester source address of a 29-bit normal fixed address (18DA/18DB)
+#define OBD_ID_EXT_SA_MASK		0x000000FF
+
+typedef enum {
+	OBD_ID_FUNCTIONAL = 0,
+	OBD_ID_PHYSICAL
+} obd_id_kind_t;
+
+typedef struct obd_id_entry_s obd_id_entry_t;
+
+//Handles a complete request received on the entry's ID
+typedef void (*obd_id_handler_t)(const obd_id_entry_t *entry,
+		emulator_ctx_t *ectx, const uint8_t *data, uint16_t len);
+
+struct obd_id_entry_s {
+	uint32_t id;
+	uint8_t idt;
+	uint8_t used;
+	obd_id_kind_t kind;
+	uint32_t phys_id;		//physical request ID of the addressed ECU
+	uint32_t resp_id;		//ID the ECU answers on
+	obd_id_handler_t handler;
+};
+
+/*
+ * With 29-bit normal fixed addressing every tester sends from its own
+ * source address and all of them are served, so entries and lookups
+ * leave the source address out.
+ */
+static inline uint32_t obd_id_normalize(uint32_t id, uint8_t idt)
+{
+	if (idt && (id & 0x1FFE0000) == 0x18DA0000) {
+		return id & ~OBD_ID_EXT_SA_MASK;
+	}
+	return id;
+}
+
+//Response ID of an entry towards the tester that sent req_id
+static inline uint32_t obd_id_resp_to(const obd_id_entry_t *entry, uint32_t req_id)
+{
+	if (!entry->idt) {
+		return entry->resp_id;
+	}
+	return (entry->resp_id & ~(OBD_ID_EXT_SA_MASK << 8)) |
+			((req_id & OBD_ID_EXT_SA_MASK) << 8);
+}
+
+void obd_id_table_clear(void);
+
+//Returns -1 when the table is full or the ID is already served
+int obd_id_table_add(uint32_t id, uint8_t idt, obd_id_kind_t kind,
+		uint32_t phys_id, uint32_t resp_id, obd_id_handler_t handler);
+
+const obd_id_entry_t *obd_id_lookup(uint32_t id, uint8_t idt);
+
+void obd_id_table_print(void);
+
+#endif /* __OBD_ID_TABLE_H_ */
@@ -0,0 +1,96 @@
+/*
+ * spsc_ring.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+
+#ifndef __SPSC_RING_H_
+#define __SPSC_RING_H_
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Lock-free single-producer/single-consumer ring of fixed size elements.
+ * Only the producer writes head and only the consumer writes tail, so the
+ * two sides may run on different cores without any lock. The number of
+ * elements must be a power of two.
+ */
+typedef struct spsc_ring_s {
+	uint8_t *buf;
+	uint32_t elem_size;
+	uint32_t mask;
+	uint32_t head;		//written by the producer only
+	uint32_t tail;		//written by the consumer only
+	uint32_t drops;		//pushes rejected because the ring was full
+} spsc_ring_t;
+
+static inline void spsc_ring_init(spsc_ring_t *r, void *buf,
+									uint32_t elem_size, uint32_t len)
+{
+	r->buf = (uint8_t *)buf;
+	r->elem_size = elem_size;
+	r->mask = len - 1;
+	r->head = 0;
+	r->tail = 0;
+	r->drops = 0;
+}
+
+static inline uint32_t spsc_ring_count(spsc_ring_t *r)
+{
+	return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) -
+			__atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+}
+
+//Producer side: returns a free slot or NULL when the ring is full
+static inline void *spsc_ring_reserve(spsc_ring_t *r)
+{
+	uint32_t head = r->head;
+	if (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) > r->mask) {
+		r->drops++;
+		return NULL;
+	}
+	return &r->buf[(head & r->mask) * r->elem_size];
+}
+
+//Producer side: publishes the slot returned by spsc_ring_reserve()
+static inline void spsc_ring_commit(spsc_ring_t *r)
+{
+	__atomic_store_n(&r->head, r->head + 1, __ATOMIC_RELEASE);
+}
+
+static inline int spsc_ring_push(spsc_ring_t *r, const void *elem)
+{
+	void *slot = spsc_ring_reserve(r);
+	if (slot == NULL) {
+		return -1;
+	}
+	memcpy(slot, elem, r->elem_size);
+	spsc_ring_commit(r);
+	return 0;
+}
+
+//Consumer side: returns the idx-th pending element without removing it
+static inline void *spsc_ring_peek(spsc_ring_t *r, uint32_t idx)
+{
+	return &r->buf[((r->tail + idx) & r->mask) * r->elem_size];
+}
+
+//Consumer side: removes n elements already read with spsc_ring_peek()
+static inline void spsc_ring_release(spsc_ring_t *r, uint32_t n)
+{
+	__atomic_store_n(&r->tail, r->tail + n, __ATOMIC_RELEASE);
+}
+
+static inline int spsc_ring_pop(spsc_ring_t *r, void *elem)
+{
+	if (spsc_ring_count(r) == 0) {
+		return -1;
+	}
+	memcpy(elem, spsc_ring_peek(r, 0), r->elem_size);
+	spsc_ring_release(r, 1);
+	return 0;
+}
+
+#endif /* __SPSC_RING_H_ */
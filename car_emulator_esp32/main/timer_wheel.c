@@ -0,0 +1,288 @@
+/*
+ * timer_wheel.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "esp_timer.h"
+
+#include "timer_wheel.h"
+
+#define TW_L1_SHIFT		TW_L0_BITS
+#define TW_L2_SHIFT		(TW_L0_BITS + TW_LN_BITS)
+
+static inline void tw_list_init(tw_list_t *l)
+{
+	l->next = l;
+	l->prev = l;
+}
+
+static inline void tw_list_add_tail(tw_list_t *head, tw_list_t *n)
+{
+	n->next = head;
+	n->prev = head->prev;
+	head->prev->next = n;
+	head->prev = n;
+}
+
+static inline void tw_list_del(tw_list_t *n)
+{
+	n->prev->next = n->next;
+	n->next->prev = n->prev;
+	n->next = NULL;
+	n->prev = NULL;
+}
+
+//Moves all entries of src to the (empty) list dst
+static inline void tw_list_splice(tw_list_t *src, tw_list_t *dst)
+{
+	if (src->next == src) {
+		return;
+	}
+	dst->next = src->next;
+	dst->prev = src->prev;
+	dst->next->prev = dst;
+	dst->prev->next = dst;
+	tw_list_init(src);
+}
+
+static void tw_add(timer_wheel_t *tw, tw_timer_t *t)
+{
+	uint32_t delta = t->expires - tw->now;
+	tw_list_t *slot;
+
+	if ((int32_t)delta < 0) {
+		//Already due, it goes to the slot handled by the next tick
+		slot = &tw->l0[tw->now & TW_L0_MASK];
+	} else if (delta < TW_L0_SIZE) {
+		slot = &tw->l0[t->expires & TW_L0_MASK];
+	} else if (delta < (1UL << TW_L2_SHIFT)) {
+		slot = &tw->l1[(t->expires >> TW_L1_SHIFT) & TW_LN_MASK];
+	} else {
+		if (delta > TW_MAX_TICKS) {
+			t->expires = tw->now + TW_MAX_TICKS;
+		}
+		slot = &tw->l2[(t->expires >> TW_L2_SHIFT) & TW_LN_MASK];
+	}
+	tw_list_add_tail(slot, &t->node);
+}
+
+//Re-inserts every timer of one upper level slot, they land one level lower
+static uint32_t tw_cascade(timer_wheel_t *tw, tw_list_t *level, uint32_t idx)
+{
+	tw_list_t pending;
+	tw_list_init(&pending);
+	tw_list_splice(&level[idx], &pending);
+
+	while (pending.next != &pending) {
+		tw_list_t *n = pending.next;
+		tw_list_del(n);
+		tw_add(tw, (tw_timer_t *)n);
+	}
+	return idx;
+}
+
+void timer_wheel_init(timer_wheel_t *tw, uint32_t tick_us)
+{
+	portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+	tw->now = 0;
+	tw->tick_us = tick_us;
+	tw->active = 0;
+	tw->lock = lock;
+	for (uint32_t i = 0; i < TW_L0_SIZE; i++) {
+		tw_list_init(&tw->l0[i]);
+	}
+	for (uint32_t i = 0; i < TW_LN_SIZE; i++) {
+		tw_list_init(&tw->l1[i]);
+		tw_list_init(&tw->l2[i]);
+	}
+	tw_list_init(&tw->expired);
+}
+
+void tw_timer_init(tw_timer_t *t, tw_cb_t cb, void *arg, const char *name)
+{
+	t->node.next = NULL;
+	t->node.prev = NULL;
+	t->expires = 0;
+	t->cb = cb;
+	t->arg = arg;
+	t->name = name;
+}
+
+void tw_timer_start(timer_wheel_t *tw, tw_timer_t *t, uint32_t tout_us)
+{
+	uint32_t ticks = (tout_us + tw->tick_us - 1) / tw->tick_us;
+	if (ticks == 0) {
+		ticks = 1;
+	}
+
+	portENTER_CRITICAL(&tw->lock);
+	if (tw_timer_is_active(t)) {
+		tw_list_del(&t->node);
+	} else {
+		tw->active++;
+	}
+	t->expires = tw->now + ticks;
+	tw_add(tw, t);
+	portEXIT_CRITICAL(&tw->lock);
+}
+
+void tw_timer_stop(timer_wheel_t *tw, tw_timer_t *t)
+{
+	portENTER_CRITICAL(&tw->lock);
+	if (tw_timer_is_active(t)) {
+		tw_list_del(&t->node);
+		tw->active--;
+	}
+	portEXIT_CRITICAL(&tw->lock);
+}
+
+void timer_wheel_tick(timer_wheel_t *tw)
+{
+	portENTER_CRITICAL(&tw->lock);
+	uint32_t idx = tw->now & TW_L0_MASK;
+	if (idx == 0 &&
+		tw_cascade(tw, tw->l1, (tw->now >> TW_L1_SHIFT) & TW_LN_MASK) == 0) {
+		tw_cascade(tw, tw->l2, (tw->now >> TW_L2_SHIFT) & TW_LN_MASK);
+	}
+	tw->now++;
+	tw_list_splice(&tw->l0[idx], &tw->expired);
+
+	//Callbacks run unlocked, they may start or stop any timer
+	while (tw->expired.next != &tw->expired) {
+		tw_timer_t *t = (tw_timer_t *)tw->expired.next;
+		tw_list_del(&t->node);
+		tw->active--;
+		portEXIT_CRITICAL(&tw->lock);
+		t->cb(t->arg);
+		portENTER_CRITICAL(&tw->lock);
+	}
+	portEXIT_CRITICAL(&tw->lock);
+}
+
+#define TW_BENCH_ROUNDS		16
+#define TW_BENCH_TICKS		2000
+#define TW_BENCH_TOUT_US(i)	((1 + ((i) * 37) % 1000) * 1000)
+
+static timer_wheel_t *bench_tw;
+static uint32_t bench_fired;
+
+//Behaves like a session which re-arms its timeout on every frame
+static void tw_bench_cb(void *arg)
+{
+	tw_timer_t *t = (tw_timer_t *)arg;
+	bench_fired++;
+	tw_timer_start(bench_tw, t, TW_BENCH_TOUT_US(bench_fired));
+}
+
+static void esp_timer_bench_cb(void *arg)
+{
+}
+
+void timer_wheel_bench(void)
+{
+	static const uint32_t sessions[] = { 1, 8, 32, 128, 512 };
+
+	bench_tw = malloc(sizeof(timer_wheel_t));
+	if (bench_tw == NULL) {
+		printf("Timer wheel bench: out of memory\n");
+		return;
+	}
+	printf("\nsessions  tw_start  tw_stop  tw_tick  esp_start  esp_stop  (ns/op)\n");
+	for (uint32_t s = 0; s < sizeof(sessions)/sizeof(sessions[0]); s++) {
+		uint32_t n = sessions[s];
+		uint32_t ops = TW_BENCH_ROUNDS * n;
+		int64_t start_us = 0;
+		int64_t stop_us = 0;
+		int64_t t0, t1, t2;
+
+		tw_timer_t *t = malloc(n * sizeof(tw_timer_t));
+		esp_timer_handle_t *et = malloc(n * sizeof(esp_timer_handle_t));
+		if (t == NULL || et == NULL) {
+			printf("%8u  out of memory\n", n);
+			free(t);
+			free(et);
+			break;
+		}
+		timer_wheel_init(bench_tw, 1000);
+		for (uint32_t i = 0; i < n; i++) {
+			tw_timer_init(&t[i], tw_bench_cb, &t[i], "bench");
+		}
+
+		for (uint32_t r = 0; r < TW_BENCH_ROUNDS; r++) {
+			t0 = esp_timer_get_time();
+			for (uint32_t i = 0; i < n; i++) {
+				tw_timer_start(bench_tw, &t[i], TW_BENCH_TOUT_US(i + r));
+			}
+			t1 = esp_timer_get_time();
+			for (uint32_t i = 0; i < n; i++) {
+				tw_timer_stop(bench_tw, &t[i]);
+			}
+			t2 = esp_timer_get_time();
+			start_us += t1 - t0;
+			stop_us += t2 - t1;
+		}
+
+		for (uint32_t i = 0; i < n; i++) {
+			tw_timer_start(bench_tw, &t[i], TW_BENCH_TOUT_US(i));
+		}
+		bench_fired = 0;
+		t0 = esp_timer_get_time();
+		for (uint32_t k = 0; k < TW_BENCH_TICKS; k++) {
+			timer_wheel_tick(bench_tw);
+		}
+		t1 = esp_timer_get_time();
+		for (uint32_t i = 0; i < n; i++) {
+			tw_timer_stop(bench_tw, &t[i]);
+		}
+		printf("%8u  %8lld  %7lld  %7lld", n, start_us * 1000 / ops,
+				stop_us * 1000 / ops, (t1 - t0) * 1000 / TW_BENCH_TICKS);
+
+		uint32_t created = 0;
+		for (; created < n; created++) {
+			const esp_timer_create_args_t args = {
+					.callback = &esp_timer_bench_cb,
+					.arg = NULL,
+					.name = "bench"
+			};
+			if (esp_timer_create(&args, &et[created]) != ESP_OK) {
+				break;
+			}
+		}
+		if (created == n) {
+			start_us = 0;
+			stop_us = 0;
+			for (uint32_t r = 0; r < TW_BENCH_ROUNDS; r++) {
+				t0 = esp_timer_get_time();
+				for (uint32_t i = 0; i < n; i++) {
+					esp_timer_start_once(et[i], TW_BENCH_TOUT_US(i + r) + 1000000);
+				}
+				t1 = esp_timer_get_time();
+				for (uint32_t i = 0; i < n; i++) {
+					esp_timer_stop(et[i]);
+				}
+				t2 = esp_timer_get_time();
+				start_us += t1 - t0;
+				stop_us += t2 - t1;
+			}
+			printf("  %9lld  %8lld\n", start_us * 1000 / ops, stop_us * 1000 / ops);
+		} else {
+			printf("  esp_timer_create failed after %u timers\n", created);
+		}
+		for (uint32_t i = 0; i < created; i++) {
+			esp_timer_delete(et[i]);
+		}
+		free(t);
+		free(et);
+	}
+	printf("tw_tick: cost of one 1ms tick while every session re-arms on expiry\n");
+	free(bench_tw);
+	bench_tw = NULL;
+}
@@ -0,0 +1,81 @@
+/*
+ * timer_wheel.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+
+#ifndef __TIMER_WHEEL_H_
+#define __TIMER_WHEEL_H_
+
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+
+/*
+ * Hierarchical timer wheel. Level 0 has 256 slots of one tick, levels 1
+ * and 2 have 64 slots each and cascade into the level below, which gives
+ * a range of 2^20 ticks. Start and stop are O(1), every timer is serviced
+ * from a single tick source.
+ */
+#define TW_L0_BITS		8
+#define TW_LN_BITS		6
+#define TW_L0_SIZE		(1 << TW_L0_BITS)
+#define TW_LN_SIZE		(1 << TW_LN_BITS)
+#define TW_L0_MASK		(TW_L0_SIZE - 1)
+#define TW_LN_MASK		(TW_LN_SIZE - 1)
+#define TW_MAX_TICKS	((1UL << (TW_L0_BITS + 2 * TW_LN_BITS)) - 1)
+
+typedef void (*tw_cb_t)(void *arg);
+
+typedef struct tw_list_s {
+	struct tw_list_s *next;
+	struct tw_list_s *prev;
+} tw_list_t;
+
+typedef struct tw_timer_s {
+	tw_list_t node;			//must be first
+	uint32_t expires;		//absolute tick
+	tw_cb_t cb;
+	void *arg;
+	const char *name;
+} tw_timer_t;
+
+typedef struct timer_wheel_s {
+	uint32_t now;
+	uint32_t tick_us;
+	uint32_t active;
+	portMUX_TYPE lock;
+	tw_list_t l0[TW_L0_SIZE];
+	tw_list_t l1[TW_LN_SIZE];
+	tw_list_t l2[TW_LN_SIZE];
+	tw_list_t expired;
+} timer_wheel_t;
+
+void timer_wheel_init(timer_wheel_t *tw, uint32_t tick_us);
+
+void tw_timer_init(tw_timer_t *t, tw_cb_t cb, void *arg, const char *name);
+
+//(Re)arms the timer, an already running timer is simply moved
+void tw_timer_start(timer_wheel_t *tw, tw_timer_t *t, uint32_t tout_us);
+
+void tw_timer_stop(timer_wheel_t *tw, tw_timer_t *t);
+
+static inline int tw_timer_is_active(tw_timer_t *t)
+{
+	return t->node.next != NULL;
+}
+
+//Timers armed and not yet expired or stopped
+static inline uint32_t timer_wheel_pending(timer_wheel_t *tw)
+{
+	return __atomic_load_n(&tw->active, __ATOMIC_RELAXED);
+}
+
+//Advances the wheel by one tick and runs the callbacks of expired timers
+void timer_wheel_tick(timer_wheel_t *tw);
+
+//Prints start/stop/tick cost for a growing number of sessions
+void timer_wheel_bench(void);
+
+#endif /* __TIMER_WHEEL_H_ */
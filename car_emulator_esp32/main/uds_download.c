@@ -0,0 +1,616 @@
+/*
+ * uds_download.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+
+#include "cantp_esp32.h"
+#include "can-tp.h"
+#include "car_emulator.h"
+#include "emu_tasks.h"
+#include "obd_id_table.h"
+#include "isotp_codec.h"
+#include "uds_download.h"
+
+#define TAG             "UDS_DL"
+
+#ifdef CONFIG_CAR_EMU_UDS_DOWNLOAD
+
+#define UDS_SID_SESSION			0x10
+#define UDS_SID_DOWNLOAD		0x34
+#define UDS_SID_TRANSFER		0x36
+#define UDS_SID_EXIT			0x37
+#define UDS_SID_TESTER_PRESENT	0x3E
+#define UDS_SID_NEGATIVE		0x7F
+#define UDS_POSITIVE			0x40
+#define UDS_SUPPRESS_POS		0x80
+
+#define UDS_NRC_FORMAT			0x13	//incorrectMessageLengthOrInvalidFormat
+#define UDS_NRC_CONDITIONS		0x22	//conditionsNotCorrect
+#define UDS_NRC_SEQUENCE		0x24	//requestSequenceError
+#define UDS_NRC_RANGE			0x31	//requestOutOfRange
+#define UDS_NRC_NOT_ACCEPTED	0x70	//uploadDownloadNotAccepted
+#define UDS_NRC_SUSPENDED		0x71	//transferDataSuspended
+#define UDS_NRC_PROGRAMMING		0x72	//generalProgrammingFailure
+#define UDS_NRC_BSC				0x73	//wrongBlockSequenceCounter
+#define UDS_NRC_PENDING			0x78	//requestCorrectlyReceived-ResponsePending
+
+typedef enum {
+	UDS_DL_IDLE = 0,
+	UDS_DL_OPENING,			//sink being opened and erased by the writer
+	UDS_DL_ACTIVE,
+	UDS_DL_EXITING			//waiting for the writer to flush
+} uds_dl_state_t;
+
+typedef enum {
+	UDS_DL_JOB_OPEN = 0,
+	UDS_DL_JOB_WRITE,
+	UDS_DL_JOB_CLOSE
+} uds_dl_job_type_t;
+
+typedef struct uds_dl_job_s {
+	uds_dl_job_type_t type;
+	uint8_t buf;
+	uint16_t len;
+	uint32_t off;
+} uds_dl_job_t;
+
+typedef struct uds_dl_sink_s {
+	const char *name;
+	int (*check)(uint32_t addr, uint32_t size);		//NULL when any range fits
+	int (*open)(uint32_t addr, uint32_t size);
+	int (*erase)(uint32_t off, uint32_t len);		//NULL when nothing is erased
+	int (*write)(uint32_t off, const uint8_t *data, uint16_t len);
+} uds_dl_sink_t;
+
+typedef struct uds_dl_s {
+	uds_dl_state_t state;
+	const uds_dl_sink_t *sink;
+	uint32_t resp_id;
+	uint8_t idt;
+	uint32_t addr;
+	uint32_t size;
+	uint32_t off;			//bytes accepted so far
+	uint8_t bsc;			//next expected block sequence counter
+	uint8_t failed;			//a sink write failed, reported on exit
+	isotp_rx_t rx;
+	uint32_t rx_id;
+	int64_t rx_last_us;
+	uint8_t *buf[UDS_DL_BUFS];
+	uint8_t busy[UDS_DL_BUFS];
+	uint8_t cur;			//buffer the next block is received into
+	uint8_t deferred;		//a 0x76 waits for buf[cur]
+	uint8_t deferred_bsc;
+} uds_dl_t;
+
+static uds_dl_t dl;
+static uds_dl_stats_t stats;
+static portMUX_TYPE dl_mux = portMUX_INITIALIZER_UNLOCKED;
+static QueueHandle_t job_queue;
+static const esp_partition_t *dl_part;
+static uint32_t dl_part_base;
+
+static int crc_sink_open(uint32_t addr, uint32_t size)
+{
+	return 0;
+}
+
+static int crc_sink_write(uint32_t off, const uint8_t *data, uint16_t len)
+{
+	return 0;
+}
+
+static const esp_partition_t *part_sink_find(void)
+{
+	if (dl_part == NULL) {
+		dl_part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+				ESP_PARTITION_SUBTYPE_ANY, UDS_DL_PARTITION);
+	}
+	return dl_part;
+}
+
+//The request address is an offset into the partition, erased in whole sectors
+static int part_sink_check(uint32_t addr, uint32_t size)
+{
+	const esp_partition_t *part = part_sink_find();
+	uint64_t erased = ((uint64_t)size + UDS_DL_SECTOR - 1) & ~(uint64_t)(UDS_DL_SECTOR - 1);
+
+	if (part == NULL || (addr % UDS_DL_SECTOR) != 0 || addr + erased > part->size) {
+		return -1;
+	}
+	return 0;
+}
+
+static int part_sink_open(uint32_t addr, uint32_t size)
+{
+	if (part_sink_check(addr, size) < 0) {
+		return -1;
+	}
+	dl_part_base = addr;
+	return 0;
+}
+
+static int part_sink_erase(uint32_t off, uint32_t len)
+{
+	return (esp_partition_erase_range(dl_part, dl_part_base + off, len) == ESP_OK)?0:-1;
+}
+
+static int part_sink_write(uint32_t off, const uint8_t *data, uint16_t len)
+{
+	return (esp_partition_write(dl_part, dl_part_base + off, data, len) == ESP_OK)?0:-1;
+}
+
+static const uds_dl_sink_t uds_dl_sinks[] = {
+	[UDS_DL_SINK_CRC] = { "crc", NULL, crc_sink_open, NULL, crc_sink_write },
+	[UDS_DL_SINK_PARTITION] = { "partition", part_sink_check, part_sink_open,
+								part_sink_erase, part_sink_write }
+};
+
+static void uds_dl_send(const uint8_t *resp, uint8_t len)
+{
+	uint8_t frame[8];
+
+	memset(frame, ISOTP_PAD, sizeof(frame));
+	frame[0] = len;
+	memcpy(&frame[1], resp, len);
+	if (cantp_can_tx(dl.resp_id, dl.idt, 8, frame, UDS_DL_TX_TOUT_US) < 0) {
+		stats.tx_errors++;
+	}
+}
+
+static void uds_dl_nrc(uint8_t sid, uint8_t nrc)
+{
+	uint8_t resp[3] = { UDS_SID_NEGATIVE, sid, nrc };
+
+	if (nrc != UDS_NRC_PENDING) {
+		stats.nrcs++;
+	}
+	uds_dl_send(resp, sizeof(resp));
+}
+
+static void uds_dl_transfer_ack(uint8_t bsc)
+{
+	uint8_t resp[2] = { UDS_SID_TRANSFER | UDS_POSITIVE, bsc };
+
+	uds_dl_send(resp, sizeof(resp));
+}
+
+static void uds_dl_job(uds_dl_job_type_t type, uint8_t buf, uint16_t len, uint32_t off)
+{
+	uds_dl_job_t job = { .type = type, .buf = buf, .len = len, .off = off };
+
+	//Never full: there are at most two writes, an open and a close queued
+	xQueueSend(job_queue, &job, portMAX_DELAY);
+}
+
+static void uds_dl_session(const uint8_t *req, uint16_t len)
+{
+	//P2 50 ms, P2* 5000 ms in 10 ms units
+	uint8_t resp[6] = { UDS_SID_SESSION | UDS_POSITIVE, 0, 0x00, 0x32, 0x01, 0xF4 };
+
+	if (len != 2) {
+		uds_dl_nrc(UDS_SID_SESSION, UDS_NRC_FORMAT);
+		return;
+	}
+	resp[1] = req[1] & ~UDS_SUPPRESS_POS;
+	if (!(req[1] & UDS_SUPPRESS_POS)) {
+		uds_dl_send(resp, sizeof(resp));
+	}
+}
+
+static void uds_dl_request_download(const uint8_t *req, uint16_t len)
+{
+	if (len < 3) {
+		uds_dl_nrc(UDS_SID_DOWNLOAD, UDS_NRC_FORMAT);
+		return;
+	}
+	uint8_t size_len = req[2] >> 4;
+	uint8_t addr_len = req[2] & 0x0F;
+	if (size_len == 0 || size_len > 4 || addr_len == 0 || addr_len > 4 ||
+			len != 3 + addr_len + size_len) {
+		uds_dl_nrc(UDS_SID_DOWNLOAD, UDS_NRC_FORMAT);
+		return;
+	}
+	if (dl.state != UDS_DL_IDLE) {
+		uds_dl_nrc(UDS_SID_DOWNLOAD, UDS_NRC_CONDITIONS);
+		return;
+	}
+
+	uint32_t addr = 0;
+	uint32_t size = 0;
+	for (uint8_t i = 0; i < addr_len; i++) {
+		addr = (addr << 8) | req[3 + i];
+	}
+	for (uint8_t i = 0; i < size_len; i++) {
+		size = (size << 8) | req[3 + addr_len + i];
+	}
+	//No compression or encryption
+	if (req[1] != 0x00 || size == 0) {
+		uds_dl_nrc(UDS_SID_DOWNLOAD, UDS_NRC_RANGE);
+		return;
+	}
+	if (dl.sink->check != NULL && dl.sink->check(addr, size) < 0) {
+		uds_dl_nrc(UDS_SID_DOWNLOAD, UDS_NRC_RANGE);
+		return;
+	}
+
+	dl.addr = addr;
+	dl.size = size;
+	dl.off = 0;
+	dl.bsc = 1;
+	dl.failed = 0;
+	dl.state = UDS_DL_OPENING;
+	if (dl.sink->erase != NULL) {
+		uds_dl_nrc(UDS_SID_DOWNLOAD, UDS_NRC_PENDING);
+	}
+	uds_dl_job(UDS_DL_JOB_OPEN, 0, 0, 0);
+}
+
+//buf[dl.cur] holds a complete TransferData request
+static void uds_dl_transfer(uint16_t len)
+{
+	const uint8_t *req = dl.buf[dl.cur];
+
+	if (dl.state != UDS_DL_ACTIVE) {
+		uds_dl_nrc(UDS_SID_TRANSFER, UDS_NRC_SEQUENCE);
+		return;
+	}
+	if (len < 2) {
+		uds_dl_nrc(UDS_SID_TRANSFER, UDS_NRC_FORMAT);
+		return;
+	}
+	//A repeated block, its response was lost
+	if (dl.off > 0 && req[1] == (uint8_t)(dl.bsc - 1)) {
+		uds_dl_transfer_ack(req[1]);
+		return;
+	}
+	if (req[1] != dl.bsc) {
+		uds_dl_nrc(UDS_SID_TRANSFER, UDS_NRC_BSC);
+		return;
+	}
+	if (len - 2 > dl.size - dl.off) {
+		uds_dl_nrc(UDS_SID_TRANSFER, UDS_NRC_SUSPENDED);
+		return;
+	}
+
+	uint8_t bsc = dl.bsc++;
+	uint8_t buf = dl.cur;
+	uint8_t send_now;
+
+	//Marked busy before the writer can see it
+	portENTER_CRITICAL(&dl_mux);
+	dl.busy[buf] = 1;
+	dl.cur = (buf + 1) % UDS_DL_BUFS;
+	send_now = !dl.busy[dl.cur];
+	if (!send_now) {
+		dl.deferred = 1;
+		dl.deferred_bsc = bsc;
+	}
+	portEXIT_CRITICAL(&dl_mux);
+
+	uds_dl_job(UDS_DL_JOB_WRITE, buf, len - 2, dl.off);
+	dl.off += len - 2;
+	stats.received = dl.off;
+	stats.blocks++;
+
+	if (send_now) {
+		uds_dl_transfer_ack(bsc);
+	} else {
+		stats.waits++;
+	}
+}
+
+static void uds_dl_exit(uint16_t len)
+{
+	if (dl.state != UDS_DL_ACTIVE || dl.off != dl.size) {
+		uds_dl_nrc(UDS_SID_EXIT, UDS_NRC_SEQUENCE);
+		return;
+	}
+	dl.state = UDS_DL_EXITING;
+	uds_dl_job(UDS_DL_JOB_CLOSE, 0, 0, 0);
+}
+
+static void uds_dl_erase(void)
+{
+	uint32_t len = (dl.size + UDS_DL_SECTOR - 1) & ~(UDS_DL_SECTOR - 1UL);
+	int64_t pending = esp_timer_get_time();
+
+	for (uint32_t off = 0; off < len; off += UDS_DL_ERASE_CHUNK) {
+		uint32_t chunk = (len - off < UDS_DL_ERASE_CHUNK)?(len - off):UDS_DL_ERASE_CHUNK;
+		if (dl.sink->erase(off, chunk) < 0) {
+			dl.failed = 1;
+			return;
+		}
+		if (esp_timer_get_time() - pending >= UDS_DL_PENDING_US) {
+			pending = esp_timer_get_time();
+			uds_dl_nrc(UDS_SID_DOWNLOAD, UDS_NRC_PENDING);
+		}
+	}
+}
+
+static void uds_dl_writer_task(void *arg)
+{
+	uds_dl_job_t job;
+
+	while (1) {
+		xQueueReceive(job_queue, &job, portMAX_DELAY);
+		switch (job.type) {
+		case UDS_DL_JOB_OPEN: {
+				if (dl.sink->open(dl.addr, dl.size) < 0) {
+					dl.state = UDS_DL_IDLE;
+					uds_dl_nrc(UDS_SID_DOWNLOAD, UDS_NRC_NOT_ACCEPTED);
+					break;
+				}
+				if (dl.sink->erase != NULL) {
+					uds_dl_erase();
+				}
+				if (dl.failed) {
+					dl.state = UDS_DL_IDLE;
+					stats.sink_errors++;
+					uds_dl_nrc(UDS_SID_DOWNLOAD, UDS_NRC_PROGRAMMING);
+					break;
+				}
+				//lengthFormatIdentifier: 2 bytes of maxNumberOfBlockLength
+				uint8_t resp[4] = { UDS_SID_DOWNLOAD | UDS_POSITIVE, 0x20,
+						UDS_DL_BLOCK_LEN >> 8, UDS_DL_BLOCK_LEN & 0xFF };
+				stats.downloads++;
+				stats.size = dl.size;
+				stats.received = 0;
+				stats.blocks = 0;
+				stats.crc = 0;
+				stats.end_us = 0;
+				dl.cur = 0;
+				dl.deferred = 0;
+				dl.state = UDS_DL_ACTIVE;
+				stats.start_us = esp_timer_get_time();
+				uds_dl_send(resp, sizeof(resp));
+			} break;
+		case UDS_DL_JOB_WRITE: {
+				const uint8_t *data = &dl.buf[job.buf][2];
+				uint8_t ack = 0;
+				uint8_t bsc;
+
+				stats.crc = esp_rom_crc32_le(stats.crc, data, job.len);
+				if (!dl.failed && dl.sink->write(job.off, data, job.len) < 0) {
+					dl.failed = 1;
+					stats.sink_errors++;
+				}
+				portENTER_CRITICAL(&dl_mux);
+				dl.busy[job.buf] = 0;
+				if (dl.deferred && job.buf == dl.cur) {
+					dl.deferred = 0;
+					ack = 1;
+					bsc = dl.deferred_bsc;
+				}
+				portEXIT_CRITICAL(&dl_mux);
+				if (ack) {
+					uds_dl_transfer_ack(bsc);
+				}
+			} break;
+		case UDS_DL_JOB_CLOSE: {
+				stats.end_us = esp_timer_get_time();
+				dl.state = UDS_DL_IDLE;
+				if (dl.failed) {
+					uds_dl_nrc(UDS_SID_EXIT, UDS_NRC_PROGRAMMING);
+					break;
+				}
+				uint8_t resp[5] = { UDS_SID_EXIT | UDS_POSITIVE, stats.crc >> 24,
+						stats.crc >> 16, stats.crc >> 8, stats.crc };
+				uds_dl_send(resp, sizeof(resp));
+				emu_logf("Download of %u bytes done, %u B/s, CRC 0x%08X\n", stats.size,
+						(uint32_t)((uint64_t)stats.size * 1000000 /
+								(stats.end_us - stats.start_us + 1)), stats.crc);
+			} break;
+		}
+	}
+}
+
+static void uds_dl_request(const uint8_t *req, uint16_t len)
+{
+	switch (req[0]) {
+	case UDS_SID_SESSION:
+		uds_dl_session(req, len);
+		break;
+	case UDS_SID_TESTER_PRESENT:
+		if (len == 2 && !(req[1] & UDS_SUPPRESS_POS)) {
+			uint8_t resp[2] = { UDS_SID_TESTER_PRESENT | UDS_POSITIVE, 0 };
+			uds_dl_send(resp, sizeof(resp));
+		}
+		break;
+	case UDS_SID_DOWNLOAD:
+		uds_dl_request_download(req, len);
+		break;
+	case UDS_SID_TRANSFER:
+		uds_dl_transfer(len);
+		break;
+	case UDS_SID_EXIT:
+		uds_dl_exit(len);
+		break;
+	}
+}
+
+static inline int uds_dl_sid(uint8_t sid)
+{
+	return sid == UDS_SID_SESSION || sid == UDS_SID_TESTER_PRESENT ||
+			sid == UDS_SID_DOWNLOAD || sid == UDS_SID_TRANSFER || sid == UDS_SID_EXIT;
+}
+
+int uds_dl_rx(const cantp_can_frame_t *frame)
+{
+	const uint8_t *d = frame->data_u8;
+	uint8_t pci = d[0] >> 4;
+	int64_t now = esp_timer_get_time();
+	uint8_t fc[8];
+
+	if (dl.sink == NULL || frame->dlc == 0) {
+		return -1;
+	}
+
+	//Consecutive Frames of the block being received
+	if (dl.rx.state == ISOTP_RX_CF && frame->id == dl.rx_id) {
+		if (now - dl.rx_last_us > UDS_DL_N_CR_US) {
+			dl.rx.state = ISOTP_IDLE;
+			stats.isotp_errors++;
+		} else if (pci == 0x2) {
+			dl.rx_last_us = now;
+			isotp_rx_result_t res = isotp_rx_frame(&dl.rx, d, frame->dlc, fc);
+			if (res == ISOTP_RX_DONE) {
+				uds_dl_request(dl.rx.data, dl.rx.len);
+			} else if (res == ISOTP_RX_ERROR) {
+				stats.isotp_errors++;
+			}
+			return 0;
+		}
+	}
+	if (pci != 0x0 && pci != 0x1) {
+		return -1;
+	}
+	if ((pci == 0x0 && (frame->dlc < 2 || !uds_dl_sid(d[1]))) ||
+			(pci == 0x1 && (frame->dlc < 8 || !uds_dl_sid(d[2])))) {
+		return -1;
+	}
+	//Only physical addressing, UDS runs next to OBD on the same IDs
+	const obd_id_entry_t *entry = obd_id_lookup(frame->id, frame->rtr);
+	if (entry == NULL || entry->kind != OBD_ID_PHYSICAL) {
+		return -1;
+	}
+	dl.resp_id = obd_id_resp_to(entry, frame->id);
+	dl.idt = frame->rtr;
+
+	if (pci == 0x0) {
+		uint8_t len = d[0] & 0x0F;
+		if (len == 0 || len + 1 > frame->dlc) {
+			return -1;
+		}
+		//A short last block goes through the block buffers like a long one
+		if (d[1] == UDS_SID_TRANSFER) {
+			portENTER_CRITICAL(&dl_mux);
+			uint8_t busy = dl.busy[dl.cur];
+			portEXIT_CRITICAL(&dl_mux);
+			if (busy) {
+				uds_dl_nrc(UDS_SID_TRANSFER, UDS_NRC_CONDITIONS);
+				return 0;
+			}
+			memcpy(dl.buf[dl.cur], &d[1], len);
+			uds_dl_transfer(len);
+			return 0;
+		}
+		uint8_t req[7];
+		memcpy(req, &d[1], len);
+		uds_dl_request(req, len);
+		return 0;
+	}
+
+	//First Frame: the block is reassembled into buf[cur]
+	uint8_t busy;
+	portENTER_CRITICAL(&dl_mux);
+	busy = dl.busy[dl.cur];
+	portEXIT_CRITICAL(&dl_mux);
+	isotp_rx_init(&dl.rx, dl.buf[dl.cur], busy?0:UDS_DL_BLOCK_LEN);
+	isotp_rx_frame(&dl.rx, d, frame->dlc, fc);
+	if (dl.rx.state != ISOTP_RX_CF) {
+		stats.isotp_errors++;
+	}
+	dl.rx_id = frame->id;
+	dl.rx_last_us = now;
+	if (cantp_can_tx(dl.resp_id, dl.idt, 8, fc, UDS_DL_TX_TOUT_US) < 0) {
+		stats.tx_errors++;
+	}
+	return 0;
+}
+
+int uds_dl_init(uds_dl_sink_type_t sink)
+{
+	for (uint8_t i = 0; i < UDS_DL_BUFS; i++) {
+		dl.buf[i] = malloc(UDS_DL_BLOCK_LEN);
+		if (dl.buf[i] == NULL) {
+			return -1;
+		}
+	}
+	job_queue = xQueueCreate(UDS_DL_BUFS + 2, sizeof(uds_dl_job_t));
+	if (job_queue == NULL) {
+		return -1;
+	}
+	if (emu_task_create(uds_dl_writer_task, "uds_dl", 3 * 1024, NULL, 2,
+										EMU_CORE_APP, NULL) != pdPASS) {
+		return -1;
+	}
+	dl.sink = &uds_dl_sinks[sink];
+	return 0;
+}
+
+int uds_dl_sink_set(uds_dl_sink_type_t sink)
+{
+	if (dl.state != UDS_DL_IDLE) {
+		return -1;
+	}
+	dl.sink = &uds_dl_sinks[sink];
+	return 0;
+}
+
+void uds_dl_stats_get(uds_dl_stats_t *st)
+{
+	*st = stats;
+}
+
+void uds_dl_print(void)
+{
+	static const char *state_str[] = { "idle", "opening", "active", "exiting" };
+	uds_dl_stats_t st = stats;
+	int64_t end = (st.end_us != 0)?st.end_us:esp_timer_get_time();
+
+	if (dl.sink == NULL) {
+		printf("\nUDS download not started\n");
+		return;
+	}
+	printf("\nUDS download %s, sink %s, downloads %u\n", state_str[dl.state],
+			dl.sink->name, st.downloads);
+	if (st.downloads == 0) {
+		return;
+	}
+	printf("%u/%u bytes in %u blocks, %lld ms, %u B/s, CRC 0x%08X\n",
+			st.received, st.size, st.blocks, (end - st.start_us) / 1000,
+			(uint32_t)((uint64_t)st.received * 1000000 / (end - st.start_us + 1)),
+			st.crc);
+	printf("waits for the sink %u, NRCs %u, ISO-TP errors %u, sink errors %u, "
+			"TX errors %u\n", st.waits, st.nrcs, st.isotp_errors, st.sink_errors,
+			st.tx_errors);
+}
+
+void uds_dl_cmd(const char *args)
+{
+	if (args[0] == '\0') {
+		uds_dl_print();
+		return;
+	}
+	uds_dl_sink_type_t sink;
+	if (strcmp(args, "=crc") == 0) {
+		sink = UDS_DL_SINK_CRC;
+	} else if (strcmp(args, "=part") == 0) {
+		sink = UDS_DL_SINK_PARTITION;
+	} else {
+		printf("\nUse dl, dl=crc or dl=part\n");
+		return;
+	}
+	if (uds_dl_sink_set(sink) < 0) {
+		printf("\nA download is running\n");
+		return;
+	}
+	printf("\nDownloads go to the %s sink\n", uds_dl_sinks[sink].name);
+}
+
+#endif //CONFIG_CAR_EMU_UDS_DOWNLOAD
@@ -0,0 +1,75 @@
+/*
+ * uds_download.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+
+#ifndef __UDS_DOWNLOAD_H_
+#define __UDS_DOWNLOAD_H_
+
+#include <stdint.h>
+
+#include "can-tp.h"
+#include "isotp_codec.h"
+
+/*
+ * UDS download sink for measuring reflash tools: DiagnosticSessionControl,
+ * TesterPresent, RequestDownload, TransferData and RequestTransferExit on
+ * the physical request IDs. Blocks are reassembled by the dispatcher
+ * straight into one of two block buffers, FC with BS 0 and STmin 0, while
+ * a writer task streams the other one into the sink. Only two blocks are
+ * ever held, whatever the image size.
+ *
+ * A TransferData response is sent as soon as the next block has a free
+ * buffer, so the tester is slowed down only when the sink is.
+ */
+#define UDS_DL_BLOCK_LEN		ISOTP_MAX_LEN	//maxNumberOfBlockLength incl. SID and counter
+#define UDS_DL_BUFS				2
+#define UDS_DL_PARTITION		"dlsink"
+#define UDS_DL_SECTOR			4096		//flash erase unit, downloads start on one
+#define UDS_DL_ERASE_CHUNK		(64 * 1024)
+#define UDS_DL_PENDING_US		2000000		//0x78 well within P2* (5 s)
+#define UDS_DL_N_CR_US			1000000
+#define UDS_DL_TX_TOUT_US		100000
+
+typedef enum {
+	UDS_DL_SINK_CRC = 0,		//only the CRC, measures the transport alone
+	UDS_DL_SINK_PARTITION		//written to the UDS_DL_PARTITION flash partition
+} uds_dl_sink_type_t;
+
+typedef struct uds_dl_stats_s {
+	uint32_t downloads;
+	uint32_t size;			//of the current or last download
+	uint32_t received;
+	uint32_t blocks;
+	uint32_t crc;			//CRC-32 of the data written, sent with 0x77
+	int64_t start_us;		//positive 0x34 response
+	int64_t end_us;			//0x77 response, 0 while running
+	uint32_t waits;			//responses deferred until the sink freed a buffer
+	uint32_t nrcs;
+	uint32_t isotp_errors;	//bad sequence numbers, N_Cr timeouts, overflows
+	uint32_t sink_errors;
+	uint32_t tx_errors;
+} uds_dl_stats_t;
+
+//Allocates the block buffers and starts the writer task
+int uds_dl_init(uds_dl_sink_type_t sink);
+
+/*
+ * Called by the dispatcher for every frame. Returns 0 when the frame is
+ * part of a UDS request handled here, -1 to pass it on.
+ */
+int uds_dl_rx(const cantp_can_frame_t *frame);
+
+//Fails while a download is running
+int uds_dl_sink_set(uds_dl_sink_type_t sink);
+
+void uds_dl_stats_get(uds_dl_stats_t *stats);
+
+void uds_dl_print(void);
+
+//Console entry, args is "" (status), "=crc" or "=part"
+void uds_dl_cmd(const char *args);
+
+#endif /* __UDS_DOWNLOAD_H_ */
@@ -0,0 +1,172 @@
+/*
+ * vehicle_profile.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+
+#include "car_emulator.h"
+#include "emu_config.h"
+#include "vehicle_profile.h"
+
+#define TAG             "PROFILE"
+
+//The emulator as it was before profiles, used without a profile blob
+static const vehicle_profile_t builtin_profile = {
+	.name = "builtin",
+	.vin = { 'E','S','P','3','2','O','B','D','2','E','M','U','L','A','T','O','R' },
+	.pids01 = { 0x00, 0x18, 0x80, 0x00 },	//0C, 0D, 11
+	.pids09 = { 0x40, 0x00, 0x00, 0x00 },	//02
+	.speed = 100,
+	.rpm = 2500,
+	.throttle = 30
+};
+
+const vehicle_profile_t *volatile vehicle_profile = &builtin_profile;
+
+static const vehicle_profile_blob_t *blob;
+static spi_flash_mmap_handle_t blob_handle;
+static uint16_t current;
+static int32_t last_switch_us;
+static int32_t max_switch_us;
+
+static int vehicle_profile_mount(void)
+{
+	const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+			ESP_PARTITION_SUBTYPE_ANY, VP_PARTITION);
+	const void *ptr;
+
+	if (part == NULL) {
+		ESP_LOGW(TAG, "No \"%s\" partition", VP_PARTITION);
+		return -1;
+	}
+	if (esp_partition_mmap(part, 0, part->size, SPI_FLASH_MMAP_DATA, &ptr,
+							&blob_handle) != ESP_OK) {
+		ESP_LOGE(TAG, "Failed to map the \"%s\" partition", VP_PARTITION);
+		return -1;
+	}
+	const vehicle_profile_blob_t *b = (const vehicle_profile_blob_t *)ptr;
+	uint32_t size = sizeof(vehicle_profile_blob_t) + b->count * sizeof(vehicle_profile_t);
+	if (b->magic != VP_MAGIC || b->version != VP_VERSION || b->count == 0 ||
+		b->size != size || size > part->size ||
+		esp_rom_crc32_le(0, (const uint8_t *)b->profiles, size - sizeof(*b)) != b->crc) {
+		ESP_LOGW(TAG, "No valid profiles in \"%s\" (magic 0x%08x version %u)",
+				VP_PARTITION, b->magic, b->version);
+		spi_flash_munmap(blob_handle);
+		return -1;
+	}
+	blob = b;
+	return 0;
+}
+
+uint16_t vehicle_profile_count(void)
+{
+	return (blob != NULL) ? blob->count : 1;
+}
+
+static const vehicle_profile_t *vehicle_profile_get(uint16_t idx)
+{
+	return (blob != NULL) ? &blob->profiles[idx] : &builtin_profile;
+}
+
+int32_t vehicle_profile_select(uint16_t idx)
+{
+	if (idx >= vehicle_profile_count()) {
+		return -1;
+	}
+	int64_t t0 = esp_timer_get_time();
+	const vehicle_profile_t *p = vehicle_profile_get(idx);
+	vehicle_profile = p;
+	current = idx;
+#ifndef CONFIG_CAR_EMU_VEHICLE_SIM
+	vehicle_state_t vs = {
+			.speed = p->speed,
+			.rpm = p->rpm,
+			.throttle = p->throttle
+	};
+	vehicle_state_set(&vs);
+#endif
+	last_switch_us = (int32_t)(esp_timer_get_time() - t0);
+	if (last_switch_us > max_switch_us) {
+		max_switch_us = last_switch_us;
+	}
+	return last_switch_us;
+}
+
+int vehicle_profile_find(const char *name)
+{
+	for (uint16_t i = 0; i < vehicle_profile_count(); i++) {
+		if (strncmp(vehicle_profile_get(i)->name, name, VP_NAME_LEN) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+int vehicle_profile_init(void)
+{
+	uint16_t idx = 0;
+
+	if (vehicle_profile_mount() == 0) {
+		ESP_LOGI(TAG, "%u profiles mapped from \"%s\"", blob->count, VP_PARTITION);
+	}
+	if (emu_config_load_blob(VP_NVS_KEY, &idx, sizeof(idx)) < 0 ||
+		idx >= vehicle_profile_count()) {
+		idx = 0;
+	}
+	//The vehicle state restored from NVS stays
+	vehicle_profile = vehicle_profile_get(idx);
+	current = idx;
+	ESP_LOGI(TAG, "Profile %u \"%.*s\" VIN %.*s", idx, VP_NAME_LEN,
+			vehicle_profile->name, OBD2_VIN_LEN, vehicle_profile->vin);
+	return 0;
+}
+
+void vehicle_profile_print(void)
+{
+	printf("\nProfiles (%s), last switch %d us, max %d us:\n",
+			(blob != NULL) ? VP_PARTITION : "built-in", last_switch_us, max_switch_us);
+	for (uint16_t i = 0; i < vehicle_profile_count(); i++) {
+		const vehicle_profile_t *p = vehicle_profile_get(i);
+		printf("%c%3u %-16.*s %.*s  DTCs %u\n", (i == current) ? '*' : ' ', i,
+				VP_NAME_LEN, p->name, OBD2_VIN_LEN, p->vin, p->n_dtc);
+	}
+}
+
+void vehicle_profile_cmd(const char *args)
+{
+	if (args[0] == 0) {
+		vehicle_profile_print();
+		return;
+	}
+	if (args[0] != '=') {
+		printf("\nWrong command\n");
+		return;
+	}
+	char *end;
+	int idx = strtol(&args[1], &end, 10);
+	if (end == &args[1] || *end != 0) {
+		idx = vehicle_profile_find(&args[1]);
+	}
+	int32_t us = (idx >= 0) ? vehicle_profile_select(idx) : -1;
+	if (us < 0) {
+		printf("\nNo profile %s\n", &args[1]);
+		return;
+	}
+	uint16_t saved = idx;
+	printf("\nProfile %d \"%.*s\" VIN %.*s, switched in %d us, %s\n", idx,
+			VP_NAME_LEN, vehicle_profile->name, OBD2_VIN_LEN, vehicle_profile->vin, us,
+			(emu_config_save_blob(VP_NVS_KEY, &saved, sizeof(saved)) < 0) ?
+					"not saved" : "saved");
+}
@@ -0,0 +1,106 @@
+/*
+ * vehicle_profile.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+
+#ifndef __VEHICLE_PROFILE_H_
+#define __VEHICLE_PROFILE_H_
+
+#include <stdint.h>
+
+#include "car_emulator.h"
+
+/*
+ * Vehicle identity and capabilities: VIN, supported Service 01 and 09
+ * PIDs, calibration ID, stored DTCs and the default vehicle state.
+ * Profiles are compiled on the host by tools/vprofc.py into a flat
+ * little-endian blob, written to the VP_PARTITION partition and used in
+ * place through the flash cache: mounting checks the header and CRC
+ * once, selecting a profile only moves vehicle_profile.
+ *
+ * The layout is fixed, any change to it needs a new VP_VERSION.
+ */
+#define VP_MAGIC				0x46525056	//"VPRF"
+#define VP_VERSION				1
+#define VP_NAME_LEN				16
+#define VP_CAL_ID_LEN			16
+#define VP_MAX_DTCS				8
+#define VP_PARTITION			"profiles"
+#define VP_NVS_KEY				"profile"
+
+typedef struct vehicle_profile_s {
+	char name[VP_NAME_LEN];			//NUL padded
+	char vin[OBD2_VIN_LEN];
+	uint8_t n_dtc;
+	uint8_t pids01[32];				//Service 01 PID 00, 20 .. E0 bitmaps
+	uint8_t pids09[4];				//Service 09 PID 00 bitmap
+	char cal_id[VP_CAL_ID_LEN];		//Service 09 PID 04, NUL padded
+	uint16_t dtc[VP_MAX_DTCS];		//Service 03, SAE J2012 encoding
+	uint16_t speed;					//km/h, vehicle state on selection
+	uint16_t rpm;
+	uint8_t throttle;				//%
+	uint8_t reserved[21];
+} vehicle_profile_t;
+
+_Static_assert(sizeof(vehicle_profile_t) == 128, "vehicle_profile_t layout changed");
+
+typedef struct vehicle_profile_blob_s {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t count;
+	uint32_t size;					//header and profiles
+	uint32_t crc;					//CRC-32 of the profiles
+	vehicle_profile_t profiles[];
+} vehicle_profile_blob_t;
+
+//Current profile, never NULL
+extern const vehicle_profile_t *volatile vehicle_profile;
+
+//PID bit set in the Service 01 supported bitmaps
+static inline uint8_t vehicle_profile_pid01(const vehicle_profile_t *p, uint8_t pid)
+{
+	if ((pid & 0x1F) == 0) {
+		//The bitmaps themselves
+		return 1;
+	}
+	uint8_t bit = pid - 1;
+	return (p->pids01[bit / 8] >> (7 - bit % 8)) & 1;
+}
+
+static inline uint8_t vehicle_profile_pid09(const vehicle_profile_t *p, uint8_t pid)
+{
+	if (pid == 0) {
+		return 1;
+	}
+	if (pid > 0x20) {
+		return 0;
+	}
+	uint8_t bit = pid - 1;
+	return (p->pids09[bit / 8] >> (7 - bit % 8)) & 1;
+}
+
+/*
+ * Maps the profile partition and selects the profile stored in NVS.
+ * Without a valid blob only the built-in profile is available.
+ */
+int vehicle_profile_init(void);
+
+/*
+ * Makes profile idx current and, without the vehicle simulation, sets
+ * its default vehicle state. Returns the switch time in us, or -1.
+ */
+int32_t vehicle_profile_select(uint16_t idx);
+
+//Returns the index of the profile called name, or -1
+int vehicle_profile_find(const char *name);
+
+uint16_t vehicle_profile_count(void);
+
+void vehicle_profile_print(void);
+
+//Console entry, args is "" (list), "=N" or "=NAME"
+void vehicle_profile_cmd(const char *args);
+
+#endif /* __VEHICLE_PROFILE_H_ */
@@ -0,0 +1,84 @@
+/*
+ * baseline.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "baseline.h"
+
+int baseline_load(baseline_t *b, const char *path)
+{
+	char line[BASELINE_LINE_LEN];
+	FILE *f = fopen(path, "r");
+
+	memset(b, 0, sizeof(baseline_t));
+	if (f == NULL) {
+		return 0;
+	}
+	while (fgets(line, sizeof(line), f) != NULL && b->n < BASELINE_MAX) {
+		line[strcspn(line, "\r\n")] = 0;
+		if (line[0] == '#' || line[0] == 0) {
+			snprintf(b->e[b->n].line, BASELINE_LINE_LEN, "%s", line);
+			b->n++;
+			continue;
+		}
+		if (sscanf(line, "%63s %31s", b->e[b->n].line, b->e[b->n].value) != 2) {
+			fprintf(stderr, "%s: bad line \"%s\"\n", path, line);
+			fclose(f);
+			return -1;
+		}
+		b->n++;
+	}
+	fclose(f);
+	return 0;
+}
+
+int baseline_save(const baseline_t *b, const char *path)
+{
+	FILE *f = fopen(path, "w");
+
+	if (f == NULL) {
+		return -1;
+	}
+	for (uint16_t i = 0; i < b->n; i++) {
+		if (b->e[i].value[0] == 0) {
+			fprintf(f, "%s\n", b->e[i].line);
+		} else {
+			fprintf(f, "%-40s %s\n", b->e[i].line, b->e[i].value);
+		}
+	}
+	return (fclose(f) == 0)?0:-1;
+}
+
+const char *baseline_get(const baseline_t *b, const char *name)
+{
+	for (uint16_t i = 0; i < b->n; i++) {
+		if (b->e[i].value[0] != 0 && strcmp(b->e[i].line, name) == 0) {
+			return b->e[i].value;
+		}
+	}
+	return NULL;
+}
+
+int baseline_set(baseline_t *b, const char *name, const char *value)
+{
+	uint16_t i;
+
+	for (i = 0; i < b->n; i++) {
+		if (b->e[i].value[0] != 0 && strcmp(b->e[i].line, name) == 0) {
+			break;
+		}
+	}
+	if (i == b->n) {
+		if (b->n >= BASELINE_MAX) {
+			return -1;
+		}
+		b->n++;
+	}
+	snprintf(b->e[i].line, BASELINE_NAME_LEN, "%s", name);
+	snprintf(b->e[i].value, sizeof(b->e[i].value), "%s", value);
+	return 0;
+}
@@ -0,0 +1,38 @@
+/*
+ * baseline.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+
+#ifndef __BASELINE_H_
+#define __BASELINE_H_
+
+#include <stdint.h>
+
+/*
+ * Results kept in the tree (baseline.txt), one "name value" per line,
+ * '#' starts a comment. Updating a baseline keeps the comments and the
+ * order of the file and appends new names.
+ */
+#define BASELINE_MAX			128
+#define BASELINE_NAME_LEN		64
+#define BASELINE_LINE_LEN		160
+
+typedef struct baseline_s {
+	uint16_t n;
+	struct {
+		char line[BASELINE_LINE_LEN];	//comment, or the name
+		char value[32];					//empty for comments
+	} e[BASELINE_MAX];
+} baseline_t;
+
+//A file that does not exist is an empty baseline
+int baseline_load(baseline_t *b, const char *path);
+int baseline_save(const baseline_t *b, const char *path);
+
+//NULL when the name is not in the baseline
+const char *baseline_get(const baseline_t *b, const char *name);
+int baseline_set(baseline_t *b, const char *name, const char *value);
+
+#endif /* __BASELINE_H_ */
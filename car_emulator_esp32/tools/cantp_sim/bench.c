@@ -0,0 +1,320 @@
+/*
+ * bench.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "can-tp.h"
+#include "obd.h"
+#include "car_emulator.h"
+#include "sim_port.h"
+#include "bench.h"
+
+#define BENCH_TP_ID				OBD_PHYS_ID_STD
+#define BENCH_TP_MAX_LEN		4095
+#define BENCH_TP_SLICE_US		100000
+#define BENCH_TP_TOUT_US		(CANTP_TXQ_MF_TOUT_MS * 1000)
+
+typedef uint32_t (*bench_fn_t)(uint32_t iters, uint32_t arg);
+
+typedef struct bench_case_s {
+	const char *name;
+	bench_fn_t fn;
+	uint32_t arg;
+	uint32_t iters;		//sized for a few milliseconds per repetition
+} bench_case_t;
+
+//Two CAN-TP nodes, the driver sends from one to the other
+typedef struct bench_tp_s {
+	sim_world_t w;
+	des_bus_t bus;
+	sim_node_t tx;
+	sim_node_t rx;
+	sim_sem_t go;
+	sim_sem_t received;
+	uint32_t iters;
+	uint16_t len;
+	uint8_t done;
+	uint32_t errors;
+	uint8_t buf[BENCH_TP_MAX_LEN];
+} bench_tp_t;
+
+static uint32_t bench_enc_0C(uint32_t iters, uint32_t arg);
+static uint32_t bench_enc_0D(uint32_t iters, uint32_t arg);
+static uint32_t bench_enc_11(uint32_t iters, uint32_t arg);
+static uint32_t bench_enc_05(uint32_t iters, uint32_t arg);
+static uint32_t bench_create_resp(uint32_t iters, uint32_t arg);
+static uint32_t bench_obd1(uint32_t iters, uint32_t arg);
+static uint32_t bench_obd9(uint32_t iters, uint32_t arg);
+static uint32_t bench_rx_parse(uint32_t iters, uint32_t arg);
+static uint32_t bench_cantp(uint32_t iters, uint32_t arg);
+
+static const bench_case_t bench_cases[] = {
+	{ "enc_0C_rpm",		bench_enc_0C,		0,		1000000 },
+	{ "enc_0D_speed",	bench_enc_0D,		0,		1000000 },
+	{ "enc_11_throttle",bench_enc_11,		0,		1000000 },
+	{ "enc_05_coolant",	bench_enc_05,		0,		1000000 },
+	{ "create_resp",	bench_create_resp,	0,		1000000 },
+	{ "obd1_0C",		bench_obd1,			0x0C,	100000 },
+	{ "obd1_00",		bench_obd1,			0x00,	100000 },
+	{ "obd9_02_vin",	bench_obd9,			0x02,	100000 },
+	{ "rx_parse",		bench_rx_parse,		0,		100000 },
+	{ "cantp_8",		bench_cantp,		8,		2000 },
+	{ "cantp_20",		bench_cantp,		20,		2000 },
+	{ "cantp_512",		bench_cantp,		512,	200 },
+	{ "cantp_4095",		bench_cantp,		4095,	30 }
+};
+#define BENCH_CASES		(sizeof(bench_cases) / sizeof(bench_cases[0]))
+
+static volatile uint32_t bench_sink;
+static uint32_t bench_sent;
+static emulator_cfg_t bench_cfg = {
+	.boadrate = CFG_500KBPS,
+	.id_type = CFG_STANDARD_ID
+};
+static emulator_ctx_t bench_ctx = {
+	.cfg = &bench_cfg
+};
+static bench_tp_t *bench_tp;
+
+//Takes the place of cantp_send_async() so the dispatch cases send nothing
+static int bench_send(cantp_rxtx_status_t *ctx, uint32_t id, uint8_t idt,
+		const uint8_t *data, uint16_t len, uint32_t deadline_us,
+		cantp_send_done_cb_t cb, void *cb_arg)
+{
+	bench_sink += data[len - 1];
+	bench_sent++;
+	return 0;
+}
+
+static int64_t bench_now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint32_t bench_enc_0C(uint32_t iters, uint32_t arg)
+{
+	uint8_t a, b;
+	for (uint32_t i = 0; i < iters; i++) {
+		obdRevConvert_0C((float)(i & 0x1FFF), &a, &b, 0, 0);
+		bench_sink += a + b;
+	}
+	return 0;
+}
+
+static uint32_t bench_enc_0D(uint32_t iters, uint32_t arg)
+{
+	uint8_t a;
+	for (uint32_t i = 0; i < iters; i++) {
+		obdRevConvert_0D((float)(i & 0xFF), &a, 0, 0, 0);
+		bench_sink += a;
+	}
+	return 0;
+}
+
+static uint32_t bench_enc_11(uint32_t iters, uint32_t arg)
+{
+	uint8_t a;
+	for (uint32_t i = 0; i < iters; i++) {
+		obdRevConvert_11((float)(i % 101), &a, 0, 0, 0);
+		bench_sink += a;
+	}
+	return 0;
+}
+
+static uint32_t bench_enc_05(uint32_t iters, uint32_t arg)
+{
+	uint8_t a;
+	for (uint32_t i = 0; i < iters; i++) {
+		obdRevConvert_05((float)(i & 0x7F) - 40, &a, 0, 0, 0);
+		bench_sink += a;
+	}
+	return 0;
+}
+
+static uint32_t bench_create_resp(uint32_t iters, uint32_t arg)
+{
+	obd2_frame_t resp;
+	for (uint32_t i = 0; i < iters; i++) {
+		createOBDResponse(&resp, 1, i & 0xFF, (i & 1) ? OBD_FUNC_ID_EXT : OBD_FUNC_ID_STD, i & 1);
+		bench_sink += resp.id;
+	}
+	return 0;
+}
+
+static uint32_t bench_obd1(uint32_t iters, uint32_t arg)
+{
+	bench_sent = 0;
+	for (uint32_t i = 0; i < iters; i++) {
+		respondToOBD1(arg, &bench_ctx);
+	}
+	return (bench_sent < iters)?(iters - bench_sent):0;
+}
+
+static uint32_t bench_obd9(uint32_t iters, uint32_t arg)
+{
+	bench_sent = 0;
+	for (uint32_t i = 0; i < iters; i++) {
+		respondToOBD9(arg, &bench_ctx);
+	}
+	return (bench_sent < iters)?(iters - bench_sent):0;
+}
+
+//Same path as cantp_esp32.c: a heap copy of the request, freed by the parser
+static uint32_t bench_rx_parse(uint32_t iters, uint32_t arg)
+{
+	static const uint8_t req[] = { 0x01, 0x0C };
+	uint32_t errors = 0;
+
+	bench_ctx.idt = (bench_cfg.id_type == CFG_EXTENDED_ID);
+	bench_ctx.id = bench_ctx.idt ? OBD_FUNC_ID_EXT : OBD_FUNC_ID_STD;
+	bench_sent = 0;
+	for (uint32_t i = 0; i < iters; i++) {
+		bench_ctx.data = malloc(sizeof(req));
+		if (bench_ctx.data == NULL) {
+			errors++;
+			continue;
+		}
+		memcpy(bench_ctx.data, req, sizeof(req));
+		bench_ctx.len = sizeof(req);
+		can_check_rx_frame(&bench_ctx);
+	}
+	return errors + ((bench_sent < iters)?(iters - bench_sent):0);
+}
+
+static void bench_tp_received(sim_node_t *node, uint32_t id, uint8_t idt,
+		uint8_t *data, uint16_t len)
+{
+	bench_tp_t *tp = (bench_tp_t *)node->arg;
+
+	if (len != tp->len || memcmp(data, tp->buf, len) != 0) {
+		tp->errors++;
+	}
+	sim_sem_give(&tp->received);
+}
+
+//Sends one message at a time, as the TX task of a session does
+static void bench_tp_task(void *arg)
+{
+	bench_tp_t *tp = (bench_tp_t *)arg;
+
+	while (1) {
+		sim_sem_take(&tp->go, SIM_FOREVER);
+		for (uint32_t i = 0; i < tp->iters; i++) {
+			sim_sem_take(&tp->tx.sndr_done, 0);
+			sim_sem_take(&tp->received, 0);
+			if (cantp_send(&tp->tx.ctx, BENCH_TP_ID, 0, tp->buf, tp->len) < 0 ||
+				sim_sem_take(&tp->tx.sndr_done, BENCH_TP_TOUT_US) < 0 ||
+				tp->tx.sndr_result != CANTP_RESULT_N_OK ||
+				sim_sem_take(&tp->received, BENCH_TP_TOUT_US) < 0) {
+				tp->errors++;
+			}
+		}
+		tp->done = 1;
+	}
+}
+
+static int bench_tp_init(bench_tp_t *tp)
+{
+	memset(tp, 0, sizeof(bench_tp_t));
+	for (uint32_t i = 0; i < BENCH_TP_MAX_LEN; i++) {
+		tp->buf[i] = i * 7 + 1;
+	}
+	if (sim_world_init(&tp->w, 1) < 0) {
+		return -1;
+	}
+	des_bus_init(&tp->bus, &tp->w.des, 500000, 0);
+	sim_sem_init(&tp->go, 0, 1);
+	sim_sem_init(&tp->received, 0, 1);
+	if (sim_node_init(&tp->tx, &tp->w, &tp->bus, "tx", NULL) < 0 ||
+		sim_node_init(&tp->rx, &tp->w, &tp->bus, "rx", NULL) < 0) {
+		return -1;
+	}
+	tp->rx.received = bench_tp_received;
+	tp->rx.arg = tp;
+	return (sim_task_create(&tp->w, "bench", bench_tp_task, tp, &tp->tx) != NULL)?0:-1;
+}
+
+static void bench_tp_free(bench_tp_t *tp)
+{
+	sim_node_free(&tp->tx);
+	sim_node_free(&tp->rx);
+	sim_world_free(&tp->w);
+}
+
+static uint32_t bench_cantp(uint32_t iters, uint32_t len)
+{
+	bench_tp_t *tp = bench_tp;
+
+	tp->iters = iters;
+	tp->len = len;
+	tp->errors = 0;
+	tp->done = 0;
+	sim_sem_give(&tp->go);
+	while (!tp->done) {
+		sim_world_run(&tp->w, tp->w.des.now_us + BENCH_TP_SLICE_US);
+		if (!tp->done && tp->w.des.n_timers == 0) {
+			//Stalled, nothing can finish the transfer any more
+			return tp->errors + 1;
+		}
+	}
+	return tp->errors;
+}
+
+static void bench_sort(int64_t *v, uint8_t n)
+{
+	for (uint8_t i = 1; i < n; i++) {
+		int64_t x = v[i];
+		int8_t j = i - 1;
+		for (; j >= 0 && v[j] > x; j--) {
+			v[j + 1] = v[j];
+		}
+		v[j + 1] = x;
+	}
+}
+
+int bench_run(cfg_can_idt_t id_type, bench_result_t *res)
+{
+	bench_tp = malloc(sizeof(bench_tp_t));
+	if (bench_tp == NULL || bench_tp_init(bench_tp) < 0) {
+		fprintf(stderr, "Out of memory\n");
+		free(bench_tp);
+		return -1;
+	}
+	bench_cfg.id_type = id_type;
+	car_emu_send_t send = car_emu_sender_set(bench_send);
+
+	for (uint32_t c = 0; c < BENCH_CASES && c < BENCH_CASES_MAX; c++) {
+		const bench_case_t *bc = &bench_cases[c];
+		int64_t ns[BENCH_REPS];		//of the whole repetition
+		uint32_t errors = bc->fn(bc->iters, bc->arg);	//warm-up
+
+		for (uint8_t r = 0; r < BENCH_REPS; r++) {
+			int64_t t0 = bench_now_ns();
+			errors += bc->fn(bc->iters, bc->arg);
+			ns[r] = bench_now_ns() - t0;
+		}
+		bench_sort(ns, BENCH_REPS);
+		res[c].name = bc->name;
+		res[c].ns = (double)ns[BENCH_REPS / 2] / bc->iters;
+		res[c].min_ns = (double)ns[0] / bc->iters;
+		res[c].max_ns = (double)ns[BENCH_REPS - 1] / bc->iters;
+		res[c].errors = errors;
+	}
+
+	car_emu_sender_set(send);
+	bench_tp_free(bench_tp);
+	free(bench_tp);
+	bench_tp = NULL;
+	return (BENCH_CASES < BENCH_CASES_MAX)?BENCH_CASES:BENCH_CASES_MAX;
+}
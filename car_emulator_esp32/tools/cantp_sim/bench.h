@@ -0,0 +1,40 @@
+/*
+ * bench.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+
+#ifndef __BENCH_H_
+#define __BENCH_H_
+
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "car_emulator.h"
+
+/*
+ * Microbenchmarks of the request/response hot paths of the firmware
+ * sources: the OBD encoders, response dispatch, RX frame parsing, and
+ * CAN-TP transfers from cantp_send() to the receiver callback of a second
+ * node. The transfers run on the virtual clock, so their time is the CPU
+ * the library and the port layer take, not the bus time. Every case is
+ * warmed up once and then timed BENCH_REPS times.
+ */
+#define BENCH_REPS				7
+#define BENCH_CASES_MAX			16
+
+typedef struct bench_result_s {
+	const char *name;
+	double ns;					//median per operation
+	double min_ns;
+	double max_ns;
+	uint32_t errors;			//wrong results, over all repetitions
+} bench_result_t;
+
+//Runs all cases, returns the number of results or -1
+int bench_run(cfg_can_idt_t id_type, bench_result_t *res);
+
+#endif /* __BENCH_H_ */
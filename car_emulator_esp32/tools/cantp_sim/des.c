@@ -0,0 +1,218 @@
+/*
+ * des.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+#include <string.h>
+
+#include "des.h"
+
+#define FNV_OFFSET		0x811C9DC5
+#define FNV_PRIME		0x01000193
+
+static inline int des_timer_before(const des_timer_t *a, const des_timer_t *b)
+{
+	return (a->t_us < b->t_us) || (a->t_us == b->t_us && a->seq < b->seq);
+}
+
+static inline void des_heap_set(des_t *des, uint32_t i, des_timer_t *t)
+{
+	des->heap[i] = t;
+	t->idx = i;
+}
+
+static void des_sift_up(des_t *des, uint32_t i)
+{
+	des_timer_t *t = des->heap[i];
+	while (i > 0) {
+		uint32_t parent = (i - 1) / 2;
+		if (!des_timer_before(t, des->heap[parent])) {
+			break;
+		}
+		des_heap_set(des, i, des->heap[parent]);
+		i = parent;
+	}
+	des_heap_set(des, i, t);
+}
+
+static void des_sift_down(des_t *des, uint32_t i)
+{
+	des_timer_t *t = des->heap[i];
+	while (1) {
+		uint32_t child = 2 * i + 1;
+		if (child >= des->n_timers) {
+			break;
+		}
+		if (child + 1 < des->n_timers &&
+			des_timer_before(des->heap[child + 1], des->heap[child])) {
+			child++;
+		}
+		if (!des_timer_before(des->heap[child], t)) {
+			break;
+		}
+		des_heap_set(des, i, des->heap[child]);
+		i = child;
+	}
+	des_heap_set(des, i, t);
+}
+
+void des_init(des_t *des, uint32_t seed)
+{
+	memset(des, 0, sizeof(des_t));
+	des->rng = (seed != 0)?seed:1;
+}
+
+void des_timer_init(des_timer_t *t, des_fn_t fn, void *arg)
+{
+	t->idx = -1;
+	t->fn = fn;
+	t->arg = arg;
+}
+
+void des_timer_stop(des_t *des, des_timer_t *t)
+{
+	if (t->idx < 0) {
+		return;
+	}
+	uint32_t i = t->idx;
+	des_timer_t *last = des->heap[--des->n_timers];
+	t->idx = -1;
+	if (last == t) {
+		return;
+	}
+	des_heap_set(des, i, last);
+	des_sift_up(des, i);
+	des_sift_down(des, last->idx);
+}
+
+int des_timer_start(des_t *des, des_timer_t *t, int64_t delay_us)
+{
+	des_timer_stop(des, t);
+	if (des->n_timers >= DES_MAX_TIMERS) {
+		return -1;
+	}
+	t->t_us = des->now_us + delay_us;
+	t->seq = des->seq++;
+	des_heap_set(des, des->n_timers++, t);
+	des_sift_up(des, t->idx);
+	return 0;
+}
+
+int des_step(des_t *des)
+{
+	if (des->n_timers == 0) {
+		return -1;
+	}
+	des_timer_t *t = des->heap[0];
+	des_timer_stop(des, t);
+	des->now_us = t->t_us;
+	des->executed++;
+	t->fn(des, t->arg);
+	return 0;
+}
+
+static inline uint32_t des_bus_arb_key(const des_frame_t *f)
+{
+	return ((f->idt ? f->id : (f->id << 18)) << 1) | f->idt;
+}
+
+static inline uint32_t des_hash(uint32_t h, const uint8_t *p, uint32_t len)
+{
+	for (uint32_t i = 0; i < len; i++) {
+		h = (h ^ p[i]) * FNV_PRIME;
+	}
+	return h;
+}
+
+static void des_bus_start_next(des_bus_t *bus);
+
+static void des_bus_done(des_t *des, void *arg)
+{
+	des_bus_t *bus = (des_bus_t *)arg;
+	des_frame_t frame = bus->cur;
+	uint8_t sender = bus->cur_node;
+
+	bus->busy = 0;
+	bus->frames++;
+	bus->hash = des_hash(bus->hash, (const uint8_t *)&des->now_us, sizeof(des->now_us));
+	bus->hash = des_hash(bus->hash, (const uint8_t *)&frame.id, sizeof(frame.id));
+	bus->hash = des_hash(bus->hash, frame.data, frame.dlc);
+
+	if (bus->drop_ppm != 0 && des_rand(des) % 1000000 < bus->drop_ppm) {
+		bus->dropped++;
+	} else {
+		for (uint8_t i = 0; i < bus->n_nodes; i++) {
+			if (i != sender) {
+				bus->nodes[i].rx(des, bus->nodes[i].ctx, &frame);
+			}
+		}
+	}
+	if (bus->nodes[sender].tx_done != NULL) {
+		bus->nodes[sender].tx_done(des, bus->nodes[sender].ctx, &frame);
+	}
+	if (!bus->busy && bus->n_pending > 0) {
+		des_bus_start_next(bus);
+	}
+}
+
+static void des_bus_start_next(des_bus_t *bus)
+{
+	uint8_t best = 0;
+	for (uint8_t i = 1; i < bus->n_pending; i++) {
+		if (des_bus_arb_key(&bus->pending[i]) < des_bus_arb_key(&bus->pending[best])) {
+			best = i;
+		}
+	}
+	bus->cur = bus->pending[best];
+	bus->cur_node = bus->pending_node[best];
+	bus->n_pending--;
+	//Keep the queue in send order for equal IDs
+	for (uint8_t i = best; i < bus->n_pending; i++) {
+		bus->pending[i] = bus->pending[i + 1];
+		bus->pending_node[i] = bus->pending_node[i + 1];
+	}
+
+	//SOF..EOF plus interframe space
+	uint32_t bits = (bus->cur.idt ? 67 : 47) + 8 * bus->cur.dlc;
+	int64_t t_us = ((int64_t)bits * 1000000 + bus->bitrate - 1) / bus->bitrate;
+	bus->busy = 1;
+	bus->busy_us += t_us;
+	des_timer_start(bus->des, &bus->done, t_us);
+}
+
+void des_bus_init(des_bus_t *bus, des_t *des, uint32_t bitrate, uint32_t drop_ppm)
+{
+	memset(bus, 0, sizeof(des_bus_t));
+	bus->des = des;
+	bus->bitrate = bitrate;
+	bus->drop_ppm = drop_ppm;
+	bus->hash = FNV_OFFSET;
+	des_timer_init(&bus->done, des_bus_done, bus);
+}
+
+int des_bus_attach(des_bus_t *bus, des_rx_fn_t rx, des_rx_fn_t tx_done, void *ctx)
+{
+	if (bus->n_nodes >= DES_BUS_NODES) {
+		return -1;
+	}
+	bus->nodes[bus->n_nodes].rx = rx;
+	bus->nodes[bus->n_nodes].tx_done = tx_done;
+	bus->nodes[bus->n_nodes].ctx = ctx;
+	return bus->n_nodes++;
+}
+
+int des_bus_send(des_bus_t *bus, uint8_t node, const des_frame_t *frame)
+{
+	if (bus->n_pending >= DES_BUS_PENDING) {
+		bus->overflows++;
+		return -1;
+	}
+	bus->pending[bus->n_pending] = *frame;
+	bus->pending_node[bus->n_pending] = node;
+	bus->n_pending++;
+	if (!bus->busy) {
+		des_bus_start_next(bus);
+	}
+	return 0;
+}
@@ -0,0 +1,126 @@
+/*
+ * des.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+
+#ifndef __DES_H_
+#define __DES_H_
+
+#include <stdint.h>
+
+/*
+ * Discrete-event simulation on a virtual clock. Every event is a timer
+ * owned by an actor, so restarting or stopping a timeout never leaves a
+ * stale event behind. Timers due at the same time run in the order they
+ * were started, and all randomness comes from the seeded generator, so a
+ * run is bit for bit reproducible from its seed.
+ */
+#define DES_MAX_TIMERS		64
+#define DES_BUS_NODES		8
+#define DES_BUS_PENDING		16
+
+typedef struct des_s des_t;
+
+typedef void (*des_fn_t)(des_t *des, void *arg);
+
+typedef struct des_timer_s {
+	int64_t t_us;
+	uint32_t seq;
+	int32_t idx;		//position in the heap, -1 when not running
+	des_fn_t fn;
+	void *arg;
+} des_timer_t;
+
+struct des_s {
+	int64_t now_us;
+	uint32_t seq;
+	uint32_t rng;
+	uint32_t n_timers;
+	uint64_t executed;
+	des_timer_t *heap[DES_MAX_TIMERS];
+};
+
+void des_init(des_t *des, uint32_t seed);
+
+void des_timer_init(des_timer_t *t, des_fn_t fn, void *arg);
+
+//(Re)starts t to fire after delay_us of virtual time, -1 when full
+int des_timer_start(des_t *des, des_timer_t *t, int64_t delay_us);
+
+void des_timer_stop(des_t *des, des_timer_t *t);
+
+static inline uint8_t des_timer_active(const des_timer_t *t)
+{
+	return t->idx >= 0;
+}
+
+//Runs the earliest timer, returns -1 when none is running
+int des_step(des_t *des);
+
+//xorshift32
+static inline uint32_t des_rand(des_t *des)
+{
+	uint32_t x = des->rng;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	des->rng = x;
+	return x;
+}
+
+//Uniform in [lo, hi]
+static inline uint32_t des_rand_range(des_t *des, uint32_t lo, uint32_t hi)
+{
+	return lo + des_rand(des) % (hi - lo + 1);
+}
+
+typedef struct des_frame_s {
+	uint32_t id;
+	uint8_t idt;
+	uint8_t dlc;
+	uint8_t data[8];
+} des_frame_t;
+
+typedef void (*des_rx_fn_t)(des_t *des, void *ctx, const des_frame_t *frame);
+
+/*
+ * Virtual CAN bus. Pending frames win arbitration by ID, a frame occupies
+ * the bus for its nominal bit time (no stuff bits) and is then delivered
+ * to every other node, unless it is dropped with probability drop_ppm.
+ * The sender sees its TX done either way, as a controller that got an
+ * ACK from some node on the bus.
+ */
+typedef struct des_bus_s {
+	des_t *des;
+	uint32_t bitrate;
+	uint32_t drop_ppm;
+	uint8_t busy;
+	uint8_t n_nodes;
+	uint8_t n_pending;
+	struct {
+		des_rx_fn_t rx;
+		des_rx_fn_t tx_done;	//may be NULL
+		void *ctx;
+	} nodes[DES_BUS_NODES];
+	des_frame_t pending[DES_BUS_PENDING];
+	uint8_t pending_node[DES_BUS_PENDING];
+	des_frame_t cur;
+	uint8_t cur_node;
+	des_timer_t done;
+	uint32_t frames;
+	uint32_t dropped;
+	uint32_t overflows;		//no room in the pending queue
+	int64_t busy_us;
+	uint32_t hash;			//FNV-1a over time, ID and data of every frame
+} des_bus_t;
+
+void des_bus_init(des_bus_t *bus, des_t *des, uint32_t bitrate, uint32_t drop_ppm);
+
+//Returns the node number used by des_bus_send()
+int des_bus_attach(des_bus_t *bus, des_rx_fn_t rx, des_rx_fn_t tx_done, void *ctx);
+
+int des_bus_send(des_bus_t *bus, uint8_t node, const des_frame_t *frame);
+
+#endif /* __DES_H_ */
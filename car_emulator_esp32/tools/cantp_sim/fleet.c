@@ -0,0 +1,203 @@
+/*
+ * fleet.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fleet.h"
+
+//Cars waiting for a worker; the owner pops at the bottom, thieves at the top
+typedef struct fleet_deque_s {
+	pthread_mutex_t lock;
+	uint32_t top;
+	uint32_t bottom;
+	uint16_t cars[FLEET_MAX_CARS];
+} fleet_deque_t;
+
+typedef struct fleet_s {
+	sim_obd_t *cars;
+	uint16_t n_cars;
+	uint8_t workers;
+	long cpus;
+	uint32_t remaining;
+	fleet_deque_t deque[FLEET_MAX_WORKERS];
+	fleet_worker_stats_t stats[FLEET_MAX_WORKERS];
+} fleet_t;
+
+typedef struct fleet_arg_s {
+	fleet_t *fleet;
+	uint8_t worker;
+} fleet_arg_t;
+
+static double fleet_now_s(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void fleet_push(fleet_deque_t *d, uint16_t car)
+{
+	pthread_mutex_lock(&d->lock);
+	d->cars[d->bottom % FLEET_MAX_CARS] = car;
+	d->bottom++;
+	pthread_mutex_unlock(&d->lock);
+}
+
+static int fleet_pop(fleet_deque_t *d)
+{
+	int car = -1;
+	pthread_mutex_lock(&d->lock);
+	if (d->bottom != d->top) {
+		d->bottom--;
+		car = d->cars[d->bottom % FLEET_MAX_CARS];
+	}
+	pthread_mutex_unlock(&d->lock);
+	return car;
+}
+
+static int fleet_steal(fleet_deque_t *d)
+{
+	int car = -1;
+	pthread_mutex_lock(&d->lock);
+	if (d->bottom != d->top) {
+		car = d->cars[d->top % FLEET_MAX_CARS];
+		d->top++;
+	}
+	pthread_mutex_unlock(&d->lock);
+	return car;
+}
+
+static void *fleet_worker(void *arg)
+{
+	fleet_arg_t *a = (fleet_arg_t *)arg;
+	fleet_t *f = a->fleet;
+	uint8_t w = a->worker;
+	fleet_worker_stats_t *st = &f->stats[w];
+	cpu_set_t cpus;
+
+	//One worker per core, as long as there are cores
+	CPU_ZERO(&cpus);
+	CPU_SET(w % f->cpus, &cpus);
+	pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+
+	while (__atomic_load_n(&f->remaining, __ATOMIC_ACQUIRE) > 0) {
+		int car = fleet_pop(&f->deque[w]);
+		for (uint8_t i = 1; car < 0 && i < f->workers; i++) {
+			car = fleet_steal(&f->deque[(w + i) % f->workers]);
+			if (car >= 0) {
+				st->steals++;
+			}
+		}
+		if (car < 0) {
+			//The last cars are running on other workers
+			sched_yield();
+			continue;
+		}
+
+		double t0 = fleet_now_s();
+		int ret = sim_obd_run(&f->cars[car], SIM_OBD_SLICE_US);
+		st->busy_s += fleet_now_s() - t0;
+		st->slices++;
+		if (ret == 0) {
+			fleet_push(&f->deque[w], car);
+		} else {
+			st->cars_done++;
+			__atomic_fetch_sub(&f->remaining, 1, __ATOMIC_RELEASE);
+		}
+	}
+	return NULL;
+}
+
+int fleet_run(const fleet_cfg_t *cfg, fleet_result_t *res)
+{
+	static fleet_t fleet;
+	fleet_arg_t args[FLEET_MAX_WORKERS];
+	pthread_t threads[FLEET_MAX_WORKERS];
+	fleet_t *f = &fleet;
+	int res_run = 0;
+
+	memset(res, 0, sizeof(fleet_result_t));
+	if (cfg->cars == 0 || cfg->cars > FLEET_MAX_CARS ||
+		cfg->workers == 0 || cfg->workers > FLEET_MAX_WORKERS) {
+		return -1;
+	}
+	memset(f, 0, sizeof(fleet_t));
+	f->cars = calloc(cfg->cars, sizeof(sim_obd_t));
+	if (f->cars == NULL) {
+		fprintf(stderr, "No memory for %u cars\n", cfg->cars);
+		return -1;
+	}
+	f->workers = cfg->workers;
+	f->cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	f->cpus = (f->cpus > 0)?f->cpus:1;
+	f->remaining = cfg->cars;
+	for (uint8_t w = 0; w < f->workers; w++) {
+		pthread_mutex_init(&f->deque[w].lock, NULL);
+	}
+	for (uint16_t n = 0; n < cfg->cars; n++) {
+		if (sim_obd_init(&f->cars[n], cfg->seed + n, cfg->bitrate,
+				cfg->drop_ppm, cfg->cycles) < 0) {
+			fprintf(stderr, "No memory for car %u\n", n);
+			f->n_cars = n + 1;
+			res_run = -1;
+			goto out;
+		}
+		f->n_cars = n + 1;
+		sim_obd_vehicle(&f->cars[n], n);
+		fleet_push(&f->deque[n % f->workers], n);
+	}
+
+	double t0 = fleet_now_s();
+	for (uint8_t w = 0; w < f->workers; w++) {
+		args[w].fleet = f;
+		args[w].worker = w;
+		if (pthread_create(&threads[w], NULL, fleet_worker, &args[w]) != 0) {
+			fprintf(stderr, "Failed to start worker %u\n", w);
+			//Runs its share on the workers started so far
+			f->workers = w;
+			break;
+		}
+	}
+	if (f->workers == 0) {
+		res_run = -1;
+		goto out;
+	}
+	for (uint8_t w = 0; w < f->workers; w++) {
+		pthread_join(threads[w], NULL);
+	}
+	res->wall_s = fleet_now_s() - t0;
+
+	for (uint16_t n = 0; n < cfg->cars; n++) {
+		sim_obd_t *s = &f->cars[n];
+		res->requests += s->stats.cycles;
+		res->answered += s->stats.responses;
+		res->failed += s->stats.failed;
+		res->bad += s->stats.bad;
+		res->events += s->w.des.executed;
+		if (!s->finished) {
+			res->stalled++;
+		}
+		res->hash = (res->hash ^ s->bus.hash) * 16777619;
+	}
+	memcpy(res->worker, f->stats, sizeof(res->worker));
+	res_run = (res->stalled == 0 && res->bad == 0)?0:-1;
+out:
+	for (uint16_t n = 0; n < f->n_cars; n++) {
+		sim_obd_free(&f->cars[n]);
+	}
+	for (uint8_t w = 0; w < cfg->workers; w++) {
+		pthread_mutex_destroy(&f->deque[w].lock);
+	}
+	free(f->cars);
+	return res_run;
+}
@@ -0,0 +1,60 @@
+/*
+ * fleet.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+
+#ifndef __FLEET_H_
+#define __FLEET_H_
+
+#include <stdint.h>
+
+#include "sim_obd.h"
+
+/*
+ * Fleet of independent cars, each a sim_obd_t with its own VIN, vehicle
+ * state, CAN-TP contexts, bus and clock, run by a pool of host threads.
+ * Cars are handed out as slices of SIM_OBD_SLICE_US virtual time: a
+ * worker keeps running its own cars from the bottom of its deque and
+ * steals from the top of another one when it runs dry, so the cores stay
+ * busy until the last car is done.
+ *
+ * Every car is deterministic on its own, so the fleet hash does not
+ * depend on the number of workers or on who ran which slice.
+ */
+#define FLEET_MAX_CARS			1024
+#define FLEET_MAX_WORKERS		64
+
+typedef struct fleet_cfg_s {
+	uint32_t seed;			//car n runs with seed + n
+	uint16_t cars;
+	uint32_t cycles;		//requests per car
+	uint32_t drop_ppm;
+	uint32_t bitrate;
+	uint8_t workers;		//1 to FLEET_MAX_WORKERS
+} fleet_cfg_t;
+
+typedef struct fleet_worker_stats_s {
+	uint32_t slices;
+	uint32_t steals;
+	uint32_t cars_done;
+	double busy_s;
+} fleet_worker_stats_t;
+
+typedef struct fleet_result_s {
+	uint32_t requests;		//cycles done over all cars
+	uint32_t answered;
+	uint32_t failed;
+	uint32_t bad;
+	uint32_t stalled;		//cars where every task waits forever
+	uint64_t events;
+	double wall_s;
+	uint32_t hash;			//over the bus hashes of the cars, in car order
+	fleet_worker_stats_t worker[FLEET_MAX_WORKERS];
+} fleet_result_t;
+
+//Returns -1 when it could not run, or a car stalled or answered wrong
+int fleet_run(const fleet_cfg_t *cfg, fleet_result_t *res);
+
+#endif /* __FLEET_H_ */
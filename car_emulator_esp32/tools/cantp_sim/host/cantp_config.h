@@ -0,0 +1,19 @@
+/*
+ * cantp_config.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+
+#ifndef __CANTP_CONFIG_H_
+#define __CANTP_CONFIG_H_
+
+#define CANTP_LOG_NONE 0
+#define CANTP_LOG_INFO 1
+#define CANTP_LOG_DEBUG 2
+#define CANTP_LOG_VERBOSE 3
+
+//Millions of frames, the simulator reports only the results
+#define CANTP_LOG CANTP_LOG_NONE
+
+#endif /* __CANTP_CONFIG_H_ */
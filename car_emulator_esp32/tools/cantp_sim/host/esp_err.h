@@ -0,0 +1,17 @@
+/*
+ * esp_err.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+
+#ifndef __ESP_ERR_H_
+#define __ESP_ERR_H_
+
+typedef int esp_err_t;
+
+#define ESP_OK					0
+#define ESP_FAIL				-1
+#define ESP_ERR_INVALID_ARG		0x102
+
+#endif /* __ESP_ERR_H_ */
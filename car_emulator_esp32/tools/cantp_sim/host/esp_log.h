@@ -0,0 +1,18 @@
+/*
+ * esp_log.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+
+#ifndef __ESP_LOG_H_
+#define __ESP_LOG_H_
+
+//Logging is off in the simulator
+#define ESP_LOGE(tag, ...)		do { } while (0)
+#define ESP_LOGW(tag, ...)		do { } while (0)
+#define ESP_LOGI(tag, ...)		do { } while (0)
+#define ESP_LOGD(tag, ...)		do { } while (0)
+#define ESP_LOGV(tag, ...)		do { } while (0)
+
+#endif /* __ESP_LOG_H_ */
@@ -0,0 +1,16 @@
+/*
+ * esp_rom_crc.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+
+#ifndef __ESP_ROM_CRC_H_
+#define __ESP_ROM_CRC_H_
+
+#include <stdint.h>
+
+//CRC-32 as zlib's crc32(), continued from crc, 0 to start
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len);
+
+#endif /* __ESP_ROM_CRC_H_ */
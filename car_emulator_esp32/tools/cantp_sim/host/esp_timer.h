@@ -0,0 +1,18 @@
+/*
+ * esp_timer.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+
+#ifndef __ESP_TIMER_H_
+#define __ESP_TIMER_H_
+
+#include <stdint.h>
+
+typedef struct sim_timer_s *esp_timer_handle_t;
+
+//Virtual time of the simulated world
+int64_t esp_timer_get_time(void);
+
+#endif /* __ESP_TIMER_H_ */
@@ -0,0 +1,44 @@
+/*
+ * FreeRTOS.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ *
+ * The part of the FreeRTOS API the firmware modules built into the host
+ * simulator use. Tasks are simulator tasks, time is virtual time.
+ */
+
+#ifndef __FREERTOS_H_
+#define __FREERTOS_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "sdkconfig.h"
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef void *TaskHandle_t;
+typedef void *SemaphoreHandle_t;
+typedef void *QueueHandle_t;
+typedef void (*TaskFunction_t)(void *arg);
+
+#define pdFALSE					0
+#define pdTRUE					1
+#define pdPASS					pdTRUE
+#define portMAX_DELAY			((TickType_t)0xFFFFFFFF)
+#define portTICK_PERIOD_MS		(1000 / CONFIG_FREERTOS_HZ)
+#define portTICK_RATE_MS		portTICK_PERIOD_MS
+#define pdMS_TO_TICKS(ms)		((TickType_t)(ms) / portTICK_PERIOD_MS)
+
+//Spinlock sections of the firmware become host mutexes
+typedef pthread_mutex_t portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED	PTHREAD_MUTEX_INITIALIZER
+#define portENTER_CRITICAL(mux)	pthread_mutex_lock(mux)
+#define portEXIT_CRITICAL(mux)	pthread_mutex_unlock(mux)
+
+void vTaskDelay(TickType_t ticks);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+
+#endif /* __FREERTOS_H_ */
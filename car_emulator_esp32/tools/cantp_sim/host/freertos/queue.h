@@ -0,0 +1,22 @@
+/*
+ * queue.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ *
+ * Queues are sim queues, see sim_port.c.
+ */
+
+#ifndef __QUEUE_H_
+#define __QUEUE_H_
+
+#include "freertos/FreeRTOS.h"
+
+QueueHandle_t xQueueCreate(UBaseType_t len, UBaseType_t item_size);
+
+//Never blocks, as sim_queue_put()
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks);
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks);
+
+#endif /* __QUEUE_H_ */
@@ -0,0 +1,8 @@
+/*
+ * semphr.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+
+#include "freertos/FreeRTOS.h"
@@ -0,0 +1,22 @@
+/*
+ * task.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+
+#include "freertos/FreeRTOS.h"
+
+#ifndef __TASK_H_
+#define __TASK_H_
+
+//Tasks on pinned host threads, only in ring_check.c
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name,
+		uint32_t stack_size, void *arg, UBaseType_t prio,
+		TaskHandle_t *handle, BaseType_t core);
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name,
+		uint32_t stack_size, void *arg, UBaseType_t prio, TaskHandle_t *handle);
+void xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks);
+
+#endif /* __TASK_H_ */
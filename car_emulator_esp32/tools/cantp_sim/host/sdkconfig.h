@@ -0,0 +1,20 @@
+/*
+ * sdkconfig.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ *
+ * Configuration of the firmware modules built into the host simulator:
+ * no logging, tracing or capture, the UDS download sink for sim_dl.c, the
+ * defaults of Kconfig.projbuild otherwise.
+ */
+
+#ifndef __SDKCONFIG_H_
+#define __SDKCONFIG_H_
+
+#define CONFIG_FREERTOS_HZ				100
+#define CONFIG_CANTP_MAX_SESSIONS		2
+#define CONFIG_CANTP_TXQ_LEN			8
+#define CONFIG_CAR_EMU_UDS_DOWNLOAD		1
+
+#endif /* __SDKCONFIG_H_ */
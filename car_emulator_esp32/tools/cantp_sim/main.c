@@ -0,0 +1,490 @@
+/*
+ * main.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ *
+ * Runs the CAN-TP library and the OBD responder of the firmware on the
+ * host, on a virtual clock (see sim.h). Built and checked with the
+ * Makefile next to it:
+ *
+ *   make check          against baseline.txt
+ *   ./cantp_sim -n 1000 fleet 64
+ *   ./cantp_sim -a 0x1000 dl 200000
+ */
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "baseline.h"
+#include "bench.h"
+#include "fleet.h"
+#include "sim_dl.h"
+#include "sim_obd.h"
+
+typedef struct sim_opts_s {
+	uint32_t seed;
+	uint32_t cycles;
+	uint32_t drop_ppm;
+	uint32_t kbps;
+	cfg_can_idt_t id_type;
+	const char *baseline;
+	uint8_t update;
+	uint32_t tolerance;			//% slower than the baseline that still passes
+	int cpu;					//the bench runs on
+	uint32_t workers;			//of the fleet, the cores by default
+	uint32_t addr;				//of the download in the partition
+	const char *image;			//downloaded file, generated from the seed if NULL
+	const char *part_file;		//holding the partition of the download
+} sim_opts_t;
+
+static const char *idt_names[] = { "std", "ext", "all" };
+
+static double now_s(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//Compares or stores one result, returns -1 when it fails the baseline
+static int check_hash(baseline_t *b, const sim_opts_t *o, const char *name, uint32_t hash)
+{
+	char value[16];
+	snprintf(value, sizeof(value), "0x%08x", hash);
+	if (o->update) {
+		return baseline_set(b, name, value);
+	}
+	const char *base = baseline_get(b, name);
+	if (base == NULL) {
+		printf("%s: %s, not in the baseline: FAILED\n", name, value);
+		return -1;
+	}
+	if (strcmp(base, value) != 0) {
+		printf("%s: %s, baseline %s: FAILED\n", name, value, base);
+		return -1;
+	}
+	printf("%s: %s as in the baseline\n", name, value);
+	return 0;
+}
+
+//Higher is better
+static int check_rate(baseline_t *b, const sim_opts_t *o, const char *name, double rate)
+{
+	char value[32];
+	snprintf(value, sizeof(value), "%.1f", rate);
+	if (o->update) {
+		return baseline_set(b, name, value);
+	}
+	const char *base = baseline_get(b, name);
+	if (base == NULL) {
+		printf("%s: %s, not in the baseline: FAILED\n", name, value);
+		return -1;
+	}
+	double limit = atof(base) * (100 - o->tolerance) / 100;
+	printf("%s: %.1f, baseline %s, limit %.1f: %s\n", name, rate, base, limit,
+			(rate >= limit)?"ok":"FAILED");
+	return (rate >= limit)?0:-1;
+}
+
+//Lower is better
+static int check_time(baseline_t *b, const sim_opts_t *o, const char *name, double ns)
+{
+	char value[32];
+	snprintf(value, sizeof(value), "%.1f", ns);
+	if (o->update) {
+		return baseline_set(b, name, value);
+	}
+	const char *base = baseline_get(b, name);
+	if (base == NULL) {
+		printf("  %8s  FAILED, not in the baseline\n", "-");
+		return -1;
+	}
+	double limit = atof(base) * (100 + o->tolerance) / 100;
+	printf("  %8s  %s\n", base, (ns <= limit)?"ok":"FAILED");
+	return (ns <= limit)?0:-1;
+}
+
+static int run_des(const sim_opts_t *o, baseline_t *b)
+{
+	sim_obd_t *s = malloc(sizeof(sim_obd_t));
+	char name[BASELINE_NAME_LEN];
+	int res = 0;
+
+	printf("des seed=%u cycles=%u drop=%uppm %ukbit/s %s\n", o->seed, o->cycles,
+			o->drop_ppm, o->kbps, idt_names[o->id_type]);
+	if (s == NULL || sim_obd_init(s, o->seed, o->kbps * 1000, o->drop_ppm, o->cycles) < 0) {
+		fprintf(stderr, "Out of memory\n");
+		return -1;
+	}
+
+	double t0 = now_s();
+	int run;
+	while ((run = sim_obd_run(s, SIM_OBD_SLICE_US)) == 0) {
+	}
+	double wall = now_s() - t0;
+	double sim = s->w.des.now_us / 1e6;
+
+	sim_obd_stats_t *st = &s->stats;
+	printf("%u cycles: %u answered, %u failed, %u retries, %u stale, %u bad\n",
+			st->cycles, st->responses, st->failed, st->retries, st->stale, st->bad);
+	printf("%u frames, %u dropped, bus load %.1f%%\n", s->bus.frames, s->bus.dropped,
+			(sim > 0)?s->bus.busy_us / 1e4 / sim:0.0);
+	printf("car: %u TX timeouts, %u RX overflows, %u sends failed; "
+			"tester: %u TX timeouts, %u RX overflows\n",
+			s->car.stats.tx_timeouts, s->car.stats.rx_overflows, s->car.stats.send_failed,
+			s->tester.stats.tx_timeouts, s->tester.stats.rx_overflows);
+	printf("%.3f sim-s in %.3f wall-s: %.1f sim-s/wall-s, %llu events, %llu switches\n",
+			sim, wall, sim / wall, (unsigned long long)s->w.des.executed,
+			(unsigned long long)s->w.switches);
+	printf("hash 0x%08x\n", s->bus.hash);
+	if (run < 0) {
+		printf("Stalled at %.6f s: every task waits for something that never comes\n", sim);
+		res = -1;
+	}
+	if (st->bad > 0) {
+		res = -1;
+	}
+
+	if (o->baseline != NULL) {
+		int n = snprintf(name, sizeof(name), "des.%u.%u.%u.%u.%s.", o->seed,
+				o->cycles, o->drop_ppm, o->kbps, idt_names[o->id_type]);
+		snprintf(&name[n], sizeof(name) - n, "hash");
+		res |= check_hash(b, o, name, s->bus.hash);
+		snprintf(&name[n], sizeof(name) - n, "rate");
+		res |= check_rate(b, o, name, sim / wall);
+	}
+	sim_obd_free(s);
+	free(s);
+	return res;
+}
+
+static int run_bench(const sim_opts_t *o, baseline_t *b)
+{
+	bench_result_t r[BENCH_CASES_MAX];
+	char name[BASELINE_NAME_LEN];
+	cpu_set_t cpus;
+	int res = 0;
+
+	CPU_ZERO(&cpus);
+	CPU_SET(o->cpu, &cpus);
+	if (sched_setaffinity(0, sizeof(cpus), &cpus) < 0) {
+		perror("sched_setaffinity");
+		return -1;
+	}
+	int n = bench_run(o->id_type, r);
+	if (n < 0) {
+		return -1;
+	}
+	printf("bench on CPU %d, median of %u after a warm-up\n", o->cpu, BENCH_REPS);
+	printf("case                 ns/op       min  spread  baseline\n");
+	for (int c = 0; c < n; c++) {
+		printf("%-16s %9.1f %9.1f %6.0f%%", r[c].name, r[c].ns, r[c].min_ns,
+				(r[c].ns > 0)?(r[c].max_ns - r[c].min_ns) * 100 / r[c].ns:0.0);
+		if (r[c].errors != 0) {
+			printf("            WRONG RESULT\n");
+			res = -1;
+			continue;
+		}
+		if (o->baseline == NULL || o->update) {
+			printf("\n");
+		}
+		if (o->baseline != NULL) {
+			snprintf(name, sizeof(name), "bench.%s.%s.ns", r[c].name, idt_names[o->id_type]);
+			res |= check_time(b, o, name, r[c].ns);
+		}
+	}
+	return res;
+}
+
+static void fleet_print(const fleet_cfg_t *cfg, const fleet_result_t *r, double base_s)
+{
+	double wall = (r->wall_s > 0)?r->wall_s:1e-9;
+	double scale = base_s / wall;
+
+	printf("%3u worker(s): %u requests in %.3f s, %.0f requests/s, x%.2f, "
+			"%.0f%% per core, hash 0x%08x\n", cfg->workers, r->requests, wall,
+			r->requests / wall, scale, scale * 100 / cfg->workers, r->hash);
+	for (uint8_t w = 0; w < cfg->workers; w++) {
+		const fleet_worker_stats_t *st = &r->worker[w];
+		printf("      worker %u: %u cars, %u slices, %u stolen, busy %.0f%%\n",
+				w, st->cars_done, st->slices, st->steals, st->busy_s * 100 / wall);
+	}
+}
+
+//One run per worker count, doubling up to o->workers
+static int run_fleet(const sim_opts_t *o, baseline_t *b, uint32_t cars)
+{
+	fleet_cfg_t cfg = {
+			.seed = o->seed,
+			.cars = cars,
+			.cycles = o->cycles,
+			.drop_ppm = o->drop_ppm,
+			.bitrate = o->kbps * 1000
+	};
+	fleet_result_t *r = malloc(sizeof(fleet_result_t));
+	char name[BASELINE_NAME_LEN];
+	uint32_t hash = 0;
+	double base_s = 0;
+	int res = 0;
+
+	if (r == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		return -1;
+	}
+	printf("fleet of %u cars, %u requests each, seed=%u drop=%uppm %ukbit/s %s, "
+			"%zu bytes per car\n", cars, o->cycles, o->seed, o->drop_ppm, o->kbps,
+			idt_names[o->id_type], sizeof(sim_obd_t));
+	for (uint32_t w = 1; ; w = (w * 2 < o->workers)?w * 2:o->workers) {
+		cfg.workers = w;
+		if (fleet_run(&cfg, r) < 0) {
+			printf("%u worker(s): %u stalled, %u bad answers\n", w, r->stalled, r->bad);
+			res = -1;
+			if (r->requests == 0) {
+				break;
+			}
+		}
+		if (w == 1) {
+			base_s = r->wall_s;
+			hash = r->hash;
+			printf("%u answered, %u failed, %llu events\n", r->answered, r->failed,
+					(unsigned long long)r->events);
+		}
+		fleet_print(&cfg, r, base_s);
+		if (r->hash != hash) {
+			printf("Results DIFFER from 1 worker\n");
+			res = -1;
+		}
+		if (o->baseline != NULL) {
+			int n = snprintf(name, sizeof(name), "fleet.%u.%u.%u.%u.%u.%s.", o->seed,
+					cars, o->cycles, o->drop_ppm, o->kbps, idt_names[o->id_type]);
+			if (w == 1) {
+				snprintf(&name[n], sizeof(name) - n, "hash");
+				res |= check_hash(b, o, name, r->hash);
+			}
+			snprintf(&name[n], sizeof(name) - n, "w%u.rate", w);
+			res |= check_rate(b, o, name, r->requests / r->wall_s);
+		}
+		if (w == o->workers) {
+			break;
+		}
+	}
+	free(r);
+	return res;
+}
+
+static uint8_t *dl_image(const sim_opts_t *o, uint32_t *size)
+{
+	uint8_t *image;
+
+	if (o->image == NULL) {
+		uint32_t x = o->seed | 1;
+		image = malloc(*size);
+		for (uint32_t i = 0; image != NULL && i < *size; i++) {
+			x ^= x << 13;
+			x ^= x >> 17;
+			x ^= x << 5;
+			image[i] = x;
+		}
+		return image;
+	}
+	FILE *f = fopen(o->image, "rb");
+	if (f == NULL || fseek(f, 0, SEEK_END) < 0 || (*size = ftell(f)) == 0 ||
+		fseek(f, 0, SEEK_SET) < 0) {
+		perror(o->image);
+		if (f != NULL) {
+			fclose(f);
+		}
+		return NULL;
+	}
+	image = malloc(*size);
+	if (image != NULL && fread(image, 1, *size, f) != *size) {
+		perror(o->image);
+		free(image);
+		image = NULL;
+	}
+	fclose(f);
+	return image;
+}
+
+static int run_dl(const sim_opts_t *o, baseline_t *b, uint32_t size)
+{
+	sim_dl_cfg_t cfg = {
+			.seed = o->seed,
+			.addr = o->addr,
+			.file = o->part_file,
+			.bitrate = o->kbps * 1000,
+			.id_type = o->id_type
+	};
+	sim_dl_result_t r;
+	char name[BASELINE_NAME_LEN];
+
+	cfg.image = dl_image(o, &size);
+	if (cfg.image == NULL) {
+		return -1;
+	}
+	cfg.size = size;
+	printf("dl of %u bytes at 0x%x into %s, seed=%u %ukbit/s %s\n", size, o->addr,
+			o->part_file, o->seed, o->kbps, idt_names[o->id_type]);
+
+	double t0 = now_s();
+	int res = sim_dl_run(&cfg, &r);
+	double wall = now_s() - t0;
+	double sim = (r.end_us - r.start_us) / 1e6;
+
+	if (r.nrc_sid != 0) {
+		printf("Negative response 0x%02x to 0x%02x\n", r.nrc, r.nrc_sid);
+	}
+	printf("%u blocks of %u bytes, CRC-32 0x%08x, ECU 0x%08x, file %s\n", r.blocks,
+			r.block_len, r.crc, r.ecu_crc, r.verified?"matches":"does NOT match");
+	if (res == 0) {
+		printf("%.3f sim-s from 0x34 to 0x77: %.1f kbyte/s, %.3f wall-s\n",
+				sim, (sim > 0)?size / sim / 1000:0.0, wall);
+	}
+	printf("%u frames, hash 0x%08x\n", r.frames, r.hash);
+
+	if (o->baseline != NULL) {
+		snprintf(name, sizeof(name), "dl.%u.%u.%u.%u.%s.hash", o->seed, size,
+				o->addr, o->kbps, idt_names[o->id_type]);
+		res |= check_hash(b, o, name, r.hash);
+	}
+	free((void *)cfg.image);
+	return res;
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+			"Usage: cantp_sim [options] des|bench|fleet [CARS]|dl [SIZE]\n"
+			"  -s SEED   seed of the run, 1\n"
+			"  -n N      request cycles, 100000\n"
+			"  -d PPM    frames lost per million, 0\n"
+			"  -r KBPS   bit rate, 500\n"
+			"  -i IDT    std, ext or all (11 and 29 bit testers), std\n"
+			"  -b FILE   check the results against the baseline in FILE\n"
+			"  -u        store the results in the baseline instead\n"
+			"  -t PCT    slowdown against the baseline that still passes, 20\n"
+			"  -c CPU    core the bench runs on, 0\n"
+			"  -w N      most fleet workers, the cores\n"
+			"  -a ADDR   download address in the partition, 0\n"
+			"  -f FILE   image to download, SIZE bytes from the seed (65536)\n"
+			"  -o FILE   file holding the partition, dlsink.bin\n");
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	sim_opts_t o = {
+			.seed = 1,
+			.cycles = 100000,
+			.kbps = 500,
+			.id_type = CFG_STANDARD_ID,
+			.tolerance = 20,
+			.part_file = "dlsink.bin"
+	};
+	baseline_t *b = calloc(1, sizeof(baseline_t));
+	int opt;
+
+	while ((opt = getopt(argc, argv, "s:n:d:r:i:b:ut:c:w:a:f:o:")) != -1) {
+		switch (opt) {
+		case 's':
+			o.seed = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			o.cycles = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			o.drop_ppm = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			o.kbps = strtoul(optarg, NULL, 0);
+			break;
+		case 'i':
+			for (o.id_type = 0; o.id_type < 3; o.id_type++) {
+				if (strcmp(optarg, idt_names[o.id_type]) == 0) {
+					break;
+				}
+			}
+			if (o.id_type == 3) {
+				usage();
+			}
+			break;
+		case 'b':
+			o.baseline = optarg;
+			break;
+		case 'u':
+			o.update = 1;
+			break;
+		case 't':
+			o.tolerance = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			o.cpu = atoi(optarg);
+			break;
+		case 'w':
+			o.workers = strtoul(optarg, NULL, 0);
+			break;
+		case 'a':
+			o.addr = strtoul(optarg, NULL, 0);
+			break;
+		case 'f':
+			o.image = optarg;
+			break;
+		case 'o':
+			o.part_file = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (o.workers == 0) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		o.workers = (cpus > 0)?cpus:1;
+	}
+	if (optind >= argc || o.kbps == 0 || b == NULL ||
+		o.workers > FLEET_MAX_WORKERS) {
+		usage();
+	}
+	if (o.baseline != NULL && baseline_load(b, o.baseline) < 0) {
+		return 1;
+	}
+	if (sim_obd_setup(o.id_type) < 0) {
+		fprintf(stderr, "ID table full\n");
+		return 1;
+	}
+
+	int res;
+	if (strcmp(argv[optind], "des") == 0) {
+		res = run_des(&o, b);
+	} else if (strcmp(argv[optind], "bench") == 0) {
+		res = run_bench(&o, b);
+	} else if (strcmp(argv[optind], "fleet") == 0) {
+		uint32_t cars = (optind + 1 < argc)?strtoul(argv[optind + 1], NULL, 0):16;
+		if (cars == 0 || cars > FLEET_MAX_CARS) {
+			usage();
+		}
+		res = run_fleet(&o, b, cars);
+	} else if (strcmp(argv[optind], "dl") == 0) {
+		uint32_t size = (optind + 1 < argc)?strtoul(argv[optind + 1], NULL, 0):65536;
+		if (size == 0) {
+			usage();
+		}
+		res = run_dl(&o, b, size);
+	} else {
+		usage();
+	}
+
+	if (o.baseline != NULL && o.update) {
+		if (baseline_save(b, o.baseline) < 0) {
+			perror(o.baseline);
+			return 1;
+		}
+		printf("Baseline %s updated\n", o.baseline);
+	}
+	free(b);
+	return (res < 0)?1:0;
+}
@@ -0,0 +1,391 @@
+/*
+ * ring_check.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ *
+ * Checks the SPSC rings and the task placement of the dual-core build on
+ * the host. emu_tasks.c is built with CONFIG_CAR_EMU_DUAL_CORE and its
+ * tasks run on host threads pinned the way FreeRTOS pins them, core N on
+ * CPU N (modulo the CPUs there are):
+ *
+ *   - every task created by emu_task_create() runs on the CPU of its role,
+ *     checked when it starts and again whenever it wakes up
+ *   - a producer on the CAN core pushes sequence numbers through
+ *     spsc_ring.h to a consumer on the application core, which must see
+ *     each one once and in order
+ *   - tasks on the CAN core log through emu_logf(), the log task on the
+ *     application core must print every line not counted as dropped, in
+ *     the order each task logged them
+ *
+ *   make ring_check && ./ring_check [-n ELEMENTS] [-l LINES]
+ */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "spsc_ring.h"
+#include "emu_tasks.h"
+
+#define RING_LEN				64
+#define RING_LOG_TASKS			2
+#define RING_LOG_TOUT_S			5.0
+#define RING_CPU_CHECK_MASK		0xFFF	//checks the CPU every 4096 elements
+
+typedef struct ring_task_s {
+	pthread_t thread;
+	TaskFunction_t fn;
+	void *arg;
+	const char *name;
+	int cpu;					//-1 without affinity
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	uint32_t notified;
+	volatile uint32_t wrong_cpu;
+} ring_task_t;
+
+typedef struct ring_elem_s {
+	uint32_t seq;
+	uint32_t inv;				//~seq, a torn element does not match
+} ring_elem_t;
+
+typedef struct ring_test_s {
+	spsc_ring_t ring;
+	ring_elem_t buf[RING_LEN];
+	uint32_t n;
+	uint32_t full;				//pushes that found the ring full
+	uint32_t errors;
+} ring_test_t;
+
+static long cpus;
+static __thread ring_task_t *self;
+
+static void ring_check_cpu(ring_task_t *t)
+{
+	if (t->cpu >= 0 && sched_getcpu() != t->cpu) {
+		t->wrong_cpu++;
+	}
+}
+
+static void *ring_task_main(void *arg)
+{
+	ring_task_t *t = (ring_task_t *)arg;
+
+	self = t;
+	ring_check_cpu(t);
+	t->fn(t->arg);
+	return NULL;
+}
+
+static BaseType_t ring_task_start(TaskFunction_t fn, const char *name, void *arg,
+		TaskHandle_t *handle, int cpu)
+{
+	ring_task_t *t = calloc(1, sizeof(ring_task_t));
+	pthread_attr_t attr;
+	cpu_set_t set;
+
+	if (t == NULL) {
+		return pdFALSE;
+	}
+	t->fn = fn;
+	t->arg = arg;
+	t->name = name;
+	t->cpu = cpu;
+	pthread_mutex_init(&t->lock, NULL);
+	pthread_cond_init(&t->cond, NULL);
+	//Written before the task can run, as FreeRTOS does
+	if (handle != NULL) {
+		*handle = (TaskHandle_t)t;
+	}
+	pthread_attr_init(&attr);
+	if (cpu >= 0) {
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+	}
+	int res = pthread_create(&t->thread, &attr, ring_task_main, t);
+	pthread_attr_destroy(&attr);
+	return (res == 0)?pdPASS:pdFALSE;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name,
+		uint32_t stack_size, void *arg, UBaseType_t prio,
+		TaskHandle_t *handle, BaseType_t core)
+{
+	return ring_task_start(fn, name, arg, handle, core % cpus);
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name,
+		uint32_t stack_size, void *arg, UBaseType_t prio, TaskHandle_t *handle)
+{
+	return ring_task_start(fn, name, arg, handle, -1);
+}
+
+void xTaskNotifyGive(TaskHandle_t task)
+{
+	ring_task_t *t = (ring_task_t *)task;
+
+	pthread_mutex_lock(&t->lock);
+	t->notified++;
+	pthread_cond_signal(&t->cond);
+	pthread_mutex_unlock(&t->lock);
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks)
+{
+	ring_task_t *t = self;
+	uint32_t n;
+
+	pthread_mutex_lock(&t->lock);
+	while (t->notified == 0) {
+		pthread_cond_wait(&t->cond, &t->lock);
+	}
+	n = t->notified;
+	t->notified = clear?0:n - 1;
+	pthread_mutex_unlock(&t->lock);
+	ring_check_cpu(t);
+	return n;
+}
+
+static double now_s(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//CAN core: as can_rx.c, reserve and commit in place
+static void ring_producer(void *arg)
+{
+	ring_test_t *rt = (ring_test_t *)arg;
+
+	for (uint32_t seq = 0; seq < rt->n; seq++) {
+		ring_elem_t *e;
+		while ((e = spsc_ring_reserve(&rt->ring)) == NULL) {
+			rt->full++;
+			sched_yield();
+		}
+		e->seq = seq;
+		e->inv = ~seq;
+		spsc_ring_commit(&rt->ring);
+		if ((seq & RING_CPU_CHECK_MASK) == 0) {
+			ring_check_cpu(self);
+		}
+	}
+}
+
+//Application core: as the consumers, peek a batch and release it at once
+static void ring_consumer(void *arg)
+{
+	ring_test_t *rt = (ring_test_t *)arg;
+	uint32_t next = 0;
+
+	while (next < rt->n) {
+		uint32_t n = spsc_ring_count(&rt->ring);
+		if (n == 0) {
+			sched_yield();
+			continue;
+		}
+		for (uint32_t i = 0; i < n; i++) {
+			ring_elem_t *e = spsc_ring_peek(&rt->ring, i);
+			if (e->seq != next || e->inv != ~next) {
+				if (rt->errors++ < 10) {
+					printf("ring: element %u is %u/0x%08x\n", next, e->seq, e->inv);
+				}
+			}
+			next++;
+		}
+		spsc_ring_release(&rt->ring, n);
+		ring_check_cpu(self);
+	}
+}
+
+static void ring_logger(void *arg)
+{
+	uint32_t lines = *(uint32_t *)arg;
+	uint32_t id = (self->name[3] - '0');
+
+	for (uint32_t i = 0; i < lines; i++) {
+		emu_logf("t%u %u\n", id, i);
+		if ((i & 0x3F) == 0) {
+			ring_check_cpu(self);
+			sched_yield();
+		}
+	}
+}
+
+static void ring_join(TaskHandle_t handle)
+{
+	pthread_join(((ring_task_t *)handle)->thread, NULL);
+}
+
+static int run_ring(uint32_t n)
+{
+	ring_test_t *rt = calloc(1, sizeof(ring_test_t));
+	TaskHandle_t prod, cons;
+
+	if (rt == NULL) {
+		return -1;
+	}
+	spsc_ring_init(&rt->ring, rt->buf, sizeof(ring_elem_t), RING_LEN);
+	rt->n = n;
+
+	double t0 = now_s();
+	if (emu_task_create(ring_consumer, "ring_cons", 4096, rt, 2, EMU_CORE_APP, &cons) != pdPASS ||
+		emu_task_create(ring_producer, "ring_prod", 4096, rt, 2, EMU_CORE_CAN, &prod) != pdPASS) {
+		fprintf(stderr, "Failed to start the ring tasks\n");
+		return -1;
+	}
+	ring_join(prod);
+	ring_join(cons);
+	double wall = now_s() - t0;
+
+	printf("ring: %u elements of %zu bytes through %u slots, CAN core to "
+			"application core, %.1f M/s, full %u times, %u wrong\n", n,
+			sizeof(ring_elem_t), RING_LEN, n / wall / 1e6, rt->full, rt->errors);
+	int res = (rt->errors == 0)?0:-1;
+	free(rt);
+	return res;
+}
+
+//Counts the lines of each logger, which must come in order
+static int log_parse(FILE *f, uint32_t *errors)
+{
+	char line[EMU_LOG_LINE_LEN];
+	uint32_t next[RING_LOG_TASKS] = { 0 };
+	uint32_t id, i;
+	int total = 0;
+
+	rewind(f);
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if (sscanf(line, "t%u %u", &id, &i) != 2 || id >= RING_LOG_TASKS) {
+			continue;
+		}
+		if (i < next[id]) {
+			(*errors)++;
+		}
+		next[id] = i + 1;
+		total++;
+	}
+	return total;
+}
+
+static int run_log(uint32_t lines)
+{
+	TaskHandle_t loggers[RING_LOG_TASKS];
+	char path[] = "/tmp/ring_check_XXXXXX";
+	uint32_t errors = 0;
+	int total = 0;
+
+	int fd = mkstemp(path);
+	FILE *f = (fd >= 0)?fdopen(fd, "r"):NULL;
+	if (f == NULL) {
+		perror(path);
+		return -1;
+	}
+	//The log task prints to stdout, here into the file
+	fflush(stdout);
+	int out = dup(STDOUT_FILENO);
+	int tmp = open(path, O_WRONLY | O_APPEND);
+	dup2(tmp, STDOUT_FILENO);
+	close(tmp);
+
+	emu_log_start();
+	for (uint8_t t = 0; t < RING_LOG_TASKS; t++) {
+		static const char *names[RING_LOG_TASKS] = { "log0", "log1" };
+		if (emu_task_create(ring_logger, names[t], 4096, &lines, 2,
+				EMU_CORE_CAN, &loggers[t]) != pdPASS) {
+			loggers[t] = NULL;
+		}
+	}
+	for (uint8_t t = 0; t < RING_LOG_TASKS; t++) {
+		if (loggers[t] != NULL) {
+			ring_join(loggers[t]);
+		}
+	}
+	uint32_t sent = lines * RING_LOG_TASKS;
+	uint32_t drops = emu_log_drops();
+	//Waits for the log task to print what is left in the ring
+	for (double t0 = now_s(); now_s() - t0 < RING_LOG_TOUT_S; ) {
+		errors = 0;
+		total = log_parse(f, &errors);
+		if (total >= sent - drops) {
+			break;
+		}
+		usleep(10000);
+	}
+
+	fflush(stdout);
+	dup2(out, STDOUT_FILENO);
+	close(out);
+	fclose(f);
+	unlink(path);
+
+	printf("log: %u lines from %u tasks on the CAN core, %u printed by the log "
+			"task, %u dropped, %u out of order\n", sent, RING_LOG_TASKS, total,
+			drops, errors);
+	return (total == sent - drops && errors == 0)?0:-1;
+}
+
+//Every task made by emu_task_create() was pinned to, and ran on, its core
+static int run_placement(void)
+{
+	const emu_task_info_t *tasks;
+	uint8_t n = emu_task_list(&tasks);
+	int res = 0;
+
+	for (uint8_t i = 0; i < n; i++) {
+		ring_task_t *t = (ring_task_t *)tasks[i].handle;
+		int core = (strncmp(t->name, "ring_cons", 9) == 0 ||
+					strcmp(t->name, "log_task") == 0)?
+					(1 - CONFIG_CAR_EMU_CAN_CORE):CONFIG_CAR_EMU_CAN_CORE;
+		int ok = (t->cpu == core % cpus && t->wrong_cpu == 0);
+		printf("task %-10s core %d CPU %d, %u times elsewhere: %s\n", t->name,
+				core, t->cpu, t->wrong_cpu, ok?"ok":"FAILED");
+		res |= ok?0:-1;
+	}
+	return res;
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t n = 10000000;
+	uint32_t lines = 10000;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:l:")) != -1) {
+		switch (opt) {
+		case 'n':
+			n = strtoul(optarg, NULL, 0);
+			break;
+		case 'l':
+			lines = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "Usage: ring_check [-n ELEMENTS] [-l LINES]\n");
+			return 2;
+		}
+	}
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	cpus = (cpus > 0)?cpus:1;
+	printf("CAN core %d, application core %d, %ld CPU(s)\n",
+			CONFIG_CAR_EMU_CAN_CORE, 1 - CONFIG_CAR_EMU_CAN_CORE, cpus);
+	if (cpus < 2) {
+		printf("Both cores run on CPU 0: the cross-core ordering is NOT exercised\n");
+	}
+
+	int res = run_ring(n);
+	res |= run_log(lines);
+	res |= run_placement();
+	printf("%s\n", (res == 0)?"ok":"FAILED");
+	return (res < 0)?1:0;
+}
@@ -0,0 +1,358 @@
+/*
+ * sim.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim.h"
+
+//World run by this host thread
+static __thread sim_world_t *sim_cur;
+
+/*
+ * A task continued on another thread must not use a thread local address
+ * taken before it switched, so it is read through a call every time.
+ */
+__attribute__((noinline)) sim_world_t *sim_world(void)
+{
+	return sim_cur;
+}
+
+sim_task_t *sim_self(void)
+{
+	sim_world_t *w = sim_world();
+	return (w != NULL)?w->cur:NULL;
+}
+
+int64_t sim_now(void)
+{
+	sim_world_t *w = sim_world();
+	return (w != NULL)?w->des.now_us:0;
+}
+
+static void sim_waitq_put(sim_waitq_t *q, sim_task_t *t)
+{
+	t->next = NULL;
+	if (q->tail != NULL) {
+		q->tail->next = t;
+	} else {
+		q->head = t;
+	}
+	q->tail = t;
+}
+
+static sim_task_t *sim_waitq_get(sim_waitq_t *q)
+{
+	sim_task_t *t = q->head;
+	if (t != NULL) {
+		q->head = t->next;
+		if (q->head == NULL) {
+			q->tail = NULL;
+		}
+		t->next = NULL;
+	}
+	return t;
+}
+
+static void sim_waitq_remove(sim_waitq_t *q, sim_task_t *t)
+{
+	sim_task_t *prev = NULL;
+	for (sim_task_t *i = q->head; i != NULL; prev = i, i = i->next) {
+		if (i != t) {
+			continue;
+		}
+		if (prev != NULL) {
+			prev->next = t->next;
+		} else {
+			q->head = t->next;
+		}
+		if (q->tail == t) {
+			q->tail = prev;
+		}
+		t->next = NULL;
+		return;
+	}
+}
+
+static void sim_ready(sim_task_t *t, int res)
+{
+	des_timer_stop(&t->w->des, &t->wake);
+	t->waiting = NULL;
+	t->res = res;
+	sim_waitq_put(&t->w->ready, t);
+}
+
+static void sim_task_timeout(des_t *des, void *arg)
+{
+	sim_task_t *t = (sim_task_t *)arg;
+	int res = 0;
+
+	//A sleep has no queue and ends normally
+	if (t->waiting != NULL) {
+		sim_waitq_remove(t->waiting, t);
+		res = -1;
+	}
+	sim_ready(t, res);
+}
+
+//Switches back to the world until the task is made ready again
+static int sim_block(sim_task_t *t, sim_waitq_t *q, int64_t tout_us)
+{
+	if (tout_us >= 0 && des_timer_start(&t->w->des, &t->wake, tout_us) < 0) {
+		fprintf(stderr, "sim: %s: DES_MAX_TIMERS too small\n", t->name);
+		abort();
+	}
+	t->waiting = q;
+	if (q != NULL) {
+		sim_waitq_put(q, t);
+	}
+	swapcontext(&t->uc, &t->w->sched);
+	return t->res;
+}
+
+static void sim_task_entry(void)
+{
+	sim_task_t *t = sim_self();
+
+	t->fn(t->arg);
+	fprintf(stderr, "sim: task %s returned\n", t->name);
+	abort();
+}
+
+sim_task_t *sim_task_create(sim_world_t *w, const char *name,
+		void (*fn)(void *arg), void *arg, void *owner)
+{
+	if (w->n_tasks >= SIM_MAX_TASKS) {
+		return NULL;
+	}
+	sim_task_t *t = calloc(1, sizeof(sim_task_t));
+	if (t == NULL) {
+		return NULL;
+	}
+	t->stack = malloc(SIM_STACK_SIZE);
+	if (t->stack == NULL) {
+		free(t);
+		return NULL;
+	}
+	t->w = w;
+	t->name = name;
+	t->fn = fn;
+	t->arg = arg;
+	t->owner = owner;
+	des_timer_init(&t->wake, sim_task_timeout, t);
+	getcontext(&t->uc);
+	t->uc.uc_stack.ss_sp = t->stack;
+	t->uc.uc_stack.ss_size = SIM_STACK_SIZE;
+	t->uc.uc_link = NULL;
+	makecontext(&t->uc, sim_task_entry, 0);
+
+	w->tasks[w->n_tasks++] = t;
+	sim_waitq_put(&w->ready, t);
+	return t;
+}
+
+void sim_sleep(int64_t us)
+{
+	sim_block(sim_self(), NULL, (us > 0)?us:0);
+}
+
+void sim_sem_init(sim_sem_t *s, uint32_t count, uint32_t max)
+{
+	memset(s, 0, sizeof(sim_sem_t));
+	s->count = count;
+	s->max = max;
+}
+
+int sim_sem_take(sim_sem_t *s, int64_t tout_us)
+{
+	if (s->count > 0) {
+		s->count--;
+		return 0;
+	}
+	if (tout_us == 0) {
+		return -1;
+	}
+	return sim_block(sim_self(), &s->waiters, tout_us);
+}
+
+void sim_sem_give(sim_sem_t *s)
+{
+	sim_task_t *t = sim_waitq_get(&s->waiters);
+	if (t != NULL) {
+		sim_ready(t, 0);
+	} else if (s->count < s->max) {
+		s->count++;
+	}
+}
+
+int sim_queue_init(sim_queue_t *q, uint32_t item_size, uint16_t len)
+{
+	memset(q, 0, sizeof(sim_queue_t));
+	q->buf = malloc((size_t)item_size * len);
+	q->item_size = item_size;
+	q->len = len;
+	return (q->buf != NULL)?0:-1;
+}
+
+void sim_queue_free(sim_queue_t *q)
+{
+	free(q->buf);
+	q->buf = NULL;
+}
+
+int sim_queue_put(sim_queue_t *q, const void *item)
+{
+	if (q->n >= q->len) {
+		q->overflows++;
+		return -1;
+	}
+	uint16_t i = (q->head + q->n) % q->len;
+	memcpy(&q->buf[(size_t)i * q->item_size], item, q->item_size);
+	q->n++;
+
+	sim_task_t *t = sim_waitq_get(&q->waiters);
+	if (t != NULL) {
+		sim_ready(t, 0);
+	}
+	return 0;
+}
+
+int sim_queue_get(sim_queue_t *q, void *item, int64_t tout_us)
+{
+	//Woken by a put, but another task may have taken the item first
+	while (q->n == 0) {
+		if (tout_us == 0 || sim_block(sim_self(), &q->waiters, tout_us) < 0) {
+			return -1;
+		}
+	}
+	memcpy(item, &q->buf[(size_t)q->head * q->item_size], q->item_size);
+	q->head = (q->head + 1) % q->len;
+	q->n--;
+	return 0;
+}
+
+static void sim_timer_expired(des_t *des, void *arg)
+{
+	sim_timer_t *t = (sim_timer_t *)arg;
+	sim_world_t *w = t->w;
+
+	t->queued = 1;
+	t->next = NULL;
+	if (w->expired_tail != NULL) {
+		w->expired_tail->next = t;
+	} else {
+		w->expired = t;
+	}
+	w->expired_tail = t;
+	sim_sem_give(&w->timer_sem);
+}
+
+//Calls the expired timers one after the other, as the esp_timer task does
+static void sim_timer_task(void *arg)
+{
+	sim_world_t *w = (sim_world_t *)arg;
+
+	while (1) {
+		sim_sem_take(&w->timer_sem, SIM_FOREVER);
+		while (w->expired != NULL) {
+			sim_timer_t *t = w->expired;
+			w->expired = t->next;
+			if (w->expired == NULL) {
+				w->expired_tail = NULL;
+			}
+			t->queued = 0;
+			w->cur->owner = t->owner;
+			t->cb(t->arg);
+		}
+	}
+}
+
+void sim_timer_init(sim_timer_t *t, sim_world_t *w, void (*cb)(void *arg),
+		void *arg, void *owner)
+{
+	memset(t, 0, sizeof(sim_timer_t));
+	t->w = w;
+	t->cb = cb;
+	t->arg = arg;
+	t->owner = owner;
+	des_timer_init(&t->t, sim_timer_expired, t);
+}
+
+//Also takes back an expiry whose callback did not run yet
+void sim_timer_stop(sim_timer_t *t)
+{
+	sim_world_t *w = t->w;
+
+	des_timer_stop(&w->des, &t->t);
+	if (!t->queued) {
+		return;
+	}
+	sim_timer_t *prev = NULL;
+	for (sim_timer_t *i = w->expired; i != NULL; prev = i, i = i->next) {
+		if (i != t) {
+			continue;
+		}
+		if (prev != NULL) {
+			prev->next = t->next;
+		} else {
+			w->expired = t->next;
+		}
+		if (w->expired_tail == t) {
+			w->expired_tail = prev;
+		}
+		break;
+	}
+	t->queued = 0;
+}
+
+int sim_timer_start(sim_timer_t *t, int64_t tout_us)
+{
+	sim_timer_stop(t);
+	return des_timer_start(&t->w->des, &t->t, tout_us);
+}
+
+int sim_world_init(sim_world_t *w, uint32_t seed)
+{
+	memset(w, 0, sizeof(sim_world_t));
+	des_init(&w->des, seed);
+	sim_sem_init(&w->timer_sem, 0, 1);
+	w->timer_task = sim_task_create(w, "esp_timer", sim_timer_task, w, NULL);
+	return (w->timer_task != NULL)?0:-1;
+}
+
+void sim_world_free(sim_world_t *w)
+{
+	for (uint8_t i = 0; i < w->n_tasks; i++) {
+		free(w->tasks[i]->stack);
+		free(w->tasks[i]);
+	}
+	w->n_tasks = 0;
+}
+
+void sim_world_run(sim_world_t *w, int64_t until_us)
+{
+	sim_world_t *prev = sim_cur;
+
+	sim_cur = w;
+	while (1) {
+		sim_task_t *t;
+		while ((t = sim_waitq_get(&w->ready)) != NULL) {
+			w->cur = t;
+			w->switches++;
+			swapcontext(&w->sched, &t->uc);
+			w->cur = NULL;
+		}
+		if (w->des.n_timers == 0 || w->des.heap[0]->t_us > until_us) {
+			break;
+		}
+		des_step(&w->des);
+	}
+	if (w->des.now_us < until_us) {
+		w->des.now_us = until_us;
+	}
+	sim_cur = prev;
+}
@@ -0,0 +1,135 @@
+/*
+ * sim.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+
+#ifndef __SIM_H_
+#define __SIM_H_
+
+#include <stdint.h>
+#include <ucontext.h>
+
+#include "des.h"
+
+/*
+ * Tasks on the virtual clock of a DES world. Every task is a coroutine
+ * with its own stack; the world switches to one ready task at a time and
+ * only takes the next timer from the DES once no task is ready, so all
+ * code of a world runs in zero virtual time and in an order that depends
+ * on the seed only, never on the host scheduler. A task gives up the CPU
+ * only in the blocking calls below, whose timeouts are DES timers.
+ *
+ * A world runs on one host thread at a time but may continue on another
+ * one after sim_world_run() returned.
+ */
+#define SIM_MAX_TASKS			16
+#define SIM_STACK_SIZE			(64 * 1024)
+#define SIM_FOREVER				(-1)
+
+typedef struct sim_world_s sim_world_t;
+typedef struct sim_task_s sim_task_t;
+
+typedef struct sim_waitq_s {
+	sim_task_t *head;
+	sim_task_t *tail;
+} sim_waitq_t;
+
+struct sim_task_s {
+	ucontext_t uc;
+	sim_world_t *w;
+	const char *name;
+	void (*fn)(void *arg);
+	void *arg;
+	void *owner;			//node of the task, for calls without a context
+	uint8_t *stack;
+	des_timer_t wake;		//timeout of the current wait
+	sim_waitq_t *waiting;	//queue the task is blocked on
+	sim_task_t *next;
+	int res;				//0 woken, -1 timed out
+};
+
+typedef struct sim_sem_s {
+	uint32_t count;
+	uint32_t max;
+	sim_waitq_t waiters;
+} sim_sem_t;
+
+typedef struct sim_queue_s {
+	uint8_t *buf;
+	uint32_t item_size;
+	uint16_t len;
+	uint16_t head;
+	uint16_t n;
+	uint32_t overflows;
+	sim_waitq_t waiters;
+} sim_queue_t;
+
+/*
+ * One-shot timer whose callback runs in the world's timer task, as
+ * esp_timer callbacks run in the esp_timer task.
+ */
+typedef struct sim_timer_s {
+	des_timer_t t;
+	sim_world_t *w;
+	void (*cb)(void *arg);
+	void *arg;
+	void *owner;
+	uint8_t queued;
+	struct sim_timer_s *next;
+} sim_timer_t;
+
+struct sim_world_s {
+	des_t des;
+	ucontext_t sched;
+	sim_task_t *cur;
+	sim_waitq_t ready;
+	sim_task_t *tasks[SIM_MAX_TASKS];
+	uint8_t n_tasks;
+	sim_task_t *timer_task;
+	sim_sem_t timer_sem;
+	sim_timer_t *expired;
+	sim_timer_t *expired_tail;
+	uint64_t switches;
+};
+
+int sim_world_init(sim_world_t *w, uint32_t seed);
+void sim_world_free(sim_world_t *w);
+
+//Runs the world until no event is left before until_us of virtual time
+void sim_world_run(sim_world_t *w, int64_t until_us);
+
+//The task is started by the next sim_world_run()
+sim_task_t *sim_task_create(sim_world_t *w, const char *name,
+		void (*fn)(void *arg), void *arg, void *owner);
+
+//World run by this thread and its running task, NULL outside of a run
+sim_world_t *sim_world(void);
+sim_task_t *sim_self(void);
+
+//Virtual time of the running world in us
+int64_t sim_now(void);
+
+void sim_sleep(int64_t us);
+
+//Binary semaphores have max 1
+void sim_sem_init(sim_sem_t *s, uint32_t count, uint32_t max);
+//Returns -1 on timeout, tout_us SIM_FOREVER waits forever
+int sim_sem_take(sim_sem_t *s, int64_t tout_us);
+//Also from timer and bus callbacks
+void sim_sem_give(sim_sem_t *s);
+
+int sim_queue_init(sim_queue_t *q, uint32_t item_size, uint16_t len);
+void sim_queue_free(sim_queue_t *q);
+//Never blocks, -1 when full
+int sim_queue_put(sim_queue_t *q, const void *item);
+int sim_queue_get(sim_queue_t *q, void *item, int64_t tout_us);
+
+void sim_timer_init(sim_timer_t *t, sim_world_t *w, void (*cb)(void *arg),
+		void *arg, void *owner);
+//(Re)starts the timer
+int sim_timer_start(sim_timer_t *t, int64_t tout_us);
+void sim_timer_stop(sim_timer_t *t);
+
+#endif /* __SIM_H_ */
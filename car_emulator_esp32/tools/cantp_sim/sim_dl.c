@@ -0,0 +1,425 @@
+/*
+ * sim_dl.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+
+#include "car_emulator.h"
+#include "emu_tasks.h"
+#include "isotp_codec.h"
+#include "uds_download.h"
+#include "sim_port.h"
+#include "sim_dl.h"
+
+#define SIM_DL_RX_QUEUE_LEN		16
+#define SIM_DL_ERASED			0xFF
+
+typedef struct sim_dl_s {
+	sim_world_t w;
+	des_bus_t bus;
+	const sim_dl_cfg_t *cfg;
+	sim_dl_result_t *res;
+	uint32_t req_id;
+	uint32_t resp_id;
+	uint8_t idt;
+	//The ECU: uds_download.c sends through the node, frames reach it from ecu_rx
+	sim_node_t ecu;
+	sim_queue_t ecu_rx;			//cantp_can_frame_t
+	//The reflash tool
+	uint8_t tester_node;
+	sim_queue_t tester_rx;		//des_frame_t
+	sim_sem_t tester_tx_done;
+	sim_sem_t idle;				//never given, the tester waits there when finished
+	uint8_t *block;
+	uint8_t finished;
+	int result;
+} sim_dl_t;
+
+static FILE *sim_dl_file;
+static esp_partition_t sim_dl_part = {
+		.type = ESP_PARTITION_TYPE_DATA,
+		.subtype = 0x40,
+		.address = 0x120000,
+		.size = SIM_DL_PART_SIZE,
+		.label = UDS_DL_PARTITION
+};
+
+/*
+ * The rest of the firmware uds_download.c calls: its writer task is a
+ * task of the ECU, the partition is a host file.
+ */
+BaseType_t emu_task_create(TaskFunction_t fn, const char *name,
+		uint32_t stack_size, void *arg, UBaseType_t prio,
+		emu_core_t core, TaskHandle_t *handle)
+{
+	sim_task_t *t = sim_task_create(sim_world(), name, fn, arg, sim_self()->owner);
+
+	if (handle != NULL) {
+		*handle = (TaskHandle_t)t;
+	}
+	return (t != NULL)?pdPASS:pdFALSE;
+}
+
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+	crc = ~crc;
+	for (uint32_t i = 0; i < len; i++) {
+		crc ^= buf[i];
+		for (uint8_t b = 0; b < 8; b++) {
+			crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+		}
+	}
+	return ~crc;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type,
+		esp_partition_subtype_t subtype, const char *label)
+{
+	if (sim_dl_file == NULL || type != sim_dl_part.type ||
+		(subtype != ESP_PARTITION_SUBTYPE_ANY && subtype != sim_dl_part.subtype) ||
+		(label != NULL && strcmp(label, sim_dl_part.label) != 0)) {
+		return NULL;
+	}
+	return &sim_dl_part;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition,
+		size_t offset, size_t size)
+{
+	uint8_t erased[UDS_DL_SECTOR];
+
+	//Whole sectors, as the flash driver
+	if (partition != &sim_dl_part || (offset % UDS_DL_SECTOR) != 0 ||
+		(size % UDS_DL_SECTOR) != 0 || offset + size > partition->size ||
+		fseek(sim_dl_file, offset, SEEK_SET) < 0) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	memset(erased, SIM_DL_ERASED, sizeof(erased));
+	for (size_t off = 0; off < size; off += UDS_DL_SECTOR) {
+		if (fwrite(erased, 1, sizeof(erased), sim_dl_file) != sizeof(erased)) {
+			return ESP_FAIL;
+		}
+	}
+	return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition,
+		size_t dst_offset, const void *src, size_t size)
+{
+	if (partition != &sim_dl_part || dst_offset + size > partition->size ||
+		fseek(sim_dl_file, dst_offset, SEEK_SET) < 0) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	return (fwrite(src, 1, size, sim_dl_file) == size)?ESP_OK:ESP_FAIL;
+}
+
+//The CAN-TP library of the node gets nothing, uds_download.c takes the frames
+static int sim_dl_ecu_accept(sim_node_t *node, uint32_t id, uint8_t idt)
+{
+	return 0;
+}
+
+static void sim_dl_ecu_rx(des_t *des, void *ctx, const des_frame_t *frame)
+{
+	sim_dl_t *dl = (sim_dl_t *)ctx;
+	cantp_can_frame_t rx_frame = {
+			.id = frame->id,
+			.dlc = frame->dlc,
+			.rtr = frame->idt
+	};
+
+	//The acceptance filter of the ECU: its own responses do not come back
+	if (frame->id != dl->req_id || frame->idt != dl->idt) {
+		return;
+	}
+	memcpy(rx_frame.data_u8, frame->data, frame->dlc);
+	sim_queue_put(&dl->ecu_rx, &rx_frame);
+}
+
+//The part of the dispatcher of cantp_session.c that feeds uds_download.c
+static void sim_dl_ecu_task(void *arg)
+{
+	sim_dl_t *dl = (sim_dl_t *)arg;
+	cantp_can_frame_t frame;
+
+	if (uds_dl_init(UDS_DL_SINK_PARTITION) < 0) {
+		fprintf(stderr, "uds_dl_init() failed\n");
+		abort();
+	}
+	while (1) {
+		sim_queue_get(&dl->ecu_rx, &frame, SIM_FOREVER);
+		uds_dl_rx(&frame);
+	}
+}
+
+static void sim_dl_tester_rx(des_t *des, void *ctx, const des_frame_t *frame)
+{
+	sim_dl_t *dl = (sim_dl_t *)ctx;
+
+	if (frame->id == dl->resp_id && frame->idt == dl->idt) {
+		sim_queue_put(&dl->tester_rx, frame);
+	}
+}
+
+static void sim_dl_tester_tx_done(des_t *des, void *ctx, const des_frame_t *frame)
+{
+	sim_dl_t *dl = (sim_dl_t *)ctx;
+
+	sim_sem_give(&dl->tester_tx_done);
+}
+
+static int sim_dl_send_frame(sim_dl_t *dl, const uint8_t *data)
+{
+	des_frame_t frame = {
+			.id = dl->req_id,
+			.idt = dl->idt,
+			.dlc = 8
+	};
+
+	memcpy(frame.data, data, 8);
+	if (des_bus_send(&dl->bus, dl->tester_node, &frame) < 0) {
+		return -1;
+	}
+	return sim_sem_take(&dl->tester_tx_done, CANTP_TXQ_N_AS_US);
+}
+
+//Sends one request, in Consecutive Frames as the Flow Control of the ECU allows
+static int sim_dl_send(sim_dl_t *dl, const uint8_t *req, uint16_t len)
+{
+	isotp_tx_t tx;
+	des_frame_t rx;
+	uint8_t frame[8];
+
+	memset(&tx, 0, sizeof(isotp_tx_t));
+	if (isotp_tx_start(&tx, req, len, frame) < 0 || sim_dl_send_frame(dl, frame) < 0) {
+		return -1;
+	}
+	while (tx.state != ISOTP_IDLE) {
+		if (tx.state == ISOTP_WAIT_FC) {
+			if (sim_queue_get(&dl->tester_rx, &rx, SIM_DL_N_BS_US) < 0 ||
+				isotp_tx_fc(&tx, rx.data) < 0) {
+				return -1;
+			}
+			continue;
+		}
+		if (tx.stmin_us > 0) {
+			sim_sleep(tx.stmin_us);
+		}
+		isotp_tx_cf(&tx, frame);
+		if (sim_dl_send_frame(dl, frame) < 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+//Waits out any 0x78 for the positive response to sid, returns its length or -1
+static int sim_dl_response(sim_dl_t *dl, uint8_t sid, uint8_t *resp)
+{
+	int64_t tout_us = SIM_DL_P2_US;
+	des_frame_t rx;
+
+	while (sim_queue_get(&dl->tester_rx, &rx, tout_us) == 0) {
+		uint8_t len = rx.data[0] & 0x0F;
+		if ((rx.data[0] >> 4) != 0 || len == 0 || len > 7) {
+			continue;
+		}
+		memcpy(resp, &rx.data[1], len);
+		if (len >= 3 && resp[0] == 0x7F && resp[1] == sid) {
+			if (resp[2] == 0x78) {
+				tout_us = SIM_DL_P2X_US;
+				continue;
+			}
+			dl->res->nrc_sid = sid;
+			dl->res->nrc = resp[2];
+			return -1;
+		}
+		if (resp[0] == sid + 0x40) {
+			return len;
+		}
+	}
+	return -1;
+}
+
+static int sim_dl_request(sim_dl_t *dl, const uint8_t *req, uint16_t len, uint8_t *resp)
+{
+	if (sim_dl_send(dl, req, len) < 0) {
+		return -1;
+	}
+	return sim_dl_response(dl, req[0], resp);
+}
+
+static int sim_dl_download(sim_dl_t *dl)
+{
+	const sim_dl_cfg_t *cfg = dl->cfg;
+	sim_dl_result_t *res = dl->res;
+	uint8_t session[2] = { 0x10, 0x02 };
+	uint8_t download[11] = { 0x34, 0x00, 0x44,
+			cfg->addr >> 24, cfg->addr >> 16, cfg->addr >> 8, cfg->addr,
+			cfg->size >> 24, cfg->size >> 16, cfg->size >> 8, cfg->size };
+	uint8_t exit[1] = { 0x37 };
+	uint8_t resp[7];
+
+	if (sim_dl_request(dl, session, sizeof(session), resp) < 0) {
+		return -1;
+	}
+	res->start_us = sim_now();
+	if (sim_dl_request(dl, download, sizeof(download), resp) < 4) {
+		return -1;
+	}
+	res->block_len = (resp[2] << 8) | resp[3];
+	if (res->block_len < 3 || res->block_len > ISOTP_MAX_LEN) {
+		return -1;
+	}
+
+	uint8_t bsc = 1;
+	for (uint32_t off = 0; off < cfg->size; bsc++) {
+		uint32_t n = cfg->size - off;
+		if (n > res->block_len - 2) {
+			n = res->block_len - 2;
+		}
+		dl->block[0] = 0x36;
+		dl->block[1] = bsc;
+		memcpy(&dl->block[2], &cfg->image[off], n);
+		if (sim_dl_request(dl, dl->block, n + 2, resp) < 2 || resp[1] != bsc) {
+			return -1;
+		}
+		off += n;
+		res->blocks++;
+	}
+
+	if (sim_dl_request(dl, exit, sizeof(exit), resp) < 5) {
+		return -1;
+	}
+	res->end_us = sim_now();
+	res->ecu_crc = ((uint32_t)resp[1] << 24) | (resp[2] << 16) | (resp[3] << 8) | resp[4];
+	return (res->ecu_crc == res->crc)?0:-1;
+}
+
+static void sim_dl_tester_task(void *arg)
+{
+	sim_dl_t *dl = (sim_dl_t *)arg;
+
+	dl->result = sim_dl_download(dl);
+	dl->finished = 1;
+	sim_sem_take(&dl->idle, SIM_FOREVER);
+}
+
+//The image at addr, and erased flash up to the end of its last sector
+static int sim_dl_verify(const sim_dl_cfg_t *cfg)
+{
+	uint32_t len = (cfg->size + UDS_DL_SECTOR - 1) & ~(UDS_DL_SECTOR - 1UL);
+	uint8_t *buf = malloc(len);
+	int res = -1;
+
+	if (buf != NULL && fflush(sim_dl_file) == 0 &&
+		fseek(sim_dl_file, cfg->addr, SEEK_SET) == 0 &&
+		fread(buf, 1, len, sim_dl_file) == len &&
+		memcmp(buf, cfg->image, cfg->size) == 0) {
+		res = 0;
+		for (uint32_t i = cfg->size; i < len; i++) {
+			if (buf[i] != SIM_DL_ERASED) {
+				res = -1;
+			}
+		}
+	}
+	free(buf);
+	return res;
+}
+
+static int sim_dl_init(sim_dl_t *dl)
+{
+	const sim_dl_cfg_t *cfg = dl->cfg;
+
+	if (cfg->id_type == CFG_EXTENDED_ID) {
+		dl->req_id = OBD_PHYS_ID_EXT;
+		dl->resp_id = OBD_RESP_ID_EXT_TO(OBD_PHYS_ID_EXT);
+		dl->idt = 1;
+	} else {
+		dl->req_id = OBD_PHYS_ID_STD;
+		dl->resp_id = OBD_RESP_ID_STD;
+	}
+	dl->block = malloc(ISOTP_MAX_LEN);
+	if (dl->block == NULL || sim_world_init(&dl->w, cfg->seed) < 0) {
+		return -1;
+	}
+	des_bus_init(&dl->bus, &dl->w.des, cfg->bitrate, 0);
+	sim_sem_init(&dl->tester_tx_done, 0, 1);
+	sim_sem_init(&dl->idle, 0, 1);
+	if (sim_queue_init(&dl->ecu_rx, sizeof(cantp_can_frame_t), SIM_DL_RX_QUEUE_LEN) < 0 ||
+		sim_queue_init(&dl->tester_rx, sizeof(des_frame_t), SIM_DL_RX_QUEUE_LEN) < 0 ||
+		sim_node_init(&dl->ecu, &dl->w, &dl->bus, "ecu", NULL) < 0) {
+		return -1;
+	}
+	dl->ecu.accept = sim_dl_ecu_accept;
+	if (des_bus_attach(&dl->bus, sim_dl_ecu_rx, NULL, dl) < 0) {
+		return -1;
+	}
+	int node = des_bus_attach(&dl->bus, sim_dl_tester_rx, sim_dl_tester_tx_done, dl);
+	if (node < 0) {
+		return -1;
+	}
+	dl->tester_node = node;
+	if (sim_task_create(&dl->w, "dispatcher", sim_dl_ecu_task, dl, &dl->ecu) == NULL ||
+		sim_task_create(&dl->w, "tester", sim_dl_tester_task, dl, NULL) == NULL) {
+		return -1;
+	}
+	return 0;
+}
+
+int sim_dl_run(const sim_dl_cfg_t *cfg, sim_dl_result_t *res)
+{
+	sim_dl_t *dl = calloc(1, sizeof(sim_dl_t));
+	int run = -1;
+
+	memset(res, 0, sizeof(sim_dl_result_t));
+	res->crc = esp_rom_crc32_le(0, cfg->image, cfg->size);
+	if (dl == NULL) {
+		return -1;
+	}
+	sim_dl_file = fopen(cfg->file, "w+b");
+	if (sim_dl_file == NULL) {
+		perror(cfg->file);
+		free(dl);
+		return -1;
+	}
+	dl->cfg = cfg;
+	dl->res = res;
+	if (sim_dl_init(dl) == 0) {
+		while (!dl->finished) {
+			sim_world_run(&dl->w, dl->w.des.now_us + SIM_DL_SLICE_US);
+			if (!dl->finished && dl->w.des.n_timers == 0) {
+				//Stalled, nothing can finish the download any more
+				break;
+			}
+		}
+		if (dl->finished) {
+			run = dl->result;
+		}
+	}
+	res->frames = dl->bus.frames;
+	res->hash = dl->bus.hash;
+	if (run == 0) {
+		res->verified = (sim_dl_verify(cfg) == 0);
+		run = res->verified?0:-1;
+	}
+
+	fclose(sim_dl_file);
+	sim_dl_file = NULL;
+	sim_queue_free(&dl->ecu_rx);
+	sim_queue_free(&dl->tester_rx);
+	sim_node_free(&dl->ecu);
+	sim_world_free(&dl->w);
+	free(dl->block);
+	free(dl);
+	return run;
+}
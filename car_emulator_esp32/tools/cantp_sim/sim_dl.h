@@ -0,0 +1,60 @@
+/*
+ * sim_dl.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+
+#ifndef __SIM_DL_H_
+#define __SIM_DL_H_
+
+#include <stdint.h>
+
+#include "car_emulator.h"
+
+/*
+ * A reflash tool downloading an image into uds_download.c of the firmware
+ * on a virtual bus. The partition sink writes into a host file in place
+ * of the dlsink flash partition, so the download can be checked byte for
+ * byte. The tester opens a programming session, requests the download at
+ * addr, sends the image in TransferData blocks of the length the ECU asks
+ * for, segmented with isotp_codec, and checks the CRC-32 returned by
+ * RequestTransferExit.
+ *
+ * Flash erase and write take no virtual time, so the result is the time
+ * of the transport and of uds_download.c alone.
+ */
+#define SIM_DL_PART_SIZE		0x2E0000	//dlsink in partitions.csv
+#define SIM_DL_P2_US			50000
+#define SIM_DL_P2X_US			5000000
+#define SIM_DL_N_BS_US			1000000
+#define SIM_DL_SLICE_US			100000
+
+typedef struct sim_dl_cfg_s {
+	uint32_t seed;
+	const uint8_t *image;
+	uint32_t size;
+	uint32_t addr;			//offset into the partition
+	const char *file;		//holding the partition
+	uint32_t bitrate;
+	cfg_can_idt_t id_type;	//CFG_STANDARD_ID or CFG_EXTENDED_ID
+} sim_dl_cfg_t;
+
+typedef struct sim_dl_result_s {
+	uint32_t blocks;
+	uint32_t block_len;		//maxNumberOfBlockLength of the 0x74 response
+	uint32_t crc;			//of the image
+	uint32_t ecu_crc;		//sent with the 0x77 response
+	uint8_t nrc_sid;		//request which got a negative response, 0 when none
+	uint8_t nrc;
+	uint8_t verified;		//the file holds the image at addr
+	int64_t start_us;		//0x34 sent
+	int64_t end_us;			//0x77 received
+	uint32_t frames;
+	uint32_t hash;			//of the bus trace
+} sim_dl_result_t;
+
+//Returns -1 when the download failed or the file does not hold the image
+int sim_dl_run(const sim_dl_cfg_t *cfg, sim_dl_result_t *res);
+
+#endif /* __SIM_DL_H_ */
@@ -0,0 +1,285 @@
+/*
+ * sim_obd.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "can-tp.h"
+#include "obd.h"
+#include "car_emulator.h"
+#include "cantp_txq.h"
+#include "emu_config.h"
+#include "emu_mem.h"
+#include "obd_id_table.h"
+#include "sim_obd.h"
+
+typedef struct sim_obd_req_s {
+	uint8_t service;
+	uint8_t pid;
+} sim_obd_req_t;
+
+//What a scan tool asks on connecting and then keeps polling
+static const sim_obd_req_t sim_obd_reqs[] = {
+	{ 1, 0x00 },
+	{ 1, 0x0C },
+	{ 1, 0x0D },
+	{ 1, 0x11 },
+	{ 9, 0x00 },
+	{ 9, 0x02 }
+};
+
+static cfg_can_idt_t sim_obd_id_type;
+
+//The builtin profile of vehicle_profile.c, which needs the flash
+static const vehicle_profile_t sim_profile = {
+	.name = "builtin",
+	.vin = { 'E','S','P','3','2','O','B','D','2','E','M','U','L','A','T','O','R' },
+	.pids01 = { 0x00, 0x18, 0x80, 0x00 },	//0C, 0D, 11
+	.pids09 = { 0x40, 0x00, 0x00, 0x00 },	//02
+	.speed = 100,
+	.rpm = 2500,
+	.throttle = 30
+};
+
+/*
+ * The rest of the firmware car_emulator.c calls: there is no flash, NVS,
+ * boot timing or memory report in the simulator.
+ */
+const vehicle_profile_t *volatile vehicle_profile = &sim_profile;
+
+void emu_boot_mark_response(void)
+{
+}
+
+int emu_config_save_vehicle(const vehicle_state_t *vs)
+{
+	return 0;
+}
+
+void emu_mem_rx_alloc(uint32_t len)
+{
+}
+
+void emu_mem_rx_free(uint32_t len)
+{
+}
+
+//The response the car has to give, returns its length
+static uint16_t sim_obd_expect(const sim_obd_t *s, const sim_obd_req_t *req, uint8_t *resp)
+{
+	const vehicle_profile_t *p = &s->profile;
+
+	resp[0] = 0x40 + req->service;
+	resp[1] = req->pid;
+	if (req->service == 9) {
+		if (req->pid == 0x00) {
+			memcpy(&resp[2], p->pids09, 4);
+			return 6;
+		}
+		resp[2] = 1;
+		memcpy(&resp[3], p->vin, OBD2_VIN_LEN);
+		return 3 + OBD2_VIN_LEN;
+	}
+	switch (req->pid) {
+		case 0x0C:
+			obdRevConvert_0C(s->state.rpm, &resp[2], &resp[3], 0, 0);
+			return 4;
+		case 0x0D:
+			obdRevConvert_0D(s->state.speed, &resp[2], 0, 0, 0);
+			return 3;
+		case 0x11:
+			obdRevConvert_11(s->state.throttle, &resp[2], 0, 0, 0);
+			return 3;
+		default:
+			memcpy(&resp[2], &p->pids01[req->pid / 8], 4);
+			return 6;
+	}
+}
+
+//cantp_received_cb() of cantp_esp32.c
+static void sim_car_received(sim_node_t *node, uint32_t id, uint8_t idt,
+		uint8_t *data, uint16_t len)
+{
+	emulator_ctx_t *ectx = (emulator_ctx_t *)node->ctx.cb_ctx;
+
+	ectx->id = id;
+	ectx->idt = idt;
+	ectx->len = len;
+	ectx->rx_us = sim_now();
+	ectx->data = malloc(len);
+	if (ectx->data == NULL) {
+		return;
+	}
+	memcpy(ectx->data, data, len);
+	can_check_rx_frame(ectx);
+}
+
+//The dispatcher only hands on what the ID table serves
+static int sim_car_accept(sim_node_t *node, uint32_t id, uint8_t idt)
+{
+	return obd_id_lookup(id, idt) != NULL;
+}
+
+static void sim_tester_received(sim_node_t *node, uint32_t id, uint8_t idt,
+		uint8_t *data, uint16_t len)
+{
+	sim_obd_t *s = (sim_obd_t *)node->arg;
+
+	s->resp_len = (len < SIM_OBD_RESP_MAX)?len:SIM_OBD_RESP_MAX;
+	memcpy(s->resp, data, s->resp_len);
+	sim_sem_give(&s->resp_sem);
+}
+
+static int sim_tester_accept(sim_node_t *node, uint32_t id, uint8_t idt)
+{
+	return idt ? (id == OBD_RESP_ID_EXT) : (id == OBD_RESP_ID_STD);
+}
+
+//Waits for the answer to req, 1 when it came
+static int sim_obd_wait(sim_obd_t *s, const uint8_t *exp, uint16_t exp_len)
+{
+	int64_t end = sim_now() + SIM_OBD_RESP_TOUT_US;
+
+	while (sim_now() < end) {
+		if (sim_sem_take(&s->resp_sem, end - sim_now()) < 0) {
+			break;
+		}
+		if (s->resp_len < 2 || s->resp[0] != exp[0] || s->resp[1] != exp[1]) {
+			s->stats.stale++;
+			continue;
+		}
+		if (s->resp_len != exp_len || memcmp(s->resp, exp, exp_len) != 0) {
+			s->stats.bad++;
+		} else {
+			s->stats.responses++;
+		}
+		return 1;
+	}
+	return 0;
+}
+
+static void sim_tester_task(void *arg)
+{
+	sim_obd_t *s = (sim_obd_t *)arg;
+	des_t *des = &s->w.des;
+	uint8_t exp[SIM_OBD_RESP_MAX];
+
+	while (s->stats.cycles < s->cycles) {
+		const sim_obd_req_t *req = &sim_obd_reqs[des_rand(des) %
+								(sizeof(sim_obd_reqs) / sizeof(sim_obd_reqs[0]))];
+		uint8_t idt = (s->cfg.id_type == CFG_MIXED_ID)?(des_rand(des) & 1):
+						(s->cfg.id_type == CFG_EXTENDED_ID);
+		//One in four requests physical
+		uint8_t phys = (des_rand(des) & 3) == 0;
+		uint32_t id = idt ? (phys ? OBD_PHYS_ID_EXT : OBD_FUNC_ID_EXT) :
+						(phys ? OBD_PHYS_ID_STD : OBD_FUNC_ID_STD);
+		uint8_t data[2] = { req->service, req->pid };
+		uint16_t exp_len = sim_obd_expect(s, req, exp);
+		uint8_t answered = 0;
+
+		for (uint8_t i = 0; i <= SIM_OBD_RETRIES && !answered; i++) {
+			if (i > 0) {
+				s->stats.retries++;
+			}
+			s->stats.requests++;
+			sim_sem_take(&s->resp_sem, 0);
+			cantp_send_async(&s->tester.ctx, id, idt, data, sizeof(data),
+								CANTP_TXQ_P2_US, NULL, NULL);
+			answered = sim_obd_wait(s, exp, exp_len);
+		}
+		if (!answered) {
+			s->stats.failed++;
+		}
+		s->stats.cycles++;
+		sim_sleep(des_rand_range(des, 0, SIM_OBD_GAP_US));
+	}
+	s->finished = 1;
+	sim_sem_take(&s->idle, SIM_FOREVER);
+}
+
+int sim_obd_setup(cfg_can_idt_t id_type)
+{
+	emulator_cfg_t cfg = {
+			.boadrate = CFG_500KBPS,
+			.id_type = id_type
+	};
+
+	sim_obd_id_type = id_type;
+	vehicle_state.speed = vehicle_profile->speed;
+	vehicle_state.rpm = vehicle_profile->rpm;
+	vehicle_state.throttle = vehicle_profile->throttle;
+	return car_emu_id_table_build(&cfg);
+}
+
+int sim_obd_init(sim_obd_t *s, uint32_t seed, uint32_t bitrate,
+		uint32_t drop_ppm, uint32_t cycles)
+{
+	memset(s, 0, sizeof(sim_obd_t));
+	if (sim_world_init(&s->w, seed) < 0) {
+		return -1;
+	}
+	des_bus_init(&s->bus, &s->w.des, bitrate, drop_ppm);
+	s->cycles = cycles;
+	s->cfg.boadrate = CFG_500KBPS;
+	s->cfg.id_type = sim_obd_id_type;
+
+	s->profile = *vehicle_profile;
+	s->state.speed = s->profile.speed;
+	s->state.rpm = s->profile.rpm;
+	s->state.throttle = s->profile.throttle;
+	s->ectx.cfg = &s->cfg;
+	s->ectx.cantp_ctx = &s->car.ctx;
+	s->ectx.profile = &s->profile;
+	s->ectx.state = &s->state;
+	if (sim_node_init(&s->car, &s->w, &s->bus, "car", &s->ectx) < 0) {
+		return -1;
+	}
+	s->car.accept = sim_car_accept;
+	s->car.received = sim_car_received;
+	s->car.arg = s;
+
+	sim_sem_init(&s->resp_sem, 0, 1);
+	sim_sem_init(&s->idle, 0, 1);
+	if (sim_node_init(&s->tester, &s->w, &s->bus, "tester", NULL) < 0) {
+		return -1;
+	}
+	s->tester.accept = sim_tester_accept;
+	s->tester.received = sim_tester_received;
+	s->tester.arg = s;
+	return (sim_task_create(&s->w, "tester", sim_tester_task, s, &s->tester) != NULL)?0:-1;
+}
+
+void sim_obd_vehicle(sim_obd_t *s, uint32_t n)
+{
+	char serial[8];
+
+	snprintf(serial, sizeof(serial), "%06u", n % 1000000);
+	memcpy(&s->profile.vin[OBD2_VIN_LEN - 6], serial, 6);
+	s->state.rpm = des_rand_range(&s->w.des, 800, 6000);
+	s->state.speed = des_rand_range(&s->w.des, 0, 200);
+	s->state.throttle = des_rand_range(&s->w.des, 0, 100);
+}
+
+void sim_obd_free(sim_obd_t *s)
+{
+	sim_node_free(&s->car);
+	sim_node_free(&s->tester);
+	sim_world_free(&s->w);
+}
+
+int sim_obd_run(sim_obd_t *s, int64_t slice_us)
+{
+	sim_world_run(&s->w, s->w.des.now_us + slice_us);
+	if (s->finished) {
+		return 1;
+	}
+	//Nothing left that could wake a task
+	return (s->w.des.n_timers == 0)?-1:0;
+}
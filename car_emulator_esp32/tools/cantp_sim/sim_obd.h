@@ -0,0 +1,81 @@
+/*
+ * sim_obd.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+
+#ifndef __SIM_OBD_H_
+#define __SIM_OBD_H_
+
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "car_emulator.h"
+#include "vehicle_profile.h"
+#include "sim.h"
+#include "sim_port.h"
+
+/*
+ * One car and one scan tool on a virtual bus. The car is the emulator's
+ * responder: an emulator_ctx_t behind a CAN-TP node, answering through
+ * can_check_rx_frame() of car_emulator.c. The tester polls Service 01
+ * and 09 PIDs, checks every answer against the profile and the vehicle
+ * state, and repeats a request that got no answer within
+ * SIM_OBD_RESP_TOUT_US, at most SIM_OBD_RETRIES times.
+ */
+#define SIM_OBD_RESP_TOUT_US		150000	//P2 and a VIN at 125 kbit/s
+#define SIM_OBD_RETRIES				3
+#define SIM_OBD_GAP_US				2000	//longest pause between requests
+#define SIM_OBD_RESP_MAX			64
+#define SIM_OBD_SLICE_US			100000
+
+typedef struct sim_obd_stats_s {
+	uint32_t cycles;			//requests answered or given up
+	uint32_t requests;			//sent, repeated ones included
+	uint32_t responses;			//matching the request
+	uint32_t retries;
+	uint32_t failed;			//no answer after all retries
+	uint32_t stale;				//answer to an earlier request
+	uint32_t bad;				//right request, wrong content
+} sim_obd_stats_t;
+
+typedef struct sim_obd_s {
+	sim_world_t w;
+	des_bus_t bus;
+	uint32_t cycles;			//to run
+	uint8_t finished;
+	//The car
+	sim_node_t car;
+	emulator_ctx_t ectx;
+	emulator_cfg_t cfg;
+	vehicle_profile_t profile;
+	vehicle_state_t state;
+	//The scan tool
+	sim_node_t tester;
+	sim_sem_t resp_sem;
+	sim_sem_t idle;				//never given, the tester waits there when finished
+	uint8_t resp[SIM_OBD_RESP_MAX];
+	uint16_t resp_len;
+	sim_obd_stats_t stats;
+} sim_obd_t;
+
+//Fills the ID table of car_emulator.c and vehicle_state, once for all worlds
+int sim_obd_setup(cfg_can_idt_t id_type);
+
+int sim_obd_init(sim_obd_t *s, uint32_t seed, uint32_t bitrate,
+		uint32_t drop_ppm, uint32_t cycles);
+void sim_obd_free(sim_obd_t *s);
+
+//Makes car n of a fleet: own serial number in the VIN and own vehicle state
+void sim_obd_vehicle(sim_obd_t *s, uint32_t n);
+
+/*
+ * Runs the world for slice_us of virtual time. Returns 1 once all cycles
+ * are done, -1 when every task waits for something that never comes.
+ */
+int sim_obd_run(sim_obd_t *s, int64_t slice_us);
+
+#endif /* __SIM_OBD_H_ */
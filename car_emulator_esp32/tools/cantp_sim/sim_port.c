@@ -0,0 +1,367 @@
+/*
+ * sim_port.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_timer.h"
+
+#include "can-tp.h"
+#include "cantp_esp32.h"
+#include "cantp_txq.h"
+#include "sim_port.h"
+
+//As in cantp_txq.c
+#define CANTP_SF_MAX_LEN	7
+
+static sim_node_t *sim_node_self(void)
+{
+	return (sim_node_t *)sim_self()->owner;
+}
+
+int64_t esp_timer_get_time(void)
+{
+	return sim_now();
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+	sim_sleep((int64_t)ticks * portTICK_PERIOD_MS * 1000);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+	return (TaskHandle_t)sim_self();
+}
+
+static int64_t sim_ticks_us(TickType_t ticks)
+{
+	return (ticks == portMAX_DELAY)?SIM_FOREVER:(int64_t)ticks * portTICK_PERIOD_MS * 1000;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t len, UBaseType_t item_size)
+{
+	sim_queue_t *q = malloc(sizeof(sim_queue_t));
+
+	if (q != NULL && sim_queue_init(q, item_size, len) < 0) {
+		free(q);
+		q = NULL;
+	}
+	return (QueueHandle_t)q;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+	return (sim_queue_put((sim_queue_t *)queue, item) == 0)?pdTRUE:pdFALSE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+	return (sim_queue_get((sim_queue_t *)queue, item, sim_ticks_us(ticks)) == 0)?pdTRUE:pdFALSE;
+}
+
+//Logging is off in the simulator
+void print_cantp_frame(cantp_frame_t cantp_frame)
+{
+}
+
+void cantp_usleep(uint32_t tout_us)
+{
+	sim_sleep(tout_us);
+}
+
+int cantp_rcvr_params_init(cantp_rxtx_status_t *ctx, cantp_params_t *par, char *name)
+{
+	ctx->params = par;
+	ctx->params->st_min = 0;
+	ctx->params->block_size = 0;
+	return 0;
+}
+
+void cantp_received_cb(cantp_rxtx_status_t *ctx,
+		uint32_t id, uint8_t idt, uint8_t *data, uint8_t len)
+{
+	sim_node_t *node = sim_node_from_ctx(ctx);
+	uint16_t full_len = len;
+
+	//The contract passes 8 bits, a multi-frame message has its first frame length
+	if (node->rx_ff_len > len && (uint8_t)node->rx_ff_len == len) {
+		full_len = node->rx_ff_len;
+	}
+	node->rx_ff_len = 0;
+	if (node->received != NULL) {
+		node->received(node, id, idt, data, full_len);
+	}
+}
+
+int cantp_rcvr_rx_ff_cb(uint32_t id, uint8_t idt, uint8_t **data, uint16_t len)
+{
+	sim_node_t *node = sim_node_self();
+
+	*data = NULL;
+	if (node->accept != NULL && !node->accept(node, id, idt)) {
+		node->stats.ff_rejected++;
+		return -1;
+	}
+	//Allocated as main.c does, the buffer is the library's from here on
+	node->rx_ff_len = len;
+	*data = malloc(len);
+	return (*data != NULL)?0:-1;
+}
+
+void cantp_sndr_result_cb(int result)
+{
+	sim_node_t *node = sim_node_self();
+
+	node->sndr_result = result;
+	sim_sem_give(&node->sndr_done);
+}
+
+void cantp_sndr_tx_done_cb(void)
+{
+}
+
+int cantp_timer_start(void *timer, char *name, long tout_us)
+{
+	return sim_timer_start((sim_timer_t *)timer, tout_us);
+}
+
+void cantp_timer_stop(void *timer)
+{
+	sim_timer_stop((sim_timer_t *)timer);
+}
+
+int cantp_sndr_state_sem_take(cantp_rxtx_status_t *ctx, uint32_t tout_us)
+{
+	return sim_sem_take((sim_sem_t *)ctx->sndr.state_sem,
+			(tout_us != 0)?(int64_t)tout_us:SIM_FOREVER);
+}
+
+void cantp_sndr_state_sem_give(cantp_rxtx_status_t *ctx)
+{
+	sim_sem_give((sim_sem_t *)ctx->sndr.state_sem);
+}
+
+int cantp_can_rx(cantp_can_frame_t *rx_frame, uint32_t tout_us)
+{
+	sim_node_t *node = sim_node_self();
+
+	return sim_queue_get(&node->rx_queue, rx_frame,
+			(tout_us != 0)?(int64_t)tout_us:SIM_FOREVER);
+}
+
+static void sim_tx_nb_end(sim_node_t *node)
+{
+	if (node->tx_nb_owner != NULL && node->tx_nb_owner == sim_self()) {
+		node->tx_nb_owner = NULL;
+		sim_sem_give(&node->tx_lock);
+	}
+}
+
+static int sim_tx_begin(sim_node_t *node, uint32_t id, uint8_t idt,
+		uint8_t dlc, uint8_t *data)
+{
+	des_frame_t frame = {
+			.id = id,
+			.idt = idt,
+			.dlc = dlc
+	};
+
+	memcpy(frame.data, data, dlc);
+	//Sent again without waiting for the previous frame
+	sim_tx_nb_end(node);
+	sim_sem_take(&node->tx_lock, SIM_FOREVER);
+	//A TX done nobody waited for
+	sim_sem_take(&node->tx_done, 0);
+	if (des_bus_send(node->bus, node->bus_node, &frame) < 0) {
+		sim_sem_give(&node->tx_lock);
+		return -1;
+	}
+	node->stats.tx_frames++;
+	return 0;
+}
+
+static int sim_tx_wait(sim_node_t *node, long tout_us)
+{
+	if (sim_sem_take(&node->tx_done, (tout_us > 0)?tout_us:CANTP_TXQ_N_AS_US) < 0) {
+		node->stats.tx_timeouts++;
+		return -1;
+	}
+	return 0;
+}
+
+int cantp_can_tx_nb(uint32_t id, uint8_t idt, uint8_t dlc, uint8_t *data)
+{
+	sim_node_t *node = sim_node_self();
+
+	if (sim_tx_begin(node, id, idt, dlc, data) < 0) {
+		return -1;
+	}
+	node->tx_nb_owner = sim_self();
+	return 0;
+}
+
+int cantp_sndr_wait_tx_done(cantp_rxtx_status_t *ctx, uint32_t tout_us)
+{
+	sim_node_t *node = sim_node_from_ctx(ctx);
+
+	int res = sim_tx_wait(node, tout_us);
+	sim_tx_nb_end(node);
+	return res;
+}
+
+//No TX scheduler between the nodes, the bus arbitrates
+int cantp_can_tx_deadline(uint32_t id, uint8_t idt, uint8_t dlc, uint8_t *data,
+		long tout_us, int64_t deadline_us)
+{
+	sim_node_t *node = sim_node_self();
+
+	if (sim_tx_begin(node, id, idt, dlc, data) < 0) {
+		return -1;
+	}
+	int res = sim_tx_wait(node, tout_us);
+	sim_sem_give(&node->tx_lock);
+	return res;
+}
+
+int cantp_can_tx(uint32_t id, uint8_t idt, uint8_t dlc, uint8_t *data, long tout_us)
+{
+	return cantp_can_tx_deadline(id, idt, dlc, data, tout_us, 0);
+}
+
+int cantp_send_async(cantp_rxtx_status_t *ctx, uint32_t id, uint8_t idt,
+		const uint8_t *data, uint16_t len, uint32_t deadline_us,
+		cantp_send_done_cb_t cb, void *cb_arg)
+{
+	sim_node_t *node = sim_node_from_ctx(ctx);
+	cantp_txq_msg_t msg = {
+			.ctx = ctx,
+			.id = id,
+			.idt = idt,
+			.len = len,
+			.queued_us = sim_now(),
+			.deadline_us = sim_now() + deadline_us,
+			.cb = cb,
+			.cb_arg = cb_arg
+	};
+
+	if (len > CANTP_TXQ_MSG_MAX) {
+		return -1;
+	}
+	memcpy(msg.data, data, len);
+	return sim_queue_put(&node->tx_queue, &msg);
+}
+
+//cantp_txq_sf_task() and cantp_txq_mf_task() of one session
+static void sim_node_tx_task(void *arg)
+{
+	sim_node_t *node = (sim_node_t *)arg;
+	cantp_txq_msg_t msg;
+
+	while (1) {
+		sim_queue_get(&node->tx_queue, &msg, SIM_FOREVER);
+
+		int result = -1;
+		if (msg.len <= CANTP_SF_MAX_LEN) {
+			uint8_t frame[8] = { 0 };
+			frame[0] = msg.len;		//N_PCI: single frame, length
+			memcpy(&frame[1], msg.data, msg.len);
+			result = cantp_can_tx_deadline(msg.id, msg.idt, 8, frame,
+										CANTP_TXQ_N_AS_US, msg.deadline_us);
+		} else {
+			//Drop a result left over from a transfer that timed out
+			sim_sem_take(&node->sndr_done, 0);
+			if (cantp_send(msg.ctx, msg.id, msg.idt, msg.data, msg.len) >= 0 &&
+				sim_sem_take(&node->sndr_done, CANTP_TXQ_MF_TOUT_MS * 1000) == 0) {
+				result = (node->sndr_result == CANTP_RESULT_N_OK)?0:-1;
+			}
+		}
+		if (result == 0) {
+			node->stats.sent++;
+		} else {
+			node->stats.send_failed++;
+		}
+		if (msg.cb != NULL) {
+			msg.cb(result, msg.cb_arg);
+		}
+	}
+}
+
+static void sim_node_rx(des_t *des, void *ctx, const des_frame_t *frame)
+{
+	sim_node_t *node = (sim_node_t *)ctx;
+	cantp_can_frame_t rx_frame = {
+			.id = frame->id,
+			.dlc = frame->dlc,
+			.rtr = frame->idt
+	};
+
+	if (node->accept != NULL && !node->accept(node, frame->id, frame->idt)) {
+		return;
+	}
+	memcpy(rx_frame.data_u8, frame->data, frame->dlc);
+	if (sim_queue_put(&node->rx_queue, &rx_frame) < 0) {
+		node->stats.rx_overflows++;
+		return;
+	}
+	node->stats.rx_frames++;
+}
+
+static void sim_node_tx_done(des_t *des, void *ctx, const des_frame_t *frame)
+{
+	sim_node_t *node = (sim_node_t *)ctx;
+
+	sim_sem_give(&node->tx_done);
+}
+
+int sim_node_init(sim_node_t *node, sim_world_t *w, des_bus_t *bus,
+		const char *name, void *cb_ctx)
+{
+	memset(node, 0, sizeof(sim_node_t));
+	node->w = w;
+	node->bus = bus;
+	node->name = name;
+	if (sim_queue_init(&node->rx_queue, sizeof(cantp_can_frame_t),
+							SIM_NODE_RX_QUEUE_LEN) < 0 ||
+		sim_queue_init(&node->tx_queue, sizeof(cantp_txq_msg_t),
+							SIM_NODE_TX_QUEUE_LEN) < 0) {
+		return -1;
+	}
+	sim_sem_init(&node->state_sem, 0, 1);
+	sim_sem_init(&node->tx_lock, 1, 1);
+	sim_sem_init(&node->tx_done, 0, 1);
+	sim_sem_init(&node->sndr_done, 0, 1);
+
+	int bus_node = des_bus_attach(bus, sim_node_rx, sim_node_tx_done, node);
+	if (bus_node < 0) {
+		return -1;
+	}
+	node->bus_node = bus_node;
+
+	//As cantp_session_table_init() sets up a session
+	node->ctx.sndr.state_sem = (void *)&node->state_sem;
+	node->ctx.cb_ctx = cb_ctx;
+	sim_timer_init(&node->sndr_timer, w, cantp_sndr_t_cb, (void *)&node->ctx, node);
+	cantp_set_sndr_timer_ptr(&node->sndr_timer, &node->ctx);
+	cantp_rcvr_params_init(&node->ctx, &node->params, (char *)name);
+
+	if (sim_task_create(w, "can_task", cantp_sndr_task, &node->ctx, node) == NULL ||
+		sim_task_create(w, "cantp_tx", sim_node_tx_task, node, node) == NULL ||
+		sim_task_create(w, "cantp_rx", cantp_rx_task, &node->ctx, node) == NULL) {
+		return -1;
+	}
+	return 0;
+}
+
+void sim_node_free(sim_node_t *node)
+{
+	sim_queue_free(&node->rx_queue);
+	sim_queue_free(&node->tx_queue);
+}
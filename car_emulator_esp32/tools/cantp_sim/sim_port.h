@@ -0,0 +1,80 @@
+/*
+ * sim_port.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+
+#ifndef __SIM_PORT_H_
+#define __SIM_PORT_H_
+
+#include <stdint.h>
+
+#include "can-tp.h"
+#include "cantp_txq.h"
+#include "des.h"
+#include "sim.h"
+
+/*
+ * CAN-TP port of the simulator: the functions cantp_esp32.c implements
+ * for the firmware, on sim tasks and a DES bus. A node is one CAN-TP
+ * context with the tasks a firmware session has: the library's sender
+ * and receiver tasks and a TX task sending cantp_send_async() messages,
+ * single frames straight and longer ones through cantp_send().
+ *
+ * The CAN-TP timeouts (the sender timer, cantp_usleep(), the RX and TX
+ * done waits) all run on the virtual clock.
+ */
+#define SIM_NODE_RX_QUEUE_LEN		16
+#define SIM_NODE_TX_QUEUE_LEN		4
+
+typedef struct sim_node_s sim_node_t;
+
+typedef struct sim_node_stats_s {
+	uint32_t rx_frames;
+	uint32_t rx_overflows;		//receiver queue full
+	uint32_t tx_frames;
+	uint32_t tx_timeouts;		//no TX done within the timeout
+	uint32_t ff_rejected;
+	uint32_t sent;				//cantp_send_async() messages done
+	uint32_t send_failed;
+} sim_node_stats_t;
+
+struct sim_node_s {
+	sim_world_t *w;
+	des_bus_t *bus;
+	uint8_t bus_node;
+	const char *name;
+	cantp_rxtx_status_t ctx;
+	cantp_params_t params;
+	sim_timer_t sndr_timer;
+	sim_sem_t state_sem;
+	sim_queue_t rx_queue;
+	sim_queue_t tx_queue;		//cantp_txq_msg_t
+	//Bus owner as in cantp_esp32.c: only one frame of the node is sent at a time
+	sim_sem_t tx_lock;
+	sim_task_t *tx_nb_owner;
+	sim_sem_t tx_done;
+	sim_sem_t sndr_done;		//cantp_sndr_result_cb() of a cantp_send()
+	int sndr_result;
+	uint16_t rx_ff_len;			//of the message being received, see cantp_received_cb()
+	sim_node_stats_t stats;
+	//Frames the node receives, on a real bus the acceptance filter
+	int (*accept)(sim_node_t *node, uint32_t id, uint8_t idt);
+	//cantp_received_cb() of the node
+	void (*received)(sim_node_t *node, uint32_t id, uint8_t idt,
+			uint8_t *data, uint16_t len);
+	void *arg;
+};
+
+//Sets up the context and starts its tasks, cb_ctx as ctx.cb_ctx
+int sim_node_init(sim_node_t *node, sim_world_t *w, des_bus_t *bus,
+		const char *name, void *cb_ctx);
+void sim_node_free(sim_node_t *node);
+
+static inline sim_node_t *sim_node_from_ctx(cantp_rxtx_status_t *ctx)
+{
+	return (sim_node_t *)((uint8_t *)ctx - __builtin_offsetof(sim_node_t, ctx));
+}
+
+#endif /* __SIM_PORT_H_ */
@@ -0,0 +1,155 @@
+#!/usr/bin/env python3
+#
+# dbc2c.py
+#
+#  Created on: Oct 19, 2026
+#      Author: refo
+#
+# Compiles the cyclic messages of a DBC file into the layout tables used by
+# cyclic_tx.c (see dbc_tables.h). Only messages with a GenMsgCycleTime are
+# emitted. The value of a signal comes from the emulator vehicle state named
+# by its "EmuSource" attribute, otherwise GenSigStartValue (raw) is sent.
+#
+#   tools/dbc2c.py dbc/vehicle.dbc main/dbc_tables.c
+#
+import re
+import sys
+
+SOURCES = {
+    '': 'DBC_SRC_CONST',
+    'speed': 'DBC_SRC_SPEED',
+    'rpm': 'DBC_SRC_RPM',
+    'throttle': 'DBC_SRC_THROTTLE',
+    'running': 'DBC_SRC_RUNNING',
+    'counter': 'DBC_SRC_COUNTER',
+}
+
+RE_BO = re.compile(r'^BO_\s+(\d+)\s+(\w+)\s*:\s*(\d+)\s+(\w+)')
+RE_SG = re.compile(r'^SG_\s+(\w+)\s*(?:[Mm]\d*\s*)?:\s*(\d+)\|(\d+)@([01])([+-])\s*'
+                   r'\(([^,]+),([^)]+)\)\s*\[([^|]*)\|([^\]]*)\]')
+RE_CYCLE = re.compile(r'^BA_\s+"GenMsgCycleTime"\s+BO_\s+(\d+)\s+(\d+)\s*;')
+RE_START = re.compile(r'^BA_\s+"GenSigStartValue"\s+SG_\s+(\d+)\s+(\w+)\s+([-+.\deE]+)\s*;')
+RE_SOURCE = re.compile(r'^BA_\s+"EmuSource"\s+SG_\s+(\d+)\s+(\w+)\s+"(\w*)"\s*;')
+
+
+def fail(lineno, msg):
+    sys.exit('dbc2c: line %d: %s' % (lineno, msg))
+
+
+def parse(path):
+    messages = {}
+    order = []
+    msg = None
+    with open(path) as f:
+        for lineno, line in enumerate(f, 1):
+            line = line.strip()
+            m = RE_BO.match(line)
+            if m:
+                raw_id = int(m.group(1))
+                msg = {
+                    'raw_id': raw_id,
+                    'id': raw_id & 0x1FFFFFFF,
+                    'idt': 1 if raw_id & 0x80000000 else 0,
+                    'name': m.group(2),
+                    'dlc': int(m.group(3)),
+                    'cycle': 0,
+                    'signals': [],
+                }
+                if msg['dlc'] > 8:
+                    fail(lineno, '%s: CAN FD frames are not supported' % msg['name'])
+                messages[raw_id] = msg
+                order.append(raw_id)
+                continue
+            m = RE_SG.match(line)
+            if m:
+                if msg is None:
+                    fail(lineno, 'signal outside of a message')
+                length = int(m.group(3))
+                if length > 32:
+                    fail(lineno, '%s: signals wider than 32 bits are not supported'
+                         % m.group(1))
+                msg['signals'].append({
+                    'name': m.group(1),
+                    'start': int(m.group(2)),
+                    'len': length,
+                    'big_endian': m.group(4) == '0',
+                    'signed': m.group(5) == '-',
+                    'factor': float(m.group(6)),
+                    'offset': float(m.group(7)),
+                    'min': float(m.group(8) or 0),
+                    'max': float(m.group(9) or 0),
+                    'init': 0.0,
+                    'source': '',
+                })
+                continue
+            if not line.startswith('BA_ '):
+                if line and not line.startswith('SG_'):
+                    msg = None
+                continue
+            m = RE_CYCLE.match(line)
+            if m:
+                messages[int(m.group(1))]['cycle'] = int(m.group(2))
+                continue
+            for regex, key in ((RE_START, 'init'), (RE_SOURCE, 'source')):
+                m = regex.match(line)
+                if not m:
+                    continue
+                sig = [s for s in messages[int(m.group(1))]['signals']
+                       if s['name'] == m.group(2)]
+                if not sig:
+                    fail(lineno, 'unknown signal %s' % m.group(2))
+                if key == 'source':
+                    if m.group(3) not in SOURCES:
+                        fail(lineno, 'unknown EmuSource "%s"' % m.group(3))
+                    sig[0]['source'] = m.group(3)
+                else:
+                    sig[0]['init'] = float(m.group(3))
+    return [messages[i] for i in order]
+
+
+def c_float(v):
+    return ('%.9g' % v) + ('f' if ('.' in '%.9g' % v or 'e' in '%.9g' % v) else '.0f')
+
+
+def emit(messages, dbc_path, out):
+    cyclic = [m for m in messages if m['cycle'] > 0]
+    out.write('/*\n * dbc_tables.c\n *\n'
+              ' * Generated by tools/dbc2c.py from %s, do not edit.\n */\n' % dbc_path)
+    out.write('#include <stdint.h>\n\n#include "dbc_tables.h"\n\n')
+    out.write('const dbc_signal_t dbc_signals[] = {\n')
+    first = 0
+    for m in cyclic:
+        m['first'] = first
+        for s in m['signals']:
+            # Start values are raw in the DBC, the table holds physical ones
+            init = s['init'] * s['factor'] + s['offset']
+            out.write('\t{ %2d, %2d, %d, %d, %s, %s, %s, %s, %s, %s },\t//%s.%s\n' % (
+                s['start'], s['len'], s['big_endian'], s['signed'],
+                SOURCES[s['source']], c_float(s['factor']), c_float(s['offset']),
+                c_float(s['min']), c_float(s['max']), c_float(init),
+                m['name'], s['name']))
+        first += len(m['signals'])
+    if first == 0:
+        out.write('\t{ 0 }\n')
+    out.write('};\n\n')
+    out.write('const dbc_message_t dbc_messages[] = {\n')
+    for m in cyclic:
+        out.write('\t{ 0x%08x, %d, %d, %5d, %3d, %2d },\t//%s\n' % (
+            m['id'], m['idt'], m['dlc'], m['cycle'], m['first'],
+            len(m['signals']), m['name']))
+    if not cyclic:
+        out.write('\t{ 0 }\n')
+    out.write('};\n\n')
+    out.write('const uint16_t dbc_n_messages = %d;\n' % len(cyclic))
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit('usage: dbc2c.py <input.dbc> <output.c>')
+    messages = parse(sys.argv[1])
+    with open(sys.argv[2], 'w') as out:
+        emit(messages, sys.argv[1], out)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,98 @@
+#!/usr/bin/env python3
+#
+# memdiff.py
+#
+#  Created on: Oct 19, 2026
+#      Author: refo
+#
+# Compares the "mem" console output of two builds, normally the default
+# and the CAR_EMU_LOW_RAM profile, after the same test run on both. The
+# heap figures and the stack size and high-water mark of every task are
+# put side by side, so the savings of a profile are read off the device
+# instead of being worked out from allocation sizes.
+#
+#   tools/memdiff.py mem_default.txt mem_lowram.txt
+#
+import re
+import sys
+
+HEAP = re.compile(r'heap: free=(\d+) min=(\d+) largest_block=(\d+) used_by_init=(\d+)')
+RXBUF = re.compile(r'CAN-TP RX buffers: now=(\d+) peak=(\d+), multi-frame total=(\d+)')
+TASK = re.compile(r'^(\S+)\s+(\d+)\s+(\d+)\s*$')
+PROFILE = re.compile(r'^Memory \((.*)\)')
+
+
+def parse(path):
+    mem = {'profile': path, 'heap': None, 'rx': [None, None, None], 'tasks': {}}
+    with open(path) as f:
+        for line in f:
+            line = line.rstrip('\r\n')
+            m = PROFILE.match(line)
+            if m:
+                # Only the last report of a log counts
+                mem = {'profile': m.group(1), 'heap': None, 'rx': [None, None, None], 'tasks': {}}
+                continue
+            m = HEAP.search(line)
+            if m:
+                mem['heap'] = [int(v) for v in m.groups()]
+                continue
+            m = RXBUF.search(line)
+            if m:
+                mem['rx'] = [int(v) for v in m.groups()]
+                continue
+            m = TASK.match(line)
+            if m and mem['heap'] is not None:
+                mem['tasks'][m.group(1)] = (int(m.group(2)), int(m.group(3)))
+    if mem['heap'] is None:
+        sys.exit('memdiff: %s: no "mem" report' % path)
+    return mem
+
+
+def row(name, a, b):
+    if a is None or b is None:
+        print('%-16s %10s %10s' % (name, '-' if a is None else a, '-' if b is None else b))
+    else:
+        print('%-16s %10d %10d %+10d' % (name, a, b, b - a))
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit('usage: memdiff.py <mem_a.txt> <mem_b.txt>')
+    a = parse(sys.argv[1])
+    b = parse(sys.argv[2])
+
+    print('A: %s (%s)\nB: %s (%s)\n' % (a['profile'], sys.argv[1], b['profile'], sys.argv[2]))
+    print('%-16s %10s %10s %10s' % ('heap', 'A', 'B', 'B-A'))
+    for i, name in enumerate(('heap free', 'heap min', 'largest block', 'used by init')):
+        row(name, a['heap'][i], b['heap'][i])
+    for i, name in enumerate(('rx buffers now', 'rx buffers peak', 'multi-frame')):
+        row(name, a['rx'][i], b['rx'][i])
+
+    print('\nstack size')
+    names = list(a['tasks']) + [n for n in b['tasks'] if n not in a['tasks']]
+    total_a = total_b = 0
+    for name in names:
+        sa = a['tasks'].get(name, (None, None))[0]
+        sb = b['tasks'].get(name, (None, None))[0]
+        total_a += sa or 0
+        total_b += sb or 0
+        row(name, sa, sb)
+    row('total', total_a, total_b)
+
+    print('\nstack min free')
+    free_a = free_b = 0
+    for name in names:
+        fa = a['tasks'].get(name, (None, None))[1]
+        fb = b['tasks'].get(name, (None, None))[1]
+        free_a += fa or 0
+        free_b += fb or 0
+        row(name, fa, fb)
+    row('total', free_a, free_b)
+
+    # What the tasks really needed, the part of the saving that is safe
+    print('\nstack used')
+    row('total', total_a - free_a, total_b - free_b)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,214 @@
+/*
+ * main.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ *
+ * Decodes captures into one CSV per Service 01 PID and reports the
+ * throughput. Built on the host with GCC 9 or clang:
+ *
+ *   cc -O3 -march=native -I main -o obddec tools/obddec/main.c \
+ *       tools/obddec/obddec.c main/obd.c -lm
+ *   ./obddec -g 10000000 > rig.log
+ *   ./obddec -c -o out rig.log
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "obddec.h"
+
+typedef struct csv_sink_s {
+	const char *dir;
+	FILE *f[256];
+} csv_sink_t;
+
+static double now_s(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void csv_write(const obddec_col_t *col, void *arg)
+{
+	csv_sink_t *s = arg;
+	FILE *f = s->f[col->pid];
+
+	if (f == NULL) {
+		char path[512];
+		snprintf(path, sizeof(path), "%s/01_%02X.csv", s->dir, col->pid);
+		f = fopen(path, "w");
+		if (f == NULL) {
+			perror(path);
+			exit(1);
+		}
+		fprintf(f, "time,ecu,A,B,C,D,value\n");
+		s->f[col->pid] = f;
+	}
+	for (uint32_t i = 0; i < col->n; i++) {
+		fprintf(f, "%lld.%06lld,%02X,%u,%u,%u,%u,%g\n",
+				(long long)(col->ts_us[i] / 1000000), (long long)(col->ts_us[i] % 1000000),
+				col->ecu[i], col->a[i], col->b[i], col->c[i], col->d[i], col->val[i]);
+	}
+}
+
+static void print_ts(uint64_t ts)
+{
+	printf("(%010llu.%06llu) can0 ", (unsigned long long)(ts / 1000000),
+			(unsigned long long)(ts % 1000000));
+}
+
+/*
+ * Polling session as a scan tool does it: single PID requests answered
+ * in single frames, and every few of them a six PID request answered in
+ * three frames.
+ */
+static void generate(uint64_t frames)
+{
+	static const uint8_t pids[] = { 0x0C, 0x0D, 0x05, 0x11, 0x10, 0x0F, 0x2F, 0x42 };
+	uint64_t ts = 0;
+	uint32_t seed = 1;
+	uint32_t polls = 0;
+
+	for (uint64_t n = 0; n < frames; ) {
+		seed = seed * 1103515245 + 12345;
+		uint8_t a = seed >> 16;
+		uint8_t b = seed >> 24;
+		uint8_t pid = pids[(seed >> 8) % sizeof(pids)];
+		uint8_t len = obddec_pids[pid].len;
+
+		ts += 1000;
+		print_ts(ts);
+		printf("7DF#0201%02X\n", pid);
+		print_ts(ts + 200);
+		printf("%03X#%02X41%02X%02X", 0x7E8 + ((seed >> 4) & 1), 2 + len, pid, a);
+		if (len > 1) {
+			printf("%02X", b);
+		}
+		printf("\n");
+		n += 2;
+		if (++polls % 8 == 0) {
+			//41 0C AB 0D A 05 A 11 A 10 AB 0F A
+			ts += 1000;
+			print_ts(ts);
+			printf("7DF#07010C0D0511100F\n");
+			print_ts(ts + 150);
+			printf("7E8#100F410C%02X%02X0D%02X\n", a, b, b);
+			print_ts(ts + 200);
+			printf("7E0#3000000000000000\n");
+			print_ts(ts + 250);
+			printf("7E8#2105%02X11%02X10%02X%02X\n", a, b, a, b);
+			print_ts(ts + 300);
+			printf("7E8#220F%02X\n", b);
+			n += 5;
+		}
+	}
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+			"Usage: obddec [-c] [-s] [-f candump|asc|gvret] [-o DIR] [FILE...]\n"
+			"       obddec -g FRAMES\n"
+			"  -c  check every value against obdConvert\n"
+			"  -s  decode with obdConvert instead of the vector kernels\n"
+			"  -f  capture format, taken from the first byte otherwise\n"
+			"  -o  write DIR/01_<PID>.csv\n"
+			"  -g  write a synthetic candump capture to stdout\n");
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	obddec_t d;
+	csv_sink_t csv;
+	obddec_fmt_t fmt = OBDDEC_FMT_AUTO;
+	int opt;
+
+	memset(&csv, 0, sizeof(csv));
+	if (obddec_init(&d, NULL, &csv) < 0) {
+		fprintf(stderr, "Out of memory\n");
+		return 1;
+	}
+	while ((opt = getopt(argc, argv, "csf:o:g:")) != -1) {
+		switch (opt) {
+		case 'c':
+			d.check = 1;
+			break;
+		case 's':
+			d.scalar = 1;
+			break;
+		case 'f':
+			if (strcmp(optarg, "candump") == 0) {
+				fmt = OBDDEC_FMT_CANDUMP;
+			} else if (strcmp(optarg, "asc") == 0) {
+				fmt = OBDDEC_FMT_ASC;
+			} else if (strcmp(optarg, "gvret") == 0) {
+				fmt = OBDDEC_FMT_GVRET;
+			} else {
+				usage();
+			}
+			break;
+		case 'o':
+			csv.dir = optarg;
+			d.sink = csv_write;
+			break;
+		case 'g':
+			generate(strtoull(optarg, NULL, 0));
+			return 0;
+		default:
+			usage();
+		}
+	}
+
+	double t0 = now_s();
+	for (int i = optind; i < argc || i == optind; i++) {
+		FILE *f = (i < argc && strcmp(argv[i], "-") != 0) ? fopen(argv[i], "rb") : stdin;
+		if (f == NULL) {
+			perror(argv[i]);
+			return 1;
+		}
+		if (obddec_file(&d, f, fmt) < 0) {
+			perror((i < argc) ? argv[i] : "stdin");
+			return 1;
+		}
+		if (f != stdin) {
+			fclose(f);
+		}
+	}
+	obddec_finish(&d);
+	double t = now_s() - t0;
+
+	printf("PID        rows          min         mean          max\n");
+	for (uint16_t pid = 0; pid < 256; pid++) {
+		obddec_col_t *col = d.col[pid];
+		if (col == NULL) {
+			continue;
+		}
+		if (obddec_pids[pid].kind == OBDDEC_RAW) {
+			printf(" %02X %11llu   (raw)\n", pid, (unsigned long long)col->rows);
+		} else {
+			printf(" %02X %11llu %12.3f %12.3f %12.3f\n", pid, (unsigned long long)col->rows,
+					col->min, col->sum / col->rows, col->max);
+		}
+		if (csv.f[pid] != NULL) {
+			fclose(csv.f[pid]);
+		}
+	}
+	obddec_stats_t *st = &d.stats;
+	printf("\n%llu frames (%llu skipped), %llu responses (%llu other, %llu ISO-TP errors), "
+			"%llu values\n", (unsigned long long)st->frames, (unsigned long long)st->skipped,
+			(unsigned long long)st->responses, (unsigned long long)st->other,
+			(unsigned long long)st->isotp_errors, (unsigned long long)st->values);
+	printf("%.3f s: %.0f frames/s, %.1f MB/s, decode %s %.2f ns/value\n", t,
+			st->frames / t, st->bytes / t / 1e6, d.scalar ? "obdConvert" : "kernels",
+			st->values ? (double)st->decode_ns / st->values : 0.0);
+	if (d.check) {
+		printf("Check: %llu mismatches\n", (unsigned long long)st->mismatches);
+	}
+	obddec_free(&d);
+	return (d.check && st->mismatches) ? 1 : 0;
+}
@@ -0,0 +1,575 @@
+/*
+ * obddec.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "obddec.h"
+
+#define U8(l, s, o, f)		{ .len = l, .kind = OBDDEC_U8, .scale = s, .offset = o, .conv = f }
+#define U16(l, s, o, f)		{ .len = l, .kind = OBDDEC_U16, .scale = s, .offset = o, .conv = f }
+#define RAW(l)				{ .len = l, .kind = OBDDEC_RAW }
+
+//Service 01, lengths from SAE J1979, formulas the inverse of obdRevConvert
+const obddec_pid_t obddec_pids[256] = {
+	[0x00] = RAW(4), [0x01] = RAW(4), [0x02] = RAW(2), [0x03] = RAW(2),
+	[0x04] = U8(1, 100.0f / 255.0f, 0.0f, obdConvert_04),
+	[0x05] = U8(1, 1.0f, -40.0f, obdConvert_05),
+	[0x06 ... 0x09] = U8(1, 100.0f / 128.0f, -100.0f, obdConvert_06_09),
+	[0x0A] = U8(1, 3.0f, 0.0f, obdConvert_0A),
+	[0x0B] = U8(1, 1.0f, 0.0f, obdConvert_0B),
+	[0x0C] = U16(2, 0.25f, 0.0f, obdConvert_0C),
+	[0x0D] = U8(1, 1.0f, 0.0f, obdConvert_0D),
+	[0x0E] = U8(1, 0.5f, -64.0f, obdConvert_0E),
+	[0x0F] = U8(1, 1.0f, -40.0f, obdConvert_0F),
+	[0x10] = U16(2, 0.01f, 0.0f, obdConvert_10),
+	[0x11] = U8(1, 100.0f / 255.0f, 0.0f, obdConvert_11),
+	[0x12] = RAW(1), [0x13] = RAW(1),
+	[0x14 ... 0x1B] = U8(2, 0.005f, 0.0f, obdConvert_14_1B),
+	[0x1C] = RAW(1), [0x1D] = RAW(1), [0x1E] = RAW(1),
+	[0x1F] = U16(2, 1.0f, 0.0f, obdConvert_1F),
+	[0x20] = RAW(4),
+	[0x21] = U16(2, 1.0f, 0.0f, obdConvert_21),
+	[0x22] = U16(2, 0.079f, 0.0f, obdConvert_22),
+	[0x23] = U16(2, 10.0f, 0.0f, obdConvert_23),
+	[0x24 ... 0x2B] = U16(4, 0.0000305f, 0.0f, obdConvert_24_2B),
+	[0x2C] = U8(1, 100.0f / 255.0f, 0.0f, obdConvert_2C),
+	[0x2D] = U8(1, 0.78125f, -100.0f, obdConvert_2D),
+	[0x2E] = U8(1, 100.0f / 255.0f, 0.0f, obdConvert_2E),
+	[0x2F] = U8(1, 100.0f / 255.0f, 0.0f, obdConvert_2F),
+	[0x30] = U8(1, 1.0f, 0.0f, obdConvert_30),
+	[0x31] = U16(2, 1.0f, 0.0f, obdConvert_31),
+	[0x32] = U16(2, 0.25f, -8192.0f, obdConvert_32),
+	[0x33] = U8(1, 1.0f, 0.0f, obdConvert_33),
+	[0x34 ... 0x3B] = U16(4, 0.0000305f, 0.0f, obdConvert_34_3B),
+	[0x3C ... 0x3F] = U16(2, 0.1f, -40.0f, obdConvert_3C_3F),
+	[0x40] = RAW(4), [0x41] = RAW(4),
+	[0x42] = U16(2, 0.001f, 0.0f, obdConvert_42),
+	[0x43] = U16(2, 100.0f / 255.0f, 0.0f, obdConvert_43),
+	[0x44] = U16(2, 0.0000305f, 0.0f, obdConvert_44),
+	[0x45] = U8(1, 100.0f / 255.0f, 0.0f, obdConvert_45),
+	[0x46] = U8(1, 1.0f, -40.0f, obdConvert_46),
+	[0x47 ... 0x4B] = U8(1, 100.0f / 255.0f, 0.0f, obdConvert_47_4B),
+	[0x4C] = U8(1, 100.0f / 255.0f, 0.0f, obdConvert_4C),
+	[0x4D] = U16(2, 1.0f, 0.0f, obdConvert_4D),
+	[0x4E] = U16(2, 1.0f, 0.0f, obdConvert_4E),
+	[0x4F] = RAW(4), [0x50] = RAW(4), [0x51] = RAW(1),
+	[0x52] = U8(1, 100.0f / 255.0f, 0.0f, obdConvert_52),
+	[0x53] = RAW(2), [0x54] = RAW(2), [0x55 ... 0x58] = RAW(2), [0x59] = RAW(2),
+	[0x5A] = RAW(1), [0x5B] = RAW(1), [0x5C] = RAW(1), [0x5D] = RAW(2),
+	[0x5E] = RAW(2), [0x5F] = RAW(1), [0x60] = RAW(4), [0x80] = RAW(4),
+	[0xA0] = RAW(4), [0xC0] = RAW(4), [0xE0] = RAW(4)
+};
+
+typedef uint8_t v8u8_t __attribute__((vector_size(8)));
+typedef uint16_t v8u16_t __attribute__((vector_size(16)));
+typedef float v8f_t __attribute__((vector_size(32)));
+
+static int8_t hexval[256];
+
+static int64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void obddec_kernel(obddec_col_t *col)
+{
+	const obddec_pid_t *p = &obddec_pids[col->pid];
+	uint32_t n = col->n;
+	uint32_t i = 0;
+
+	if (p->kind == OBDDEC_RAW) {
+		for (; i < n; i++) {
+			col->val[i] = NAN;
+		}
+		return;
+	}
+	v8f_t scale = { p->scale, p->scale, p->scale, p->scale,
+					p->scale, p->scale, p->scale, p->scale };
+	v8f_t offset = { p->offset, p->offset, p->offset, p->offset,
+					p->offset, p->offset, p->offset, p->offset };
+	if (p->kind == OBDDEC_U8) {
+		for (; i + 8 <= n; i += 8) {
+			v8u8_t a;
+			memcpy(&a, &col->a[i], sizeof(a));
+			v8f_t v = __builtin_convertvector(a, v8f_t) * scale + offset;
+			memcpy(&col->val[i], &v, sizeof(v));
+		}
+		for (; i < n; i++) {
+			col->val[i] = col->a[i] * p->scale + p->offset;
+		}
+	} else {
+		for (; i + 8 <= n; i += 8) {
+			v8u8_t a, b;
+			memcpy(&a, &col->a[i], sizeof(a));
+			memcpy(&b, &col->b[i], sizeof(b));
+			v8u16_t raw = (__builtin_convertvector(a, v8u16_t) << 8) |
+							__builtin_convertvector(b, v8u16_t);
+			v8f_t v = __builtin_convertvector(raw, v8f_t) * scale + offset;
+			memcpy(&col->val[i], &v, sizeof(v));
+		}
+		for (; i < n; i++) {
+			col->val[i] = ((col->a[i] << 8) | col->b[i]) * p->scale + p->offset;
+		}
+	}
+}
+
+void obddec_scalar(obddec_col_t *col)
+{
+	OBDConvFunc conv = obddec_pids[col->pid].conv;
+
+	for (uint32_t i = 0; i < col->n; i++) {
+		col->val[i] = (conv != NULL) ?
+				conv(col->a[i], col->b[i], col->c[i], col->d[i]) : NAN;
+	}
+}
+
+static void obddec_flush(obddec_t *d, obddec_col_t *col)
+{
+	int64_t t0 = now_ns();
+	if (d->scalar) {
+		obddec_scalar(col);
+	} else {
+		obddec_kernel(col);
+	}
+	d->stats.decode_ns += now_ns() - t0;
+
+	OBDConvFunc conv = obddec_pids[col->pid].conv;
+	for (uint32_t i = 0; i < col->n; i++) {
+		float v = col->val[i];
+		if (d->check && conv != NULL) {
+			float ref = conv(col->a[i], col->b[i], col->c[i], col->d[i]);
+			if (fabsf(v - ref) > 1e-5f * fmaxf(1.0f, fabsf(ref))) {
+				d->stats.mismatches++;
+			}
+		}
+		if (isnan(v)) {
+			continue;
+		}
+		if (v < col->min) {
+			col->min = v;
+		}
+		if (v > col->max) {
+			col->max = v;
+		}
+		col->sum += v;
+	}
+	if (d->sink != NULL) {
+		d->sink(col, d->arg);
+	}
+	col->rows += col->n;
+	col->n = 0;
+}
+
+static void obddec_value(obddec_t *d, uint8_t pid, uint8_t ecu, int64_t ts_us,
+		const uint8_t *v, uint8_t len)
+{
+	obddec_col_t *col = d->col[pid];
+
+	if (col == NULL) {
+		col = calloc(1, sizeof(obddec_col_t));
+		if (col == NULL) {
+			return;
+		}
+		col->pid = pid;
+		col->min = INFINITY;
+		col->max = -INFINITY;
+		d->col[pid] = col;
+	}
+	uint32_t n = col->n;
+	col->ts_us[n] = ts_us;
+	col->ecu[n] = ecu;
+	col->a[n] = v[0];
+	col->b[n] = (len > 1) ? v[1] : 0;
+	col->c[n] = (len > 2) ? v[2] : 0;
+	col->d[n] = (len > 3) ? v[3] : 0;
+	d->stats.values++;
+	if (++col->n == OBDDEC_BATCH) {
+		obddec_flush(d, col);
+	}
+}
+
+//Positive Service 01 response, one or more PIDs with their data
+static void obddec_response(obddec_t *d, uint8_t ecu, int64_t ts_us,
+		const uint8_t *p, uint16_t len)
+{
+	if (len < 2 || p[0] != 0x41) {
+		d->stats.other++;
+		return;
+	}
+	d->stats.responses++;
+	for (uint16_t i = 1; i < len; ) {
+		uint8_t pid = p[i];
+		uint8_t plen = obddec_pids[pid].len;
+		if (plen == 0 || i + 1 + plen > len) {
+			break;
+		}
+		obddec_value(d, pid, ecu, ts_us, &p[i + 1], plen);
+		i += 1 + plen;
+	}
+}
+
+//ISO 15765-4 responders: 7E8 .. 7EF, 18DAF1xx
+static obddec_isotp_t *obddec_responder(obddec_t *d, const obddec_frame_t *f)
+{
+	obddec_isotp_t *rx;
+
+	if (!f->idt && f->id >= 0x7E8 && f->id <= 0x7EF) {
+		rx = &d->rx[f->id - 0x7E8];
+	} else if (f->idt && (f->id & 0x1FFFFF00) == 0x18DAF100) {
+		rx = &d->rx[8 + (f->id & 0x07)];
+	} else {
+		return NULL;
+	}
+	if (rx->id != f->id) {
+		rx->id = f->id;
+		rx->got = 0;
+	}
+	return rx;
+}
+
+void obddec_frame(obddec_t *d, const obddec_frame_t *f)
+{
+	d->stats.frames++;
+	obddec_isotp_t *rx = obddec_responder(d, f);
+	if (rx == NULL || f->dlc < 1) {
+		return;
+	}
+	uint8_t ecu = f->id & 0xFF;
+	const uint8_t *p = f->data;
+	uint8_t n;
+
+	switch (p[0] >> 4) {
+	case 0:		//single frame
+		n = p[0] & 0x0F;
+		if (n == 0 || n > f->dlc - 1) {
+			d->stats.isotp_errors++;
+			return;
+		}
+		obddec_response(d, ecu, f->ts_us, &p[1], n);
+		return;
+	case 1:		//first frame
+		rx->len = ((p[0] & 0x0F) << 8) | p[1];
+		if (f->dlc < 8 || rx->len < 8 || rx->len > OBDDEC_MAX_PDU) {
+			d->stats.isotp_errors++;
+			rx->got = 0;
+			return;
+		}
+		memcpy(rx->buf, &p[2], 6);
+		rx->got = 6;
+		rx->sn = 1;
+		return;
+	case 2:		//consecutive frame
+		if (rx->got == 0) {
+			return;
+		}
+		if ((p[0] & 0x0F) != rx->sn) {
+			d->stats.isotp_errors++;
+			rx->got = 0;
+			return;
+		}
+		n = rx->len - rx->got;
+		if (n > 7) {
+			n = 7;
+		}
+		if (n > f->dlc - 1) {
+			d->stats.isotp_errors++;
+			rx->got = 0;
+			return;
+		}
+		memcpy(&rx->buf[rx->got], &p[1], n);
+		rx->got += n;
+		rx->sn = (rx->sn + 1) & 0x0F;
+		if (rx->got == rx->len) {
+			obddec_response(d, ecu, f->ts_us, rx->buf, rx->len);
+			rx->got = 0;
+		}
+		return;
+	default:	//flow control is the tester's
+		return;
+	}
+}
+
+static const char *parse_hex(const char *p, uint32_t *v, uint8_t *digits)
+{
+	uint32_t x = 0;
+	uint8_t n = 0;
+
+	while (hexval[(uint8_t)*p] >= 0) {
+		x = (x << 4) | hexval[(uint8_t)*p++];
+		n++;
+	}
+	*v = x;
+	*digits = n;
+	return p;
+}
+
+//"12.345678" into us
+static const char *parse_ts(const char *p, int64_t *ts_us)
+{
+	int64_t sec = 0;
+	int32_t usec = 0;
+	uint8_t n = 0;
+
+	if (*p < '0' || *p > '9') {
+		return NULL;
+	}
+	while (*p >= '0' && *p <= '9') {
+		sec = sec * 10 + (*p++ - '0');
+	}
+	if (*p == '.') {
+		p++;
+		while (*p >= '0' && *p <= '9') {
+			if (n++ < 6) {
+				usec = usec * 10 + (*p - '0');
+			}
+			p++;
+		}
+	}
+	for (; n < 6; n++) {
+		usec *= 10;
+	}
+	*ts_us = sec * 1000000 + usec;
+	return p;
+}
+
+//(0000012.345678) can0 7DF#02010C
+static int parse_candump(const char *p, obddec_frame_t *f)
+{
+	uint8_t n;
+
+	if (*p++ != '(' || (p = parse_ts(p, &f->ts_us)) == NULL || *p++ != ')') {
+		return -1;
+	}
+	while (*p == ' ') {
+		p++;
+	}
+	while (*p != ' ' && *p != 0) {
+		p++;
+	}
+	while (*p == ' ') {
+		p++;
+	}
+	p = parse_hex(p, &f->id, &n);
+	if (*p++ != '#' || n == 0) {
+		return -1;
+	}
+	f->idt = (n > 3);
+	for (f->dlc = 0; f->dlc < 8; f->dlc++) {
+		if (hexval[(uint8_t)p[0]] < 0 || hexval[(uint8_t)p[1]] < 0) {
+			break;
+		}
+		f->data[f->dlc] = (hexval[(uint8_t)p[0]] << 4) | hexval[(uint8_t)p[1]];
+		p += 2;
+	}
+	return 0;
+}
+
+//   12.345678 1  7DF             Rx   d 3 02 01 0C
+static int parse_asc(const char *p, obddec_frame_t *f)
+{
+	uint32_t v;
+	uint8_t n;
+
+	while (*p == ' ') {
+		p++;
+	}
+	if ((p = parse_ts(p, &f->ts_us)) == NULL) {
+		return -1;
+	}
+	while (*p == ' ') {
+		p++;
+	}
+	while (*p >= '0' && *p <= '9') {
+		p++;
+	}
+	while (*p == ' ') {
+		p++;
+	}
+	p = parse_hex(p, &f->id, &n);
+	if (n == 0) {
+		return -1;
+	}
+	f->idt = (*p == 'x');
+	if (f->idt) {
+		p++;
+	}
+	while (*p == ' ') {
+		p++;
+	}
+	if ((p[0] != 'R' && p[0] != 'T') || p[1] != 'x') {
+		return -1;
+	}
+	p += 2;
+	while (*p == ' ') {
+		p++;
+	}
+	if (*p++ != 'd') {
+		return -1;
+	}
+	while (*p == ' ') {
+		p++;
+	}
+	p = parse_hex(p, &v, &n);
+	if (n != 1 || v > 8) {
+		return -1;
+	}
+	f->dlc = v;
+	for (uint8_t i = 0; i < f->dlc; i++) {
+		while (*p == ' ') {
+			p++;
+		}
+		p = parse_hex(p, &v, &n);
+		if (n != 2) {
+			return -1;
+		}
+		f->data[i] = v;
+	}
+	return 0;
+}
+
+//Whole lines in buf[0 .. len), returns how much was used
+static size_t obddec_lines(obddec_t *d, obddec_fmt_t fmt, char *buf, size_t len, int eof)
+{
+	size_t pos = 0;
+	obddec_frame_t f;
+
+	while (pos < len) {
+		char *line = &buf[pos];
+		char *end = memchr(line, '\n', len - pos);
+		if (end == NULL) {
+			if (!eof && len - pos < OBDDEC_MAX_LINE) {
+				break;
+			}
+			//Last line without a newline, or not a capture at all
+			end = &buf[len];
+		}
+		*end = 0;
+		pos = end - buf + 1;
+		int ret = (fmt == OBDDEC_FMT_CANDUMP) ? parse_candump(line, &f) : parse_asc(line, &f);
+		if (ret < 0) {
+			d->stats.skipped++;
+			continue;
+		}
+		obddec_frame(d, &f);
+	}
+	return (pos > len) ? len : pos;
+}
+
+//F1 00 <timestamp us> <id, bit 31 extended> <len | bus << 4> <data> 00
+static size_t obddec_gvret(obddec_t *d, const uint8_t *buf, size_t len)
+{
+	size_t pos = 0;
+	obddec_frame_t f;
+
+	while (pos + 12 <= len) {
+		const uint8_t *p = &buf[pos];
+		if (p[0] != 0xF1 || p[1] != 0x00 || (p[10] & 0x0F) > 8) {
+			d->stats.skipped++;
+			pos++;
+			continue;
+		}
+		uint8_t dlc = p[10] & 0x0F;
+		if (pos + 12 + dlc > len) {
+			break;
+		}
+		uint32_t ts = p[2] | (p[3] << 8) | (p[4] << 16) | ((uint32_t)p[5] << 24);
+		uint32_t id = p[6] | (p[7] << 8) | (p[8] << 16) | ((uint32_t)p[9] << 24);
+		if (ts < d->gvret_ts) {
+			d->gvret_wrap += 1LL << 32;
+		}
+		d->gvret_ts = ts;
+		f.ts_us = d->gvret_wrap + ts;
+		f.id = id & 0x1FFFFFFF;
+		f.idt = (id >> 31) & 1;
+		f.dlc = dlc;
+		memcpy(f.data, &p[11], dlc);
+		obddec_frame(d, &f);
+		pos += 12 + dlc;
+	}
+	return pos;
+}
+
+int obddec_file(obddec_t *d, FILE *f, obddec_fmt_t fmt)
+{
+	size_t fill = 0;
+	int eof = 0;
+
+	d->gvret_ts = 0;
+	d->gvret_wrap = 0;
+	memset(d->rx, 0, sizeof(d->rx));
+	while (!eof) {
+		size_t n = fread(&d->buf[fill], 1, OBDDEC_CHUNK - fill, f);
+		if (n == 0) {
+			if (ferror(f)) {
+				return -1;
+			}
+			eof = 1;
+		}
+		fill += n;
+		d->stats.bytes += n;
+		if (fill == 0) {
+			break;
+		}
+		if (fmt == OBDDEC_FMT_AUTO) {
+			fmt = (d->buf[0] == (char)0xF1) ? OBDDEC_FMT_GVRET :
+					(d->buf[0] == '(') ? OBDDEC_FMT_CANDUMP : OBDDEC_FMT_ASC;
+		}
+		size_t used = (fmt == OBDDEC_FMT_GVRET) ?
+				obddec_gvret(d, (const uint8_t *)d->buf, fill) :
+				obddec_lines(d, fmt, d->buf, fill, eof);
+		if (eof && used < fill) {
+			//A cut off GVRET record
+			d->stats.skipped++;
+			used = fill;
+		}
+		memmove(d->buf, &d->buf[used], fill - used);
+		fill -= used;
+	}
+	return 0;
+}
+
+void obddec_finish(obddec_t *d)
+{
+	for (uint16_t pid = 0; pid < 256; pid++) {
+		if (d->col[pid] != NULL && d->col[pid]->n > 0) {
+			obddec_flush(d, d->col[pid]);
+		}
+	}
+}
+
+int obddec_init(obddec_t *d, obddec_sink_t sink, void *arg)
+{
+	memset(d, 0, sizeof(*d));
+	memset(hexval, -1, sizeof(hexval));
+	for (uint8_t i = 0; i < 10; i++) {
+		hexval['0' + i] = i;
+	}
+	for (uint8_t i = 0; i < 6; i++) {
+		hexval['A' + i] = 10 + i;
+		hexval['a' + i] = 10 + i;
+	}
+	d->sink = sink;
+	d->arg = arg;
+	//Room for a terminating NUL after a last line without a newline
+	d->buf = malloc(OBDDEC_CHUNK + 1);
+	return (d->buf != NULL) ? 0 : -1;
+}
+
+void obddec_free(obddec_t *d)
+{
+	for (uint16_t pid = 0; pid < 256; pid++) {
+		free(d->col[pid]);
+		d->col[pid] = NULL;
+	}
+	free(d->buf);
+	d->buf = NULL;
+}
@@ -0,0 +1,134 @@
+/*
+ * obddec.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: refo
+ */
+
+#ifndef __OBDDEC_H_
+#define __OBDDEC_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "obd.h"
+
+/*
+ * Offline decoder for captured OBD traffic, built on the host (see
+ * main.c). Frames are read in OBDDEC_CHUNK pieces from any capture the
+ * emulator writes (candump, Vector ASC or GVRET), ISO-TP responses are
+ * reassembled per responder and every Service 01 PID in them is put as
+ * a row into the column of that PID. A column holds OBDDEC_BATCH rows;
+ * a full batch is decoded at once, handed to the sink and reused, so
+ * memory does not grow with the capture.
+ *
+ * Nearly all Service 01 formulas are value = raw * scale + offset with
+ * raw being A or 256A+B, those are decoded eight rows at a time with
+ * GCC vector extensions. The rest keep only their raw bytes.
+ */
+#define OBDDEC_BATCH			4096
+#define OBDDEC_CHUNK			(1 << 20)
+#define OBDDEC_MAX_PDU			256
+#define OBDDEC_ECUS				16
+#define OBDDEC_MAX_LINE			128
+
+typedef enum {
+	OBDDEC_FMT_AUTO = 0,
+	OBDDEC_FMT_CANDUMP,
+	OBDDEC_FMT_ASC,
+	OBDDEC_FMT_GVRET
+} obddec_fmt_t;
+
+typedef enum {
+	OBDDEC_RAW = 0,				//no formula, raw bytes only
+	OBDDEC_U8,					//A * scale + offset
+	OBDDEC_U16					//(256A+B) * scale + offset
+} obddec_kind_t;
+
+typedef struct obddec_frame_s {
+	int64_t ts_us;
+	uint32_t id;
+	uint8_t idt;
+	uint8_t dlc;
+	uint8_t data[8];
+} obddec_frame_t;
+
+typedef struct obddec_pid_s {
+	uint8_t len;				//data bytes, 0 for PIDs not known
+	uint8_t kind;				//obddec_kind_t
+	float scale;
+	float offset;
+	OBDConvFunc conv;			//scalar reference from obd.c
+} obddec_pid_t;
+
+typedef struct obddec_col_s {
+	uint8_t pid;
+	uint32_t n;					//rows in this batch
+	uint64_t rows;				//rows before this batch
+	float min;
+	float max;
+	double sum;
+	int64_t ts_us[OBDDEC_BATCH];
+	uint8_t ecu[OBDDEC_BATCH];	//responder address
+	uint8_t a[OBDDEC_BATCH];
+	uint8_t b[OBDDEC_BATCH];
+	uint8_t c[OBDDEC_BATCH];
+	uint8_t d[OBDDEC_BATCH];
+	float val[OBDDEC_BATCH];	//NAN for OBDDEC_RAW
+} obddec_col_t;
+
+//Gets every decoded batch, col->n rows
+typedef void (*obddec_sink_t)(const obddec_col_t *col, void *arg);
+
+typedef struct obddec_isotp_s {
+	uint32_t id;
+	uint16_t len;
+	uint16_t got;				//0 while no response is open
+	uint8_t sn;
+	uint8_t buf[OBDDEC_MAX_PDU];
+} obddec_isotp_t;
+
+typedef struct obddec_stats_s {
+	uint64_t bytes;
+	uint64_t frames;
+	uint64_t skipped;			//lines or bytes that are not frames
+	uint64_t responses;			//Service 01 responses
+	uint64_t other;				//other reassembled responses
+	uint64_t isotp_errors;
+	uint64_t values;
+	uint64_t mismatches;		//kernel against obdConvert, with check
+	uint64_t decode_ns;
+} obddec_stats_t;
+
+typedef struct obddec_s {
+	obddec_sink_t sink;
+	void *arg;
+	uint8_t check;				//compare every value with obdConvert
+	uint8_t scalar;				//decode with obdConvert only
+	obddec_col_t *col[256];
+	obddec_isotp_t rx[OBDDEC_ECUS];
+	obddec_stats_t stats;
+	uint32_t gvret_ts;			//GVRET timestamps are 32 bit
+	int64_t gvret_wrap;
+	char *buf;
+} obddec_t;
+
+extern const obddec_pid_t obddec_pids[256];
+
+int obddec_init(obddec_t *d, obddec_sink_t sink, void *arg);
+void obddec_free(obddec_t *d);
+
+//Reads a capture to its end, fmt OBDDEC_FMT_AUTO looks at the first byte
+int obddec_file(obddec_t *d, FILE *f, obddec_fmt_t fmt);
+
+//For frames from another source
+void obddec_frame(obddec_t *d, const obddec_frame_t *f);
+
+//Decodes and hands over the batches that are not full yet
+void obddec_finish(obddec_t *d);
+
+//Decodes col->val of a batch, both as the vector kernels and as obdConvert
+void obddec_kernel(obddec_col_t *col);
+void obddec_scalar(obddec_col_t *col);
+
+#endif /* __OBDDEC_H_ */
@@ -0,0 +1,181 @@
+#!/usr/bin/env python3
+#
+# vprofc.py
+#
+#  Created on: Oct 19, 2026
+#      Author: refo
+#
+# Compiles vehicle profiles into the flat blob vehicle_profile.c maps from
+# the "profiles" partition (see vehicle_profile.h for the layout). Every
+# [NAME] section is a profile; the firmware uses the blob as it is, so
+# everything is checked here.
+#
+#   tools/vprofc.py profiles/vehicles.txt profiles.bin
+#   parttool.py write_partition --partition-name=profiles --input profiles.bin
+#   tools/vprofc.py --list profiles.bin
+#
+import mmap
+import struct
+import sys
+import zlib
+
+VP_MAGIC = 0x46525056
+VP_VERSION = 1
+VP_NAME_LEN = 16
+VP_CAL_ID_LEN = 16
+VP_MAX_DTCS = 8
+VP_PARTITION_SIZE = 0x10000
+
+HEADER = struct.Struct('<IHHII')
+PROFILE = struct.Struct('<16s17sB32s4s16s8HHHB21x')
+assert PROFILE.size == 128
+
+# PIDs the emulator answers, besides the bitmaps
+PIDS01 = (0x0C, 0x0D, 0x11)
+PIDS09 = (0x02, 0x04)
+DTC_LETTERS = 'PCBU'
+
+DEFAULTS = {
+    'vin': None,
+    'pids01': '0C 0D 11',
+    'pids09': '02',
+    'cal_id': '',
+    'dtc': '',
+    'speed': '0',
+    'rpm': '800',
+    'throttle': '0',
+}
+
+
+def fail(lineno, msg):
+    sys.exit('vprofc: line %d: %s' % (lineno, msg))
+
+
+def parse(path):
+    profiles = []
+    prof = None
+    with open(path) as f:
+        for lineno, line in enumerate(f, 1):
+            line = line.split('#', 1)[0].strip()
+            if not line:
+                continue
+            if line.startswith('[') and line.endswith(']'):
+                prof = {'name': line[1:-1].strip(), 'line': lineno}
+                if not prof['name'] or len(prof['name']) > VP_NAME_LEN:
+                    fail(lineno, 'profile names are 1 to %d characters' % VP_NAME_LEN)
+                if any(p['name'] == prof['name'] for p in profiles):
+                    fail(lineno, 'profile %s defined twice' % prof['name'])
+                profiles.append(prof)
+                continue
+            if prof is None or '=' not in line:
+                fail(lineno, 'expected [NAME] or key = value')
+            key, value = (s.strip() for s in line.split('=', 1))
+            if key not in DEFAULTS:
+                fail(lineno, 'unknown key %s' % key)
+            prof[key] = (value, lineno)
+    return profiles
+
+
+def bitmap(value, lineno, allowed, size):
+    bits = bytearray(size)
+    for tok in value.replace(',', ' ').split():
+        try:
+            pid = int(tok, 16)
+        except ValueError:
+            fail(lineno, 'bad PID %s' % tok)
+        if pid not in allowed:
+            fail(lineno, 'PID %02X is not emulated (%s)' %
+                 (pid, ' '.join('%02X' % p for p in allowed)))
+        bit = pid - 1
+        bits[bit // 8] |= 0x80 >> (bit % 8)
+    return bytes(bits)
+
+
+def dtc_code(tok, lineno):
+    # SAE J2012: 2 bits letter, 2 bits first digit, 3 hex digits
+    tok = tok.upper()
+    if len(tok) != 5 or tok[0] not in DTC_LETTERS or tok[1] not in '0123':
+        fail(lineno, 'bad DTC %s' % tok)
+    try:
+        return (DTC_LETTERS.index(tok[0]) << 14) | int(tok[1:], 16)
+    except ValueError:
+        fail(lineno, 'bad DTC %s' % tok)
+
+
+def number(value, lineno, top):
+    try:
+        v = int(value, 0)
+    except ValueError:
+        fail(lineno, 'bad number %s' % value)
+    if not 0 <= v <= top:
+        fail(lineno, '%d is out of 0..%d' % (v, top))
+    return v
+
+
+def pack(prof):
+    get = {k: prof.get(k, (v, prof['line'])) for k, v in DEFAULTS.items()}
+    vin, lineno = get['vin']
+    if vin is None or len(vin) != 17 or not vin.isascii() or not vin.isalnum():
+        fail(lineno, '%s: a VIN is 17 letters and digits' % prof['name'])
+    cal_id, lineno = get['cal_id']
+    if len(cal_id) > VP_CAL_ID_LEN or not cal_id.isascii():
+        fail(lineno, 'calibration IDs are up to %d characters' % VP_CAL_ID_LEN)
+    pids09 = bitmap(*get['pids09'], PIDS09, 4)
+    if pids09[0] & 0x10 and not cal_id:
+        fail(get['pids09'][1], '%s: PID 04 needs a cal_id' % prof['name'])
+    dtcs = [dtc_code(t, get['dtc'][1]) for t in get['dtc'][0].replace(',', ' ').split()]
+    if len(dtcs) > VP_MAX_DTCS:
+        fail(get['dtc'][1], 'up to %d DTCs' % VP_MAX_DTCS)
+    return PROFILE.pack(
+        prof['name'].encode(), vin.encode(), len(dtcs),
+        bitmap(*get['pids01'], PIDS01, 32), pids09, cal_id.encode(),
+        *(dtcs + [0] * (VP_MAX_DTCS - len(dtcs))),
+        number(*get['speed'], 0xFFFF), number(*get['rpm'], 0xFFFF),
+        number(*get['throttle'], 100))
+
+
+def compile_profiles(src, dst):
+    profiles = parse(src)
+    if not profiles:
+        sys.exit('vprofc: %s: no profiles' % src)
+    body = b''.join(pack(p) for p in profiles)
+    size = HEADER.size + len(body)
+    if size > VP_PARTITION_SIZE:
+        sys.exit('vprofc: %d bytes do not fit the partition' % size)
+    with open(dst, 'wb') as f:
+        f.write(HEADER.pack(VP_MAGIC, VP_VERSION, len(profiles), size,
+                            zlib.crc32(body)))
+        f.write(body)
+    print('%s: %d profiles, %d bytes' % (dst, len(profiles), size))
+
+
+def list_profiles(path):
+    # Read in place, the way the firmware does
+    with open(path, 'rb') as f, mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ) as m:
+        magic, version, count, size, crc = HEADER.unpack_from(m)
+        if magic != VP_MAGIC or version != VP_VERSION:
+            sys.exit('vprofc: %s: not a version %d profile blob' % (path, VP_VERSION))
+        if size != HEADER.size + count * PROFILE.size or size > len(m):
+            sys.exit('vprofc: %s: bad size' % path)
+        if zlib.crc32(m[HEADER.size:size]) != crc:
+            sys.exit('vprofc: %s: bad CRC' % path)
+        for i in range(count):
+            p = PROFILE.unpack_from(m, HEADER.size + i * PROFILE.size)
+            name, vin, n_dtc = p[0].rstrip(b'\0').decode(), p[1].decode(), p[2]
+            dtcs = ' '.join('%c%04X' % (DTC_LETTERS[d >> 14], d & 0x3FFF)
+                            for d in p[6:6 + n_dtc])
+            print('%3d %-16s %s  %s' % (i, name, vin, dtcs or 'no DTCs'))
+
+
+def main():
+    if len(sys.argv) == 3 and sys.argv[1] == '--list':
+        list_profiles(sys.argv[2])
+    elif len(sys.argv) == 3:
+        compile_profiles(sys.argv[1], sys.argv[2])
+    else:
+        sys.exit('usage: vprofc.py <profiles.txt> <profiles.bin>\n'
+                 '       vprofc.py --list <profiles.bin>')
+
+
+if __name__ == '__main__':
+    main()